@@ -0,0 +1,82 @@
+#!/bin/bash
+# コンパイラ(字句解析からコード生成まで)のスループットを計測する
+# 使い方: bench/bench.sh [ケース名...]  (省略時はすべてのケース)
+#   FCC           計測するfcc (デフォルト: ./bin/fcc)
+#   BENCH_SCALE   入力の規模の倍率 (デフォルト: 1)
+#   BENCH_RUNS    各ケースの実行回数。実時間が最短の結果を採用する (デフォルト: 3)
+#   BENCH_OUTPUT  結果をJSON Lines形式で追記するファイル。コミット間の比較に使う
+#   BENCH_FLAGS   計測するfccに追加で渡すオプション (例: -fthreads=4)
+# 最後にTokenの大きさ(sizeof)とメモリ使用量(-fmem-report)を表示する
+FCC=${FCC:-./bin/fcc}
+RUNS=${BENCH_RUNS:-3}
+tmp=`mktemp -d /tmp/fcc-bench-XXXXXX`
+trap 'rm -rf $tmp' INT TERM HUP EXIT
+
+. `dirname $0`/gen.sh
+
+# -ftime-report=jsonの出力からフェーズの実時間(ms)を取り出す
+phase() {
+    echo "$1" | grep -o "\"$2\":{\"wall_ms\":[0-9.]*" | head -n 1 | sed 's/.*://'
+}
+
+# -ftime-report=jsonの出力から数値を取り出す
+field() {
+    echo "$1" | grep -o "\"$2\":[0-9.]*" | head -n 1 | sed 's/.*://'
+}
+
+# -fmem-reportの出力からTokenの行(生成数、バイト数、最大生存バイト数、文字列、アリーナ)を取り出す
+token_mem() {
+    $FCC -fmem-report -S -o /dev/null $1 2>&1 >/dev/null | awk '$1 == "Token" { print $2, $3, $4, $5, $6; exit }'
+}
+
+cases=${@:-$BENCH_CASES}
+commit=`git rev-parse --short HEAD 2>/dev/null`
+
+printf "%-13s %8s %9s %10s %9s %9s %9s %9s %9s %10s %9s\n" case lines tokens 'wall(ms)' tokenize preproc parse codegen 'Mtok/s' 'Klines/s' 'RSS(MB)'
+for c in $cases; do
+    gen_$c $tmp || exit 1
+
+    best=
+    best_wall=
+    for i in `seq $RUNS`; do
+        report=`$FCC $BENCH_FLAGS -ftime-report=json -S -o /dev/null $tmp/$c.c 2>&1 >/dev/null`
+        if [ $? -ne 0 ]; then
+            echo "$c: コンパイルに失敗しました" >&2
+            echo "$report" | head -n 5 >&2
+            exit 1
+        fi
+        wall=`echo "$report" | grep -o '"total":{"wall_ms":[0-9.]*' | sed 's/.*://'`
+        if [ -z "$best_wall" ] || awk -v a=$wall -v b=$best_wall 'BEGIN { exit !(a < b) }'; then
+            best=$report
+            best_wall=$wall
+        fi
+    done
+
+    lines=`field "$best" lines`
+    tokens=`field "$best" tokens`
+    rss=`field "$best" peak_rss_kb`
+    tokenize=`phase "$best" tokenize`
+    preproc=`awk -v a=$(phase "$best" preprocess) -v b=$(phase "$best" 'preprocess: include') -v c=$(phase "$best" 'preprocess: macro') -v d=$(phase "$best" 'preprocess: #if') 'BEGIN { print a + b + c + d }'`
+    parse=`phase "$best" parse`
+    codegen=`awk -v a=$(phase "$best" 'codegen: lvar offsets') -v b=$(phase "$best" 'codegen: data') -v c=$(phase "$best" 'codegen: text') 'BEGIN { print a + b + c }'`
+
+    awk -v c=$c -v l=$lines -v t=$tokens -v w=$best_wall -v tk=${tokenize:-0} -v pp=$preproc -v pa=${parse:-0} -v cg=$codegen -v r=$rss 'BEGIN {
+        printf "%-13s %8d %9d %10.1f %9.1f %9.1f %9.1f %9.1f %9.2f %10.1f %9.1f\n", c, l, t, w, tk, pp, pa, cg, t / w / 1000, l / w, r / 1024
+    }'
+
+    # トークンの大きさとメモリ使用量は表の下にまとめて表示する
+    read created bytes peak strings arena <<< `token_mem $tmp/$c.c`
+    token_report="$token_report`awk -v c=$c -v n=$created -v b=$bytes -v p=$peak -v s=$strings -v a=$arena 'BEGIN {
+        printf "%-13s %9d %9d %10.1f %10.1f %10.1f", c, n, n ? b / n : 0, p / 1048576, s / 1048576, a / 1048576
+    }'`
+"
+
+    if [ -n "$BENCH_OUTPUT" ]; then
+        token="{\"created\":$created,\"bytes\":$bytes,\"peak_live_bytes\":$peak,\"string_bytes\":$strings,\"arena_bytes\":$arena}"
+        echo "{\"commit\":\"$commit\",\"case\":\"$c\",\"scale\":${BENCH_SCALE:-1},\"report\":$best,\"token\":$token}" >> $BENCH_OUTPUT
+    fi
+done
+
+echo
+printf "%-13s %9s %9s %10s %10s %10s\n" case tokens 'size(B)' 'live(MB)' 'str(MB)' 'arena(MB)'
+printf "%s" "$token_report"
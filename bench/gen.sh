@@ -0,0 +1,188 @@
+#!/bin/bash
+# ベンチマーク用の大きな入力を生成する関数群。bench.shから読み込んで使う
+# 各関数は第1引数のディレクトリに<ケース名>.c(と必要なヘッダファイル)を生成する
+# 規模はBENCH_SCALE(デフォルト: 1)倍する
+
+# 規模を倍率で調整した値を返す(最小1)
+scaled() {
+    awk -v n=$1 -v s=${BENCH_SCALE:-1} 'BEGIN { v = int(n * s); print (v < 1) ? 1 : v }'
+}
+
+# 約20万行の1ファイル(構造体、グローバル変数、ループ、switch、文字列リテラルを含む関数の繰り返し)
+gen_amalgamation() {
+    awk -v n=`scaled 5000` 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "typedef struct Node%d {\n", i
+            printf "    int key;\n    long value;\n    char name[16];\n    struct Node%d *next;\n} Node%d;\n\n", i, i
+            printf "static Node%d pool%d[8];\n", i, i
+            printf "static const char *label%d = \"label number %d\";\n\n", i, i
+            printf "static int lookup%d(Node%d *head, int key) {\n", i, i
+            printf "    for (Node%d *p = head; p; p = p->next) {\n", i
+            printf "        if (p->key == key)\n            return (int)p->value;\n    }\n    return -1;\n}\n\n"
+            printf "int step%d(int x, int y) {\n", i
+            printf "    int acc = 0;\n"
+            printf "    for (int k = 0; k < 8; k++) {\n"
+            printf "        pool%d[k].key = k * %d + x;\n", i, i % 97
+            printf "        pool%d[k].value = (long)k * y;\n", i
+            printf "        pool%d[k].next = k + 1 < 8 ? &pool%d[k + 1] : 0;\n    }\n", i, i
+            printf "    switch (x & 3) {\n"
+            printf "    case 0:\n        acc += lookup%d(pool%d, y);\n        break;\n", i, i
+            printf "    case 1:\n        acc -= label%d[x & 7];\n        break;\n", i
+            printf "    default:\n        acc ^= x * %d + y;\n    }\n", i
+            printf "    return acc;\n}\n\n"
+        }
+    }' > $1/amalgamation.c
+}
+
+# 小さな関数が大量にあるファイル
+gen_functions() {
+    awk -v n=`scaled 5000` 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "int fn%d(int a, int b) { int c = a * %d + b; if (c < 0) c = -c; return c %% 1000; }\n", i, i
+        }
+        printf "int main() {\n    int s = 0;\n"
+        for (i = 0; i < n; i += 10) {
+            printf "    s += fn%d(s, %d);\n", i, i
+        }
+        printf "    return s & 0x7f;\n}\n"
+    }' > $1/functions.c
+}
+
+# 入れ子になった関数マクロとトークン連結を多用するファイル
+gen_macros() {
+    cat > $1/macros.c <<'EOF'
+#define CAT(a, b) a##b
+#define XCAT(a, b) CAT(a, b)
+#define STR(x) #x
+#define XSTR(x) STR(x)
+#define ADD(a, b) ((a) + (b))
+#define MUL(a, b) ((a) * (b))
+#define SQ(x) MUL(x, x)
+#define F1(x) ADD(SQ(x), 1)
+#define G1(x) MUL(ADD(x, 2), 3)
+#define F2(x) F1(G1(x))
+#define G2(x) G1(F1(x))
+#define F3(x) F2(G2(x))
+#define G3(x) G2(F2(x))
+#define F4(x) F3(G3(x))
+#define APPLY(f, ...) f(__VA_ARGS__)
+#define FIELD(t, n) t XCAT(field_, n);
+#define DECL(n) long XCAT(var_, n) = APPLY(F2, n); static const char *XCAT(name_, n) = XSTR(XCAT(var_, n));
+EOF
+    awk -v n=`scaled 2000` -v f=`scaled 200` 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "DECL(%d)\n", i
+        }
+        for (i = 0; i < f; i++) {
+            printf "struct S%d { FIELD(int, a%d) FIELD(long, b%d) FIELD(char, c%d) };\n", i, i, i, i
+            printf "long XCAT(func_, %d)(long x) { return F4(x) + XCAT(var_, %d); }\n", i, i % n
+        }
+    }' >> $1/macros.c
+}
+
+# 大量のヘッダファイルを繰り返しインクルードするファイル。ヘッダファイルはインクルードガードを持つ
+gen_includes() {
+    mkdir -p $1/include
+    awk -v n=`scaled 300` -v dir=$1/include 'BEGIN {
+        for (i = 0; i < n; i++) {
+            file = sprintf("%s/h%d.h", dir, i)
+            printf "#ifndef H%d_H\n#define H%d_H\n", i, i > file
+            for (j = 1; j <= 3; j++) {
+                if (i + j < n) {
+                    printf "#include \"h%d.h\"\n", i + j > file
+                }
+            }
+            printf "typedef struct T%d { int a; long b; } T%d;\n", i, i > file
+            printf "extern int shared%d;\n", i > file
+            printf "int get%d(T%d *t);\n", i, i > file
+            printf "#define VALUE%d %d\n", i, i > file
+            printf "#endif\n" > file
+            close(file)
+        }
+        for (k = 0; k < 2; k++) {
+            for (i = 0; i < n; i++) {
+                printf "#include \"include/h%d.h\"\n", i
+            }
+        }
+        printf "int sum() {\n    return 0"
+        for (i = 0; i < n; i++) {
+            printf " + VALUE%d", i
+        }
+        printf ";\n}\n"
+    }' > $1/includes.c
+}
+
+# 大きな配列、構造体の配列、文字列の表の初期化子を持つファイル
+gen_initializers() {
+    awk -v n=`scaled 200000` -v m=`scaled 20000` 'BEGIN {
+        printf "int table[] = {\n"
+        for (i = 0; i < n; i++) {
+            printf "%d,%s", (i * 7919) % 100003, (i % 16 == 15) ? "\n" : " "
+        }
+        printf "};\n\n"
+        printf "struct Point { int x; double y; char tag[8]; };\n"
+        printf "struct Point points[] = {\n"
+        for (i = 0; i < m; i++) {
+            printf "    {%d, %d.5, \"p%d\"},\n", i, i, i % 1000
+        }
+        printf "};\n\n"
+        printf "const char *names[] = {\n"
+        for (i = 0; i < m; i++) {
+            printf "    \"name_%d\",\n", i
+        }
+        printf "};\n"
+    }' > $1/initializers.c
+}
+
+# 深く入れ子になった式と長い式を持つファイル
+gen_expressions() {
+    awk -v n=`scaled 200` -v d=300 -v w=1000 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "int nested%d(int x) {\n    return ", i
+            for (j = 0; j < d; j++) {
+                printf "(x + "
+            }
+            printf "%d", i
+            for (j = 0; j < d; j++) {
+                printf ")"
+            }
+            printf ";\n}\n"
+            printf "long flat%d(long x, long y) {\n    return x", i
+            for (j = 0; j < w; j++) {
+                printf " %s %s", (j % 3 == 0) ? "+" : (j % 3 == 1) ? "-" : "^", (j % 2) ? "y" : j
+            }
+            printf ";\n}\n"
+        }
+    }' > $1/expressions.c
+}
+
+# キーワード、型名、2文字以上の区切り文字が大半を占めるファイル(字句解析のキーワード、区切り文字の判定を計測する)
+gen_keywords() {
+    awk -v n=`scaled 50` -v m=100 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "static unsigned long kw%d(const signed char c, volatile unsigned short s) {\n", i
+            printf "    register unsigned long acc = 0;\n"
+            for (j = 0; j < m; j++) {
+                printf "    { static const unsigned long v = sizeof(long) + sizeof(short) + %d; register long r = (long)c; ", j
+                printf "r += v; r <<= 1; r >>= 1; r &= 3; r |= s; r ^= 5; r -= 1; "
+                printf "if (r != 0 && r <= 10 || r >= 2) r++; else r--; acc += (unsigned long)r; }\n"
+            }
+            printf "    return acc;\n}\n"
+        }
+    }' > $1/keywords.c
+}
+
+# システムヘッダのようにコメントと字下げが大半を占めるファイル(字句解析の空白、コメントの読み飛ばしを計測する)
+gen_comments() {
+    awk -v n=`scaled 20000` 'BEGIN {
+        for (i = 0; i < n; i++) {
+            printf "/*\n * Copyright (C) 1991-2023 Free Software Foundation, Inc.  This file is part of the GNU C Library.\n"
+            printf " *   The GNU C Library is free software; you can redistribute it and/or modify it.\n */\n"
+            printf "extern int function_%d (const char *__restrict __string, int __flags);  /* trailing comment */\n", i
+            printf "        // indented line comment for the declaration above %d\n", i
+        }
+    }' > $1/comments.c
+}
+
+# 生成できるケースの一覧
+BENCH_CASES="amalgamation functions macros includes initializers expressions keywords comments"
@@ -0,0 +1,113 @@
+#!/bin/bash
+# fccが生成したバイナリの実行性能を計測し、ホストのCコンパイラ(-O0, -O2)と比較する
+# 使い方: bench/runtime.sh [プログラム名...]  (省略時はbench/runtime/*.cのすべて)
+#   FCC           計測するfcc (デフォルト: ./bin/fcc)
+#   CC            比較するホストのCコンパイラ (デフォルト: gcc)
+#   BENCH_RUNS    各プログラムの実行回数。実時間が最短の結果を採用する (デフォルト: 3)
+#   BENCH_OUTPUT  結果をJSON Lines形式で追記するファイル。コミット間の比較に使う
+# 命令数はperf statが使える場合のみ計測する(使えない場合は"-"と表示する)
+FCC=${FCC:-./bin/fcc}
+CC=${CC:-gcc}
+RUNS=${BENCH_RUNS:-3}
+dir=`dirname $0`/runtime
+tmp=`mktemp -d /tmp/fcc-bench-XXXXXX`
+trap 'rm -rf $tmp' INT TERM HUP EXIT
+
+# 比較する構成の一覧
+CONFIGS="fcc O0 O2"
+
+# 構成に応じてバイナリを生成する
+build() {
+    case $1 in
+    fcc) $FCC -o $3 $2 ;;
+    O0) $CC -O0 -w -o $3 $2 ;;
+    O2) $CC -O2 -w -o $3 $2 ;;
+    esac
+}
+
+# プログラムを実行し、実時間(ms)を出力する。プログラムの出力は第2引数のファイルに書き出す
+run_time() {
+    local start=`date +%s%N`
+    $1 > $2 || return 1
+    local end=`date +%s%N`
+    awk -v s=$start -v e=$end 'BEGIN { printf "%.1f", (e - s) / 1e6 }'
+}
+
+# プログラムを実行したときのユーザー空間の命令数を出力する
+instructions() {
+    if [ -z "$use_perf" ]; then
+        echo -
+        return
+    fi
+    perf stat -x, -e instructions:u -o $tmp/perf.txt $1 > /dev/null 2>&1
+    grep instructions $tmp/perf.txt | cut -d, -f1
+}
+
+# .textなどの実行されるセクションのサイズ(バイト)を出力する
+text_size() {
+    size $1 | tail -n 1 | awk '{ print $1 }'
+}
+
+use_perf=
+if perf stat -x, -e instructions:u true > /dev/null 2>&1; then
+    use_perf=1
+fi
+
+if [ $# -gt 0 ]; then
+    programs=$@
+else
+    programs=`ls $dir/*.c | xargs -n 1 basename | sed 's/\.c$//'`
+fi
+commit=`git rev-parse --short HEAD 2>/dev/null`
+
+printf "%-10s %10s %10s %10s %7s %7s %10s %10s %10s %8s %8s %8s\n" program 'fcc(ms)' 'O0(ms)' 'O2(ms)' 'fcc/O0' 'fcc/O2' 'fcc(Minsn)' 'O0(Minsn)' 'O2(Minsn)' 'fcc(B)' 'O0(B)' 'O2(B)'
+for p in $programs; do
+    declare -A wall insns text
+    for c in $CONFIGS; do
+        exe=$tmp/$p.$c
+        if ! build $c $dir/$p.c $exe; then
+            echo "$p: $cによるビルドに失敗しました" >&2
+            exit 1
+        fi
+
+        best=
+        for i in `seq $RUNS`; do
+            t=`run_time $exe $tmp/$p.$c.out`
+            if [ $? -ne 0 ]; then
+                echo "$p: $cでビルドしたプログラムが異常終了しました" >&2
+                exit 1
+            fi
+            if [ -z "$best" ] || awk -v a=$t -v b=$best 'BEGIN { exit !(a < b) }'; then
+                best=$t
+            fi
+        done
+        wall[$c]=$best
+        insns[$c]=`instructions $exe`
+        text[$c]=`text_size $exe`
+
+        # 実行結果がホストのコンパイラと一致することを確認する
+        if ! cmp -s $tmp/$p.$c.out $tmp/$p.fcc.out; then
+            echo "$p: fccと$cで実行結果が異なります" >&2
+            exit 1
+        fi
+    done
+
+    awk -v p=$p -v f=${wall[fcc]} -v o0=${wall[O0]} -v o2=${wall[O2]} \
+        -v fi=${insns[fcc]} -v i0=${insns[O0]} -v i2=${insns[O2]} \
+        -v fs=${text[fcc]} -v s0=${text[O0]} -v s2=${text[O2]} '
+        function minsn(n) { return (n == "-") ? "-" : sprintf("%.1f", n / 1e6) }
+        BEGIN {
+            printf "%-10s %10.1f %10.1f %10.1f %7.2f %7.2f %10s %10s %10s %8d %8d %8d\n", p, f, o0, o2, f / o0, f / o2, minsn(fi), minsn(i0), minsn(i2), fs, s0, s2
+        }'
+
+    if [ -n "$BENCH_OUTPUT" ]; then
+        json="{\"commit\":\"$commit\",\"program\":\"$p\""
+        for c in $CONFIGS; do
+            n=${insns[$c]}
+            [ "$n" = - ] && n=null
+            json="$json,\"$c\":{\"wall_ms\":${wall[$c]},\"instructions\":$n,\"text_bytes\":${text[$c]}}"
+        done
+        echo "$json}" >> $BENCH_OUTPUT
+    fi
+    unset wall insns text
+done
@@ -0,0 +1,80 @@
+/* ハッシュ表: 文字列キーのチェイン法と整数キーのオープンアドレス法 */
+#include <stdio.h>
+#include <string.h>
+
+void *malloc(unsigned long size);
+void *calloc(unsigned long n, unsigned long size);
+void free(void *p);
+
+typedef struct Entry Entry;
+struct Entry
+{
+	Entry *next;
+	char key[24];
+	long value;
+};
+
+#define BUCKETS 4096
+static Entry *buckets[BUCKETS];
+
+static unsigned hash_str(const char *s)
+{
+	unsigned h = 2166136261u;
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 16777619u;
+	return h;
+}
+
+static Entry *lookup(const char *key, int create)
+{
+	unsigned h = hash_str(key) % BUCKETS;
+	for (Entry *e = buckets[h]; e; e = e->next)
+		if (strcmp(e->key, key) == 0)
+			return e;
+	if (!create)
+		return 0;
+	Entry *e = malloc(sizeof(Entry));
+	strcpy(e->key, key);
+	e->value = 0;
+	e->next = buckets[h];
+	buckets[h] = e;
+	return e;
+}
+
+#define SLOTS (1 << 18)
+static long keys[SLOTS];
+static long values[SLOTS];
+
+static long *slot(long key)
+{
+	unsigned long i = (unsigned long)(key * 0x9E3779B97F4A7C15) >> 46;
+	while (keys[i] != 0 && keys[i] != key)
+		i = (i + 1) & (SLOTS - 1);
+	keys[i] = key;
+	return &values[i];
+}
+
+int main()
+{
+	char buf[24];
+	long sum = 0;
+
+	for (int i = 0; i < 200000; i++)
+	{
+		sprintf(buf, "key%d", i % 20000);
+		lookup(buf, 1)->value += i;
+	}
+	for (int i = 0; i < 20000; i += 7)
+	{
+		sprintf(buf, "key%d", i);
+		sum += lookup(buf, 0)->value;
+	}
+
+	for (long i = 1; i < 1000000; i++)
+		*slot((i * 7919) % 100000 + 1) += i;
+	for (long i = 1; i <= 100000; i += 3)
+		sum += *slot(i);
+
+	printf("%ld\n", sum);
+	return 0;
+}
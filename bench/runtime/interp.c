@@ -0,0 +1,84 @@
+/* バイトコードインタプリタ: switchによるディスパッチループ */
+#include <stdio.h>
+
+enum
+{
+	OP_PUSH,
+	OP_LOAD,
+	OP_STORE,
+	OP_ADD,
+	OP_SUB,
+	OP_LT,
+	OP_JZ,
+	OP_JMP,
+	OP_HALT,
+};
+
+static long run(const int *code, long *vars)
+{
+	long stack[64];
+	int sp = 0, pc = 0;
+	for (;;)
+	{
+		switch (code[pc++])
+		{
+		case OP_PUSH:
+			stack[sp++] = code[pc++];
+			break;
+		case OP_LOAD:
+			stack[sp++] = vars[code[pc++]];
+			break;
+		case OP_STORE:
+			vars[code[pc++]] = stack[--sp];
+			break;
+		case OP_ADD:
+			sp--;
+			stack[sp - 1] += stack[sp];
+			break;
+		case OP_SUB:
+			sp--;
+			stack[sp - 1] -= stack[sp];
+			break;
+		case OP_LT:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] < stack[sp];
+			break;
+		case OP_JZ:
+			if (stack[--sp] == 0)
+				pc = code[pc];
+			else
+				pc++;
+			break;
+		case OP_JMP:
+			pc = code[pc];
+			break;
+		case OP_HALT:
+			return stack[sp - 1];
+		}
+	}
+}
+
+int main()
+{
+	/* a = 0; b = 1; i = 0; while (i < n) { t = a + b; a = b; b = t; i = i + 1; } */
+	static const int code[] = {
+		OP_PUSH, 0, OP_STORE, 0,
+		OP_PUSH, 1, OP_STORE, 1,
+		OP_PUSH, 0, OP_STORE, 2,
+		/* 12: */ OP_LOAD, 2, OP_LOAD, 3, OP_LT, OP_JZ, 42,
+		OP_LOAD, 0, OP_LOAD, 1, OP_ADD, OP_STORE, 4,
+		OP_LOAD, 1, OP_STORE, 0,
+		OP_LOAD, 4, OP_STORE, 1,
+		OP_LOAD, 2, OP_PUSH, 1, OP_ADD, OP_STORE, 2,
+		OP_JMP, 12,
+		/* 42: */ OP_LOAD, 0, OP_HALT};
+
+	long total = 0;
+	for (int r = 0; r < 50; r++)
+	{
+		long vars[8] = {0, 0, 0, 30000 + r, 0};
+		total += run(code, vars) & 0xffff;
+	}
+	printf("%ld\n", total);
+	return 0;
+}
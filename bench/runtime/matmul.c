@@ -0,0 +1,51 @@
+/* 行列積: double型の正方行列の積を繰り返す */
+#include <stdio.h>
+
+#define N 200
+
+static double a[N][N], b[N][N], c[N][N];
+
+static void init(void)
+{
+	unsigned seed = 12345;
+	for (int i = 0; i < N; i++)
+	{
+		for (int j = 0; j < N; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			a[i][j] = (seed >> 16) % 100 / 10.0;
+			seed = seed * 1103515245 + 12345;
+			b[i][j] = (seed >> 16) % 100 / 10.0;
+		}
+	}
+}
+
+static void multiply(void)
+{
+	for (int i = 0; i < N; i++)
+	{
+		for (int j = 0; j < N; j++)
+			c[i][j] = 0;
+		for (int k = 0; k < N; k++)
+		{
+			double aik = a[i][k];
+			for (int j = 0; j < N; j++)
+				c[i][j] += aik * b[k][j];
+		}
+	}
+}
+
+int main()
+{
+	init();
+	double trace = 0;
+	for (int r = 0; r < 3; r++)
+	{
+		multiply();
+		for (int i = 0; i < N; i++)
+			trace += c[i][i];
+		a[r][r] += 1;
+	}
+	printf("%.3f\n", trace);
+	return 0;
+}
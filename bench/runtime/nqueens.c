@@ -0,0 +1,58 @@
+/* N-queens: ビット演算による全解の探索 */
+#include <stdio.h>
+
+static int solve(int n, int row, unsigned cols, unsigned diag1, unsigned diag2)
+{
+	if (row == n)
+		return 1;
+
+	int count = 0;
+	unsigned avail = ~(cols | diag1 | diag2) & ((1u << n) - 1);
+	while (avail)
+	{
+		unsigned bit = avail & -avail;
+		avail ^= bit;
+		count += solve(n, row + 1, cols | bit, (diag1 | bit) << 1, (diag2 | bit) >> 1);
+	}
+	return count;
+}
+
+/* 盤面の配列を使う素朴な実装 */
+static int board[16];
+
+static int safe(int row, int col)
+{
+	for (int r = 0; r < row; r++)
+	{
+		int c = board[r];
+		if (c == col || c - col == r - row || c - col == row - r)
+			return 0;
+	}
+	return 1;
+}
+
+static int place(int n, int row)
+{
+	if (row == n)
+		return 1;
+	int count = 0;
+	for (int col = 0; col < n; col++)
+	{
+		if (safe(row, col))
+		{
+			board[row] = col;
+			count += place(n, row + 1);
+		}
+	}
+	return count;
+}
+
+int main()
+{
+	long total = 0;
+	for (int i = 0; i < 3; i++)
+		total += solve(12, 0, 0, 0, 0);
+	total += place(10, 0);
+	printf("%ld\n", total);
+	return 0;
+}
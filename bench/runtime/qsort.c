@@ -0,0 +1,73 @@
+/* ソート: libcのqsortと自前のクイックソート */
+#include <stdio.h>
+
+void qsort(void *base, unsigned long n, unsigned long size, int (*cmp)(const void *, const void *));
+
+#define N 500000
+static int data[N], work[N];
+
+static int compare(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+static void quicksort(int *v, int lo, int hi)
+{
+	while (lo < hi)
+	{
+		int pivot = v[(lo + hi) / 2];
+		int i = lo, j = hi;
+		while (i <= j)
+		{
+			while (v[i] < pivot)
+				i++;
+			while (v[j] > pivot)
+				j--;
+			if (i <= j)
+			{
+				int t = v[i];
+				v[i] = v[j];
+				v[j] = t;
+				i++;
+				j--;
+			}
+		}
+		if (j - lo < hi - i)
+		{
+			quicksort(v, lo, j);
+			lo = i;
+		}
+		else
+		{
+			quicksort(v, i, hi);
+			hi = j;
+		}
+	}
+}
+
+int main()
+{
+	unsigned seed = 42;
+	for (int i = 0; i < N; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		data[i] = seed >> 1;
+	}
+
+	for (int i = 0; i < N; i++)
+		work[i] = data[i];
+	qsort(work, N, sizeof(int), compare);
+	long check = (long)work[0] + work[N / 2] + work[N - 1];
+
+	for (int i = 0; i < N; i++)
+		work[i] = data[i];
+	quicksort(work, 0, N - 1);
+	for (int i = 1; i < N; i++)
+		if (work[i - 1] > work[i])
+			return 1;
+	check += work[N / 3];
+
+	printf("%ld\n", check);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/* 文字列処理: 単語の数え上げ、反転、部分文字列の検索 */
+#include <stdio.h>
+#include <string.h>
+
+static char text[1 << 20];
+
+static int is_alpha(int c)
+{
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+static int count_words(const char *s)
+{
+	int n = 0, in_word = 0;
+	for (; *s; s++)
+	{
+		if (is_alpha(*s))
+		{
+			if (!in_word)
+				n++;
+			in_word = 1;
+		}
+		else
+			in_word = 0;
+	}
+	return n;
+}
+
+static void reverse(char *s, int len)
+{
+	for (int i = 0, j = len - 1; i < j; i++, j--)
+	{
+		char t = s[i];
+		s[i] = s[j];
+		s[j] = t;
+	}
+}
+
+/* 素朴な部分文字列検索 */
+static int count_matches(const char *s, int len, const char *pat)
+{
+	int m = strlen(pat), n = 0;
+	for (int i = 0; i + m <= len; i++)
+	{
+		int j = 0;
+		while (j < m && s[i + j] == pat[j])
+			j++;
+		if (j == m)
+			n++;
+	}
+	return n;
+}
+
+static void to_upper(char *s)
+{
+	for (; *s; s++)
+		if ('a' <= *s && *s <= 'z')
+			*s -= 'a' - 'A';
+}
+
+int main()
+{
+	static const char *words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit"};
+	int len = 0;
+	unsigned seed = 1;
+	while (len < (int)sizeof(text) - 32)
+	{
+		seed = seed * 1103515245 + 12345;
+		const char *w = words[(seed >> 16) % 8];
+		int wl = strlen(w);
+		memcpy(text + len, w, wl);
+		len += wl;
+		text[len++] = (seed >> 8) % 13 == 0 ? '\n' : ' ';
+	}
+	text[len] = 0;
+
+	long result = 0;
+	for (int r = 0; r < 4; r++)
+	{
+		result += count_words(text);
+		result += count_matches(text, len, "dolor sit");
+		reverse(text, len);
+	}
+	to_upper(text);
+	result += count_matches(text, len, "AMET");
+	printf("%ld\n", result);
+	return 0;
+}
@@ -0,0 +1,71 @@
+/* 構造体: 値返し、構造体のコピー、入れ子の構造体(fccは構造体の値渡しに対応していないためポインタで渡す) */
+#include <stdio.h>
+
+typedef struct
+{
+	double x, y, z;
+} Vec;
+
+typedef struct
+{
+	Vec pos;
+	Vec vel;
+	double mass;
+	int id;
+} Particle;
+
+static Vec add(const Vec *a, const Vec *b)
+{
+	Vec r = {a->x + b->x, a->y + b->y, a->z + b->z};
+	return r;
+}
+
+static Vec scale(const Vec *a, double s)
+{
+	Vec r = {a->x * s, a->y * s, a->z * s};
+	return r;
+}
+
+static double dot(const Vec *a, const Vec *b)
+{
+	return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+#define N 2000
+static Particle ps[N];
+
+static void step(double dt)
+{
+	Vec gravity = {0, -9.8, 0};
+	for (int i = 0; i < N; i++)
+	{
+		Particle p = ps[i];
+		Vec dv = scale(&gravity, dt);
+		p.vel = add(&p.vel, &dv);
+		Vec dp = scale(&p.vel, dt);
+		p.pos = add(&p.pos, &dp);
+		if (p.pos.y < 0)
+		{
+			p.pos.y = -p.pos.y;
+			p.vel.y = -p.vel.y * 0.9;
+		}
+		ps[i] = p;
+	}
+}
+
+int main()
+{
+	for (int i = 0; i < N; i++)
+	{
+		Particle p = {{i % 17, 10 + i % 5, i % 3}, {1, 0, -1}, 1 + i % 4, i};
+		ps[i] = p;
+	}
+	for (int t = 0; t < 400; t++)
+		step(0.01);
+
+	double energy = 0;
+	for (int i = 0; i < N; i++)
+		energy += 0.5 * ps[i].mass * dot(&ps[i].vel, &ps[i].vel);
+	printf("%.3f\n", energy);
+	return 0;
+}
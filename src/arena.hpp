@@ -0,0 +1,160 @@
+/**
+ * @file arena.hpp
+ * @author K.Fukunaga
+ * @brief 同じ型のオブジェクトをまとめて確保するアリーナ
+ * @version 0.1
+ * @date 2023-09-08
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "memreport.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+/**
+ * @brief 同じ型のオブジェクトをN個ずつまとめて確保した領域(チャンク)から割り当てるアリーナ
+ *
+ * @details 割り当てはチャンクの先頭から順に行うので、続けて生成したオブジェクト(トークナイズしたトークン列など)は
+ * メモリ上でも連続して並ぶ。解放された領域はフリーリストに繋いで次の割り当てに再利用する。
+ * チャンクはrelease()で生存しているオブジェクトがなくなったときにまとめて解放する。
+ * 翻訳単位をまたいで使うオブジェクトは別のアリーナから割り当て、解放するときはowns()で割り当て元を判別する。
+ * 割り当てたチャンクのバイト数はMemReportに記録する。
+ *
+ * @tparam T 割り当てるオブジェクトの型
+ * @tparam K MemReportに記録するデータ構造の種類
+ * @tparam N 1つのチャンクに含まれるオブジェクトの数
+ */
+template <class T, MemReport::Kind K, size_t N = 1024>
+class Arena
+{
+public:
+	/**
+	 * @brief オブジェクト1つ分の領域を割り当てる
+	 *
+	 * @return 割り当てた領域
+	 */
+	void *allocate()
+	{
+		++_live;
+		if (_free)
+		{
+			auto slot = _free;
+			_free = slot->_next;
+			return slot;
+		}
+		if (N == _used)
+		{
+			_chunks.emplace_back(std::make_unique_for_overwrite<Slot[]>(N));
+			const Slot *start = _chunks.back().get();
+			_starts.insert(std::upper_bound(_starts.begin(), _starts.end(), start, std::less<const Slot *>()), start);
+			MemReport::arena_grown(K, sizeof(Slot) * N);
+			_used = 0;
+		}
+		return &_chunks.back()[_used++];
+	}
+
+	/**
+	 * @brief allocate()で割り当てた領域を解放し、フリーリストに繋ぐ
+	 *
+	 * @param p 解放する領域
+	 */
+	void deallocate(void *p)
+	{
+		auto slot = static_cast<Slot *>(p);
+		slot->_next = _free;
+		_free = slot;
+		--_live;
+	}
+
+	/**
+	 * @brief 別のアリーナのチャンク、フリーリスト、生存しているオブジェクトを引き取る。
+	 * 別のスレッドで割り当てたオブジェクトを、以降はこのアリーナで解放できるようにする。
+	 *
+	 * @param other 引き取るアリーナ(空になる)
+	 */
+	void adopt(Arena &&other)
+	{
+		/* 割り当て途中の最後のチャンクは自身のものを使い続ける */
+		auto pos = _chunks.empty() ? _chunks.end() : _chunks.end() - 1;
+		_chunks.insert(pos, std::make_move_iterator(other._chunks.begin()), std::make_move_iterator(other._chunks.end()));
+		_starts.insert(_starts.end(), other._starts.begin(), other._starts.end());
+		std::sort(_starts.begin(), _starts.end(), std::less<const Slot *>());
+
+		/* フリーリストを繋ぐ */
+		if (other._free)
+		{
+			auto tail = other._free;
+			while (tail->_next)
+			{
+				tail = tail->_next;
+			}
+			tail->_next = _free;
+			_free = other._free;
+		}
+		_live += other._live;
+
+		other._chunks.clear();
+		other._starts.clear();
+		other._free = nullptr;
+		other._used = N;
+		other._live = 0;
+	}
+
+	/**
+	 * @brief 領域がこのアリーナのチャンクから割り当てたものであるか。
+	 * チャンクの先頭アドレスを昇順に並べておき、二分探索で含みうるチャンクを1つに絞る。
+	 *
+	 * @param p 調べる領域
+	 * @return このアリーナから割り当てたものであればtrue
+	 */
+	bool owns(const void *p) const
+	{
+		auto slot = static_cast<const Slot *>(p);
+		auto itr = std::upper_bound(_starts.begin(), _starts.end(), slot, std::less<const Slot *>());
+		return itr != _starts.begin() && std::less<const Slot *>()(slot, *(itr - 1) + N);
+	}
+
+	/**
+	 * @brief 生存しているオブジェクトがなければすべてのチャンクをまとめて解放する
+	 *
+	 * @return 解放したか
+	 */
+	bool release()
+	{
+		if (_live != 0)
+		{
+			return false;
+		}
+		MemReport::arena_grown(K, -static_cast<int64_t>(sizeof(Slot) * N * _chunks.size()));
+		_chunks.clear();
+		_starts.clear();
+		_free = nullptr;
+		_used = N;
+		return true;
+	}
+
+private:
+	/**
+	 * @brief オブジェクト1つ分の領域。未使用の間はフリーリストの次の領域を指す
+	 *
+	 */
+	union Slot
+	{
+		Slot *_next;					  /*!< フリーリストの次の領域 */
+		alignas(T) std::byte _storage[sizeof(T)]; /*!< オブジェクトを格納する領域 */
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> _chunks; /*!< 確保したチャンク */
+	std::vector<const Slot *> _starts;			  /*!< チャンクの先頭アドレス(昇順。owns()で二分探索する) */
+	Slot *_free = nullptr;						  /*!< フリーリストの先頭 */
+	size_t _used = N;							  /*!< 最後のチャンクで割り当て済みの領域の数 */
+	size_t _live = 0;							  /*!< 生存しているオブジェクトの数 */
+};
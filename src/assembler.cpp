@@ -0,0 +1,2058 @@
+/**
+ * @file assembler.cpp
+ * @author K.Fukunaga
+ * @brief CodeGenが出力したアセンブリから直接オブジェクトファイルを生成する内蔵アセンブラ
+ *
+ * Intel記法のx86-64アセンブリを1行ずつ機械語に変換してセクションに追加していく。
+ * ジャンプ命令はすべて短い形式(rel8)で仮に配置し、届かないものだけを長い形式(rel32)に
+ * 伸ばす処理を変化がなくなるまで繰り返す('as'と同じ方式)。最後に再配置を解決して
+ * ELF形式の再配置可能オブジェクトファイルを書き出す。
+ * @version 0.1
+ * @date 2023-08-27
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "assembler.hpp"
+#include "timereport.hpp"
+#include <elf.h>
+#include <cstring>
+#include <cerrno>
+
+/** セクションの番号 */
+static constexpr int TEXT = 0;
+static constexpr int DATA = 1;
+static constexpr int BSS = 2;
+
+/** RIP相対アドレッシングを表すベースレジスタの番号 */
+static constexpr int RIP = 16;
+
+/** jmp命令を表す条件コード */
+static constexpr int JMP = 16;
+
+/** 特殊オペコードで表せるアドレスの増分の最大値 ((255 - opcode_base) / line_range) */
+static constexpr int MAX_SPECIAL_ADDR_DELTA = 17;
+
+/* DWARFの行番号プログラムのパラメータ */
+static constexpr int LINE_BASE = -5;
+static constexpr int LINE_RANGE = 14;
+static constexpr int OPCODE_BASE = 13;
+
+/* DWARFの定数 */
+static constexpr uint8_t DW_LNS_copy = 0x01;
+static constexpr uint8_t DW_LNS_advance_pc = 0x02;
+static constexpr uint8_t DW_LNS_advance_line = 0x03;
+static constexpr uint8_t DW_LNS_set_file = 0x04;
+static constexpr uint8_t DW_LNS_const_add_pc = 0x08;
+static constexpr uint8_t DW_LNE_end_sequence = 0x01;
+static constexpr uint8_t DW_LNE_set_address = 0x02;
+static constexpr uint8_t DW_TAG_compile_unit = 0x11;
+static constexpr uint8_t DW_CHILDREN_no = 0x00;
+static constexpr uint8_t DW_AT_name = 0x03;
+static constexpr uint8_t DW_AT_stmt_list = 0x10;
+static constexpr uint8_t DW_AT_low_pc = 0x11;
+static constexpr uint8_t DW_AT_high_pc = 0x12;
+static constexpr uint8_t DW_AT_language = 0x13;
+static constexpr uint8_t DW_AT_comp_dir = 0x1b;
+static constexpr uint8_t DW_AT_producer = 0x25;
+static constexpr uint8_t DW_FORM_addr = 0x01;
+static constexpr uint8_t DW_FORM_data2 = 0x05;
+static constexpr uint8_t DW_FORM_data4 = 0x06;
+static constexpr uint8_t DW_FORM_string = 0x08;
+static constexpr uint16_t DW_LANG_Mips_Assembler = 0x8001;
+
+/** 処理中の行(エラー報告用) */
+static string_view current_line;
+
+/** 処理中の行番号(エラー報告用) */
+static int line_no = 0;
+
+vector<Assembler::Section> Assembler::sections;
+std::unordered_map<string, Assembler::Symbol> Assembler::symbols;
+vector<string> Assembler::symbol_order;
+vector<string> Assembler::file_names;
+vector<Assembler::LineInfo> Assembler::lines;
+std::unordered_map<string, int> Assembler::label_counts;
+int Assembler::current = TEXT;
+
+/**
+ * @brief レジスタの情報
+ *
+ */
+struct RegInfo
+{
+	int _num;	/*!< レジスタ番号 */
+	int _size;	/*!< サイズ(バイト) */
+	bool _xmm;	/*!< XMMレジスタであるか */
+};
+
+/**
+ * @brief レジスタ名からレジスタの情報を引く表を作成する
+ *
+ * @return レジスタ名をキーとする表
+ */
+static std::unordered_map<string_view, RegInfo> make_register_table()
+{
+	static constexpr string_view r64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+	static constexpr string_view r32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+	static constexpr string_view r16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+	static constexpr string_view r8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+	static constexpr string_view xmm[] = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+
+	std::unordered_map<string_view, RegInfo> table;
+	for (int i = 0; i < 16; ++i)
+	{
+		table[r64[i]] = {i, 8, false};
+		table[r32[i]] = {i, 4, false};
+		table[r16[i]] = {i, 2, false};
+		table[r8[i]] = {i, 1, false};
+		table[xmm[i]] = {i, 16, true};
+	}
+	return table;
+}
+
+/** レジスタ名の表 */
+static const std::unordered_map<string_view, RegInfo> registers = make_register_table();
+
+/** 算術演算命令と/digitの値 */
+static const std::unordered_map<string_view, int> alu_ops = {
+	{"add", 0}, {"or", 1}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7}};
+
+/** 単項演算命令(F7 /digit)と/digitの値 */
+static const std::unordered_map<string_view, int> unary_ops = {
+	{"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7}};
+
+/** シフト命令と/digitの値 */
+static const std::unordered_map<string_view, int> shift_ops = {
+	{"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7}};
+
+/** 条件コード */
+static const std::unordered_map<string_view, int> condition_codes = {
+	{"o", 0x0}, {"no", 0x1}, {"b", 0x2}, {"c", 0x2}, {"nae", 0x2}, {"ae", 0x3}, {"nb", 0x3}, {"nc", 0x3}, {"e", 0x4}, {"z", 0x4}, {"ne", 0x5}, {"nz", 0x5}, {"be", 0x6}, {"na", 0x6}, {"a", 0x7}, {"nbe", 0x7}, {"s", 0x8}, {"ns", 0x9}, {"p", 0xA}, {"pe", 0xA}, {"np", 0xB}, {"po", 0xB}, {"l", 0xC}, {"nge", 0xC}, {"ge", 0xD}, {"nl", 0xD}, {"le", 0xE}, {"ng", 0xE}, {"g", 0xF}, {"nle", 0xF}};
+
+/**
+ * @brief XMMレジスタを使う命令の必須プレフィックスとオペコード
+ *
+ */
+struct SseOp
+{
+	uint8_t _prefix; /*!< 必須プレフィックス。なければ0 */
+	uint8_t _opcode; /*!< 0Fに続くオペコード */
+};
+
+/** オペランドが(xmm, xmm/m)の形のSSE命令 */
+static const std::unordered_map<string_view, SseOp> sse_ops = {
+	{"addss", {0xF3, 0x58}}, {"addsd", {0xF2, 0x58}}, {"mulss", {0xF3, 0x59}}, {"mulsd", {0xF2, 0x59}}, {"subss", {0xF3, 0x5C}}, {"subsd", {0xF2, 0x5C}}, {"divss", {0xF3, 0x5E}}, {"divsd", {0xF2, 0x5E}}, {"cvtss2sd", {0xF3, 0x5A}}, {"cvtsd2ss", {0xF2, 0x5A}}, {"ucomiss", {0x00, 0x2E}}, {"ucomisd", {0x66, 0x2E}}, {"comiss", {0x00, 0x2F}}, {"comisd", {0x66, 0x2F}}, {"xorps", {0x00, 0x57}}, {"xorpd", {0x66, 0x57}}, {"andps", {0x00, 0x54}}, {"andpd", {0x66, 0x54}}, {"pxor", {0x66, 0xEF}}};
+
+/** コードセクションのパディングに使うNOP命令('as'と同じもの)。添字はバイト数 */
+static const vector<uint8_t> nops[] = {
+	{},
+	{0x90},
+	{0x66, 0x90},
+	{0x0F, 0x1F, 0x00},
+	{0x0F, 0x1F, 0x40, 0x00},
+	{0x0F, 0x1F, 0x44, 0x00, 0x00},
+	{0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+	{0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+	{0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+	{0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+	{0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+	{0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/**
+ * @brief 処理中の行を示してエラーを報告し終了する
+ *
+ * @param msg エラーメッセージ
+ */
+static void asm_error(string &&msg)
+{
+	error("アセンブル中のエラー: " + std::to_string(line_no) + "行目: " + msg + ": " + string(current_line));
+}
+
+/**
+ * @brief 前後の空白を取り除く
+ *
+ * @param str 対象の文字列
+ * @return 空白を取り除いた文字列
+ */
+static string_view trim(string_view str)
+{
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+	{
+		str.remove_prefix(1);
+	}
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+	{
+		str.remove_suffix(1);
+	}
+	return str;
+}
+
+/**
+ * @brief 引用符の外にある最初の文字cの位置を返す
+ *
+ * @param str 対象の文字列
+ * @param c 探す文字
+ * @return 見つかった位置。見つからなければstring_view::npos
+ */
+static size_t find_unquoted(const string_view &str, const char &c)
+{
+	bool quoted = false;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		if ('\\' == str[i] && quoted)
+		{
+			++i;
+		}
+		else if ('"' == str[i])
+		{
+			quoted = !quoted;
+		}
+		else if (c == str[i] && !quoted)
+		{
+			return i;
+		}
+	}
+	return string_view::npos;
+}
+
+/**
+ * @brief 値が符号付き8ビット整数で表せるか
+ */
+static bool is_int8(const int64_t &val)
+{
+	return -128 <= val && val <= 127;
+}
+
+/**
+ * @brief 値が符号付き32ビット整数で表せるか
+ */
+static bool is_int32(const int64_t &val)
+{
+	return INT32_MIN <= val && val <= INT32_MAX;
+}
+
+/**
+ * @brief 値をsizeバイトのリトルエンディアンで書き込む
+ *
+ * @param buf 書き込み先
+ * @param val 値
+ * @param size バイト数
+ */
+static void put(vector<uint8_t> &buf, const uint64_t &val, const int &size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		buf.push_back(static_cast<uint8_t>(val >> (8 * i)));
+	}
+}
+
+/**
+ * @brief 値をsizeバイトのリトルエンディアンで上書きする
+ *
+ * @param buf 書き込み先
+ * @param offset 書き込む位置
+ * @param val 値
+ * @param size バイト数
+ */
+static void patch(vector<uint8_t> &buf, const size_t &offset, const uint64_t &val, const int &size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		buf[offset + i] = static_cast<uint8_t>(val >> (8 * i));
+	}
+}
+
+/**
+ * @brief 符号なしLEB128形式で書き込む
+ */
+static void put_uleb(vector<uint8_t> &buf, uint64_t val)
+{
+	do
+	{
+		uint8_t byte = val & 0x7F;
+		val >>= 7;
+		buf.push_back(val ? (byte | 0x80) : byte);
+	} while (val);
+}
+
+/**
+ * @brief 符号付きLEB128形式で書き込む
+ */
+static void put_sleb(vector<uint8_t> &buf, int64_t val)
+{
+	while (true)
+	{
+		uint8_t byte = val & 0x7F;
+		val >>= 7;
+		if ((0 == val && !(byte & 0x40)) || (-1 == val && (byte & 0x40)))
+		{
+			buf.push_back(byte);
+			return;
+		}
+		buf.push_back(byte | 0x80);
+	}
+}
+
+/**
+ * @brief NUL終端文字列を書き込む
+ */
+static void put_str(vector<uint8_t> &buf, const string &str)
+{
+	buf.insert(buf.end(), str.begin(), str.end());
+	buf.push_back(0);
+}
+
+/*******************/
+/* Assembler Class */
+/*******************/
+
+/**
+ * @brief ファイルに書かれたアセンブリをアセンブルする
+ *
+ * @param input_path 入力ファイルのパス。"-"なら標準入力
+ * @param output_path 出力先のパス
+ */
+void Assembler::assemble_file(const string &input_path, const string &output_path)
+{
+	/* "-"は標準入力 */
+	if ("-" == input_path)
+	{
+		string input((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+		assemble(input, output_path);
+		return;
+	}
+
+	std::ifstream ifs(input_path, std::ios::binary);
+	if (!ifs)
+	{
+		error("ファイルが開けません: " + input_path);
+	}
+	string input((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	assemble(input, output_path);
+}
+
+/**
+ * @brief アセンブリをアセンブルしてオブジェクトファイルを出力する
+ *
+ * @param input アセンブリ
+ * @param output_path 出力先のパス
+ */
+void Assembler::assemble(const string_view &input, const string &output_path)
+{
+	TimeReport::Scope scope(TimeReport::PH_ASSEMBLE);
+	reset();
+
+	line_no = 0;
+	for (size_t pos = 0; pos < input.size();)
+	{
+		size_t end = input.find('\n', pos);
+		if (string_view::npos == end)
+		{
+			end = input.size();
+		}
+		++line_no;
+		current_line = input.substr(pos, end - pos);
+		parse_line(current_line);
+		pos = end + 1;
+	}
+
+	/* ジャンプ命令の長さを確定させてアドレスを決める */
+	relax();
+
+	/* 行番号情報があればデバッグ情報を出力する */
+	if (!lines.empty())
+	{
+		emit_debug_info();
+	}
+
+	write_object(output_path);
+}
+
+/**
+ * @brief アセンブルの状態を初期化する
+ *
+ */
+void Assembler::reset()
+{
+	sections.clear();
+	sections.emplace_back(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR);
+	sections.emplace_back(".data", SHT_PROGBITS, SHF_WRITE | SHF_ALLOC);
+	sections.emplace_back(".bss", SHT_NOBITS, SHF_WRITE | SHF_ALLOC);
+	/* スタックを実行不可能にする(--noexecstack) */
+	sections.emplace_back(".note.GNU-stack", SHT_PROGBITS, 0);
+	symbols.clear();
+	symbol_order.clear();
+	file_names.clear();
+	lines.clear();
+	label_counts.clear();
+	current = TEXT;
+}
+
+/**
+ * @brief 1行を解析する。';'で区切られた複数の文を含んでもよい
+ *
+ * @param line 入力の行
+ */
+void Assembler::parse_line(string_view line)
+{
+	/* コメントを取り除く */
+	line = line.substr(0, find_unquoted(line, '#'));
+
+	while (!line.empty())
+	{
+		size_t sep = find_unquoted(line, ';');
+		auto stmt = trim(line.substr(0, sep));
+		line = (string_view::npos == sep) ? string_view() : line.substr(sep + 1);
+
+		if (stmt.empty())
+		{
+			continue;
+		}
+
+		/* ラベル */
+		if (':' == stmt.back())
+		{
+			define_label(string(trim(stmt.substr(0, stmt.size() - 1))));
+			continue;
+		}
+
+		size_t space = stmt.find_first_of(" \t");
+		auto name = stmt.substr(0, space);
+		auto rest = (string_view::npos == space) ? string_view() : trim(stmt.substr(space));
+
+		/* ディレクティブ */
+		if ('.' == name.front())
+		{
+			parse_directive(name, rest);
+			continue;
+		}
+
+		/* repプレフィックス */
+		if ("rep" == name)
+		{
+			if ("stosb" == rest)
+			{
+				emit_bytes({0xF3, 0xAA});
+			}
+			else if ("movsb" == rest)
+			{
+				emit_bytes({0xF3, 0xA4});
+			}
+			else
+			{
+				asm_error("未対応の命令です");
+			}
+			continue;
+		}
+
+		/* 命令。オペランドは','で区切られる */
+		vector<Operand> ops;
+		while (!rest.empty())
+		{
+			size_t comma = rest.find(',');
+			ops.emplace_back(parse_operand(trim(rest.substr(0, comma))));
+			rest = (string_view::npos == comma) ? string_view() : rest.substr(comma + 1);
+		}
+		encode(name, ops);
+	}
+}
+
+/**
+ * @brief ディレクティブを処理する
+ *
+ * @param name ディレクティブ名
+ * @param rest 引数
+ */
+void Assembler::parse_directive(const string_view &name, string_view rest)
+{
+	if (".text" == name)
+	{
+		current = TEXT;
+	}
+	else if (".data" == name)
+	{
+		current = DATA;
+	}
+	else if (".bss" == name)
+	{
+		current = BSS;
+	}
+	else if (".globl" == name || ".global" == name)
+	{
+		auto sym = string(rest);
+		if (!symbols.contains(sym))
+		{
+			symbol_order.emplace_back(sym);
+		}
+		symbols[sym]._global = true;
+	}
+	else if (".local" == name)
+	{
+		auto sym = string(rest);
+		if (!symbols.contains(sym))
+		{
+			symbol_order.emplace_back(sym);
+			symbols[sym];
+		}
+	}
+	else if (".align" == name || ".balign" == name)
+	{
+		auto n = parse_number(rest);
+		if (n <= 0 || (n & (n - 1)))
+		{
+			asm_error("アライメントが2の累乗ではありません");
+		}
+		align(n);
+	}
+	else if (".byte" == name)
+	{
+		while (!rest.empty())
+		{
+			size_t comma = rest.find(',');
+			emit_bytes({static_cast<uint8_t>(parse_number(trim(rest.substr(0, comma))))});
+			rest = (string_view::npos == comma) ? string_view() : rest.substr(comma + 1);
+		}
+	}
+	else if (".quad" == name)
+	{
+		string sym;
+		int64_t addend;
+		parse_expression(rest, sym, addend);
+		if (sym.empty())
+		{
+			emit_imm(addend, 8);
+		}
+		else
+		{
+			add_fixup(sym, addend, R_X86_64_64);
+			emit_imm(0, 8);
+		}
+	}
+	else if (".zero" == name)
+	{
+		auto &bytes = sections[current]._frags.back()._bytes;
+		bytes.resize(bytes.size() + parse_number(rest));
+	}
+	else if (".file" == name)
+	{
+		/* 番号のない.fileはソースファイル名を示すだけなので無視する */
+		if (!rest.empty() && std::isdigit(static_cast<unsigned char>(rest.front())))
+		{
+			size_t space = rest.find_first_of(" \t");
+			auto no = parse_number(rest.substr(0, space));
+			auto path = trim(rest.substr(space));
+			if (path.size() < 2 || '"' != path.front() || '"' != path.back())
+			{
+				asm_error("ファイル名が不正です");
+			}
+			if (static_cast<int64_t>(file_names.size()) <= no)
+			{
+				file_names.resize(no + 1);
+			}
+			file_names[no] = string(path.substr(1, path.size() - 2));
+		}
+	}
+	else if (".loc" == name)
+	{
+		size_t space = rest.find_first_of(" \t");
+		if (string_view::npos == space)
+		{
+			asm_error("行番号がありません");
+		}
+		auto args = trim(rest.substr(space));
+		int file = parse_number(rest.substr(0, space));
+		int line = parse_number(args.substr(0, args.find_first_of(" \t")));
+		if (TEXT == current)
+		{
+			lines.push_back({current_position(), file, line});
+		}
+	}
+	else if (".intel_syntax" == name)
+	{
+		if (!rest.empty() && "noprefix" != rest)
+		{
+			asm_error("Intel記法はnoprefixのみ対応しています");
+		}
+	}
+	else
+	{
+		asm_error("未対応のディレクティブです");
+	}
+}
+
+/**
+ * @brief 現在位置にラベルを定義する
+ *
+ * @param name ラベル名
+ */
+void Assembler::define_label(const string &name)
+{
+	auto label = name;
+	/* 数字だけのラベルは何度でも定義できる。n番目の定義を別の名前で区別する */
+	if (std::all_of(name.begin(), name.end(), ::isdigit))
+	{
+		label = ".L.num." + name + "." + std::to_string(++label_counts[name]);
+	}
+
+	if (!symbols.contains(label))
+	{
+		symbol_order.emplace_back(label);
+	}
+	auto &sym = symbols[label];
+	if (sym._section >= 0)
+	{
+		asm_error("ラベルが重複して定義されています");
+	}
+	sym._section = current;
+	sym._pos = current_position();
+}
+
+/**
+ * @brief 数字のラベルへの参照("1f", "2b")を定義時につけた名前に変換する。それ以外はそのまま返す
+ *
+ * @param name 参照するラベル名
+ * @return 変換後のラベル名
+ */
+string Assembler::local_label(const string_view &name)
+{
+	if (name.size() >= 2 && ('f' == name.back() || 'b' == name.back()) &&
+		std::all_of(name.begin(), name.end() - 1, ::isdigit))
+	{
+		auto num = string(name.substr(0, name.size() - 1));
+		int count = label_counts[num] + ('f' == name.back() ? 1 : 0);
+		return ".L.num." + num + "." + std::to_string(count);
+	}
+	return string(name);
+}
+
+/**
+ * @brief 数値を読み取る。10進数のほか0xで始まる16進数に対応する
+ *
+ * @param str 数値の文字列
+ * @return 読み取った値
+ */
+int64_t Assembler::parse_number(const string_view &str)
+{
+	auto s = trim(str);
+	bool neg = false;
+	if (!s.empty() && ('-' == s.front() || '+' == s.front()))
+	{
+		neg = ('-' == s.front());
+		s = trim(s.substr(1));
+	}
+	if (s.empty() || !std::isdigit(static_cast<unsigned char>(s.front())))
+	{
+		asm_error("数値が不正です");
+	}
+
+	/* 18446744073709551615のように符号付き64ビットに収まらない値も読めるよう符号なしで読む */
+	auto tmp = string(s);
+	char *end;
+	errno = 0;
+	uint64_t val = strtoull(tmp.c_str(), &end, 0);
+	if (*end || ERANGE == errno)
+	{
+		asm_error("数値が不正です");
+	}
+	return static_cast<int64_t>(neg ? -val : val);
+}
+
+/**
+ * @brief "ラベル + 数値"、"ラベル - 数値"、"数値"の形の式を読み取る
+ *
+ * @param str 式の文字列
+ * @param sym 読み取ったラベル。ラベルがなければ空
+ * @param addend 読み取った数値
+ */
+void Assembler::parse_expression(string_view str, string &sym, int64_t &addend)
+{
+	str = trim(str);
+	sym.clear();
+	addend = 0;
+
+	if (str.empty())
+	{
+		asm_error("式がありません");
+	}
+
+	if (std::isdigit(static_cast<unsigned char>(str.front())) || '-' == str.front())
+	{
+		addend = parse_number(str);
+		return;
+	}
+
+	size_t op = str.find_first_of("+-");
+	sym = local_label(trim(str.substr(0, op)));
+	if (string_view::npos != op)
+	{
+		addend = parse_number(str.substr(op + 1));
+		if ('-' == str[op])
+		{
+			addend = -addend;
+		}
+	}
+}
+
+/**
+ * @brief オペランドを解析する
+ *
+ * @param str オペランドの文字列
+ * @return 解析したオペランド
+ */
+Assembler::Operand Assembler::parse_operand(string_view str)
+{
+	Operand op;
+
+	/* レジスタ */
+	if (auto it = registers.find(str); registers.end() != it)
+	{
+		op._kind = it->second._xmm ? OperandKind::XMM : OperandKind::REG;
+		op._reg = it->second._num;
+		op._size = it->second._size;
+		return op;
+	}
+
+	/* サイズ指定 */
+	static constexpr std::pair<string_view, int> size_specs[] = {{"BYTE PTR", 1}, {"WORD PTR", 2}, {"DWORD PTR", 4}, {"QWORD PTR", 8}};
+	for (auto &[spec, size] : size_specs)
+	{
+		if (str.starts_with(spec))
+		{
+			op._size = size;
+			str = trim(str.substr(spec.size()));
+			break;
+		}
+	}
+
+	/* メモリ */
+	if (!str.empty() && '[' == str.front())
+	{
+		if (']' != str.back())
+		{
+			asm_error("メモリオペランドが不正です");
+		}
+		op._kind = OperandKind::MEM;
+		auto inner = trim(str.substr(1, str.size() - 2));
+
+		/* ベースレジスタ */
+		size_t op_pos = inner.find_first_of("+-");
+		auto base = trim(inner.substr(0, op_pos));
+		if ("rip" == base)
+		{
+			op._reg = RIP;
+		}
+		else if (auto it = registers.find(base); registers.end() != it && 8 == it->second._size && !it->second._xmm)
+		{
+			op._reg = it->second._num;
+		}
+		else
+		{
+			asm_error("ベースレジスタが不正です");
+		}
+
+		if (string_view::npos == op_pos)
+		{
+			return op;
+		}
+
+		/* 変位 */
+		bool neg = ('-' == inner[op_pos]);
+		auto disp = trim(inner.substr(op_pos + 1));
+		if (disp.ends_with("@GOTPCREL"))
+		{
+			op._gotpcrel = true;
+			disp.remove_suffix(9);
+		}
+
+		if (!disp.empty() && (std::isdigit(static_cast<unsigned char>(disp.front())) || '-' == disp.front()))
+		{
+			op._val = parse_number(disp);
+			if (neg)
+			{
+				op._val = -op._val;
+			}
+		}
+		else
+		{
+			if (RIP != op._reg || neg)
+			{
+				asm_error("メモリオペランドが不正です");
+			}
+			parse_expression(disp, op._sym, op._val);
+		}
+		return op;
+	}
+
+	if (op._size)
+	{
+		asm_error("サイズ指定の後にメモリオペランドがありません");
+	}
+
+	/* 即値。"1f"、"1b"は数字のラベルへの参照 */
+	bool numeric_label = str.size() >= 2 && ('f' == str.back() || 'b' == str.back()) &&
+						 std::all_of(str.begin(), str.end() - 1, ::isdigit);
+	if (!str.empty() && !numeric_label && (std::isdigit(static_cast<unsigned char>(str.front())) || '-' == str.front()))
+	{
+		op._kind = OperandKind::IMM;
+		op._val = parse_number(str);
+		return op;
+	}
+
+	/* ラベル */
+	if (str.empty())
+	{
+		asm_error("オペランドがありません");
+	}
+	op._kind = OperandKind::SYM;
+	op._sym = local_label(str);
+	return op;
+}
+
+/**
+ * @brief 現在のセクションにバイト列を追加する
+ *
+ * @param bytes 追加するバイト列
+ */
+void Assembler::emit_bytes(const std::initializer_list<uint8_t> &bytes)
+{
+	auto &buf = sections[current]._frags.back()._bytes;
+	buf.insert(buf.end(), bytes);
+}
+
+/**
+ * @brief 現在のセクションに即値をリトルエンディアンで追加する
+ *
+ * @param val 値
+ * @param size バイト数
+ */
+void Assembler::emit_imm(const int64_t &val, const int &size)
+{
+	put(sections[current]._frags.back()._bytes, val, size);
+}
+
+/**
+ * @brief 現在位置に再配置が必要な箇所を登録する
+ *
+ * @param sym 参照するラベル
+ * @param addend 加数
+ * @param type 再配置の種類
+ */
+void Assembler::add_fixup(const string &sym, const int64_t &addend, const uint32_t &type)
+{
+	if (!symbols.contains(sym))
+	{
+		symbol_order.emplace_back(sym);
+		symbols[sym];
+	}
+	sections[current]._fixups.push_back({current_position(), sym, addend, type});
+}
+
+/**
+ * @brief 現在のセクションの位置を返す
+ *
+ * @return 現在位置
+ */
+Assembler::Position Assembler::current_position()
+{
+	auto &frags = sections[current]._frags;
+	return {static_cast<int>(frags.size()) - 1, frags.back()._bytes.size()};
+}
+
+/**
+ * @brief 現在位置をnバイト境界に揃える
+ *
+ * @param n 境界
+ */
+void Assembler::align(const uint64_t &n)
+{
+	auto &sec = sections[current];
+	sec._align = std::max(sec._align, n);
+
+	/* コードセクションではアドレスが確定するまでパディングの長さが決まらない */
+	if (TEXT == current)
+	{
+		sec._frags.back()._align = n;
+		sec._frags.emplace_back();
+		return;
+	}
+
+	auto &bytes = sec._frags.back()._bytes;
+	bytes.resize((bytes.size() + n - 1) / n * n);
+}
+
+/**
+ * @brief 命令を符号化して出力する。
+ *
+ * @details 出力は[プレフィックス][REX][オペコード][ModR/M][SIB][変位]の順で、即値は呼び出し側で続けて出力する。
+ * @param prefix 必須プレフィックス(0x66, 0xF2, 0xF3)。なければ空
+ * @param w REX.Wを立てるか(64ビットオペランド)
+ * @param opcode オペコード
+ * @param reg ModR/Mのregフィールドに入れるレジスタ番号または/digitの値
+ * @param rm ModR/Mのr/mフィールドで指定するオペランド
+ * @param force_rex REXプレフィックスを必ず出力するか(spl, bpl, sil, dilを使う場合)
+ * @param imm_size 後ろに続く即値のバイト数(RIP相対の変位の計算に使う)
+ */
+void Assembler::emit_op(const vector<uint8_t> &prefix, const bool &w, const vector<uint8_t> &opcode, const int &reg, const Operand &rm, const bool &force_rex, const int &imm_size)
+{
+	auto &buf = sections[current]._frags.back()._bytes;
+	buf.insert(buf.end(), prefix.begin(), prefix.end());
+
+	uint8_t rex = 0;
+	if (w)
+	{
+		rex |= 0x08;
+	}
+	if (reg >= 8)
+	{
+		rex |= 0x04;
+	}
+	if (rm._reg >= 8 && RIP != rm._reg)
+	{
+		rex |= 0x01;
+	}
+	if (rex || force_rex)
+	{
+		buf.push_back(0x40 | rex);
+	}
+	buf.insert(buf.end(), opcode.begin(), opcode.end());
+
+	/* レジスタ */
+	if (OperandKind::REG == rm._kind || OperandKind::XMM == rm._kind)
+	{
+		buf.push_back(0xC0 | ((reg & 7) << 3) | (rm._reg & 7));
+		return;
+	}
+
+	if (OperandKind::MEM != rm._kind)
+	{
+		asm_error("オペランドが不正です");
+	}
+
+	/* RIP相対。変位は次の命令の先頭からの距離なので後ろに続く即値の分も差し引く */
+	if (RIP == rm._reg)
+	{
+		buf.push_back(0x05 | ((reg & 7) << 3));
+		if (rm._sym.empty())
+		{
+			put(buf, rm._val, 4);
+			return;
+		}
+		uint32_t type = R_X86_64_PC32;
+		if (rm._gotpcrel)
+		{
+			type = (rex || force_rex) ? R_X86_64_REX_GOTPCRELX : R_X86_64_GOTPCRELX;
+		}
+		add_fixup(rm._sym, rm._val - 4 - imm_size, type);
+		put(buf, 0, 4);
+		return;
+	}
+
+	/* rbp, r13をベースにする場合は変位0でも省略できない */
+	int base = rm._reg & 7;
+	int mod = 2;
+	if (0 == rm._val && 5 != base)
+	{
+		mod = 0;
+	}
+	else if (is_int8(rm._val))
+	{
+		mod = 1;
+	}
+	buf.push_back((mod << 6) | ((reg & 7) << 3) | base);
+
+	/* rsp, r12をベースにする場合はSIBバイトが必要 */
+	if (4 == base)
+	{
+		buf.push_back(0x24);
+	}
+
+	if (1 == mod)
+	{
+		put(buf, rm._val, 1);
+	}
+	else if (2 == mod)
+	{
+		if (!is_int32(rm._val))
+		{
+			asm_error("変位が大きすぎます");
+		}
+		put(buf, rm._val, 4);
+	}
+}
+
+/**
+ * @brief ジャンプ命令を出力する。長さはrelax()で決まるため断片を区切る
+ *
+ * @param cond 条件コード。jmpの場合はJMP
+ * @param target ジャンプ先
+ */
+void Assembler::encode_jump(const int &cond, const Operand &target)
+{
+	if (OperandKind::SYM != target._kind)
+	{
+		asm_error("ジャンプ先が不正です");
+	}
+
+	if (!symbols.contains(target._sym))
+	{
+		symbol_order.emplace_back(target._sym);
+		symbols[target._sym];
+	}
+
+	auto &frags = sections[current]._frags;
+	frags.back()._jump = cond;
+	frags.back()._target = target._sym;
+	frags.emplace_back();
+}
+
+/**
+ * @brief 命令を機械語に変換する
+ *
+ * @param mnemonic ニーモニック
+ * @param ops オペランド
+ */
+void Assembler::encode(const string_view &mnemonic, vector<Operand> &ops)
+{
+	auto is = [&](const int &i, const OperandKind &kind)
+	{
+		return i < static_cast<int>(ops.size()) && kind == ops[i]._kind;
+	};
+	auto n = ops.size();
+	auto reg = OperandKind::REG;
+	auto xmm = OperandKind::XMM;
+	auto mem = OperandKind::MEM;
+	auto imm = OperandKind::IMM;
+	auto sym = OperandKind::SYM;
+
+	/* 16ビットオペランドにはオペランドサイズプレフィックスが必要 */
+	auto p16 = [](const int &size)
+	{
+		return (2 == size) ? vector<uint8_t>{0x66} : vector<uint8_t>{};
+	};
+	/* 8ビットレジスタのspl, bpl, sil, dilはREXプレフィックスがないと指定できない */
+	auto byte_rex = [&](const Operand &op)
+	{
+		return OperandKind::REG == op._kind && 1 == op._size && 4 <= op._reg && op._reg <= 7;
+	};
+	/* オペランドのサイズ。メモリでサイズ指定がなければもう一方のオペランドに合わせる */
+	auto size_of = [&](const Operand &op, const Operand &other)
+	{
+		int size = op._size ? op._size : other._size;
+		if (!size)
+		{
+			asm_error("オペランドのサイズが不明です");
+		}
+		return size;
+	};
+	/* 即値をオペランドのサイズに切り詰めて符号拡張した値('as'と同じ解釈) */
+	auto truncate = [&](const int64_t &val, const int &size)
+	{
+		switch (size)
+		{
+		case 1:
+			return static_cast<int64_t>(static_cast<int8_t>(val));
+		case 2:
+			return static_cast<int64_t>(static_cast<int16_t>(val));
+		case 4:
+			return static_cast<int64_t>(static_cast<int32_t>(val));
+		default:
+			if (!is_int32(val))
+			{
+				asm_error("即値が大きすぎます");
+			}
+			return val;
+		}
+	};
+
+	/* オペランドなし */
+	if (0 == n)
+	{
+		if ("ret" == mnemonic)
+		{
+			emit_bytes({0xC3});
+		}
+		else if ("cqo" == mnemonic)
+		{
+			emit_bytes({0x48, 0x99});
+		}
+		else if ("cdq" == mnemonic)
+		{
+			emit_bytes({0x99});
+		}
+		else if ("cdqe" == mnemonic)
+		{
+			emit_bytes({0x48, 0x98});
+		}
+		else if ("leave" == mnemonic)
+		{
+			emit_bytes({0xC9});
+		}
+		else if ("nop" == mnemonic)
+		{
+			emit_bytes({0x90});
+		}
+		else
+		{
+			asm_error("未対応の命令です");
+		}
+		return;
+	}
+
+	if ("mov" == mnemonic && 2 == n)
+	{
+		auto &d = ops[0];
+		auto &s = ops[1];
+		if (is(0, reg) && is(1, reg))
+		{
+			if (d._size != s._size)
+			{
+				asm_error("オペランドのサイズが一致しません");
+			}
+			emit_op(p16(d._size), 8 == d._size, {static_cast<uint8_t>(1 == d._size ? 0x88 : 0x89)}, s._reg, d, byte_rex(d) || byte_rex(s));
+		}
+		else if (is(0, reg) && is(1, imm))
+		{
+			/* 64ビットの即値は符号拡張した32ビットで表せればC7、表せなければmovabsを使う */
+			if (8 == d._size && !is_int32(s._val))
+			{
+				emit_bytes({static_cast<uint8_t>(0x48 | (d._reg >= 8 ? 1 : 0)), static_cast<uint8_t>(0xB8 + (d._reg & 7))});
+				emit_imm(s._val, 8);
+			}
+			else if (8 == d._size)
+			{
+				emit_op({}, true, {0xC7}, 0, d, false, 4);
+				emit_imm(s._val, 4);
+			}
+			else
+			{
+				auto &buf = sections[current]._frags.back()._bytes;
+				if (2 == d._size)
+				{
+					buf.push_back(0x66);
+				}
+				if (d._reg >= 8 || byte_rex(d))
+				{
+					buf.push_back(0x40 | (d._reg >= 8 ? 1 : 0));
+				}
+				buf.push_back((1 == d._size ? 0xB0 : 0xB8) + (d._reg & 7));
+				emit_imm(s._val, d._size);
+			}
+		}
+		else if (is(0, reg) && is(1, mem))
+		{
+			emit_op(p16(d._size), 8 == d._size, {static_cast<uint8_t>(1 == d._size ? 0x8A : 0x8B)}, d._reg, s, byte_rex(d));
+		}
+		else if (is(0, mem) && is(1, reg))
+		{
+			emit_op(p16(s._size), 8 == s._size, {static_cast<uint8_t>(1 == s._size ? 0x88 : 0x89)}, s._reg, d, byte_rex(s));
+		}
+		else if (is(0, mem) && is(1, imm))
+		{
+			int size = size_of(d, d);
+			int imm_size = std::min(size, 4);
+			emit_op(p16(size), 8 == size, {static_cast<uint8_t>(1 == size ? 0xC6 : 0xC7)}, 0, d, false, imm_size);
+			emit_imm(truncate(s._val, size), imm_size);
+		}
+		else
+		{
+			asm_error("オペランドが不正です");
+		}
+		return;
+	}
+
+	/* add, or, and, sub, xor, cmp */
+	if (auto it = alu_ops.find(mnemonic); alu_ops.end() != it && 2 == n)
+	{
+		int digit = it->second;
+		auto &d = ops[0];
+		auto &s = ops[1];
+		if ((is(0, reg) || is(0, mem)) && is(1, reg))
+		{
+			if (is(0, reg) && d._size != s._size)
+			{
+				asm_error("オペランドのサイズが一致しません");
+			}
+			uint8_t opcode = (digit << 3) | (1 == s._size ? 0x00 : 0x01);
+			emit_op(p16(s._size), 8 == s._size, {opcode}, s._reg, d, byte_rex(d) || byte_rex(s));
+		}
+		else if (is(0, reg) && is(1, mem))
+		{
+			uint8_t opcode = (digit << 3) | (1 == d._size ? 0x02 : 0x03);
+			emit_op(p16(d._size), 8 == d._size, {opcode}, d._reg, s, byte_rex(d));
+		}
+		else if ((is(0, reg) || is(0, mem)) && is(1, imm))
+		{
+			int size = size_of(d, d);
+			auto val = truncate(s._val, size);
+			bool acc = is(0, reg) && 0 == d._reg;
+			if (1 == size)
+			{
+				/* al向けの短い形式がある */
+				if (acc)
+				{
+					emit_bytes({static_cast<uint8_t>((digit << 3) | 0x04)});
+				}
+				else
+				{
+					emit_op({}, false, {0x80}, digit, d, byte_rex(d), 1);
+				}
+				emit_imm(val, 1);
+			}
+			else if (is_int8(val))
+			{
+				emit_op(p16(size), 8 == size, {0x83}, digit, d, false, 1);
+				emit_imm(val, 1);
+			}
+			else
+			{
+				int imm_size = (2 == size) ? 2 : 4;
+				if (acc)
+				{
+					/* ax, eax, rax向けの短い形式がある */
+					auto &buf = sections[current]._frags.back()._bytes;
+					if (2 == size)
+					{
+						buf.push_back(0x66);
+					}
+					if (8 == size)
+					{
+						buf.push_back(0x48);
+					}
+					buf.push_back((digit << 3) | 0x05);
+				}
+				else
+				{
+					emit_op(p16(size), 8 == size, {0x81}, digit, d, false, imm_size);
+				}
+				emit_imm(val, imm_size);
+			}
+		}
+		else
+		{
+			asm_error("オペランドが不正です");
+		}
+		return;
+	}
+
+	if ("test" == mnemonic && 2 == n && (is(0, reg) || is(0, mem)) && is(1, reg))
+	{
+		auto &s = ops[1];
+		emit_op(p16(s._size), 8 == s._size, {static_cast<uint8_t>(1 == s._size ? 0x84 : 0x85)}, s._reg, ops[0], byte_rex(ops[0]) || byte_rex(s));
+		return;
+	}
+
+	if ("lea" == mnemonic && 2 == n && is(0, reg) && is(1, mem))
+	{
+		emit_op(p16(ops[0]._size), 8 == ops[0]._size, {0x8D}, ops[0]._reg, ops[1], false);
+		return;
+	}
+
+	if ("imul" == mnemonic && 2 == n && is(0, reg) && (is(1, reg) || is(1, mem)))
+	{
+		emit_op(p16(ops[0]._size), 8 == ops[0]._size, {0x0F, 0xAF}, ops[0]._reg, ops[1], false);
+		return;
+	}
+
+	/* not, neg, mul, div, idiv */
+	if (auto it = unary_ops.find(mnemonic); unary_ops.end() != it && 1 == n && (is(0, reg) || is(0, mem)))
+	{
+		int size = size_of(ops[0], ops[0]);
+		emit_op(p16(size), 8 == size, {static_cast<uint8_t>(1 == size ? 0xF6 : 0xF7)}, it->second, ops[0], byte_rex(ops[0]));
+		return;
+	}
+
+	/* shl, shr, sar */
+	if (auto it = shift_ops.find(mnemonic); shift_ops.end() != it && (is(0, reg) || is(0, mem)))
+	{
+		int size = size_of(ops[0], ops[0]);
+		bool byte = (1 == size);
+		if (1 == n || (is(1, imm) && 1 == ops[1]._val))
+		{
+			emit_op(p16(size), 8 == size, {static_cast<uint8_t>(byte ? 0xD0 : 0xD1)}, it->second, ops[0], byte_rex(ops[0]));
+		}
+		else if (is(1, reg) && 1 == ops[1]._size && 1 == ops[1]._reg)
+		{
+			/* clでシフト */
+			emit_op(p16(size), 8 == size, {static_cast<uint8_t>(byte ? 0xD2 : 0xD3)}, it->second, ops[0], byte_rex(ops[0]));
+		}
+		else if (is(1, imm))
+		{
+			emit_op(p16(size), 8 == size, {static_cast<uint8_t>(byte ? 0xC0 : 0xC1)}, it->second, ops[0], byte_rex(ops[0]), 1);
+			emit_imm(ops[1]._val, 1);
+		}
+		else
+		{
+			asm_error("オペランドが不正です");
+		}
+		return;
+	}
+
+	if (("push" == mnemonic || "pop" == mnemonic) && 1 == n && is(0, reg) && 8 == ops[0]._size)
+	{
+		if (ops[0]._reg >= 8)
+		{
+			emit_bytes({0x41});
+		}
+		emit_bytes({static_cast<uint8_t>(("push" == mnemonic ? 0x50 : 0x58) + (ops[0]._reg & 7))});
+		return;
+	}
+
+	/* movsx, movzx, movzb, movsxd */
+	if (("movsx" == mnemonic || "movzx" == mnemonic || "movzb" == mnemonic || "movsxd" == mnemonic) && 2 == n && is(0, reg))
+	{
+		auto &d = ops[0];
+		auto &s = ops[1];
+		int src_size = ("movzb" == mnemonic) ? 1 : s._size;
+		if (!(is(1, reg) || is(1, mem)) || !src_size)
+		{
+			asm_error("オペランドが不正です");
+		}
+
+		if (4 == src_size)
+		{
+			/* movsxd */
+			emit_op({}, true, {0x63}, d._reg, s, false);
+			return;
+		}
+
+		bool sign = ("movsx" == mnemonic);
+		uint8_t opcode = (1 == src_size ? 0xB6 : 0xB7) + (sign ? 0x08 : 0x00);
+		emit_op(p16(d._size), 8 == d._size, {0x0F, opcode}, d._reg, s, byte_rex(s));
+		return;
+	}
+
+	/* setcc */
+	if (mnemonic.starts_with("set") && 1 == n && (is(0, reg) || is(0, mem)))
+	{
+		auto it = condition_codes.find(mnemonic.substr(3));
+		if (condition_codes.end() == it)
+		{
+			asm_error("未対応の命令です");
+		}
+		emit_op({}, false, {0x0F, static_cast<uint8_t>(0x90 | it->second)}, 0, ops[0], byte_rex(ops[0]));
+		return;
+	}
+
+	if ("jmp" == mnemonic && 1 == n)
+	{
+		if (is(0, sym))
+		{
+			encode_jump(JMP, ops[0]);
+		}
+		else
+		{
+			emit_op({}, false, {0xFF}, 4, ops[0], false);
+		}
+		return;
+	}
+
+	/* jcc */
+	if ('j' == mnemonic.front() && 1 == n)
+	{
+		auto it = condition_codes.find(mnemonic.substr(1));
+		if (condition_codes.end() == it)
+		{
+			asm_error("未対応の命令です");
+		}
+		encode_jump(it->second, ops[0]);
+		return;
+	}
+
+	if ("call" == mnemonic && 1 == n)
+	{
+		if (is(0, sym))
+		{
+			emit_bytes({0xE8});
+			add_fixup(ops[0]._sym, -4, R_X86_64_PLT32);
+			emit_imm(0, 4);
+		}
+		else
+		{
+			emit_op({}, false, {0xFF}, 2, ops[0], false);
+		}
+		return;
+	}
+
+	/* movss, movsd */
+	if (("movss" == mnemonic || "movsd" == mnemonic) && 2 == n)
+	{
+		uint8_t prefix = ("movss" == mnemonic) ? 0xF3 : 0xF2;
+		if (is(0, xmm) && (is(1, xmm) || is(1, mem)))
+		{
+			emit_op({prefix}, false, {0x0F, 0x10}, ops[0]._reg, ops[1], false);
+		}
+		else if (is(0, mem) && is(1, xmm))
+		{
+			emit_op({prefix}, false, {0x0F, 0x11}, ops[1]._reg, ops[0], false);
+		}
+		else
+		{
+			asm_error("オペランドが不正です");
+		}
+		return;
+	}
+
+	/* movq, movd */
+	if (("movq" == mnemonic || "movd" == mnemonic) && 2 == n)
+	{
+		bool w = ("movq" == mnemonic);
+		if (is(0, xmm) && is(1, reg))
+		{
+			emit_op({0x66}, w, {0x0F, 0x6E}, ops[0]._reg, ops[1], false);
+		}
+		else if (is(0, reg) && is(1, xmm))
+		{
+			emit_op({0x66}, w, {0x0F, 0x7E}, ops[1]._reg, ops[0], false);
+		}
+		else if (w && is(0, xmm) && is(1, xmm))
+		{
+			emit_op({0xF3}, false, {0x0F, 0x7E}, ops[0]._reg, ops[1], false);
+		}
+		else
+		{
+			asm_error("オペランドが不正です");
+		}
+		return;
+	}
+
+	/* cvtsi2ss, cvtsi2sd */
+	if (("cvtsi2ss" == mnemonic || "cvtsi2sd" == mnemonic) && 2 == n && is(0, xmm) && (is(1, reg) || is(1, mem)))
+	{
+		uint8_t prefix = ("cvtsi2ss" == mnemonic) ? 0xF3 : 0xF2;
+		int size = ops[1]._size ? ops[1]._size : 4;
+		emit_op({prefix}, 8 == size, {0x0F, 0x2A}, ops[0]._reg, ops[1], false);
+		return;
+	}
+
+	/* cvttss2si, cvttsd2si */
+	if (("cvttss2si" == mnemonic || "cvttsd2si" == mnemonic) && 2 == n && is(0, reg) && (is(1, xmm) || is(1, mem)))
+	{
+		uint8_t prefix = ("cvttss2si" == mnemonic) ? 0xF3 : 0xF2;
+		emit_op({prefix}, 8 == ops[0]._size, {0x0F, 0x2C}, ops[0]._reg, ops[1], false);
+		return;
+	}
+
+	/* その他のSSE命令 */
+	if (auto it = sse_ops.find(mnemonic); sse_ops.end() != it && 2 == n && is(0, xmm) && (is(1, xmm) || is(1, mem)))
+	{
+		auto prefix = it->second._prefix ? vector<uint8_t>{it->second._prefix} : vector<uint8_t>{};
+		emit_op(prefix, false, {0x0F, it->second._opcode}, ops[0]._reg, ops[1], false);
+		return;
+	}
+
+	asm_error("未対応の命令です");
+}
+
+/**
+ * @brief 断片の後ろに続くジャンプ命令またはパディングの長さ
+ *
+ * @param jump ジャンプ命令の条件コード。ジャンプ命令がなければ-1
+ * @param is_long ジャンプ命令をrel32で符号化するか
+ * @param align パディングの境界。パディングでなければ0
+ * @param addr ジャンプ命令またはパディングの先頭アドレス
+ * @return バイト数
+ */
+static uint64_t variable_size(const int &jump, const bool &is_long, const int &align, const uint64_t &addr)
+{
+	if (align)
+	{
+		return (align - addr % align) % align;
+	}
+	if (jump < 0)
+	{
+		return 0;
+	}
+	if (!is_long)
+	{
+		return 2;
+	}
+	return (JMP == jump) ? 5 : 6;
+}
+
+/**
+ * @brief ジャンプ命令の長さを決めて各断片のアドレスを確定させる。
+ * すべてrel8で始め、届かないものをrel32に伸ばす処理を変化がなくなるまで繰り返す
+ *
+ */
+void Assembler::relax()
+{
+	for (int i = 0; i < static_cast<int>(sections.size()); ++i)
+	{
+		auto &frags = sections[i]._frags;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+
+			uint64_t addr = 0;
+			for (auto &frag : frags)
+			{
+				frag._addr = addr;
+				addr += frag._bytes.size();
+				addr += variable_size(frag._jump, frag._long, frag._align, addr);
+			}
+
+			for (auto &frag : frags)
+			{
+				if (frag._jump < 0 || frag._long)
+				{
+					continue;
+				}
+
+				/* 他のセクション、グローバル、未定義のラベルへのジャンプは再配置が必要なので常にrel32 */
+				auto &target = symbols[frag._target];
+				if (target._section != i || target._global)
+				{
+					frag._long = true;
+					changed = true;
+					continue;
+				}
+
+				int64_t disp = address(i, target._pos) - (frag._addr + frag._bytes.size() + 2);
+				if (!is_int8(disp))
+				{
+					frag._long = true;
+					changed = true;
+				}
+			}
+		}
+
+		/* 再配置が必要なジャンプ命令 */
+		for (int f = 0; f < static_cast<int>(frags.size()); ++f)
+		{
+			auto &frag = frags[f];
+			if (frag._jump < 0)
+			{
+				continue;
+			}
+			auto &target = symbols[frag._target];
+			if (target._section != i || target._global)
+			{
+				size_t off = frag._bytes.size() + (JMP == frag._jump ? 1 : 2);
+				sections[i]._fixups.push_back({{f, off}, frag._target, -4, R_X86_64_PLT32});
+			}
+		}
+	}
+}
+
+/**
+ * @brief 位置のアドレス(セクション先頭からのオフセット)を返す。relax()の後に呼ぶ
+ *
+ * @param section セクション
+ * @param pos 位置
+ * @return アドレス
+ */
+uint64_t Assembler::address(const int &section, const Position &pos)
+{
+	return sections[section]._frags[pos._frag]._addr + pos._off;
+}
+
+/**
+ * @brief セクションの内容を返す。relax()の後に呼ぶ
+ *
+ * @param section セクション
+ * @return セクションの内容
+ */
+vector<uint8_t> Assembler::section_contents(const int &section)
+{
+	vector<uint8_t> buf;
+	for (auto &frag : sections[section]._frags)
+	{
+		buf.insert(buf.end(), frag._bytes.begin(), frag._bytes.end());
+
+		/* パディング */
+		if (frag._align)
+		{
+			auto pad = variable_size(-1, false, frag._align, buf.size());
+			while (pad > 0)
+			{
+				auto n = std::min<uint64_t>(pad, std::size(nops) - 1);
+				buf.insert(buf.end(), nops[n].begin(), nops[n].end());
+				pad -= n;
+			}
+			continue;
+		}
+
+		if (frag._jump < 0)
+		{
+			continue;
+		}
+
+		/* ジャンプ命令 */
+		auto &target = symbols[frag._target];
+		bool resolved = (target._section == section && !target._global);
+		int64_t disp = 0;
+		if (!frag._long)
+		{
+			disp = address(section, target._pos) - (buf.size() + 2);
+			buf.push_back((JMP == frag._jump) ? 0xEB : 0x70 + frag._jump);
+			put(buf, disp, 1);
+			continue;
+		}
+
+		if (JMP == frag._jump)
+		{
+			buf.push_back(0xE9);
+		}
+		else
+		{
+			buf.push_back(0x0F);
+			buf.push_back(0x80 + frag._jump);
+		}
+		if (resolved)
+		{
+			disp = address(section, target._pos) - (buf.size() + 4);
+		}
+		put(buf, disp, 4);
+	}
+	return buf;
+}
+
+/**
+ * @brief .debug_line, .debug_info, .debug_abbrev, .debug_arangesセクションを作成する。
+ * 形式は'as'と同じくDWARFバージョン3とする
+ *
+ */
+void Assembler::emit_debug_info()
+{
+	auto text_size = section_contents(TEXT).size();
+
+	/* 各セクションの先頭を指すラベル。再配置でセクションのシンボルに置き換えられる */
+	auto section_label = [](const int &i)
+	{
+		auto name = ".L.section." + std::to_string(i);
+		if (!symbols.contains(name))
+		{
+			symbol_order.emplace_back(name);
+			auto &sym = symbols[name];
+			sym._section = i;
+			sym._pos = {0, 0};
+		}
+		return name;
+	};
+	/* デバッグ情報のセクションを追加してcurrentにする */
+	auto new_section = [&](const string &name)
+	{
+		sections.emplace_back(name, SHT_PROGBITS, 0);
+		current = sections.size() - 1;
+		return current;
+	};
+	auto buf = [&]() -> vector<uint8_t> &
+	{
+		return sections[current]._frags.back()._bytes;
+	};
+
+	/* .debug_line */
+	int line_sec = new_section(".debug_line");
+	{
+		/* ディレクトリとファイル名に分ける */
+		vector<string> dirs;
+		vector<std::pair<string, int>> files;
+		for (size_t i = 1; i < file_names.size(); ++i)
+		{
+			auto path = file_names[i];
+			auto slash = path.rfind('/');
+			if (string::npos == slash)
+			{
+				files.emplace_back(path, 0);
+				continue;
+			}
+			auto dir = path.substr(0, slash);
+			auto it = std::find(dirs.begin(), dirs.end(), dir);
+			if (dirs.end() == it)
+			{
+				dirs.emplace_back(dir);
+				it = dirs.end() - 1;
+			}
+			files.emplace_back(path.substr(slash + 1), it - dirs.begin() + 1);
+		}
+
+		/* ヘッダ */
+		put(buf(), 0, 4);
+		put(buf(), 3, 2);
+		put(buf(), 0, 4);
+		size_t header_start = buf().size();
+		emit_bytes({1, 1, static_cast<uint8_t>(LINE_BASE), LINE_RANGE, OPCODE_BASE});
+		emit_bytes({0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1});
+		for (auto &dir : dirs)
+		{
+			put_str(buf(), dir);
+		}
+		buf().push_back(0);
+		for (auto &[name, dir] : files)
+		{
+			put_str(buf(), name);
+			put_uleb(buf(), dir);
+			put_uleb(buf(), 0);
+			put_uleb(buf(), 0);
+		}
+		buf().push_back(0);
+		patch(buf(), 6, buf().size() - header_start, 4);
+
+		/* 行番号プログラム */
+		int file = 1;
+		int line = 1;
+		uint64_t addr = 0;
+		bool first = true;
+
+		/* 行とアドレスを進める。('as'のdwarf2dbg.cと同じ規則でオペコードを選ぶ) */
+		auto advance = [&](int line_delta, const uint64_t &addr_delta)
+		{
+			int tmp = line_delta - LINE_BASE;
+			bool need_copy = false;
+			if (tmp < 0 || tmp >= LINE_RANGE)
+			{
+				buf().push_back(DW_LNS_advance_line);
+				put_sleb(buf(), line_delta);
+				line_delta = 0;
+				tmp = -LINE_BASE;
+				need_copy = true;
+			}
+			if (0 == line_delta && 0 == addr_delta)
+			{
+				buf().push_back(DW_LNS_copy);
+				return;
+			}
+			tmp += OPCODE_BASE;
+			if (addr_delta < 256 + MAX_SPECIAL_ADDR_DELTA)
+			{
+				uint64_t opcode = tmp + addr_delta * LINE_RANGE;
+				if (opcode <= 255)
+				{
+					buf().push_back(opcode);
+					return;
+				}
+				if (addr_delta >= MAX_SPECIAL_ADDR_DELTA)
+				{
+					opcode = tmp + (addr_delta - MAX_SPECIAL_ADDR_DELTA) * LINE_RANGE;
+					if (opcode <= 255)
+					{
+						buf().push_back(DW_LNS_const_add_pc);
+						buf().push_back(opcode);
+						return;
+					}
+				}
+			}
+			buf().push_back(DW_LNS_advance_pc);
+			put_uleb(buf(), addr_delta);
+			buf().push_back(need_copy ? DW_LNS_copy : tmp);
+		};
+
+		for (auto &row : lines)
+		{
+			auto row_addr = address(TEXT, row._pos);
+			if (row._file != file)
+			{
+				buf().push_back(DW_LNS_set_file);
+				put_uleb(buf(), row._file);
+				file = row._file;
+			}
+			if (first)
+			{
+				/* DW_LNE_set_address */
+				emit_bytes({0, 9, DW_LNE_set_address});
+				add_fixup(section_label(TEXT), row_addr, R_X86_64_64);
+				put(buf(), 0, 8);
+				addr = row_addr;
+				first = false;
+			}
+			advance(row._line - line, row_addr - addr);
+			line = row._line;
+			addr = row_addr;
+		}
+
+		/* .textの末尾で終了 */
+		if (text_size - addr == MAX_SPECIAL_ADDR_DELTA)
+		{
+			buf().push_back(DW_LNS_const_add_pc);
+		}
+		else if (text_size != addr)
+		{
+			buf().push_back(DW_LNS_advance_pc);
+			put_uleb(buf(), text_size - addr);
+		}
+		emit_bytes({0, 1, DW_LNE_end_sequence});
+		patch(buf(), 0, buf().size() - 4, 4);
+	}
+
+	/* .debug_info */
+	int info_sec = new_section(".debug_info");
+	int abbrev_sec = sections.size();
+	put(buf(), 0, 4);
+	put(buf(), 3, 2);
+	add_fixup(section_label(abbrev_sec), 0, R_X86_64_32);
+	put(buf(), 0, 4);
+	buf().push_back(8);
+	put_uleb(buf(), 1);
+	add_fixup(section_label(line_sec), 0, R_X86_64_32);
+	put(buf(), 0, 4);
+	add_fixup(section_label(TEXT), 0, R_X86_64_64);
+	put(buf(), 0, 8);
+	add_fixup(section_label(TEXT), text_size, R_X86_64_64);
+	put(buf(), 0, 8);
+	put_str(buf(), file_names.size() > 1 ? file_names[1] : "");
+	put_str(buf(), fs::current_path().string());
+	put_str(buf(), "fcc");
+	put(buf(), DW_LANG_Mips_Assembler, 2);
+	patch(buf(), 0, buf().size() - 4, 4);
+
+	/* .debug_abbrev */
+	new_section(".debug_abbrev");
+	emit_bytes({1, DW_TAG_compile_unit, DW_CHILDREN_no});
+	emit_bytes({DW_AT_stmt_list, DW_FORM_data4});
+	emit_bytes({DW_AT_low_pc, DW_FORM_addr});
+	emit_bytes({DW_AT_high_pc, DW_FORM_addr});
+	emit_bytes({DW_AT_name, DW_FORM_string});
+	emit_bytes({DW_AT_comp_dir, DW_FORM_string});
+	emit_bytes({DW_AT_producer, DW_FORM_string});
+	emit_bytes({DW_AT_language, DW_FORM_data2});
+	emit_bytes({0, 0, 0});
+
+	/* .debug_aranges */
+	new_section(".debug_aranges");
+	sections[current]._align = 16;
+	put(buf(), 44, 4);
+	put(buf(), 2, 2);
+	add_fixup(section_label(info_sec), 0, R_X86_64_32);
+	put(buf(), 0, 4);
+	emit_bytes({8, 0, 0, 0, 0, 0});
+	add_fixup(section_label(TEXT), 0, R_X86_64_64);
+	put(buf(), 0, 8);
+	put(buf(), text_size, 8);
+	put(buf(), 0, 16);
+
+	/* 追加したセクションのアドレスを確定させる */
+	for (size_t i = line_sec; i < sections.size(); ++i)
+	{
+		sections[i]._frags.back()._addr = 0;
+	}
+}
+
+/**
+ * @brief ELF形式の再配置可能オブジェクトファイルを書き出す。
+ * 再配置はローカルなラベルへのものをセクションのシンボルへの参照に置き換える。
+ * 同じセクション内のローカルなラベルへのPC相対参照はここで解決し、再配置を残さない。
+ *
+ * @param output_path 出力先のパス
+ */
+void Assembler::write_object(const string &output_path)
+{
+	/**
+	 * @brief 出力する再配置
+	 *
+	 */
+	struct Reloc
+	{
+		uint64_t _offset;	  /*!< 書き換える位置 */
+		string _sym;		  /*!< 参照するシンボル。セクションへの参照なら空 */
+		int _section;		  /*!< 参照するセクション */
+		uint32_t _type;		  /*!< 再配置の種類 */
+		int64_t _addend;	  /*!< 加数 */
+	};
+
+	int nsec = sections.size();
+	vector<vector<uint8_t>> contents(nsec);
+	vector<vector<Reloc>> relocs(nsec);
+	std::unordered_set<string> referenced;
+	bool use_got = false;
+
+	for (int i = 0; i < nsec; ++i)
+	{
+		contents[i] = section_contents(i);
+
+		for (auto &fix : sections[i]._fixups)
+		{
+			auto offset = address(i, fix._pos);
+			auto &sym = symbols[fix._sym];
+			bool got = (R_X86_64_REX_GOTPCRELX == fix._type || R_X86_64_GOTPCRELX == fix._type);
+			bool pcrel = (R_X86_64_PC32 == fix._type || R_X86_64_PLT32 == fix._type);
+
+			if (sym._section >= 0 && !sym._global && !got)
+			{
+				auto value = address(sym._section, sym._pos);
+				/* 同じセクション内へのPC相対参照はアセンブル時に解決できる */
+				if (pcrel && sym._section == i)
+				{
+					patch(contents[i], offset, value + fix._addend - offset, 4);
+					continue;
+				}
+				relocs[i].push_back({offset, "", sym._section, fix._type, static_cast<int64_t>(value) + fix._addend});
+				continue;
+			}
+
+			use_got |= got;
+			referenced.insert(fix._sym);
+			relocs[i].push_back({offset, fix._sym, -1, fix._type, fix._addend});
+		}
+	}
+
+	/* セクションヘッダの番号を割り当てる。再配置があるセクションの直後に.rela.セクションを置く */
+	vector<int> shndx(nsec), rela_shndx(nsec, 0);
+	int shnum = 1;
+	for (int i = 0; i < nsec; ++i)
+	{
+		shndx[i] = shnum++;
+		if (!relocs[i].empty())
+		{
+			rela_shndx[i] = shnum++;
+		}
+	}
+	int symtab_shndx = shnum++;
+	int strtab_shndx = shnum++;
+	int shstrtab_shndx = shnum++;
+
+	/* シンボルテーブル。ローカルなシンボルを先に並べる */
+	vector<Elf64_Sym> symtab(1);
+	vector<uint8_t> strtab(1, 0);
+	vector<int> section_sym(nsec, 0);
+	auto add_symbol = [&](const string &name, const int &bind, const int &type, const int &section, const uint64_t &value)
+	{
+		Elf64_Sym esym{};
+		if (!name.empty())
+		{
+			esym.st_name = strtab.size();
+			put_str(strtab, name);
+		}
+		esym.st_info = ELF64_ST_INFO(bind, type);
+		esym.st_shndx = (section >= 0) ? shndx[section] : SHN_UNDEF;
+		esym.st_value = value;
+		symtab.push_back(esym);
+		return static_cast<int>(symtab.size()) - 1;
+	};
+
+	for (int i = 0; i < nsec; ++i)
+	{
+		if (".note.GNU-stack" != sections[i]._name)
+		{
+			section_sym[i] = add_symbol("", STB_LOCAL, STT_SECTION, i, 0);
+		}
+	}
+	for (auto &name : symbol_order)
+	{
+		auto &sym = symbols[name];
+		bool hidden = name.starts_with(".L") && !referenced.contains(name);
+		if (sym._section >= 0 && !sym._global && !hidden)
+		{
+			sym._index = add_symbol(name, STB_LOCAL, STT_NOTYPE, sym._section, address(sym._section, sym._pos));
+		}
+	}
+	int first_global = symtab.size();
+
+	/* GOTを参照する場合は'as'と同様に_GLOBAL_OFFSET_TABLE_を未定義シンボルとして置く */
+	if (use_got && !symbols.contains("_GLOBAL_OFFSET_TABLE_"))
+	{
+		add_symbol("_GLOBAL_OFFSET_TABLE_", STB_GLOBAL, STT_NOTYPE, -1, 0);
+	}
+	for (auto &name : symbol_order)
+	{
+		auto &sym = symbols[name];
+		if (sym._global || (sym._section < 0 && referenced.contains(name)))
+		{
+			uint64_t value = (sym._section >= 0) ? address(sym._section, sym._pos) : 0;
+			sym._index = add_symbol(name, STB_GLOBAL, STT_NOTYPE, sym._section, value);
+		}
+	}
+
+	/* ファイルの内容を組み立てる */
+	vector<uint8_t> out(sizeof(Elf64_Ehdr), 0);
+	vector<Elf64_Shdr> shdrs(shnum);
+	vector<uint8_t> shstrtab(1, 0);
+
+	auto add_section = [&](const int &index, const string &name, const uint32_t &type, const uint64_t &flags, const uint64_t &align, const vector<uint8_t> &data, const uint64_t &size)
+	{
+		auto &sh = shdrs[index];
+		sh.sh_name = shstrtab.size();
+		put_str(shstrtab, name);
+		sh.sh_type = type;
+		sh.sh_flags = flags;
+		sh.sh_addralign = align;
+		out.resize((out.size() + align - 1) / align * align);
+		sh.sh_offset = out.size();
+		sh.sh_size = size;
+		if (SHT_NOBITS != type)
+		{
+			out.insert(out.end(), data.begin(), data.end());
+		}
+		return &sh;
+	};
+
+	for (int i = 0; i < nsec; ++i)
+	{
+		auto &sec = sections[i];
+		add_section(shndx[i], sec._name, sec._type, sec._flags, sec._align, contents[i], contents[i].size());
+
+		if (relocs[i].empty())
+		{
+			continue;
+		}
+
+		vector<uint8_t> data;
+		for (auto &rel : relocs[i])
+		{
+			int index = rel._sym.empty() ? section_sym[rel._section] : symbols[rel._sym]._index;
+			put(data, rel._offset, 8);
+			put(data, ELF64_R_INFO(static_cast<uint64_t>(index), rel._type), 8);
+			put(data, rel._addend, 8);
+		}
+		auto sh = add_section(rela_shndx[i], ".rela" + sec._name, SHT_RELA, SHF_INFO_LINK, 8, data, data.size());
+		sh->sh_link = symtab_shndx;
+		sh->sh_info = shndx[i];
+		sh->sh_entsize = sizeof(Elf64_Rela);
+	}
+
+	vector<uint8_t> symdata(symtab.size() * sizeof(Elf64_Sym));
+	memcpy(symdata.data(), symtab.data(), symdata.size());
+	auto sh = add_section(symtab_shndx, ".symtab", SHT_SYMTAB, 0, 8, symdata, symdata.size());
+	sh->sh_link = strtab_shndx;
+	sh->sh_info = first_global;
+	sh->sh_entsize = sizeof(Elf64_Sym);
+	add_section(strtab_shndx, ".strtab", SHT_STRTAB, 0, 1, strtab, strtab.size());
+
+	/* .shstrtabは自分自身の名前を含むので先に名前を登録する */
+	shdrs[shstrtab_shndx].sh_name = shstrtab.size();
+	put_str(shstrtab, ".shstrtab");
+	auto &shstr = shdrs[shstrtab_shndx];
+	shstr.sh_type = SHT_STRTAB;
+	shstr.sh_addralign = 1;
+	shstr.sh_offset = out.size();
+	shstr.sh_size = shstrtab.size();
+	out.insert(out.end(), shstrtab.begin(), shstrtab.end());
+
+	/* セクションヘッダ */
+	out.resize((out.size() + 7) / 8 * 8);
+	uint64_t shoff = out.size();
+	out.resize(out.size() + shnum * sizeof(Elf64_Shdr));
+	memcpy(out.data() + shoff, shdrs.data(), shnum * sizeof(Elf64_Shdr));
+
+	/* ELFヘッダ */
+	Elf64_Ehdr ehdr{};
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+	ehdr.e_type = ET_REL;
+	ehdr.e_machine = EM_X86_64;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_shoff = shoff;
+	ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum = shnum;
+	ehdr.e_shstrndx = shstrtab_shndx;
+	memcpy(out.data(), &ehdr, sizeof(ehdr));
+
+	std::ofstream ofs(output_path, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+	{
+		error("ファイルが開けません: " + output_path);
+	}
+	ofs.write(reinterpret_cast<const char *>(out.data()), out.size());
+	ofs.close();
+	if (!ofs)
+	{
+		error("ファイルの書き込みに失敗しました: " + output_path);
+	}
+}
@@ -0,0 +1,167 @@
+/**
+ * @file assembler.hpp
+ * @author K.Fukunaga
+ * @brief CodeGenが出力したアセンブリから直接オブジェクトファイルを生成する内蔵アセンブラ
+ * @version 0.1
+ * @date 2023-08-27
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdint>
+
+/**
+ * @brief Intel記法のx86-64アセンブリを機械語に変換し、ELF形式の再配置可能オブジェクトファイルを出力するクラス
+ *
+ * @details -fintegrated-asオプションが指定されたとき'as'の代わりに使う。
+ * 対応する命令、ディレクティブはCodeGenが出力するものに限る。
+ * 命令の符号化、ジャンプ命令の短縮、再配置の選び方は'as'に合わせてあり、
+ * .text、.dataセクションの内容と再配置情報は'as'の出力と一致する。
+ */
+class Assembler
+{
+public:
+	/* 静的メンバ関数(public) */
+	static void assemble(const string_view &input, const string &output_path);
+	static void assemble_file(const string &input_path, const string &output_path);
+
+private:
+	/**
+	 * @brief オペランドの種類
+	 *
+	 */
+	enum class OperandKind
+	{
+		REG, /*!< 汎用レジスタ */
+		XMM, /*!< XMMレジスタ */
+		MEM, /*!< メモリ */
+		IMM, /*!< 即値 */
+		SYM, /*!< ラベル */
+	};
+
+	/**
+	 * @brief 命令のオペランド
+	 *
+	 */
+	struct Operand
+	{
+		OperandKind _kind = OperandKind::IMM; /*!< 種類 */
+		int _reg = 0;						  /*!< レジスタ番号、メモリの場合はベースレジスタの番号 */
+		int _size = 0;						  /*!< オペランドのサイズ(バイト)。メモリでサイズ指定がない場合は0 */
+		int64_t _val = 0;					  /*!< 即値、メモリの場合は変位 */
+		string _sym;						  /*!< 参照するラベル */
+		bool _gotpcrel = false;				  /*!< @GOTPCREL指定があるか */
+	};
+
+	/**
+	 * @brief セクション内の位置。ジャンプ命令の短縮によりアドレスが変わるため断片と断片内のオフセットで表す
+	 *
+	 */
+	struct Position
+	{
+		int _frag = 0;	  /*!< 断片の番号 */
+		size_t _off = 0;  /*!< 断片内のオフセット */
+	};
+
+	/**
+	 * @brief セクションを構成する断片。固定長の機械語と、その後ろに続く長さが可変のジャンプ命令からなる
+	 *
+	 */
+	struct Fragment
+	{
+		vector<uint8_t> _bytes; /*!< 固定長の機械語 */
+		int _jump = -1;			/*!< 後ろに続くジャンプ命令の条件コード。jmpは16、ジャンプ命令がなければ-1 */
+		string _target;			/*!< ジャンプ先のラベル */
+		bool _long = false;		/*!< ジャンプ命令をrel32で符号化するか */
+		int _align = 0;			/*!< 0でなければジャンプ命令の代わりにこの境界までパディングする */
+		uint64_t _addr = 0;		/*!< 断片の先頭アドレス */
+	};
+
+	/**
+	 * @brief 再配置が必要な箇所
+	 *
+	 */
+	struct Fixup
+	{
+		Position _pos;		 /*!< 書き換える位置 */
+		string _sym;		 /*!< 参照するラベル */
+		int64_t _addend = 0; /*!< 加数 */
+		uint32_t _type = 0;	 /*!< 再配置の種類 */
+	};
+
+	/**
+	 * @brief セクション
+	 *
+	 */
+	struct Section
+	{
+		string _name;			 /*!< セクション名 */
+		uint32_t _type = 0;		 /*!< セクションの種類 */
+		uint64_t _flags = 0;	 /*!< セクションの属性 */
+		uint64_t _align = 1;	 /*!< アライメント */
+		vector<Fragment> _frags; /*!< 断片 */
+		vector<Fixup> _fixups;	 /*!< 再配置が必要な箇所 */
+
+		Section(const string &name, const uint32_t &type, const uint64_t &flags) : _name(name), _type(type), _flags(flags), _frags(1) {}
+	};
+
+	/**
+	 * @brief ラベル
+	 *
+	 */
+	struct Symbol
+	{
+		int _section = -1;	 /*!< 定義されたセクション。未定義なら-1 */
+		Position _pos;		 /*!< 定義された位置 */
+		bool _global = false; /*!< .globlが指定されたか */
+		int _index = 0;		 /*!< シンボルテーブル内の番号 */
+	};
+
+	/**
+	 * @brief .locディレクティブで指定された行番号情報
+	 *
+	 */
+	struct LineInfo
+	{
+		Position _pos; /*!< 対応する命令の位置 */
+		int _file = 0; /*!< ファイル番号 */
+		int _line = 0; /*!< 行番号 */
+	};
+
+	Assembler();
+
+	/* 静的メンバ関数(private) */
+	static void reset();
+	static void parse_line(string_view line);
+	static void parse_directive(const string_view &name, string_view rest);
+	static void define_label(const string &name);
+	static string local_label(const string_view &name);
+	static Operand parse_operand(string_view str);
+	static int64_t parse_number(const string_view &str);
+	static void parse_expression(string_view str, string &sym, int64_t &addend);
+	static void encode(const string_view &mnemonic, vector<Operand> &ops);
+	static void encode_jump(const int &cond, const Operand &target);
+	static void emit_op(const vector<uint8_t> &prefix, const bool &w, const vector<uint8_t> &opcode, const int &reg, const Operand &rm, const bool &force_rex, const int &imm_size = 0);
+	static void emit_imm(const int64_t &val, const int &size);
+	static void emit_bytes(const std::initializer_list<uint8_t> &bytes);
+	static void add_fixup(const string &sym, const int64_t &addend, const uint32_t &type);
+	static void align(const uint64_t &n);
+	static Position current_position();
+	static void relax();
+	static uint64_t address(const int &section, const Position &pos);
+	static vector<uint8_t> section_contents(const int &section);
+	static void emit_debug_info();
+	static void write_object(const string &output_path);
+
+	static vector<Section> sections;
+	static std::unordered_map<string, Symbol> symbols;
+	static vector<string> symbol_order;
+	static vector<string> file_names;
+	static vector<LineInfo> lines;
+	static std::unordered_map<string, int> label_counts;
+	static int current;
+};
@@ -0,0 +1,97 @@
+/**
+ * @file atom.cpp
+ * @author K.Fukunaga
+ * @brief 識別子とパンクチュエータの綴りを番号で表すアトムの定義
+ * @version 0.1
+ * @date 2023-09-09
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "atom.hpp"
+
+/** predefinedの綴りから番号を求める完全ハッシュ表 */
+constexpr PerfectHash<std::size(Atom::predefined), 10> Atom::predefined_hash{predefined};
+
+/**
+ * @brief 綴りに対応するアトムを返す。初めて現れた綴りであれば新しい番号を割り当てる。
+ *
+ * @param str 綴り
+ */
+Atom::Atom(const std::string_view &str)
+{
+	/* キーワードなどのあらかじめ登録されている綴り */
+	auto i = predefined_hash.find(str);
+	if (i >= 0)
+	{
+		_id = i;
+		return;
+	}
+
+	auto &t = table();
+	std::unique_lock<std::mutex> lock(t._mutex, std::defer_lock);
+	if (t._concurrent)
+	{
+		lock.lock();
+	}
+	auto it = t._ids.find(str);
+	if (it != t._ids.end())
+	{
+		_id = it->second;
+		return;
+	}
+	_id = t._spellings.size();
+	t._ids.emplace(t._spellings.emplace_back(str), _id);
+}
+
+/**
+ * @brief アトムの綴りを返す
+ *
+ * @return 綴り
+ */
+const std::string &Atom::str() const
+{
+	auto &t = table();
+	std::unique_lock<std::mutex> lock(t._mutex, std::defer_lock);
+	if (t._concurrent)
+	{
+		lock.lock();
+	}
+	return t._spellings[_id];
+}
+
+/**
+ * @brief 複数のスレッドからアトムを生成するかを設定する。他のスレッドが動いていない間に呼ぶこと。
+ *
+ * @param concurrent 複数のスレッドから使う間はtrue
+ */
+void Atom::set_concurrent(const bool &concurrent)
+{
+	table()._concurrent = concurrent;
+}
+
+/**
+ * @brief あらかじめ登録されている綴りをpredefinedの順に登録する
+ *
+ */
+Atom::Table::Table()
+{
+	for (const auto &str : predefined)
+	{
+		uint32_t id = _spellings.size();
+		_ids.emplace(_spellings.emplace_back(str), id);
+	}
+}
+
+/**
+ * @brief 綴りと番号の対応表を返す。
+ * 静的変数の初期化の順序によらず使えるように、初めて呼ばれたときに生成する。
+ *
+ * @return 対応表
+ */
+Atom::Table &Atom::table()
+{
+	static Table table;
+	return table;
+}
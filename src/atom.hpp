@@ -0,0 +1,161 @@
+/**
+ * @file atom.hpp
+ * @author K.Fukunaga
+ * @brief 識別子とパンクチュエータの綴りを番号で表すアトムの定義
+ * @version 0.1
+ * @date 2023-09-09
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "perfecthash.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @brief 識別子とパンクチュエータの綴りに一意な番号を対応付けたもの(アトム)
+ *
+ * @details 同じ綴りには常に同じ番号を割り当てるので、綴りの比較やハッシュ表の検索は番号の比較で済む。
+ * キーワード、パンクチュエータなどコンパイラが名前で参照する綴りはpredefinedに並べた順に番号を割り当てておき、
+ * 文字列リテラルからの変換(Atom("if")など)はコンパイル時に番号を求める。predefinedにない綴りを渡すとコンパイルエラーになる。
+ * それ以外の綴りはトークナイズ時に表に登録する。表はトークンのキャッシュと同じく翻訳単位をまたいで保持する。
+ * キーワードやパンクチュエータはコンパイル時に生成した完全ハッシュ表で番号を求めるので、実行時の表を引かない。
+ * 複数のスレッドでトークナイズする間はset_concurrent(true)とし、実行時の表をロックして使う。
+ */
+class Atom
+{
+public:
+	constexpr Atom() = default;
+
+	/**
+	 * @brief あらかじめ登録されている綴りのアトムをコンパイル時に求める
+	 *
+	 * @param str 綴り
+	 */
+	template <size_t N>
+	consteval Atom(const char (&str)[N]) : _id(predefined_id(std::string_view(str, N - 1)))
+	{
+	}
+
+	explicit Atom(const std::string_view &str);
+
+	const std::string &str() const;
+
+	/**
+	 * @brief アトムの番号を返す
+	 *
+	 * @return 番号(空のアトムは0)
+	 */
+	constexpr uint32_t id() const
+	{
+		return _id;
+	}
+
+	constexpr bool is_keyword() const;
+	constexpr bool is_typename() const;
+	constexpr bool operator==(const Atom &rhs) const = default;
+
+	static void set_concurrent(const bool &concurrent);
+
+private:
+	/**
+	 * @brief あらかじめ登録されている綴りの番号を返す。見つからなければコンパイルエラーにする。
+	 *
+	 * @param str 綴り
+	 * @return 番号
+	 */
+	static consteval uint32_t predefined_id(const std::string_view &str)
+	{
+		for (uint32_t i = 0; i < std::size(predefined); ++i)
+		{
+			if (predefined[i] == str)
+			{
+				return i;
+			}
+		}
+		throw "アトムとしてあらかじめ登録されていない綴りです";
+	}
+
+	/**
+	 * @brief 綴りと番号の対応表
+	 *
+	 */
+	struct Table
+	{
+		std::deque<std::string> _spellings;					  /*!< 番号順の綴り */
+		std::unordered_map<std::string_view, uint32_t> _ids; /*!< 綴りから番号への対応(キーは_spellingsの要素を指す) */
+		std::mutex _mutex;									  /*!< 複数のスレッドから使う間のロック */
+		bool _concurrent = false;							  /*!< 複数のスレッドから使う間はtrue */
+
+		Table();
+	};
+
+	static Table &table();
+
+	uint32_t _id = 0; /*!< 番号 */
+
+	/**
+	 * 番号を固定する綴りの一覧。先頭は空の綴り(番号0)。
+	 * is_typename()とis_keyword()は範囲で判定するので、型名、それ以外のキーワードの順に連続して並べる。
+	 */
+	static constexpr std::string_view predefined[] = {
+		"",
+		/* 型名 */
+		"void", "_Bool", "char", "short", "int", "long", "float", "double", "struct", "union",
+		"typedef", "enum", "static", "extern", "_Alignas", "signed", "unsigned",
+		"const", "volatile", "auto", "register", "restrict", "__restrict", "__restrict__", "_Noreturn",
+		/* 型名以外のキーワード */
+		"return", "if", "else", "for", "while", "sizeof", "goto", "break", "continue", "switch", "case", "default", "_Alignof", "do",
+		/* パンクチュエータ */
+		"<<=", ">>=", "...", "==", "!=", "<=", ">=", "->", "+=", "-=", "*=", "/=",
+		"++", "--", "%=", "&=", "|=", "^=", "&&", "||", "<<", ">>", "##",
+		"!", "#", "%", "&", "(", ")", "*", "+", ",", "-", ".", "/", ":", ";", "<", "=", ">", "?", "[", "]", "^", "{", "|", "}", "~",
+		/* プリプロセッサ、組み込みの識別子 */
+		"include", "define", "undef", "ifdef", "ifndef", "elif", "endif", "error", "defined", "__VA_ARGS__", "pragma", "once",
+		"__builtin_reg_class", "__func__", "__FUNCTION__"};
+
+	/** predefinedの綴りから番号を求める完全ハッシュ表(構築に時間がかかるのでatom.cppで定義する) */
+	static const PerfectHash<std::size(predefined), 10> predefined_hash;
+};
+
+/**
+ * @brief キーワードであるか
+ *
+ * @return キーワードであればtrue
+ */
+constexpr bool Atom::is_keyword() const
+{
+	return Atom("void")._id <= _id && _id <= Atom("do")._id;
+}
+
+/**
+ * @brief 型名または記憶クラス指定子などの型の宣言を始めるキーワードであるか
+ *
+ * @return 型名であればtrue
+ */
+constexpr bool Atom::is_typename() const
+{
+	return Atom("void")._id <= _id && _id <= Atom("_Noreturn")._id;
+}
+
+/**
+ * @brief アトムのハッシュ。番号をそのまま使う
+ *
+ */
+template <>
+struct std::hash<Atom>
+{
+	size_t operator()(const Atom &atom) const noexcept
+	{
+		return atom.id();
+	}
+};
@@ -0,0 +1,449 @@
+/**
+ * @file cache.cpp
+ * @author K.Fukunaga
+ * @brief コンパイル結果のキャッシュ
+ *
+ * キャッシュディレクトリの構成は以下の通り。
+ * 	- XX/YYYY... : キーの先頭2文字のディレクトリに置いたエントリ(アセンブリかオブジェクトファイル)
+ * 	- stats : "ヒット数 ミス数 合計サイズ"。更新はflockで排他する
+ * 	.
+ * @version 0.1
+ * @date 2023-08-31
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "cache.hpp"
+#include "input.hpp"
+#include "tokenize.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/**
+ * @brief FNV-1a(128ビット)でハッシュ値を計算する
+ *
+ */
+class Hasher
+{
+public:
+	/**
+	 * @brief データを追加する。区切りを明確にするため長さも追加する
+	 *
+	 * @param data 追加するデータ
+	 */
+	void add(const string_view &data)
+	{
+		auto len = std::to_string(data.size());
+		update(len);
+		update(":");
+		update(data);
+	}
+
+	/**
+	 * @brief ハッシュ値を16進数の文字列で返す
+	 *
+	 * @return ハッシュ値
+	 */
+	string hex() const
+	{
+		static constexpr char digits[] = "0123456789abcdef";
+		string out;
+		for (int i = 124; i >= 0; i -= 4)
+		{
+			out.push_back(digits[static_cast<int>(_hash >> i) & 0xf]);
+		}
+		return out;
+	}
+
+private:
+	void update(const string_view &data)
+	{
+		for (const auto &c : data)
+		{
+			_hash ^= static_cast<uint8_t>(c);
+			_hash *= PRIME;
+		}
+	}
+
+	static constexpr unsigned __int128 PRIME = (static_cast<unsigned __int128>(1) << 88) + 0x13b;
+	unsigned __int128 _hash = (static_cast<unsigned __int128>(0x6c62272e07bb0142) << 64) + 0x62b821756295c58d;
+};
+
+/**
+ * @brief キャッシュのキーを計算する
+ *
+ * @param token プリプロセス済みのトークン列
+ * @param in 入力引数
+ * @param input_path 入力ファイルのパス(アセンブリの.fileディレクティブに出力される)
+ * @param kind 保存するものの種類("s"、"o-as"など)
+ * @return キー
+ */
+string Cache::key(const Token *token, const unique_ptr<Input> &in, const string &input_path, const string_view &kind)
+{
+	Hasher h;
+	h.add(build_id());
+	h.add(kind);
+	h.add(input_path);
+	h.add(in->_opt_g ? "g" : "");
+	for (const auto &dir : in->_include)
+	{
+		h.add(dir);
+	}
+
+	/* プリコンパイル済みヘッダの宣言はトークン列に含まれない */
+	if (!in->_include_pch.empty())
+	{
+		int64_t mtime = 0, size = 0;
+		Token::file_stat(in->_include_pch, mtime, size);
+		h.add(in->_include_pch);
+		h.add(std::to_string(mtime) + ":" + std::to_string(size));
+	}
+
+	for (auto tok = token; TokenKind::TK_EOF != tok->_kind; tok = tok->_next.get())
+	{
+		/* 連結した文字列リテラルや#で作った文字列リテラルは元のファイルに綴りがないので、
+		 * 元の入力文字列ではなくトークンが持つ文字列と数値の型をハッシュする */
+		h.add(std::to_string(static_cast<int>(tok->_kind)) + ":" + std::to_string(tok->_literal_type));
+		h.add(tok->_str);
+
+		/* デバッグ情報には行番号が含まれる */
+		if (in->_opt_g)
+		{
+			h.add(tok->_file->_name);
+			h.add(std::to_string(tok->line_no()));
+		}
+	}
+	return h.hex();
+}
+
+/**
+ * @brief キャッシュからエントリを読み込む。ヒットしたエントリは最終使用時刻を更新する
+ *
+ * @param in 入力引数
+ * @param key キー
+ * @param contents 読み込んだ内容を格納する
+ * @return true ヒットした
+ * @return false ミスした
+ */
+bool Cache::fetch(const unique_ptr<Input> &in, const string &key, string &contents)
+{
+	auto path = entry_path(in, key);
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs)
+	{
+		update_stats(in, 0, 1, 0);
+		return false;
+	}
+
+	contents.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+	/* 更新時刻を最終使用時刻として使う */
+	utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+	update_stats(in, 1, 0, 0);
+	return true;
+}
+
+/**
+ * @brief キャッシュにエントリを保存する。一時ファイルに書いてから置き換えるので、読み込み中の他のプロセスが壊れた内容を読むことはない。
+ * 保存できなくてもコンパイルは続けられるのでエラーにはしない
+ *
+ * @param in 入力引数
+ * @param key キー
+ * @param contents 保存する内容
+ */
+void Cache::store(const unique_ptr<Input> &in, const string &key, const string_view &contents)
+{
+	auto path = entry_path(in, key);
+	std::error_code ec;
+	fs::create_directories(fs::path(path).parent_path(), ec);
+
+	auto tmp = path + ".tmp." + std::to_string(getpid());
+	{
+		std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+		ofs.write(contents.data(), contents.size());
+		if (!ofs)
+		{
+			fs::remove(tmp, ec);
+			return;
+		}
+	}
+
+	/* 並列に同じキーでミスした他のfccが先に保存していれば、置き換えたエントリとのサイズの差だけを加える */
+	auto old_size = fs::file_size(path, ec);
+	if (ec)
+	{
+		old_size = 0;
+	}
+
+	fs::rename(tmp, path, ec);
+	if (ec)
+	{
+		fs::remove(tmp, ec);
+		return;
+	}
+	update_stats(in, 0, 0, static_cast<int64_t>(contents.size()) - static_cast<int64_t>(old_size));
+}
+
+/**
+ * @brief キャッシュから読み込んだエントリをファイルに書き出す
+ *
+ * @param in 入力引数
+ * @param key キー
+ * @param path 出力先のパス
+ * @return true ヒットした
+ * @return false ミスした
+ */
+bool Cache::fetch_file(const unique_ptr<Input> &in, const string &key, const string &path)
+{
+	string contents;
+	if (!fetch(in, key, contents))
+	{
+		return false;
+	}
+
+	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+	{
+		error("ファイルが開けません: " + path);
+	}
+	ofs.write(contents.data(), contents.size());
+	return true;
+}
+
+/**
+ * @brief ファイルの内容をキャッシュに保存する
+ *
+ * @param in 入力引数
+ * @param key キー
+ * @param path 保存するファイルのパス
+ */
+void Cache::store_file(const unique_ptr<Input> &in, const string &key, const string &path)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs)
+	{
+		return;
+	}
+	string contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	store(in, key, contents);
+}
+
+/**
+ * @brief キャッシュのヒット数、ミス数、合計サイズを表示する(--cache-stats)
+ *
+ * @param in 入力引数
+ */
+void Cache::print_stats(const unique_ptr<Input> &in)
+{
+	uint64_t hits = 0, misses = 0, size = 0;
+	std::ifstream ifs(in->_cache_dir + "/stats");
+	ifs >> hits >> misses >> size;
+
+	auto total = hits + misses;
+	std::cout << "キャッシュディレクトリ: " << in->_cache_dir << "\n";
+	std::cout << "ヒット: " << hits << "\n";
+	std::cout << "ミス: " << misses << "\n";
+	std::cout << "ヒット率: " << (total ? 100.0 * hits / total : 0.0) << "%\n";
+	std::cout << "サイズ: " << size << " / " << in->_cache_size << " バイト\n";
+}
+
+/**
+ * @brief デフォルトのキャッシュディレクトリを返す。$XDG_CACHE_HOME/fcc/objectsか~/.cache/fcc/objects
+ *
+ * @return キャッシュディレクトリのパス
+ */
+string Cache::default_dir()
+{
+	if (auto dir = getenv("XDG_CACHE_HOME"); dir && *dir)
+	{
+		return string(dir) + "/fcc/objects";
+	}
+	if (auto home = getenv("HOME"); home && *home)
+	{
+		return string(home) + "/.cache/fcc/objects";
+	}
+	return (fs::temp_directory_path() / "fcc_cache").string();
+}
+
+/**
+ * @brief "64M"のようなサイズの指定を解釈する。接尾辞K, M, Gを使える
+ *
+ * @param arg サイズの指定
+ * @return バイト数。不正な指定なら0
+ */
+uint64_t Cache::parse_size(const string &arg)
+{
+	size_t idx = 0;
+	uint64_t n = 0;
+	try
+	{
+		n = std::stoull(arg, &idx);
+	}
+	catch (const std::exception &e)
+	{
+		return 0;
+	}
+
+	auto suffix = arg.substr(idx);
+	if (suffix.empty())
+	{
+		return n;
+	}
+	if ("K" == suffix || "k" == suffix)
+	{
+		return n << 10;
+	}
+	if ("M" == suffix || "m" == suffix)
+	{
+		return n << 20;
+	}
+	if ("G" == suffix || "g" == suffix)
+	{
+		return n << 30;
+	}
+	return 0;
+}
+
+/**
+ * @brief キーに対応するエントリのパスを返す
+ *
+ * @param in 入力引数
+ * @param key キー
+ * @return エントリのパス
+ */
+string Cache::entry_path(const unique_ptr<Input> &in, const string &key)
+{
+	return in->_cache_dir + "/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+/**
+ * @brief 実行中のfccのビルドを識別する文字列を返す。fccを作り直せばキャッシュは無効になる
+ *
+ * @return 実行ファイルのパス、サイズ、更新時刻をつなげた文字列
+ */
+string Cache::build_id()
+{
+	static string id;
+	if (!id.empty())
+	{
+		return id;
+	}
+
+	struct stat st = {};
+	std::error_code ec;
+	auto exe = fs::read_symlink("/proc/self/exe", ec).string();
+	if (ec || stat(exe.c_str(), &st) != 0)
+	{
+		/* 実行ファイルが分からなければビルド日時で代用する */
+		id = string(__DATE__) + " " + __TIME__;
+		return id;
+	}
+
+	id = exe + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+	return id;
+}
+
+/**
+ * @brief 統計情報を更新する。合計サイズが上限を超えたら古いエントリを削除する
+ *
+ * @param in 入力引数
+ * @param hits ヒット数の増分
+ * @param misses ミス数の増分
+ * @param size 合計サイズの増分
+ * @return 更新後の合計サイズ
+ */
+uint64_t Cache::update_stats(const unique_ptr<Input> &in, const uint64_t &hits, const uint64_t &misses, const int64_t &size)
+{
+	std::error_code ec;
+	fs::create_directories(in->_cache_dir, ec);
+
+	auto path = in->_cache_dir + "/stats";
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	/* 並列に実行された他のfccと排他する */
+	flock(fd, LOCK_EX);
+
+	char buf[128] = {};
+	if (pread(fd, buf, sizeof(buf) - 1, 0) < 0)
+	{
+		buf[0] = '\0';
+	}
+	uint64_t total_hits = 0, total_misses = 0, total_size = 0;
+	sscanf(buf, "%lu %lu %lu", &total_hits, &total_misses, &total_size);
+
+	total_hits += hits;
+	total_misses += misses;
+	total_size = (size < 0 && total_size < uint64_t(-size)) ? 0 : total_size + size;
+
+	if (total_size > in->_cache_size)
+	{
+		total_size = evict(in->_cache_dir, in->_cache_size);
+	}
+
+	auto out = std::to_string(total_hits) + " " + std::to_string(total_misses) + " " + std::to_string(total_size) + "\n";
+	if (ftruncate(fd, 0) == 0 && pwrite(fd, out.data(), out.size(), 0) < 0)
+	{
+		total_size = 0;
+	}
+
+	flock(fd, LOCK_UN);
+	close(fd);
+	return total_size;
+}
+
+/**
+ * @brief 最終使用時刻が古いエントリから順に、合計サイズが上限の8割以下になるまで削除する
+ *
+ * @param dir キャッシュディレクトリ
+ * @param max_size 合計サイズの上限
+ * @return 削除後の合計サイズ
+ */
+uint64_t Cache::evict(const string &dir, const uint64_t &max_size)
+{
+	struct Entry
+	{
+		fs::file_time_type _time; /*!< 最終使用時刻 */
+		uint64_t _size;			  /*!< サイズ */
+		fs::path _path;			  /*!< パス */
+	};
+
+	vector<Entry> entries;
+	uint64_t total = 0;
+	std::error_code ec;
+
+	for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+	{
+		auto name = it->path().filename().string();
+		if (!it->is_regular_file(ec) || "stats" == name || string::npos != name.find(".tmp."))
+		{
+			continue;
+		}
+
+		Entry e = {it->last_write_time(ec), it->file_size(ec), it->path()};
+		total += e._size;
+		entries.emplace_back(e);
+	}
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+			  { return a._time < b._time; });
+
+	for (const auto &e : entries)
+	{
+		if (total <= max_size / 10 * 8)
+		{
+			break;
+		}
+		if (fs::remove(e._path, ec))
+		{
+			total -= e._size;
+		}
+	}
+	return total;
+}
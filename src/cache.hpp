@@ -0,0 +1,51 @@
+/**
+ * @file cache.hpp
+ * @author K.Fukunaga
+ * @brief コンパイル結果のキャッシュ
+ * @version 0.1
+ * @date 2023-08-31
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdint>
+
+class Input;
+
+/**
+ * @brief プリプロセス済みのトークン列をキーとしてコンパイル結果(アセンブリ、オブジェクトファイル)を保存するクラス
+ *
+ * @details -fcacheオプションが指定されたときに使う。キーはトークン列、コンパイルに影響するオプション、
+ * fcc自身のビルドを識別する値のハッシュ値で、キャッシュヒットした場合は構文解析とコード生成(.oならアセンブルも)を省略する。
+ * エントリは一時ファイルに書いてから置き換えるので、並列に実行された複数のfccが同じディレクトリを共有できる。
+ * 合計サイズが上限を超えたら、最後に使われた時刻(更新時刻)が古いものから削除する。
+ */
+class Cache
+{
+public:
+	/* 静的メンバ関数(public) */
+	static string key(const Token *token, const unique_ptr<Input> &in, const string &input_path, const string_view &kind);
+	static bool fetch(const unique_ptr<Input> &in, const string &key, string &contents);
+	static void store(const unique_ptr<Input> &in, const string &key, const string_view &contents);
+	static bool fetch_file(const unique_ptr<Input> &in, const string &key, const string &path);
+	static void store_file(const unique_ptr<Input> &in, const string &key, const string &path);
+	static void print_stats(const unique_ptr<Input> &in);
+	static string default_dir();
+	static uint64_t parse_size(const string &arg);
+	static string build_id();
+
+	/** キャッシュの合計サイズのデフォルトの上限 */
+	static constexpr uint64_t DEFAULT_MAX_SIZE = 256 << 20;
+
+private:
+	Cache();
+
+	/* 静的メンバ関数(private) */
+	static string entry_path(const unique_ptr<Input> &in, const string &key);
+	static uint64_t update_stats(const unique_ptr<Input> &in, const uint64_t &hits, const uint64_t &misses, const int64_t &size);
+	static uint64_t evict(const string &dir, const uint64_t &max_size);
+};
@@ -16,6 +16,9 @@
 #include "parse.hpp"
 #include "object.hpp"
 #include "type.hpp"
+#include "timereport.hpp"
+#include "codegenstats.hpp"
+#include <sstream>
 
 /** スタックの深さ */
 static int depth = 0;
@@ -29,10 +32,26 @@ static std::ostream *os = &std::cout;
 /* デバッグ情報を付与するか */
 static bool print_dbg_info = false;
 
+/** ラベルの通し番号 */
+static int label_counter = 1;
+
 /*****************/
 /* CodeGen Class */
 /*****************/
 
+/**
+ * @brief 翻訳単位ごとのコード生成の状態(ラベルの通し番号など)を初期化する
+ *
+ */
+void CodeGen::reset()
+{
+	depth = 0;
+	current_func = nullptr;
+	os = &std::cout;
+	print_dbg_info = false;
+	label_counter = 1;
+}
+
 /**
  * @brief 型をサイズごとに分類したIDを返す
  *
@@ -291,8 +310,7 @@ void CodeGen::cmp_zero(const Type *ty)
  */
 int CodeGen::label_count()
 {
-	static int i = 1;
-	return i++;
+	return label_counter++;
 }
 
 /** @brief 'rax'の数値をスタックにpushする */
@@ -476,7 +494,7 @@ void CodeGen::generate_expression(Node *node)
 {
 	if (print_dbg_info)
 	{
-		*os << "  .loc " << node->_token->_file->_file_no << " " << node->_token->_line_no << "\n";
+		*os << "  .loc " << node->_token->_file->_file_no << " " << node->_token->line_no() << "\n";
 	}
 
 	switch (node->_kind)
@@ -974,7 +992,7 @@ void CodeGen::generate_statement(Node *node)
 {
 	if (print_dbg_info)
 	{
-		*os << "  .loc " << node->_token->_file->_file_no << " " << node->_token->_line_no << "\n";
+		*os << "  .loc " << node->_token->_file->_file_no << " " << node->_token->line_no() << "\n";
 	}
 
 	switch (node->_kind)
@@ -1155,6 +1173,7 @@ void CodeGen::emit_data(const unique_ptr<Object> &program)
 		if (var->_init_data)
 		{
 			/* 初期化式がある場合は.dataセクションに配置 */
+			CodeGenStats::count_data(var->_ty->_size, true);
 			*os << "  .data\n";
 			*os << var->_name << ":\n";
 
@@ -1178,6 +1197,7 @@ void CodeGen::emit_data(const unique_ptr<Object> &program)
 		}
 
 		/* 初期化式がない場合は.bssセクションに配置 */
+		CodeGenStats::count_data(var->_ty->_size, false);
 		*os << "  .bss\n";
 		*os << var->_name << ":\n";
 		*os << "  .zero " << var->_ty->_size << "\n";
@@ -1199,6 +1219,14 @@ void CodeGen::emit_text(const unique_ptr<Object> &program)
 			continue;
 		}
 
+		/* -fcodegen-statsオプションが指定されていれば関数1つ分のアセンブリを集計してから出力する */
+		auto out = os;
+		std::ostringstream fn_text;
+		if (CodeGenStats::is_enabled())
+		{
+			os = &fn_text;
+		}
+
 		/* 関数のラベル部分を出力 */
 		if (fn->_is_static)
 		{
@@ -1303,6 +1331,13 @@ void CodeGen::emit_text(const unique_ptr<Object> &program)
 		*os << "  mov rsp, rbp\n";
 		*os << "  pop rbp\n";
 		*os << "  ret\n";
+
+		if (CodeGenStats::is_enabled())
+		{
+			os = out;
+			CodeGenStats::count_function(fn->_name, fn->_stack_size, fn_text.view());
+			*os << fn_text.view();
+		}
 	}
 }
 
@@ -1310,12 +1345,15 @@ void CodeGen::emit_text(const unique_ptr<Object> &program)
  * @brief 関数ごとにASTを意味解析し、Intel記法でアセンブリを出力する
  *
  * @param program アセンブリを出力する対象関数
+ * @param input_path 入力ファイルのパス
+ * @param out 出力先
+ * @param opt_g デバッグ情報を出力するか
  */
-void CodeGen::generate_code(const unique_ptr<Object> &program, const string &input_path, const string &output_path, const bool &opt_g)
+void CodeGen::generate_code(const unique_ptr<Object> &program, const string &input_path, std::ostream *out, const bool &opt_g)
 {
-
-	os = open_file(output_path);
+	os = out;
 	print_dbg_info = opt_g;
+	CodeGenStats::begin(input_path);
 
 	/* intel記法であることを宣言 */
 	*os << ".intel_syntax noprefix\n";
@@ -1331,13 +1369,26 @@ void CodeGen::generate_code(const unique_ptr<Object> &program, const string &inp
 	}
 
 	/* スタックサイズを計算してセット */
-	assign_lvar_offsets(program);
+	{
+		TimeReport::Scope scope(TimeReport::PH_LVAR_OFFSETS);
+		assign_lvar_offsets(program);
+	}
 
 	/* .data部を出力 */
-	emit_data(program);
+	{
+		TimeReport::Scope scope(TimeReport::PH_EMIT_DATA);
+		emit_data(program);
+	}
 
 	/* text部を出力 */
-	emit_text(program);
+	{
+		TimeReport::Scope scope(TimeReport::PH_EMIT_TEXT);
+		emit_text(program);
+	}
+
+	os->flush();
+	os = &std::cout;
+	CodeGenStats::end();
 }
 
 
@@ -25,7 +25,8 @@ public:
 	/* 静的メンバ関数 (public) */
 	/**************************/
 
-	static void generate_code(const unique_ptr<Object> &program, const string &input_path, const string &output_patt, const bool &opt_g);
+	static void generate_code(const unique_ptr<Object> &program, const string &input_path, std::ostream *out, const bool &opt_g);
+	static void reset();
 
 private:
 	/* このクラスのインスタンス化は禁止 */
@@ -0,0 +1,348 @@
+/**
+ * @file codegenstats.cpp
+ * @author K.Fukunaga
+ * @brief 生成したアセンブリの静的な品質指標の集計
+ * @version 0.1
+ * @date 2023-09-07
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "codegenstats.hpp"
+#include <sstream>
+
+/** 集計するか */
+bool CodeGenStats::enabled = false;
+
+/** 集計中の入力ファイルの名前 */
+string CodeGenStats::current_name;
+
+/** 関数ごとの集計結果 */
+vector<CodeGenStats::Function> CodeGenStats::functions;
+
+/** .data部に出力したバイト数 */
+uint64_t CodeGenStats::data_bytes = 0;
+
+/** .bss部に確保したバイト数 */
+uint64_t CodeGenStats::bss_bytes = 0;
+
+/** 出力したグローバル変数の数 */
+uint64_t CodeGenStats::data_objects = 0;
+
+/**
+ * @brief 集計結果を加える
+ *
+ * @param other 加える集計結果
+ */
+void CodeGenStats::Counter::add(const Counter &other)
+{
+	_instructions += other._instructions;
+	for (int i = 0; i < IC_COUNT; ++i)
+	{
+		_classes[i] += other._classes[i];
+	}
+	_push += other._push;
+	_pop += other._pop;
+	_loads += other._loads;
+	_stores += other._stores;
+	_branches += other._branches;
+	_conditional_branches += other._conditional_branches;
+}
+
+/**
+ * @brief 集計を有効にする
+ *
+ */
+void CodeGenStats::enable()
+{
+	enabled = true;
+}
+
+/**
+ * @brief 集計が有効かを返す
+ *
+ * @return 集計が有効であればtrue
+ */
+bool CodeGenStats::is_enabled()
+{
+	return enabled;
+}
+
+/**
+ * @brief 翻訳単位1つ分の集計を開始する。これまでの集計結果は破棄する。
+ *
+ * @param name 入力ファイルの名前
+ */
+void CodeGenStats::begin(const string &name)
+{
+	if (!enabled)
+	{
+		return;
+	}
+	current_name = name;
+	functions.clear();
+	data_bytes = bss_bytes = data_objects = 0;
+}
+
+/**
+ * @brief 関数1つ分のアセンブリを集計する
+ *
+ * @param name 関数名
+ * @param frame_size スタックフレームのサイズ
+ * @param text 関数のアセンブリ
+ */
+void CodeGenStats::count_function(const string &name, const int &frame_size, const string_view &text)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	Function fn;
+	fn._name = name;
+	fn._frame_size = frame_size;
+
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		auto eol = text.find('\n', pos);
+		if (string_view::npos == eol)
+		{
+			eol = text.size();
+		}
+		auto line = text.substr(pos, eol - pos);
+		pos = eol + 1;
+
+		/* ラベル、ディレクティブは命令ではない */
+		if (!line.starts_with("  ") || line.starts_with("  ."))
+		{
+			continue;
+		}
+
+		/* 1行に';'で区切られた複数の命令が書かれていることがある */
+		while (!line.empty())
+		{
+			auto sep = line.find(';');
+			count_instruction(line.substr(0, sep), fn._counter);
+			if (string_view::npos == sep)
+			{
+				break;
+			}
+			line.remove_prefix(sep + 1);
+		}
+	}
+
+	functions.emplace_back(move(fn));
+}
+
+/**
+ * @brief グローバル変数1つ分のデータを集計する
+ *
+ * @param size 変数のサイズ
+ * @param initialized 初期化式があり.data部に出力したか
+ */
+void CodeGenStats::count_data(const int &size, const bool &initialized)
+{
+	if (!enabled)
+	{
+		return;
+	}
+	++data_objects;
+	(initialized ? data_bytes : bss_bytes) += size;
+}
+
+/**
+ * @brief begin()からの集計結果をJSONで標準エラー出力に書き出す
+ *
+ */
+void CodeGenStats::end()
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	std::ostringstream os;
+	os << "{\"file\":\"";
+	for (auto c : current_name)
+	{
+		if (c == '"' || c == '\\')
+		{
+			os << '\\';
+		}
+		os << c;
+	}
+	os << "\",\"functions\":[";
+
+	Counter total;
+	uint64_t frame_bytes = 0;
+	for (size_t i = 0; i < functions.size(); ++i)
+	{
+		const auto &fn = functions[i];
+		os << (i ? "," : "") << "{\"name\":\"" << fn._name << "\",\"frame_size\":" << fn._frame_size << ",";
+		write_counter(os, fn._counter);
+		os << "}";
+		total.add(fn._counter);
+		frame_bytes += fn._frame_size;
+	}
+
+	os << "],\"total\":{\"functions\":" << functions.size() << ",\"frame_size\":" << frame_bytes << ",";
+	write_counter(os, total);
+	os << "},\"data\":{\"objects\":" << data_objects << ",\"data_bytes\":" << data_bytes << ",\"bss_bytes\":" << bss_bytes << "}}\n";
+
+	/* 並列にコンパイルしているときに他のジョブの出力と混ざらないようにまとめて書き出す */
+	std::cerr << os.str();
+	std::cerr.flush();
+}
+
+/**
+ * @brief 命令の種類を判定する
+ *
+ * @param mnemonic ニーモニック
+ * @return 命令の種類
+ */
+CodeGenStats::InstClass CodeGenStats::classify(const string_view &mnemonic)
+{
+	static const std::unordered_map<string_view, InstClass> table = {
+		{"mov", IC_MOVE}, {"movsx", IC_MOVE}, {"movzx", IC_MOVE}, {"movsxd", IC_MOVE}, {"movzb", IC_MOVE},
+		{"movss", IC_MOVE}, {"movsd", IC_MOVE}, {"movq", IC_MOVE}, {"stosb", IC_MOVE},
+		{"lea", IC_LEA},
+		{"add", IC_ARITH}, {"sub", IC_ARITH}, {"imul", IC_ARITH}, {"mul", IC_ARITH}, {"idiv", IC_ARITH}, {"div", IC_ARITH},
+		{"neg", IC_ARITH}, {"not", IC_ARITH}, {"and", IC_ARITH}, {"or", IC_ARITH}, {"xor", IC_ARITH},
+		{"shl", IC_ARITH}, {"shr", IC_ARITH}, {"sar", IC_ARITH}, {"cqo", IC_ARITH}, {"cdq", IC_ARITH},
+		{"cmp", IC_COMPARE}, {"test", IC_COMPARE}, {"ucomiss", IC_COMPARE}, {"ucomisd", IC_COMPARE},
+		{"call", IC_CALL}, {"ret", IC_CALL},
+		{"push", IC_STACK}, {"pop", IC_STACK},
+	};
+
+	auto it = table.find(mnemonic);
+	if (it != table.end())
+	{
+		return it->second;
+	}
+	if (mnemonic.starts_with("j"))
+	{
+		return IC_BRANCH;
+	}
+	if (mnemonic.starts_with("set"))
+	{
+		return IC_COMPARE;
+	}
+	if (mnemonic.starts_with("cvt") || mnemonic.ends_with("ss") || mnemonic.ends_with("sd") || mnemonic.starts_with("xorp") ||
+		"pxor" == mnemonic)
+	{
+		return IC_FLOAT;
+	}
+	return IC_OTHER;
+}
+
+/**
+ * @brief 命令1つを集計する
+ *
+ * @param inst 命令(ニーモニックとオペランド)
+ * @param counter 集計先
+ */
+void CodeGenStats::count_instruction(string_view inst, Counter &counter)
+{
+	auto trim = [](string_view s)
+	{
+		auto b = s.find_first_not_of(' ');
+		if (string_view::npos == b)
+		{
+			return string_view();
+		}
+		return s.substr(b, s.find_last_not_of(' ') - b + 1);
+	};
+
+	inst = trim(inst);
+	if (inst.empty())
+	{
+		return;
+	}
+
+	auto sp = inst.find(' ');
+	auto mnemonic = inst.substr(0, sp);
+	auto operands = string_view::npos == sp ? string_view() : trim(inst.substr(sp));
+
+	/* rep stosbはstosbとして数える(ストア1回) */
+	if ("rep" == mnemonic)
+	{
+		sp = operands.find(' ');
+		mnemonic = operands.substr(0, sp);
+		operands = string_view::npos == sp ? string_view() : trim(operands.substr(sp));
+		if ("stosb" == mnemonic)
+		{
+			++counter._stores;
+		}
+	}
+
+	auto cls = classify(mnemonic);
+	++counter._instructions;
+	++counter._classes[cls];
+
+	if ("push" == mnemonic)
+	{
+		++counter._push;
+	}
+	else if ("pop" == mnemonic)
+	{
+		++counter._pop;
+	}
+	else if (IC_BRANCH == cls)
+	{
+		++counter._branches;
+		if ("jmp" != mnemonic)
+		{
+			++counter._conditional_branches;
+		}
+	}
+
+	/* メモリオペランドを数える。leaはメモリにアクセスしない */
+	if (IC_LEA == cls || IC_STACK == cls || operands.find('[') == string_view::npos)
+	{
+		return;
+	}
+	auto comma = operands.find(',');
+	auto dst = operands.substr(0, comma);
+	if (string_view::npos != comma && operands.substr(comma).find('[') != string_view::npos)
+	{
+		/* 転送元がメモリ */
+		++counter._loads;
+	}
+	if (dst.find('[') != string_view::npos)
+	{
+		if (IC_MOVE == cls || mnemonic.starts_with("set"))
+		{
+			++counter._stores;
+		}
+		else if (IC_COMPARE == cls || "idiv" == mnemonic || "div" == mnemonic || "imul" == mnemonic || "mul" == mnemonic)
+		{
+			++counter._loads;
+		}
+		else
+		{
+			/* 読み出して書き戻す(add QWORD PTR [rbp - 8], 16など) */
+			++counter._loads;
+			++counter._stores;
+		}
+	}
+}
+
+/**
+ * @brief 集計結果をJSONのメンバとして書き出す
+ *
+ * @param os 出力先
+ * @param counter 集計結果
+ */
+void CodeGenStats::write_counter(std::ostream &os, const Counter &counter)
+{
+	os << "\"instructions\":" << counter._instructions << ",\"classes\":{";
+	for (int i = 0; i < IC_COUNT; ++i)
+	{
+		os << (i ? "," : "") << "\"" << class_names[i] << "\":" << counter._classes[i];
+	}
+	os << "},\"push\":" << counter._push << ",\"pop\":" << counter._pop << ",\"loads\":" << counter._loads
+	   << ",\"stores\":" << counter._stores << ",\"branches\":" << counter._branches
+	   << ",\"conditional_branches\":" << counter._conditional_branches;
+}
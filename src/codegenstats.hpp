@@ -0,0 +1,100 @@
+/**
+ * @file codegenstats.hpp
+ * @author K.Fukunaga
+ * @brief 生成したアセンブリの静的な品質指標の集計
+ * @version 0.1
+ * @date 2023-09-07
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdint>
+
+/**
+ * @brief -fcodegen-statsオプションが指定されたとき、生成したアセンブリの命令数などを関数ごとに集計して報告するクラス
+ *
+ * @details CodeGenが出力した関数1つ分のアセンブリを受け取り、命令を種類ごとに数える。
+ * 併せてpush/popの数、メモリのロード、ストアの数、分岐の数、スタックフレームのサイズと、.data部、.bss部のバイト数を記録する。
+ * 実行時の性能の目安としてコミット間で比較できるように、結果は翻訳単位ごとにJSONの1行として標準エラー出力に書き出す。
+ * -fcacheでキャッシュヒットした場合はコード生成を行わないので報告しない。
+ */
+class CodeGenStats
+{
+public:
+	/**
+	 * @brief 命令の種類
+	 *
+	 */
+	enum InstClass
+	{
+		IC_MOVE,	/*!< 転送(mov, movsx, movss, rep stosbなど) */
+		IC_LEA,		/*!< アドレスの計算 */
+		IC_ARITH,	/*!< 整数の算術演算、論理演算、シフト */
+		IC_FLOAT,	/*!< 浮動小数点数の演算、変換 */
+		IC_COMPARE, /*!< 比較とフラグの読み出し(cmp, test, setcc, ucomisなど) */
+		IC_BRANCH,	/*!< ジャンプ */
+		IC_CALL,	/*!< 関数呼び出しと復帰 */
+		IC_STACK,	/*!< push, pop */
+		IC_OTHER,	/*!< その他 */
+		IC_COUNT,	/*!< 種類の数 */
+	};
+
+	/* 静的メンバ関数(public) */
+	static void enable();
+	static bool is_enabled();
+	static void begin(const string &name);
+	static void count_function(const string &name, const int &frame_size, const string_view &text);
+	static void count_data(const int &size, const bool &initialized);
+	static void end();
+
+private:
+	/**
+	 * @brief 命令の集計結果
+	 *
+	 */
+	struct Counter
+	{
+		uint64_t _instructions = 0;			 /*!< 命令数 */
+		uint64_t _classes[IC_COUNT] = {};	 /*!< 種類ごとの命令数 */
+		uint64_t _push = 0;					 /*!< pushの数 */
+		uint64_t _pop = 0;					 /*!< popの数 */
+		uint64_t _loads = 0;				 /*!< メモリからのロード(push, popを除く) */
+		uint64_t _stores = 0;				 /*!< メモリへのストア(push, popを除く) */
+		uint64_t _branches = 0;				 /*!< 分岐 */
+		uint64_t _conditional_branches = 0; /*!< 条件分岐 */
+
+		void add(const Counter &other);
+	};
+
+	/**
+	 * @brief 関数ごとの集計結果
+	 *
+	 */
+	struct Function
+	{
+		string _name;		 /*!< 関数名 */
+		int _frame_size = 0; /*!< スタックフレームのサイズ */
+		Counter _counter;	 /*!< 命令の集計結果 */
+	};
+
+	CodeGenStats();
+
+	/* 静的メンバ関数(private) */
+	static InstClass classify(const string_view &mnemonic);
+	static void count_instruction(string_view inst, Counter &counter);
+	static void write_counter(std::ostream &os, const Counter &counter);
+
+	static bool enabled;
+	static string current_name;
+	static vector<Function> functions;
+	static uint64_t data_bytes;
+	static uint64_t bss_bytes;
+	static uint64_t data_objects;
+
+	/** 命令の種類の名前 */
+	static constexpr string_view class_names[] = {"move", "lea", "arith", "float", "compare", "branch", "call", "stack", "other"};
+};
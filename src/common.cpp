@@ -11,13 +11,80 @@
 
 #include "common.hpp"
 #include "tokenize.hpp"
+#include "timereport.hpp"
 #include <sys/wait.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <cerrno>
 
 /** 警告レベル */
 static int warning_level = 1;
 
+/** このスレッドのエラーを報告せずにDeferredErrorを投げるか */
+static thread_local bool errors_deferred = false;
+
+/**
+ * @brief ファイルディスクリプタへ書き込むストリームバッファ
+ *
+ */
+class FdStreamBuf : public std::streambuf
+{
+public:
+    FdStreamBuf(const int &fd) : _fd(fd)
+    {
+        setp(_buf, _buf + sizeof(_buf));
+    }
+
+    ~FdStreamBuf()
+    {
+        sync();
+    }
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (sync() != 0)
+        {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override
+    {
+        for (char *p = pbase(); p < pptr();)
+        {
+            ssize_t n = write(_fd, p, pptr() - p);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return -1;
+            }
+            p += n;
+        }
+        setp(_buf, _buf + sizeof(_buf));
+        return 0;
+    }
+
+private:
+    int _fd;             /*!< 書き込み先 */
+    char _buf[1 << 16]; /*!< 書き込みバッファ */
+};
+
+/** open_file, open_fdで開いた出力先 */
+static unique_ptr<std::ostream> output_file;
+
+/** open_fdで開いた出力先のストリームバッファ */
+static unique_ptr<FdStreamBuf> output_buf;
+
 /**
  * @brief エラーを報告して終了する
  *
@@ -25,6 +92,10 @@ static int warning_level = 1;
  */
 void error(string &&msg)
 {
+    if (errors_deferred)
+    {
+        throw DeferredError();
+    }
     std::cerr << msg << std::endl;
     exit(1);
 }
@@ -37,17 +108,14 @@ void error(string &&msg)
  */
 void error_at(string &&msg, const int &location)
 {
+    if (errors_deferred)
+    {
+        throw DeferredError();
+    }
     auto current_file = Token::get_current_file();
 
     /* エラー箇所が含まれる行の行数を取得 */
-    int line_no = 1;
-    for (int l = 0; l < location; ++l)
-    {
-        if (current_file->_contents[l] == '\n')
-        {
-            ++line_no;
-        }
-    }
+    int line_no = current_file->_source->line_no(location);
 
     verror_at(current_file->_name, current_file->_contents, move(msg), location, line_no);
     exit(1);
@@ -61,7 +129,7 @@ void error_at(string &&msg, const int &location)
  * @param location エラー箇所
  * @param line_no エラー箇所の行数
  */
-void verror_at(const string &filename, const string &input, string &&msg, const int &location, const int &line_no)
+void verror_at(const string &filename, const string_view &input, string &&msg, const int &location, const int &line_no)
 {
     int line_start = location;
     /* エラー箇所が含まれる行の先頭位置を探す */
@@ -105,7 +173,11 @@ void verror_at(const string &filename, const string &input, string &&msg, const
  */
 void error_token(string &&msg, const Token *token)
 {
-    verror_at(token->_file->_name, token->_file->_contents, move(msg), token->_location, token->_line_no);
+    if (errors_deferred)
+    {
+        throw DeferredError();
+    }
+    verror_at(token->_file->_name, token->_file->_contents, move(msg), token->_location, token->line_no());
     exit(1);
 }
 
@@ -121,7 +193,17 @@ void warn_token(string &&msg, const int &level, Token *token)
     if(warning_level == 0 || warning_level >= level){
         return;
     }
-    verror_at(token->_file->_name, token->_file->_contents, move(msg), token->_location, token->_line_no);
+    verror_at(token->_file->_name, token->_file->_contents, move(msg), token->_location, token->line_no());
+}
+
+/**
+ * @brief このスレッドでエラーを報告する関数が、出力して終了する代わりにDeferredErrorを投げるようにする
+ *
+ * @param defer 投げるようにする場合はtrue
+ */
+void defer_errors(const bool &defer)
+{
+    errors_deferred = defer;
 }
 
 /**
@@ -135,11 +217,26 @@ void init_warning_level(int level)
 }
 
 /**
- * @brief forkした子プロセスでargvを引数としてexecvpを起動
+ * @brief forkした子プロセスでargvを引数としてexecvpを起動し、終了を待つ。
+ * 子プロセスが失敗した場合は終了する。
  *
  * @param argv 引数リスト
  */
 void run_subprocess(const vector<string> &argv)
+{
+    TimeReport::Scope scope(TimeReport::subprocess_phase(argv[0]));
+    wait_subprocess(spawn_subprocess(argv));
+}
+
+/**
+ * @brief forkした子プロセスでargvを引数としてexecvpを起動し、終了を待たずにpidを返す。
+ *
+ * @param argv 引数リスト
+ * @param in_fd 子プロセスの標準入力とするファイルディスクリプタ。-1なら引き継ぐ。
+ * @param out_fd 子プロセスの標準出力とするファイルディスクリプタ。-1なら引き継ぐ。
+ * @return 起動した子プロセスのpid
+ */
+pid_t spawn_subprocess(const vector<string> &argv, const int &in_fd, const int &out_fd)
 {
     /* 引数の数 + 1 (NULL終端)*/
     size_t capacity = argv.size() + 1;
@@ -153,32 +250,56 @@ void run_subprocess(const vector<string> &argv)
     }
     cmd[capacity - 1] = nullptr;
 
-    if (fork() == 0)
+    pid_t pid = fork();
+    if (pid == 0)
     {
+        /* 標準入出力を付け替える */
+        if (in_fd >= 0)
+        {
+            dup2(in_fd, STDIN_FILENO);
+        }
+        if (out_fd >= 0)
+        {
+            dup2(out_fd, STDOUT_FILENO);
+        }
         /* 子プロセスでコマンドを実行する */
         execvp(cmd[0], cmd);
         std::cerr << "\'exec\'コマンドが失敗しました" << endl;
         _exit(1);
     }
 
-    /* 子プロセスが終了するのを待機 */
-    int status;
-    while (wait(&status) > 0)
+    /* 解放 */
+    for (size_t i = 0; i < argv.size(); ++i)
     {
+        delete[] cmd[i];
     }
 
-    if (status != 0)
+    delete[] cmd;
+
+    if (pid < 0)
     {
-        exit(1);
+        error("\'fork\'に失敗しました");
     }
+    return pid;
+}
 
-    /* 解放 */
-    for (size_t i = 0; i < argv.size(); ++i)
+/**
+ * @brief spawn_subprocessで起動した子プロセスの終了を待つ。子プロセスが失敗した場合は終了する。
+ *
+ * @param pid 子プロセスのpid
+ */
+void wait_subprocess(const pid_t &pid)
+{
+    int status = 1;
+    if (waitpid(pid, &status, 0) < 0)
     {
-        delete[] cmd[i];
+        status = 1;
     }
 
-    delete[] cmd;
+    if (status != 0)
+    {
+        exit(1);
+    }
 }
 
 /**
@@ -190,17 +311,46 @@ void run_subprocess(const vector<string> &argv)
  */
 std::ostream *open_file(const string &path)
 {
-    static unique_ptr<std::ofstream> os;
-    os = nullptr;
+    close_file();
     /* 出力先が標準出力ではない */
     if (path != "-")
     {
         /* ファイルを開く */
-        os = make_unique<std::ofstream>(path);
-        if (!os->fail())
+        output_file = make_unique<std::ofstream>(path);
+        if (!output_file->fail())
         {
-            return os.get();
+            return output_file.get();
         }
     }
     return &std::cout;
+}
+
+/**
+ * @brief ファイルディスクリプタ(パイプなど)へ書き込むストリームを開く。
+ * ファイルディスクリプタ自体はclose_file()では閉じないため、呼び出し側で閉じること。
+ *
+ * @param fd 出力先のファイルディスクリプタ
+ * @return 出力用ostreamのポインタ
+ */
+std::ostream *open_fd(const int &fd)
+{
+    close_file();
+    output_buf = make_unique<FdStreamBuf>(fd);
+    output_file = make_unique<std::ostream>(output_buf.get());
+    return output_file.get();
+}
+
+/**
+ * @brief open_fileで開いたファイルを閉じる。標準出力の場合はフラッシュのみ行う。
+ *
+ */
+void close_file()
+{
+    if (output_file)
+    {
+        output_file->flush();
+    }
+    output_file = nullptr;
+    output_buf = nullptr;
+    std::cout.flush();
 }
\ No newline at end of file
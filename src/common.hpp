@@ -16,6 +16,7 @@
 #include <cassert>
 #include <memory>
 #include <vector>
+#include <deque>
 #include <string>
 #include <locale>
 #include <unordered_map>
@@ -23,11 +24,13 @@
 #include <algorithm>
 #include <functional>
 #include <filesystem>
+#include <sys/types.h>
+#include "memreport.hpp"
+#include "atom.hpp"
 
 class Token;
 
 namespace fs = std::filesystem;
-using Hideset = std::unordered_set<std::string>;
 using std::endl;
 using std::make_shared;
 using std::make_unique;
@@ -39,14 +42,28 @@ using std::string_view;
 using std::unique_ptr;
 using std::vector;
 
+/**
+ * @brief defer_errors(true)としたスレッドで、エラーを報告する関数が出力も終了もせずに投げる例外。
+ * ヘッダファイルを先読みするスレッドで使い、エラーは本当にインクルードしたときに改めて報告する。
+ *
+ */
+struct DeferredError
+{
+};
+
 /* 汎用関数 */
-void error(string &&msg);
+[[noreturn]] void error(string &&msg);
 void error_at(string &&msg, const int &location);
-void verror_at(const string &filename, const string &input, string &&msg, const int &location, const int &line_no);
+void verror_at(const string &filename, const string_view &input, string &&msg, const int &location, const int &line_no);
 void error_token(string &&msg, const Token *token);
 void warn_token(string &&msg, const int &level, Token *token);
+void defer_errors(const bool &defer);
 void run_subprocess(const vector<string> &argv);
+pid_t spawn_subprocess(const vector<string> &argv, const int &in_fd = -1, const int &out_fd = -1);
+void wait_subprocess(const pid_t &pid);
 void init_warning_level(int level);
 std::ostream *open_file(const string &path);
+std::ostream *open_fd(const int &fd);
+void close_file();
 
 #define unreachable() error("エラー: " + string(__FILE__) + " : " + std::to_string(__LINE__))
\ No newline at end of file
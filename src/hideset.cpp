@@ -0,0 +1,156 @@
+/**
+ * @file hideset.cpp
+ * @author K.Fukunaga
+ * @brief マクロ展開に利用する、既に展開済みのマクロの名前の集合
+ * @version 0.1
+ * @date 2023-09-15
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "hideset.hpp"
+#include <algorithm>
+
+/** 登録済みのhideset */
+std::unordered_set<std::unique_ptr<Hideset>, Hideset::Contents, Hideset::Contents> Hideset::table;
+
+/** hidesetと追加した名前の組から、追加した結果への対応 */
+std::unordered_map<std::pair<const Hideset *, Atom>, const Hideset *, Hideset::PairHash> Hideset::added;
+
+/** hidesetの組(アドレスの小さい順)から、和集合への対応 */
+std::unordered_map<std::pair<const Hideset *, const Hideset *>, const Hideset *, Hideset::PairHash> Hideset::merged;
+
+/**
+ * @brief アトムの番号順に並べるための比較関数
+ *
+ */
+static bool less_id(const Atom &lhs, const Atom &rhs)
+{
+	return lhs.id() < rhs.id();
+}
+
+/**
+ * @brief 番号順に並べた名前からhidesetを生成する
+ *
+ * @param names 番号順に並べた名前
+ */
+Hideset::Hideset(std::vector<Atom> &&names) : _names(std::move(names)) {}
+
+/**
+ * @brief 名前を含むか
+ *
+ * @param name マクロの名前
+ * @return 含んでいればtrue
+ */
+bool Hideset::contains(const Atom &name) const
+{
+	return std::binary_search(_names.begin(), _names.end(), name, less_id);
+}
+
+/**
+ * @brief hidesetに名前を追加した結果を返す
+ *
+ * @param hs 対象のhideset(nullptrは空)
+ * @param name 追加するマクロの名前
+ * @return 追加した結果のhideset
+ */
+const Hideset *Hideset::add(const Hideset *hs, const Atom &name)
+{
+	if (hs && hs->contains(name))
+	{
+		return hs;
+	}
+
+	auto [itr, inserted] = added.try_emplace({hs, name}, nullptr);
+	if (inserted)
+	{
+		std::vector<Atom> names;
+		if (hs)
+		{
+			names.reserve(hs->size() + 1);
+			names = hs->_names;
+		}
+		names.insert(std::upper_bound(names.begin(), names.end(), name, less_id), name);
+		itr->second = intern(std::move(names));
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 2つのhidesetの和集合を返す
+ *
+ * @param hs1 hideset(nullptrは空)
+ * @param hs2 hideset(nullptrは空)
+ * @return 和集合のhideset
+ */
+const Hideset *Hideset::merge(const Hideset *hs1, const Hideset *hs2)
+{
+	if (!hs1 || hs1 == hs2)
+	{
+		return hs2;
+	}
+	if (!hs2)
+	{
+		return hs1;
+	}
+
+	/* 和集合は順序によらないので、キーはアドレスの小さい順にする */
+	if (std::less<const Hideset *>()(hs2, hs1))
+	{
+		std::swap(hs1, hs2);
+	}
+	auto [itr, inserted] = merged.try_emplace({hs1, hs2}, nullptr);
+	if (inserted)
+	{
+		std::vector<Atom> names;
+		names.reserve(hs1->size() + hs2->size());
+		std::set_union(hs1->begin(), hs1->end(), hs2->begin(), hs2->end(), std::back_inserter(names), less_id);
+		itr->second = intern(std::move(names));
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 翻訳単位ごとに登録済みのhidesetと記録した結果を破棄する。
+ * hidesetを参照するトークン(マクロ展開の結果)が残っていないときに呼び出す。
+ *
+ */
+void Hideset::reset()
+{
+	added.clear();
+	merged.clear();
+	table.clear();
+}
+
+/**
+ * @brief 同じ内容のhidesetが登録済みであればそれを、そうでなければ新しく生成して登録したものを返す
+ *
+ * @param names 番号順に並べた名前
+ * @return 登録済みのhideset
+ */
+const Hideset *Hideset::intern(std::vector<Atom> &&names)
+{
+	auto itr = table.find(std::span<const Atom>(names));
+	if (itr != table.end())
+	{
+		return itr->get();
+	}
+	return table.emplace(std::unique_ptr<Hideset>(new Hideset(std::move(names)))).first->get();
+}
+
+/**
+ * @brief 名前の番号の列のハッシュ値を求める
+ *
+ * @param names 番号順に並べた名前
+ * @return ハッシュ値
+ */
+size_t Hideset::Contents::operator()(std::span<const Atom> names) const noexcept
+{
+	size_t h = names.size();
+	for (const auto &name : names)
+	{
+		h = h * 1000003 ^ name.id();
+	}
+	return h;
+}
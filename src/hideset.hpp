@@ -0,0 +1,126 @@
+/**
+ * @file hideset.hpp
+ * @author K.Fukunaga
+ * @brief マクロ展開に利用する、既に展開済みのマクロの名前の集合
+ * @version 0.1
+ * @date 2023-09-15
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "atom.hpp"
+#include "memreport.hpp"
+#include <memory>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief マクロ展開に利用する、既に展開済みのマクロの名前の集合(hideset)
+ *
+ * @details hidesetは変更しない共有の値として扱い、同じ内容のものは表に登録した1つだけを生成する(ハッシュコンシング)。
+ * トークンはポインタで参照するので、トークンの複製ではhidesetを複製しない。空のhidesetはnullptrで表す。
+ * 内容はアトムの番号順に並べた配列で、マクロの入れ子の深さ程度の要素数なので二分探索で調べる。
+ * 名前の追加と和集合の結果はポインタの組をキーに記録しておき、同じマクロの展開で何度も求め直さない。
+ * プリプロセスはメインスレッドだけで行うので、表はロックしない。
+ */
+class Hideset : MemCounted<Hideset, MemReport::MK_HIDESET>
+{
+public:
+	Hideset(const Hideset &) = delete;
+	Hideset &operator=(const Hideset &) = delete;
+
+	bool contains(const Atom &name) const;
+
+	/**
+	 * @brief 要素数を返す
+	 *
+	 * @return 要素数
+	 */
+	size_t size() const
+	{
+		return _names.size();
+	}
+
+	/**
+	 * @brief 先頭の要素を指すイテレータを返す
+	 *
+	 */
+	std::vector<Atom>::const_iterator begin() const
+	{
+		return _names.begin();
+	}
+
+	/**
+	 * @brief 末尾の次を指すイテレータを返す
+	 *
+	 */
+	std::vector<Atom>::const_iterator end() const
+	{
+		return _names.end();
+	}
+
+	/* 静的メンバ関数(public) */
+	static const Hideset *add(const Hideset *hs, const Atom &name);
+	static const Hideset *merge(const Hideset *hs1, const Hideset *hs2);
+	static void reset();
+
+private:
+	/**
+	 * @brief 登録済みのhidesetと、番号順に並べた名前の配列を内容で比較するためのハッシュ関数と比較関数
+	 *
+	 */
+	struct Contents
+	{
+		using is_transparent = void;
+
+		size_t operator()(std::span<const Atom> names) const noexcept;
+		size_t operator()(const std::unique_ptr<Hideset> &hs) const noexcept
+		{
+			return (*this)(std::span<const Atom>(hs->_names));
+		}
+		bool operator()(std::span<const Atom> lhs, std::span<const Atom> rhs) const noexcept
+		{
+			return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+		}
+		bool operator()(const std::unique_ptr<Hideset> &lhs, std::span<const Atom> rhs) const noexcept
+		{
+			return (*this)(std::span<const Atom>(lhs->_names), rhs);
+		}
+		bool operator()(std::span<const Atom> lhs, const std::unique_ptr<Hideset> &rhs) const noexcept
+		{
+			return (*this)(lhs, std::span<const Atom>(rhs->_names));
+		}
+		bool operator()(const std::unique_ptr<Hideset> &lhs, const std::unique_ptr<Hideset> &rhs) const noexcept
+		{
+			return (*this)(std::span<const Atom>(lhs->_names), std::span<const Atom>(rhs->_names));
+		}
+	};
+
+	/**
+	 * @brief 2つの値の組のハッシュ関数
+	 *
+	 */
+	struct PairHash
+	{
+		template <class T, class U>
+		size_t operator()(const std::pair<T, U> &p) const noexcept
+		{
+			return std::hash<T>()(p.first) * 31 + std::hash<U>()(p.second);
+		}
+	};
+
+	explicit Hideset(std::vector<Atom> &&names);
+
+	/* 静的メンバ関数(private) */
+	static const Hideset *intern(std::vector<Atom> &&names);
+
+	std::vector<Atom> _names; /*!< アトムの番号順に並べた名前 */
+
+	static std::unordered_set<std::unique_ptr<Hideset>, Contents, Contents> table;
+	static std::unordered_map<std::pair<const Hideset *, Atom>, const Hideset *, PairHash> added;
+	static std::unordered_map<std::pair<const Hideset *, const Hideset *>, const Hideset *, PairHash> merged;
+};
@@ -10,6 +10,9 @@
  */
 
 #include "input.hpp"
+#include "scheduler.hpp"
+#include "cache.hpp"
+#include "server.hpp"
 
 /** 現在の入力ファイルの種類の指定 */
 FileType Input::opt_x = FileType::FILE_NONE;
@@ -17,6 +20,7 @@ FileType Input::opt_x = FileType::FILE_NONE;
 /* 文字列とファイルタイプの対応テーブル */
 const std::unordered_map<string, FileType> Input::filetype_table = {
 	{"c", FileType::FILE_C},
+	{"c-header", FileType::FILE_C_HEADER},
 	{"assembler", FileType::FILE_ASM},
 	{"none", FileType::FILE_NONE},
 };
@@ -31,6 +35,7 @@ unique_ptr<Input> Input::parse_args(const std::vector<std::string> &args)
 {
 	auto in = make_unique<Input>();
 	bool stdin_flg = false;
+	in->_cache_size = Cache::DEFAULT_MAX_SIZE;
 
 	/* args[0]は実行ファイルのパス */
 	for (size_t i = 1, sz = args.size(); i < sz; ++i)
@@ -132,6 +137,168 @@ unique_ptr<Input> Input::parse_args(const std::vector<std::string> &args)
 			continue;
 		}
 
+		if ("-include-pch" == args[i])
+		{
+			in->_include_pch = args[++i];
+			continue;
+		}
+
+		if ("-j" == args[i])
+		{
+			in->_jobs = parse_jobs(args[++i]);
+			continue;
+		}
+
+		if (args[i].starts_with("-j"))
+		{
+			in->_jobs = parse_jobs(args[i].substr(2));
+			continue;
+		}
+
+		if ("-fintegrated-as" == args[i])
+		{
+			in->_opt_integrated_as = true;
+			continue;
+		}
+
+		if ("-fno-integrated-as" == args[i])
+		{
+			in->_opt_integrated_as = false;
+			continue;
+		}
+
+		if ("-fuse-ld=fcc" == args[i])
+		{
+			in->_opt_internal_ld = true;
+			continue;
+		}
+
+		if ("-fuse-ld=ld" == args[i] || "-fuse-ld=bfd" == args[i])
+		{
+			in->_opt_internal_ld = false;
+			continue;
+		}
+
+		if ("-fcache" == args[i])
+		{
+			if (in->_cache_dir.empty())
+			{
+				in->_cache_dir = Cache::default_dir();
+			}
+			continue;
+		}
+
+		if ("-fno-cache" == args[i])
+		{
+			in->_cache_dir.clear();
+			continue;
+		}
+
+		if (args[i].starts_with("-fcache-dir="))
+		{
+			in->_cache_dir = args[i].substr(12);
+			continue;
+		}
+
+		if (args[i].starts_with("-fcache-size="))
+		{
+			in->_cache_size = Cache::parse_size(args[i].substr(13));
+			if (0 == in->_cache_size)
+			{
+				std::cerr << "-fcache-sizeオプションの指定が正しくありません: " << args[i] << "\n";
+				usage(1);
+			}
+			continue;
+		}
+
+		if ("--cache-stats" == args[i])
+		{
+			in->_opt_cache_stats = true;
+			continue;
+		}
+
+		if ("-ftime-report" == args[i])
+		{
+			in->_opt_time_report = true;
+			in->_opt_time_report_json = false;
+			continue;
+		}
+
+		if ("-ftime-report=json" == args[i])
+		{
+			in->_opt_time_report = true;
+			in->_opt_time_report_json = true;
+			continue;
+		}
+
+		if ("-fmem-report" == args[i])
+		{
+			in->_opt_mem_report = true;
+			continue;
+		}
+
+		if ("-fcodegen-stats" == args[i])
+		{
+			in->_opt_codegen_stats = true;
+			continue;
+		}
+
+		if (args[i].starts_with("-fscan="))
+		{
+			in->_opt_scan = args[i].substr(7);
+			continue;
+		}
+
+		if (args[i].starts_with("-fthreads="))
+		{
+			auto arg = args[i].substr(10);
+			size_t idx = 0;
+			try
+			{
+				in->_threads = std::stoi(arg, &idx);
+			}
+			catch (const std::exception &e)
+			{
+				idx = 0;
+			}
+			if (arg.empty() || idx != arg.size() || in->_threads < 0)
+			{
+				std::cerr << "-fthreadsオプションには0以上の整数を指定してください: " << args[i] << "\n";
+				usage(1);
+			}
+			continue;
+		}
+
+		if ("-fserver" == args[i])
+		{
+			in->_server_socket = Server::default_socket();
+			continue;
+		}
+
+		if (args[i].starts_with("-fserver="))
+		{
+			in->_server_socket = args[i].substr(9);
+			continue;
+		}
+
+		if ("-fno-server" == args[i])
+		{
+			in->_server_socket.clear();
+			continue;
+		}
+
+		if ("-pipe" == args[i])
+		{
+			in->_opt_pipe = true;
+			continue;
+		}
+
+		if ("-fsubprocess" == args[i])
+		{
+			in->_opt_subprocess = true;
+			continue;
+		}
+
 		if ("-fcc" == args[i])
 		{
 			in->_opt_fcc = true;
@@ -169,11 +336,28 @@ unique_ptr<Input> Input::parse_args(const std::vector<std::string> &args)
 		in->_inputs.emplace_back(args[i], get_file_type(args[i]));
 	}
 
+	/* --cache-statsオプションは統計情報を表示して終了する */
+	if (in->_opt_cache_stats)
+	{
+		if (in->_cache_dir.empty())
+		{
+			in->_cache_dir = Cache::default_dir();
+		}
+		Cache::print_stats(in);
+		exit(0);
+	}
+
 	if (in->_inputs.empty())
 	{
 		error("入力ファイルが指定されていません\n");
 	}
 
+	/* 並列数の指定がなければオンラインのCPU数とする */
+	if (in->_jobs == 0)
+	{
+		in->_jobs = Scheduler::default_jobs();
+	}
+
 	/* デフォルトのインクルードパスを設定する */
 	auto path = fs::path(args[0]).parent_path() / "../include";
 	in->_include.emplace_back(path.string());
@@ -198,6 +382,24 @@ void Input::usage(int status)
 	std::cerr << "  -E      プリプロセスのみを行いコンパイル、アセンブル、リンクを行いません。\n";
 	std::cerr << "  -S      コンパイルまでを行いアセンブル、リンクを行いません。\n";
 	std::cerr << "  -c      リンクを抑止します。\n";
+	std::cerr << "  -x c-header 以降の入力ファイルをヘッダファイルとしてプリコンパイルします。出力はファイル名に.pchを付けたものです。\n";
+	std::cerr << "  -include-pch FILE プリコンパイル済みヘッダを翻訳単位の先頭でインクルードしたものとして読み込みます。\n";
+	std::cerr << "  -j N    最大N個の入力ファイルを並列に処理します。デフォルトはCPU数です。\n";
+	std::cerr << "  -fsubprocess 翻訳単位ごとに子プロセスでコンパイルします。\n";
+	std::cerr << "  -pipe   アセンブリを一時ファイルではなくパイプでアセンブラに渡します。-fintegrated-as, -fcacheと併用した場合は無視します。\n";
+	std::cerr << "  -fintegrated-as 'as'の代わりに内蔵アセンブラでアセンブルします。\n";
+	std::cerr << "  -fcache コンパイル結果をキャッシュし、同じ入力とオプションのコンパイルでは再利用します。\n";
+	std::cerr << "  -fcache-dir=DIR キャッシュディレクトリを指定します(-fcacheを含む)。デフォルトは~/.cache/fcc/objectsです。\n";
+	std::cerr << "  -fcache-size=N キャッシュの合計サイズの上限を指定します(K, M, Gを使用可)。デフォルトは256Mです。\n";
+	std::cerr << "  --cache-stats キャッシュのヒット数、ミス数、サイズを表示します。\n";
+	std::cerr << "  -fuse-ld=fcc 'ld'の代わりに内蔵リンカで静的リンクします。対応できない入力は'ld'でリンクします。\n";
+	std::cerr << "  -ftime-report[=json] フェーズごとの実時間とCPU時間を入力ファイルごとに標準エラー出力に表示します。\n";
+	std::cerr << "  -fmem-report データ構造ごとの生成数、バイト数とフェーズごとの最大RSSを標準エラー出力に表示します。\n";
+	std::cerr << "  -fcodegen-stats 生成したアセンブリの命令数、push/pop、ロード/ストア、分岐の数などを関数ごとにJSONで標準エラー出力に表示します。\n";
+	std::cerr << "  -fthreads=N インクルードされるヘッダファイルをN個のスレッドで先読みしてトークナイズします。\n";
+	std::cerr << "  -fscan=IMPL トークナイザの走査の実装(scalar, sse2, avx2)を指定します。デフォルトはCPUが対応する最速の実装(auto)です。\n";
+	std::cerr << "  -fserver[=SOCKET] コンパイルサーバに処理を任せます。接続できなければ自身で処理します。\n";
+	std::cerr << "  --server [SOCKET] コンパイルサーバとして起動します(第1引数のみ)。\n";
 	exit(status);
 }
 
@@ -221,7 +423,7 @@ string Input::replace_extension(const string &path, const string &extn)
 }
 
 /**
- * @brief 引数が必要なオプションであるか（-o, -I）
+ * @brief 引数が必要なオプションであるか（-o, -x, -I, -include-pch, -j）
  *
  * @param arg 入力引数
  * @return true 引数が必要なオプションである
@@ -229,7 +431,7 @@ string Input::replace_extension(const string &path, const string &extn)
  */
 bool Input::take_arg(const string &arg)
 {
-	constexpr string_view ops[] = {"-o", "-x", "-I"};
+	constexpr string_view ops[] = {"-o", "-x", "-I", "-include-pch", "-j"};
 
 	for (auto &x : ops)
 	{
@@ -243,6 +445,33 @@ bool Input::take_arg(const string &arg)
 }
 
 
+/**
+ * @brief -jオプションの引数を並列数として解釈する。正の整数でなければエラー。
+ *
+ * @param arg -jオプションの引数
+ * @return 並列数
+ */
+int Input::parse_jobs(const string &arg)
+{
+	size_t idx = 0;
+	int n = 0;
+	try
+	{
+		n = std::stoi(arg, &idx);
+	}
+	catch (const std::exception &e)
+	{
+		idx = 0;
+	}
+
+	if (arg.empty() || idx != arg.size() || n <= 0)
+	{
+		std::cerr << "-jオプションには正の整数を指定してください: " << arg << "\n";
+		usage(1);
+	}
+	return n;
+}
+
 /**
  * @brief ファイルの種類を判定する
  * 
@@ -28,6 +28,7 @@ public:
 	{
 		FILE_NONE, /*!< 指定なし */
 		FILE_C,	   /*!< Cソースファイル */
+		FILE_C_HEADER, /*!< プリコンパイルするCヘッダファイル */
 		FILE_ASM,  /*!< アセンブリファイル */
 		FILE_OBJ   /*!< オブジェクトファイル */
 	};
@@ -49,6 +50,10 @@ public:
 	string _output_path = "";  /*!< アウトプットファイルパス */
 	string _fcc_input = "";	   /*!< -fccオプションが指定されている時の入力先 */
 	string _fcc_output = "";   /*!< -fccオプションが指定されている時の出力先 */
+	string _cache_dir = "";	   /*!< コンパイル結果のキャッシュディレクトリ。空ならキャッシュを使わない */
+	uint64_t _cache_size = 0;  /*!< キャッシュの合計サイズの上限(-fcache-size) */
+	string _server_socket = ""; /*!< コンパイルサーバのソケット(-fserver)。空ならサーバを使わない */
+	string _include_pch = "";	/*!< 翻訳単位の先頭で読み込むプリコンパイル済みヘッダ(-include-pch) */
 
 	bool _opt_g = false;   /*!< -gオプションが指定されているか */
 	bool _opt_S = false;   /*!< -Sオプションが指定されているか */
@@ -56,6 +61,18 @@ public:
 	bool _opt_E = false;   /*!< -Eオプションが指定されているか */
 	bool _opt_fcc = false; /*!< -fccオプションが指定されているか */
 	bool _opt_w = false;   /*!< -wオプションが指定されているか */
+	bool _opt_subprocess = false; /*!< -fsubprocessオプションが指定されているか */
+	bool _opt_pipe = false;		  /*!< -pipeオプションが指定されているか */
+	bool _opt_integrated_as = false; /*!< -fintegrated-asオプションが指定されているか */
+	bool _opt_internal_ld = false;	 /*!< -fuse-ld=fccオプションが指定されているか */
+	bool _opt_cache_stats = false;	 /*!< --cache-statsオプションが指定されているか */
+	bool _opt_time_report = false;	 /*!< -ftime-reportオプションが指定されているか */
+	bool _opt_time_report_json = false; /*!< -ftime-report=jsonオプションが指定されているか */
+	bool _opt_mem_report = false;	 /*!< -fmem-reportオプションが指定されているか */
+	bool _opt_codegen_stats = false; /*!< -fcodegen-statsオプションが指定されているか */
+	string _opt_scan;				 /*!< -fscan=オプションで指定したトークナイザの走査の実装(scalar, sse2, avx2, auto) */
+	int _threads = 0;				 /*!< ヘッダファイルを先読みしてトークナイズするスレッドの数(-fthreads=オプション) */
+	int _jobs = 0;		   /*!< 並列に処理する入力ファイルの最大数(-jオプション) */
 
 	/* 静的メンバ関数(public) */
 	static unique_ptr<Input> parse_args(const std::vector<string> &args);
@@ -66,6 +83,7 @@ private:
 	static void usage(int status);
 	static bool take_arg(const string &arg);
 	static FileType get_file_type(const string &filename);
+	static int parse_jobs(const string &arg);
 
 	static FileType opt_x;
 	static const std::unordered_map<string, FileType> filetype_table;
@@ -0,0 +1,1725 @@
+/**
+ * @file linker.cpp
+ * @author K.Fukunaga
+ * @brief オブジェクトファイルと静的ライブラリから実行ファイルを生成する内蔵リンカ
+ *
+ * crtファイルと入力ファイルを読み込み、未定義のシンボルを定義するメンバを
+ * 静的ライブラリ(libgcc.a, libgcc_eh.a, libc.a)から変化がなくなるまで取り出す('ld'の--start-groupと同じ)。
+ * 入力セクションを名前で出力セクションにまとめ、R、RX、RWの3つのセグメントに配置して
+ * 再配置を解決し、静的リンクされた実行ファイルを書き出す。
+ * @version 0.1
+ * @date 2023-08-29
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "linker.hpp"
+#include "timereport.hpp"
+#include <cstring>
+#include <cctype>
+#include <ar.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+vector<unique_ptr<uint8_t[]>> Linker::buffers;
+vector<Linker::ObjectFile> Linker::files;
+vector<Linker::InputSection> Linker::input_sections;
+vector<Linker::OutputSection> Linker::output_sections;
+std::unordered_map<string, int> Linker::output_map;
+vector<Linker::Symbol> Linker::symbols;
+std::unordered_map<string, int> Linker::symbol_map;
+vector<Linker::Archive> Linker::archives;
+std::unordered_set<string> Linker::comdat_groups;
+std::map<std::tuple<int, int, bool>, int> Linker::got_map;
+vector<std::pair<std::pair<int, int>, bool>> Linker::got_entries;
+std::map<std::pair<int, int>, int> Linker::iplt_map;
+vector<std::pair<int, int>> Linker::iplt_entries;
+vector<int> Linker::commons;
+int Linker::got = -1;
+int Linker::iplt = -1;
+int Linker::rela_iplt = -1;
+int Linker::bss = -1;
+size_t Linker::phnum = 0;
+uint64_t Linker::tls_start = 0;
+uint64_t Linker::tls_size = 0;
+
+/** IPLTの1エントリのサイズ */
+static constexpr uint64_t IPLT_ENTRY_SIZE = 16;
+
+/**
+ * @brief nをalignの倍数に切り上げる
+ *
+ * @param n 切り上げる値
+ * @param align 2の累乗
+ * @return 切り上げた値
+ */
+static uint64_t align_to(const uint64_t &n, const uint64_t &align)
+{
+	return align <= 1 ? n : (n + align - 1) & ~(align - 1);
+}
+
+/**
+ * @brief ビッグエンディアンの32ビット整数を読み込む(アーカイブのシンボルテーブル)
+ *
+ * @param p 読み込む位置
+ * @return 読み込んだ値
+ */
+static uint32_t read_be32(const uint8_t *p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+/**
+ * @brief 文字列がCの識別子として有効か(__start_, __stop_シンボルを定義するセクション名)
+ *
+ * @param name 文字列
+ * @return true 識別子として有効
+ * @return false 識別子として無効
+ */
+static bool is_c_identifier(const string_view &name)
+{
+	if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+	{
+		return false;
+	}
+	return std::all_of(name.begin(), name.end(), [](const char &c)
+					   { return std::isalnum(static_cast<unsigned char>(c)) || '_' == c; });
+}
+
+/**
+ * @brief 初期化関数の配列セクションの優先度を返す。".init_array.00100"なら100、優先度の指定がなければ65536
+ *
+ * @param name 入力セクション名
+ * @return 優先度
+ */
+static int array_priority(const string_view &name)
+{
+	auto dot = name.find('.', 1);
+	if (string_view::npos == dot)
+	{
+		return 65536;
+	}
+	return std::atoi(string(name.substr(dot + 1)).c_str());
+}
+
+/**
+ * @brief オブジェクトファイルをリンクして静的リンクされた実行ファイルを出力する
+ *
+ * @param inputs 入力オブジェクトファイルのパス
+ * @param output 出力先のパス
+ * @param libpath crt1.o, libc.aなどがあるディレクトリ
+ * @param gcc_libpath crtbeginT.o, libgcc.aなどがあるディレクトリ
+ * @return true リンクに成功した
+ * @return false 対応していない入力が含まれているため、何も出力していない
+ */
+bool Linker::link(const vector<string> &inputs, const string &output, const string &libpath, const string &gcc_libpath)
+{
+	TimeReport::Scope scope(TimeReport::PH_LINK);
+	reset();
+
+	/* 'gcc -static'と同じ順序で読み込む */
+	vector<string> objects = {libpath + "/crt1.o", libpath + "/crti.o", gcc_libpath + "/crtbeginT.o"};
+	objects.insert(objects.end(), inputs.begin(), inputs.end());
+
+	for (const auto &path : objects)
+	{
+		size_t size = 0;
+		auto data = read_file(path, size);
+		if (!data || !load_object(path, data, size))
+		{
+			return false;
+		}
+	}
+
+	for (const auto &path : {gcc_libpath + "/libgcc.a", gcc_libpath + "/libgcc_eh.a", libpath + "/libc.a"})
+	{
+		if (!load_archive(path))
+		{
+			return false;
+		}
+	}
+
+	if (!extract_members())
+	{
+		return false;
+	}
+
+	/* .eh_frameの終端と.init, .finiの末尾は最後に置く */
+	for (const auto &path : {gcc_libpath + "/crtend.o", libpath + "/crtn.o"})
+	{
+		size_t size = 0;
+		auto data = read_file(path, size);
+		if (!data || !load_object(path, data, size))
+		{
+			return false;
+		}
+	}
+
+	if (!extract_members() || !create_output_sections())
+	{
+		return false;
+	}
+
+	define_linker_symbols();
+
+	/* 未定義のシンボルがあれば'ld'にエラーを報告させる */
+	for (const auto &sym : symbols)
+	{
+		if (sym._file < 0 && !sym._linker && sym._strong_ref)
+		{
+			return false;
+		}
+	}
+
+	if (!scan_relocations())
+	{
+		return false;
+	}
+
+	layout();
+	set_linker_symbols();
+	return write_output(output);
+}
+
+/**
+ * @brief リンクの状態を初期化する
+ *
+ */
+void Linker::reset()
+{
+	buffers.clear();
+	files.clear();
+	input_sections.clear();
+	output_sections.clear();
+	output_map.clear();
+	symbols.clear();
+	symbol_map.clear();
+	archives.clear();
+	comdat_groups.clear();
+	got_map.clear();
+	got_entries.clear();
+	iplt_map.clear();
+	iplt_entries.clear();
+	commons.clear();
+	got = iplt = rela_iplt = bss = -1;
+	tls_start = tls_size = 0;
+}
+
+/**
+ * @brief ファイルの内容をすべて読み込む。読み込んだ内容はリンクが終わるまで保持する
+ *
+ * @param path ファイルのパス
+ * @param size 読み込んだサイズを格納する
+ * @return 読み込んだ内容。開けなければnullptr
+ */
+const uint8_t *Linker::read_file(const string &path, size_t &size)
+{
+	std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+	if (!ifs)
+	{
+		return nullptr;
+	}
+	size = ifs.tellg();
+	ifs.seekg(0);
+
+	auto buf = make_unique_for_overwrite<uint8_t[]>(size);
+	if (!ifs.read(reinterpret_cast<char *>(buf.get()), size))
+	{
+		return nullptr;
+	}
+	buffers.emplace_back(move(buf));
+	return buffers.back().get();
+}
+
+/**
+ * @brief 再配置可能オブジェクトファイルを読み込み、セクションとシンボルを登録する
+ *
+ * @param name ファイル名
+ * @param data ファイルの内容
+ * @param size ファイルのサイズ
+ * @return true 読み込みに成功した
+ * @return false 対応していない形式か、シンボルが多重定義されている
+ */
+bool Linker::load_object(const string &name, const uint8_t *data, const size_t &size)
+{
+	if (size < sizeof(Elf64_Ehdr) || 0 != memcmp(data, ELFMAG, SELFMAG))
+	{
+		return false;
+	}
+
+	auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(data);
+	if (ELFCLASS64 != ehdr->e_ident[EI_CLASS] || ET_REL != ehdr->e_type || EM_X86_64 != ehdr->e_machine ||
+		0 == ehdr->e_shnum || ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size)
+	{
+		return false;
+	}
+
+	int file_no = files.size();
+	ObjectFile obj;
+	obj._name = name;
+	obj._data = data;
+	obj._shdrs = reinterpret_cast<const Elf64_Shdr *>(data + ehdr->e_shoff);
+	obj._shnum = ehdr->e_shnum;
+	obj._sections.assign(obj._shnum, -1);
+
+	for (size_t i = 0; i < obj._shnum; ++i)
+	{
+		const auto &shdr = obj._shdrs[i];
+		if (SHT_SYMTAB == shdr.sh_type)
+		{
+			obj._syms = reinterpret_cast<const Elf64_Sym *>(data + shdr.sh_offset);
+			obj._symnum = shdr.sh_size / sizeof(Elf64_Sym);
+			obj._first_global = shdr.sh_info;
+			obj._strtab = reinterpret_cast<const char *>(data + obj._shdrs[shdr.sh_link].sh_offset);
+		}
+	}
+
+	/* 既に読み込んだCOMDATグループと同じグループのセクションは破棄する */
+	vector<bool> discarded(obj._shnum, false);
+	for (size_t i = 0; i < obj._shnum; ++i)
+	{
+		const auto &shdr = obj._shdrs[i];
+		if (SHT_GROUP != shdr.sh_type || !obj._syms)
+		{
+			continue;
+		}
+
+		auto words = reinterpret_cast<const uint32_t *>(data + shdr.sh_offset);
+		string signature = obj._strtab + obj._syms[shdr.sh_info].st_name;
+		if ((words[0] & GRP_COMDAT) && !comdat_groups.insert(signature).second)
+		{
+			for (size_t k = 1; k < shdr.sh_size / sizeof(uint32_t); ++k)
+			{
+				discarded[words[k]] = true;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < obj._shnum; ++i)
+	{
+		const auto &shdr = obj._shdrs[i];
+
+		/* 圧縮されたセクションは展開できない */
+		if (shdr.sh_flags & SHF_COMPRESSED)
+		{
+			return false;
+		}
+
+		switch (shdr.sh_type)
+		{
+		case SHT_PROGBITS:
+		case SHT_NOBITS:
+		case SHT_NOTE:
+		case SHT_INIT_ARRAY:
+		case SHT_FINI_ARRAY:
+		case SHT_PREINIT_ARRAY:
+		case SHT_X86_64_UNWIND:
+		{
+			InputSection isec;
+			isec._file = file_no;
+			isec._shndx = i;
+			isec._discarded = discarded[i];
+			obj._sections[i] = input_sections.size();
+			input_sections.emplace_back(isec);
+			break;
+		}
+		case SHT_REL:
+			return false;
+		default:
+			break;
+		}
+	}
+
+	/* 再配置情報を対象のセクションに結びつける */
+	for (size_t i = 0; i < obj._shnum; ++i)
+	{
+		const auto &shdr = obj._shdrs[i];
+		if (SHT_RELA == shdr.sh_type && shdr.sh_info < obj._shnum && obj._sections[shdr.sh_info] >= 0)
+		{
+			input_sections[obj._sections[shdr.sh_info]]._rela = i;
+		}
+	}
+
+	/* 大域シンボルを登録する */
+	obj._symbols.assign(obj._symnum, -1);
+	for (size_t i = obj._first_global; i < obj._symnum; ++i)
+	{
+		const auto &esym = obj._syms[i];
+		int idx = intern(obj._strtab + esym.st_name);
+		obj._symbols[i] = idx;
+		auto &sym = symbols[idx];
+
+		if (SHN_UNDEF == esym.st_shndx)
+		{
+			if (STB_WEAK != ELF64_ST_BIND(esym.st_info))
+			{
+				sym._strong_ref = true;
+			}
+			continue;
+		}
+
+		if (SHN_COMMON == esym.st_shndx)
+		{
+			if (sym._file < 0 || (sym._common && files[sym._file]._syms[sym._index].st_size < esym.st_size))
+			{
+				sym._file = file_no;
+				sym._index = i;
+				sym._common = true;
+			}
+			continue;
+		}
+
+		/* 破棄したセクションに定義されたシンボルは定義とみなさない */
+		if (esym.st_shndx < SHN_LORESERVE && (obj._sections[esym.st_shndx] < 0 || discarded[esym.st_shndx]))
+		{
+			continue;
+		}
+
+		bool weak = (STB_WEAK == ELF64_ST_BIND(esym.st_info));
+		if (sym._file < 0 || sym._common || (sym._weak && !weak))
+		{
+			sym._file = file_no;
+			sym._index = i;
+			sym._weak = weak;
+			sym._common = false;
+		}
+		else if (!sym._weak && !weak)
+		{
+			/* 多重定義 */
+			return false;
+		}
+	}
+
+	files.emplace_back(move(obj));
+	return true;
+}
+
+/**
+ * @brief 静的ライブラリを読み込み、シンボルテーブルを解析する。メンバはまだ読み込まない
+ *
+ * @param path ファイルのパス
+ * @return true 読み込みに成功した
+ * @return false ファイルがないか、対応していない形式
+ */
+bool Linker::load_archive(const string &path)
+{
+	size_t size = 0;
+	auto data = read_file(path, size);
+	if (!data || size < 8 || 0 != memcmp(data, "!<arch>\n", 8))
+	{
+		return false;
+	}
+
+	Archive ar;
+	ar._path = path;
+	ar._data = data;
+	ar._size = size;
+
+	const uint8_t *armap = nullptr;
+	size_t armap_size = 0;
+
+	for (size_t pos = 8; pos + sizeof(ar_hdr) <= size;)
+	{
+		auto hdr = reinterpret_cast<const char *>(data + pos);
+		string_view name(hdr, 16);
+		size_t len = std::strtoull(string(hdr + 48, 10).c_str(), nullptr, 10);
+		auto body = data + pos + sizeof(ar_hdr);
+
+		if (name.starts_with("/ "))
+		{
+			armap = body;
+			armap_size = len;
+		}
+		else if (name.starts_with("// "))
+		{
+			ar._long_names = string_view(reinterpret_cast<const char *>(body), len);
+		}
+		else if (name.starts_with("/SYM64/"))
+		{
+			return false;
+		}
+
+		pos += sizeof(ar_hdr) + len;
+		pos += pos & 1;
+	}
+
+	if (!armap || armap_size < 4)
+	{
+		return false;
+	}
+
+	uint32_t n = read_be32(armap);
+	auto names = reinterpret_cast<const char *>(armap + 4 + 4 * n);
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		string_view name(names);
+		ar._index.emplace_back(name, read_be32(armap + 4 + 4 * i));
+		names += name.size() + 1;
+	}
+
+	archives.emplace_back(move(ar));
+	return true;
+}
+
+/**
+ * @brief 未定義のシンボルを定義するメンバを、変化がなくなるまで静的ライブラリから取り出して読み込む。
+ * 弱い参照しかないシンボルのためにはメンバを取り出さない
+ *
+ * @return true 成功した
+ * @return false 対応していないメンバが含まれていた
+ */
+bool Linker::extract_members()
+{
+	for (bool changed = true; changed;)
+	{
+		changed = false;
+		for (auto &ar : archives)
+		{
+			for (const auto &[name, pos] : ar._index)
+			{
+				if (ar._extracted.contains(pos))
+				{
+					continue;
+				}
+
+				auto it = symbol_map.find(string(name));
+				if (symbol_map.end() == it || symbols[it->second]._file >= 0 || !symbols[it->second]._strong_ref)
+				{
+					continue;
+				}
+
+				ar._extracted.insert(pos);
+				if (pos + sizeof(ar_hdr) > ar._size)
+				{
+					return false;
+				}
+
+				/* メンバ名。"/123"の形式なら長いメンバ名のテーブルを参照する */
+				auto hdr = reinterpret_cast<const char *>(ar._data + pos);
+				string_view member(hdr, 16);
+				if (member.starts_with('/') && member.size() > 1 && std::isdigit(static_cast<unsigned char>(member[1])))
+				{
+					member = ar._long_names.substr(std::strtoull(string(member.substr(1)).c_str(), nullptr, 10));
+				}
+				member = member.substr(0, member.find('/'));
+
+				/* ELFの構造体を読むためにアラインメントされた領域にコピーする */
+				size_t len = std::strtoull(string(hdr + 48, 10).c_str(), nullptr, 10);
+				auto buf = make_unique_for_overwrite<uint8_t[]>(len);
+				memcpy(buf.get(), ar._data + pos + sizeof(ar_hdr), len);
+				buffers.emplace_back(move(buf));
+
+				if (!load_object(ar._path + "(" + string(member) + ")", buffers.back().get(), len))
+				{
+					return false;
+				}
+				changed = true;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief 大域シンボルの番号を返す。初めて現れた名前なら未定義のシンボルとして登録する
+ *
+ * @param name シンボル名
+ * @return 大域シンボルの番号
+ */
+int Linker::intern(const string_view &name)
+{
+	auto [it, inserted] = symbol_map.try_emplace(string(name), symbols.size());
+	if (inserted)
+	{
+		symbols.emplace_back();
+		symbols.back()._name = name;
+	}
+	return it->second;
+}
+
+/**
+ * @brief 入力セクションを出力する出力セクションの番号を返す。まだなければ作成する
+ *
+ * @param shdr 入力セクションのヘッダ
+ * @param name 入力セクション名
+ * @return 出力セクションの番号。出力しない場合は-1、対応していないセクションは-2
+ */
+int Linker::output_section(const Elf64_Shdr &shdr, const string_view &name)
+{
+	/* 名前の接頭辞でまとめる出力セクション */
+	static const std::pair<string_view, string_view> rules[] = {
+		{".text", ".text"},
+		{".rodata", ".rodata"},
+		{".data.rel.ro", ".data.rel.ro"},
+		{".data", ".data"},
+		{".bss", ".bss"},
+		{".tdata", ".tdata"},
+		{".tbss", ".tbss"},
+		{".init_array", ".init_array"},
+		{".fini_array", ".fini_array"},
+		{".gcc_except_table", ".gcc_except_table"},
+	};
+
+	/* 出力セクションの配置順 */
+	static const std::unordered_map<string_view, int> ranks = {
+		{".rela.iplt", 1},
+		{".rodata", 2},
+		{".eh_frame", 4},
+		{".gcc_except_table", 5},
+		{".init", 100},
+		{".iplt", 101},
+		{".text", 102},
+		{".fini", 104},
+		{".tdata", 200},
+		{".tbss", 201},
+		{".preinit_array", 202},
+		{".init_array", 203},
+		{".fini_array", 204},
+		{".data.rel.ro", 205},
+		{".got", 206},
+		{".data", 207},
+		{".bss", 300},
+	};
+
+	/* グローバルコンストラクタの古い形式には対応しない */
+	if (".ctors" == name || ".dtors" == name || name.starts_with(".ctors.") || name.starts_with(".dtors."))
+	{
+		return -2;
+	}
+
+	if (!(shdr.sh_flags & SHF_ALLOC))
+	{
+		/* メモリに配置しないセクションはデバッグ情報だけを残す */
+		if (!name.starts_with(".debug_"))
+		{
+			return -1;
+		}
+	}
+	else if (".note.gnu.property" == name || (shdr.sh_flags & SHF_EXCLUDE))
+	{
+		return -1;
+	}
+
+	string out_name(name);
+	for (const auto &[prefix, out] : rules)
+	{
+		if (name == prefix || (name.starts_with(prefix) && '.' == name[prefix.size()]))
+		{
+			out_name = out;
+			break;
+		}
+	}
+
+	auto it = output_map.find(out_name);
+	if (output_map.end() != it)
+	{
+		auto &osec = output_sections[it->second];
+		if (SHT_NOBITS == osec._type && SHT_NOBITS != shdr.sh_type)
+		{
+			osec._type = SHT_PROGBITS;
+		}
+		return it->second;
+	}
+
+	OutputSection osec;
+	osec._name = out_name;
+	osec._type = shdr.sh_type;
+	osec._flags = shdr.sh_flags & (SHF_ALLOC | SHF_WRITE | SHF_EXECINSTR | SHF_TLS);
+
+	if (ranks.contains(out_name))
+	{
+		osec._rank = ranks.at(out_name);
+	}
+	else if (!(shdr.sh_flags & SHF_ALLOC))
+	{
+		osec._rank = 400;
+	}
+	else if (shdr.sh_flags & SHF_EXECINSTR)
+	{
+		osec._rank = 103;
+	}
+	else if (shdr.sh_flags & SHF_WRITE)
+	{
+		osec._rank = SHT_NOBITS == shdr.sh_type ? 301 : 208;
+	}
+	else
+	{
+		osec._rank = SHT_NOTE == shdr.sh_type ? 0 : 3;
+	}
+
+	output_map.emplace(out_name, output_sections.size());
+	output_sections.emplace_back(osec);
+	return output_sections.size() - 1;
+}
+
+/**
+ * @brief 入力セクションを出力セクションに振り分ける
+ *
+ * @return true 成功した
+ * @return false 対応していないセクションが含まれていた
+ */
+bool Linker::create_output_sections()
+{
+	for (size_t i = 0; i < input_sections.size(); ++i)
+	{
+		auto &isec = input_sections[i];
+		if (isec._discarded)
+		{
+			continue;
+		}
+
+		const auto &file = files[isec._file];
+		const auto &shdr = file._shdrs[isec._shndx];
+		string_view name = reinterpret_cast<const char *>(file._data + file._shdrs[reinterpret_cast<const Elf64_Ehdr *>(file._data)->e_shstrndx].sh_offset + shdr.sh_name);
+
+		int out = output_section(shdr, name);
+		if (-2 == out)
+		{
+			return false;
+		}
+		if (out < 0)
+		{
+			continue;
+		}
+
+		isec._output = out;
+		output_sections[out]._members.emplace_back(i);
+	}
+
+	/* 初期化関数の配列は優先度の順に並べる */
+	for (auto &osec : output_sections)
+	{
+		if (SHT_INIT_ARRAY != osec._type && SHT_FINI_ARRAY != osec._type && SHT_PREINIT_ARRAY != osec._type)
+		{
+			continue;
+		}
+
+		std::stable_sort(osec._members.begin(), osec._members.end(), [](const int &a, const int &b)
+						 {
+			auto name = [](const int &i) {
+				const auto &file = files[input_sections[i]._file];
+				auto shstrtab = file._data + file._shdrs[reinterpret_cast<const Elf64_Ehdr *>(file._data)->e_shstrndx].sh_offset;
+				return string_view(reinterpret_cast<const char *>(shstrtab + file._shdrs[input_sections[i]._shndx].sh_name));
+			};
+			return array_priority(name(a)) < array_priority(name(b)); });
+	}
+
+	/* コモンシンボルは.bssに割り当てる */
+	for (size_t i = 0; i < symbols.size(); ++i)
+	{
+		if (symbols[i]._common)
+		{
+			commons.emplace_back(i);
+		}
+	}
+
+	if (output_map.contains(".bss"))
+	{
+		bss = output_map.at(".bss");
+	}
+	else if (!commons.empty())
+	{
+		Elf64_Shdr shdr = {};
+		shdr.sh_type = SHT_NOBITS;
+		shdr.sh_flags = SHF_ALLOC | SHF_WRITE;
+		bss = output_section(shdr, ".bss");
+	}
+	return true;
+}
+
+/**
+ * @brief 参照されているが定義されていない、リンカが定義するシンボルを登録する。値はレイアウト後に決める
+ *
+ */
+void Linker::define_linker_symbols()
+{
+	vector<string> names = {
+		"__ehdr_start",
+		"__executable_start",
+		"_GLOBAL_OFFSET_TABLE_",
+		"__preinit_array_start",
+		"__preinit_array_end",
+		"__init_array_start",
+		"__init_array_end",
+		"__fini_array_start",
+		"__fini_array_end",
+		"__rela_iplt_start",
+		"__rela_iplt_end",
+		"_etext",
+		"etext",
+		"__etext",
+		"_edata",
+		"edata",
+		"__bss_start",
+		"_end",
+		"end",
+	};
+
+	for (const auto &osec : output_sections)
+	{
+		if (is_c_identifier(osec._name))
+		{
+			names.emplace_back("__start_" + osec._name);
+			names.emplace_back("__stop_" + osec._name);
+		}
+	}
+
+	for (const auto &name : names)
+	{
+		auto it = symbol_map.find(name);
+		if (symbol_map.end() != it && symbols[it->second]._file < 0)
+		{
+			symbols[it->second]._linker = true;
+		}
+	}
+}
+
+/**
+ * @brief 再配置を調べ、GOTとIPLT(STT_GNU_IFUNCシンボルの呼び出し口)のエントリを割り当てる
+ *
+ * @return true 成功した
+ * @return false 対応していない再配置が含まれていた
+ */
+bool Linker::scan_relocations()
+{
+	for (const auto &isec : input_sections)
+	{
+		if (isec._output < 0 || 0 == isec._rela)
+		{
+			continue;
+		}
+
+		const auto &file = files[isec._file];
+		const auto &shdr = file._shdrs[isec._rela];
+		auto rels = reinterpret_cast<const Elf64_Rela *>(file._data + shdr.sh_offset);
+		bool alloc = file._shdrs[isec._shndx].sh_flags & SHF_ALLOC;
+
+		for (size_t i = 0; i < shdr.sh_size / sizeof(Elf64_Rela); ++i)
+		{
+			auto type = ELF64_R_TYPE(rels[i].r_info);
+			auto symidx = ELF64_R_SYM(rels[i].r_info);
+
+			switch (type)
+			{
+			case R_X86_64_NONE:
+			case R_X86_64_64:
+			case R_X86_64_PC32:
+			case R_X86_64_PLT32:
+			case R_X86_64_32:
+			case R_X86_64_32S:
+			case R_X86_64_PC64:
+			case R_X86_64_GOTPC32:
+			case R_X86_64_TPOFF32:
+			case R_X86_64_TPOFF64:
+			case R_X86_64_DTPOFF32:
+			case R_X86_64_DTPOFF64:
+			case R_X86_64_GOTPCREL:
+			case R_X86_64_GOTPCRELX:
+			case R_X86_64_REX_GOTPCRELX:
+			case R_X86_64_GOTTPOFF:
+				break;
+			default:
+				return false;
+			}
+
+			if (0 == symidx || symidx >= file._symnum)
+			{
+				continue;
+			}
+
+			auto target = resolve(isec._file, symidx);
+			if (target._ifunc && alloc && !iplt_map.contains(target._key))
+			{
+				iplt_map.emplace(target._key, iplt_entries.size());
+				iplt_entries.emplace_back(target._key);
+			}
+
+			bool tls = (R_X86_64_GOTTPOFF == type);
+			if (tls || R_X86_64_GOTPCREL == type || R_X86_64_GOTPCRELX == type || R_X86_64_REX_GOTPCRELX == type)
+			{
+				std::tuple<int, int, bool> key = {target._key.first, target._key.second, tls};
+				if (!got_map.contains(key))
+				{
+					got_map.emplace(key, got_entries.size());
+					got_entries.emplace_back(target._key, tls);
+				}
+			}
+		}
+	}
+
+	/* リンカが作成するセクション */
+	auto create = [](const string &name, const uint32_t &type, const uint64_t &flags, const uint64_t &align, const uint64_t &size)
+	{
+		Elf64_Shdr shdr = {};
+		shdr.sh_type = type;
+		shdr.sh_flags = flags;
+		int idx = output_section(shdr, name);
+		output_sections[idx]._align = align;
+		output_sections[idx]._size = size;
+		return idx;
+	};
+
+	/* GOTの後ろにIPLTから参照するエントリを置く */
+	if (!got_entries.empty() || !iplt_entries.empty() || symbol_map.contains("_GLOBAL_OFFSET_TABLE_"))
+	{
+		got = create(".got", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8, 8 * (got_entries.size() + iplt_entries.size()));
+	}
+
+	if (!iplt_entries.empty())
+	{
+		iplt = create(".iplt", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16, IPLT_ENTRY_SIZE * iplt_entries.size());
+		rela_iplt = create(".rela.iplt", SHT_RELA, SHF_ALLOC, 8, sizeof(Elf64_Rela) * iplt_entries.size());
+	}
+	return true;
+}
+
+/**
+ * @brief 入力セクションと出力セクションのアドレス、ファイル内のオフセットを決める
+ *
+ */
+void Linker::layout()
+{
+	/* 出力セクション内の入力セクションの配置 */
+	for (auto &osec : output_sections)
+	{
+		for (const auto &i : osec._members)
+		{
+			auto &isec = input_sections[i];
+			const auto &shdr = files[isec._file]._shdrs[isec._shndx];
+			osec._align = std::max<uint64_t>(osec._align, std::max<uint64_t>(shdr.sh_addralign, 1));
+			isec._offset = align_to(osec._size, shdr.sh_addralign);
+			osec._size = isec._offset + shdr.sh_size;
+		}
+	}
+
+	for (const auto &i : commons)
+	{
+		auto &sym = symbols[i];
+		auto &osec = output_sections[bss];
+		const auto &esym = files[sym._file]._syms[sym._index];
+		osec._align = std::max<uint64_t>(osec._align, esym.st_value);
+		sym._value = align_to(osec._size, esym.st_value);
+		osec._size = sym._value + esym.st_size;
+	}
+
+	vector<int> order(output_sections.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [](const int &a, const int &b)
+					 { return output_sections[a]._rank < output_sections[b]._rank; });
+
+	/* プログラムヘッダの数 */
+	bool has_rx = false, has_rw = false, has_tls = false;
+	for (const auto &osec : output_sections)
+	{
+		has_rx |= (SEG_RX == segment(osec));
+		has_rw |= (SEG_RW == segment(osec));
+		has_tls |= bool(osec._flags & SHF_TLS);
+	}
+	phnum = 2 + has_rx + has_rw + has_tls;
+
+	uint64_t offset = sizeof(Elf64_Ehdr) + phnum * sizeof(Elf64_Phdr);
+	uint64_t addr = BASE_ADDRESS + offset;
+	Segment current = SEG_R;
+	int index = 1;
+
+	for (const auto &i : order)
+	{
+		auto &osec = output_sections[i];
+		osec._index = index++;
+
+		Segment seg = segment(osec);
+
+		/* セグメントの境界はページ境界に揃える */
+		if (seg != current)
+		{
+			current = seg;
+			if (SEG_NONE != seg)
+			{
+				offset = align_to(offset, SEGMENT_ALIGN);
+				addr = BASE_ADDRESS + offset;
+			}
+		}
+
+		if (SEG_NONE == seg)
+		{
+			osec._offset = offset = align_to(offset, osec._align);
+			osec._addr = 0;
+			offset += osec._size;
+			continue;
+		}
+
+		if (SHT_NOBITS != osec._type)
+		{
+			offset = align_to(offset, osec._align);
+			osec._offset = offset;
+			osec._addr = BASE_ADDRESS + offset;
+			offset += osec._size;
+			addr = BASE_ADDRESS + offset;
+			continue;
+		}
+
+		/* .tbssはスレッドごとの領域に置くので後続のセクションと重なってよい */
+		osec._offset = offset;
+		if (osec._flags & SHF_TLS)
+		{
+			osec._addr = align_to(addr, osec._align);
+			continue;
+		}
+		addr = align_to(addr, osec._align);
+		osec._addr = addr;
+		addr += osec._size;
+	}
+
+	/* スレッドローカル領域 */
+	uint64_t tls_end = 0, tls_align = 1;
+	tls_start = UINT64_MAX;
+	for (const auto &osec : output_sections)
+	{
+		if (osec._flags & SHF_TLS)
+		{
+			tls_start = std::min(tls_start, osec._addr);
+			tls_end = std::max(tls_end, osec._addr + osec._size);
+			tls_align = std::max(tls_align, osec._align);
+		}
+	}
+	if (UINT64_MAX == tls_start)
+	{
+		tls_start = tls_end = 0;
+	}
+	tls_size = align_to(tls_end - tls_start, tls_align);
+}
+
+/**
+ * @brief リンカが定義するシンボルの値を決める
+ *
+ */
+void Linker::set_linker_symbols()
+{
+	auto set = [](const string &name, const uint64_t &value)
+	{
+		auto it = symbol_map.find(name);
+		if (symbol_map.end() != it && symbols[it->second]._linker)
+		{
+			symbols[it->second]._value = value;
+		}
+	};
+
+	/* 出力セクションの先頭と末尾。セクションがなければ空の範囲にする */
+	auto range = [&set](const string &osec_name, const string &start, const string &stop)
+	{
+		uint64_t begin = BASE_ADDRESS, end = BASE_ADDRESS;
+		if (output_map.contains(osec_name))
+		{
+			const auto &osec = output_sections[output_map.at(osec_name)];
+			begin = osec._addr;
+			end = osec._addr + osec._size;
+		}
+		set(start, begin);
+		set(stop, end);
+	};
+
+	set("__ehdr_start", BASE_ADDRESS);
+	set("__executable_start", BASE_ADDRESS);
+	set("_GLOBAL_OFFSET_TABLE_", got >= 0 ? output_sections[got]._addr : BASE_ADDRESS);
+	range(".preinit_array", "__preinit_array_start", "__preinit_array_end");
+	range(".init_array", "__init_array_start", "__init_array_end");
+	range(".fini_array", "__fini_array_start", "__fini_array_end");
+	range(".rela.iplt", "__rela_iplt_start", "__rela_iplt_end");
+
+	uint64_t etext = BASE_ADDRESS, edata = BASE_ADDRESS, end = BASE_ADDRESS;
+	for (const auto &osec : output_sections)
+	{
+		if (SEG_RX == segment(osec))
+		{
+			etext = std::max(etext, osec._addr + osec._size);
+		}
+		if (SEG_RW == segment(osec) && !(osec._flags & SHF_TLS))
+		{
+			if (SHT_NOBITS != osec._type)
+			{
+				edata = std::max(edata, osec._addr + osec._size);
+			}
+			end = std::max(end, osec._addr + osec._size);
+		}
+	}
+	end = std::max(end, edata);
+
+	for (const auto &name : {"_etext", "etext", "__etext"})
+	{
+		set(name, etext);
+	}
+	for (const auto &name : {"_edata", "edata", "__bss_start"})
+	{
+		set(name, edata);
+	}
+	for (const auto &name : {"_end", "end"})
+	{
+		set(name, end);
+	}
+
+	for (const auto &osec : output_sections)
+	{
+		if (is_c_identifier(osec._name))
+		{
+			range(osec._name, "__start_" + osec._name, "__stop_" + osec._name);
+		}
+	}
+}
+
+/**
+ * @brief 出力セクションを配置するセグメントを返す
+ *
+ * @param osec 出力セクション
+ * @return セグメント
+ */
+Linker::Segment Linker::segment(const OutputSection &osec)
+{
+	return osec._rank < 100 ? SEG_R : osec._rank < 200 ? SEG_RX
+								  : osec._rank < 400   ? SEG_RW
+													   : SEG_NONE;
+}
+
+/**
+ * @brief 入力セクションの先頭アドレスを返す。メモリに配置しないセクションは出力セクション内のオフセット
+ *
+ * @param isec 入力セクションの番号
+ * @return 先頭アドレス
+ */
+uint64_t Linker::section_address(const int &isec)
+{
+	return output_sections[input_sections[isec]._output]._addr + input_sections[isec]._offset;
+}
+
+/**
+ * @brief ファイル内で定義されたシンボルのアドレスを返す
+ *
+ * @param file シンボルを定義したファイル
+ * @param sym シンボル
+ * @param ifunc STT_GNU_IFUNCシンボルかを格納する
+ * @return アドレス。出力しないセクションのシンボルなら0
+ */
+uint64_t Linker::symbol_value(const int &file, const Elf64_Sym &sym, bool &ifunc)
+{
+	ifunc = (STT_GNU_IFUNC == ELF64_ST_TYPE(sym.st_info));
+
+	if (SHN_ABS == sym.st_shndx)
+	{
+		return sym.st_value;
+	}
+	if (SHN_UNDEF == sym.st_shndx || sym.st_shndx >= SHN_LORESERVE)
+	{
+		return 0;
+	}
+
+	int isec = files[file]._sections[sym.st_shndx];
+	if (isec < 0 || input_sections[isec]._output < 0)
+	{
+		return 0;
+	}
+	return section_address(isec) + sym.st_value;
+}
+
+/**
+ * @brief 再配置が参照するシンボルを解決する
+ *
+ * @param file 再配置を含むファイル
+ * @param symidx ファイル内のシンボル番号
+ * @return 解決結果
+ */
+Linker::Target Linker::resolve(const int &file, const size_t &symidx)
+{
+	const auto &obj = files[file];
+	if (symidx >= obj._first_global)
+	{
+		return resolve_global(obj._symbols[symidx]);
+	}
+
+	Target target;
+	target._key = {file, int(symidx)};
+	target._value = symbol_value(file, obj._syms[symidx], target._ifunc);
+	return target;
+}
+
+/**
+ * @brief 大域シンボルを解決する。未定義の弱いシンボルは0
+ *
+ * @param idx 大域シンボルの番号
+ * @return 解決結果
+ */
+Linker::Target Linker::resolve_global(const int &idx)
+{
+	Target target;
+	target._key = {-1, idx};
+
+	const auto &sym = symbols[idx];
+	if (sym._linker)
+	{
+		target._value = sym._value;
+	}
+	else if (sym._common)
+	{
+		target._value = output_sections[bss]._addr + sym._value;
+	}
+	else if (sym._file >= 0)
+	{
+		target._value = symbol_value(sym._file, files[sym._file]._syms[sym._index], target._ifunc);
+	}
+	return target;
+}
+
+/**
+ * @brief GOT、IPLTのキーからシンボルを解決する
+ *
+ * @param key キー
+ * @return 解決結果
+ */
+Linker::Target Linker::resolve_key(const std::pair<int, int> &key)
+{
+	return key.first < 0 ? resolve_global(key.second) : resolve(key.first, key.second);
+}
+
+/**
+ * @brief シンボルのGOTエントリのアドレスを返す
+ *
+ * @param key シンボルのキー
+ * @param tls スレッドポインタからのオフセットを格納するエントリか
+ * @return アドレス
+ */
+uint64_t Linker::got_address(const std::pair<int, int> &key, const bool &tls)
+{
+	return output_sections[got]._addr + 8 * got_map.at({key.first, key.second, tls});
+}
+
+/**
+ * @brief STT_GNU_IFUNCシンボルのIPLTエントリのアドレスを返す
+ *
+ * @param key シンボルのキー
+ * @return アドレス
+ */
+uint64_t Linker::iplt_address(const std::pair<int, int> &key)
+{
+	return output_sections[iplt]._addr + IPLT_ENTRY_SIZE * iplt_map.at(key);
+}
+
+/**
+ * @brief GOT、IPLT、IPLTの再配置(R_X86_64_IRELATIVE)の内容を書き込む
+ *
+ * @param buf 出力ファイルの内容
+ */
+void Linker::write_synthetic_sections(vector<uint8_t> &buf)
+{
+	uint64_t tp = tls_start + tls_size;
+
+	if (got >= 0)
+	{
+		auto p = buf.data() + output_sections[got]._offset;
+		for (size_t i = 0; i < got_entries.size(); ++i)
+		{
+			const auto &[key, tls] = got_entries[i];
+			auto target = resolve_key(key);
+			uint64_t value = tls ? target._value - tp : target._ifunc ? iplt_address(key)
+																	: target._value;
+			memcpy(p + 8 * i, &value, 8);
+		}
+	}
+
+	if (iplt < 0)
+	{
+		return;
+	}
+
+	/* IPLTのエントリはGOTの後ろに置いたエントリを介してジャンプする。エントリはlibcの起動時に書き込まれる */
+	const auto &code = output_sections[iplt];
+	auto rela = reinterpret_cast<Elf64_Rela *>(buf.data() + output_sections[rela_iplt]._offset);
+	for (size_t i = 0; i < iplt_entries.size(); ++i)
+	{
+		uint64_t slot = output_sections[got]._addr + 8 * (got_entries.size() + i);
+		uint64_t entry = code._addr + IPLT_ENTRY_SIZE * i;
+		int32_t disp = slot - (entry + 6);
+
+		auto p = buf.data() + code._offset + IPLT_ENTRY_SIZE * i;
+		memset(p, 0xcc, IPLT_ENTRY_SIZE);
+		p[0] = 0xff;
+		p[1] = 0x25;
+		memcpy(p + 2, &disp, 4);
+
+		rela[i].r_offset = slot;
+		rela[i].r_info = ELF64_R_INFO(0, R_X86_64_IRELATIVE);
+		rela[i].r_addend = resolve_key(iplt_entries[i])._value;
+	}
+}
+
+/**
+ * @brief 出力するすべての入力セクションの再配置を解決する
+ *
+ * @param buf 出力ファイルの内容
+ * @return true 成功した
+ * @return false 再配置の値が範囲外になった
+ */
+bool Linker::apply_relocations(vector<uint8_t> &buf)
+{
+	uint64_t tp = tls_start + tls_size;
+	bool ok = true;
+
+	for (size_t n = 0; n < input_sections.size(); ++n)
+	{
+		const auto &isec = input_sections[n];
+		if (isec._output < 0 || 0 == isec._rela)
+		{
+			continue;
+		}
+
+		const auto &file = files[isec._file];
+		const auto &shdr = file._shdrs[isec._rela];
+		auto rels = reinterpret_cast<const Elf64_Rela *>(file._data + shdr.sh_offset);
+		bool alloc = file._shdrs[isec._shndx].sh_flags & SHF_ALLOC;
+		auto base = buf.data() + output_sections[isec._output]._offset + isec._offset;
+		uint64_t addr = section_address(n);
+
+		for (size_t i = 0; i < shdr.sh_size / sizeof(Elf64_Rela); ++i)
+		{
+			const auto &rel = rels[i];
+			auto type = ELF64_R_TYPE(rel.r_info);
+			auto symidx = ELF64_R_SYM(rel.r_info);
+			auto loc = base + rel.r_offset;
+			uint64_t P = addr + rel.r_offset;
+			int64_t A = rel.r_addend;
+
+			Target target;
+			if (0 != symidx && symidx < file._symnum)
+			{
+				target = resolve(isec._file, symidx);
+			}
+
+			/* STT_GNU_IFUNCシンボルへの参照はIPLTのエントリを指す */
+			uint64_t S = (target._ifunc && alloc) ? iplt_address(target._key) : target._value;
+
+			auto write32 = [&](const int64_t &val, const bool &is_signed)
+			{
+				if (is_signed ? val != int32_t(val) : uint64_t(val) != uint32_t(val))
+				{
+					ok = false;
+				}
+				uint32_t v = val;
+				memcpy(loc, &v, 4);
+			};
+			auto write64 = [&](const uint64_t &val)
+			{
+				memcpy(loc, &val, 8);
+			};
+
+			switch (type)
+			{
+			case R_X86_64_NONE:
+				break;
+			case R_X86_64_64:
+				write64(S + A);
+				break;
+			case R_X86_64_PC32:
+			case R_X86_64_PLT32:
+				write32(S + A - P, true);
+				break;
+			case R_X86_64_32:
+				write32(S + A, false);
+				break;
+			case R_X86_64_32S:
+				write32(S + A, true);
+				break;
+			case R_X86_64_PC64:
+				write64(S + A - P);
+				break;
+			case R_X86_64_GOTPC32:
+				write32(output_sections[got]._addr + A - P, true);
+				break;
+			case R_X86_64_TPOFF32:
+				write32(S + A - tp, true);
+				break;
+			case R_X86_64_TPOFF64:
+				write64(S + A - tp);
+				break;
+			case R_X86_64_DTPOFF32:
+				write32(S + A - tls_start, true);
+				break;
+			case R_X86_64_DTPOFF64:
+				write64(S + A - tls_start);
+				break;
+			case R_X86_64_GOTPCREL:
+			case R_X86_64_GOTPCRELX:
+			case R_X86_64_REX_GOTPCRELX:
+				write32(got_address(target._key, false) + A - P, true);
+				break;
+			case R_X86_64_GOTTPOFF:
+				write32(got_address(target._key, true) + A - P, true);
+				break;
+			default:
+				unreachable();
+			}
+		}
+	}
+	return ok;
+}
+
+/**
+ * @brief 出力ファイルのシンボルテーブルを作成する。セクションと.Lで始まるラベル以外の局所シンボルと、定義された大域シンボルを出力する
+ *
+ * @param symtab シンボルテーブルの出力先
+ * @param strtab シンボル名の文字列テーブルの出力先
+ * @return 局所シンボルの数(シンボルテーブルのsh_info)
+ */
+size_t Linker::write_symtab(vector<uint8_t> &symtab, string &strtab)
+{
+	vector<Elf64_Sym> syms(1);
+	strtab.assign(1, '\0');
+
+	auto add = [&](const int &file, const Elf64_Sym &esym, const string_view &name)
+	{
+		Elf64_Sym out = esym;
+		bool dummy = false;
+		if (SHN_ABS != esym.st_shndx)
+		{
+			int isec = files[file]._sections[esym.st_shndx];
+			out.st_shndx = output_sections[input_sections[isec]._output]._index;
+			out.st_value = symbol_value(file, esym, dummy);
+		}
+		/* TLSシンボルの値はスレッドローカル領域の先頭からのオフセット */
+		if (STT_TLS == ELF64_ST_TYPE(esym.st_info))
+		{
+			out.st_value -= tls_start;
+		}
+		out.st_name = strtab.size();
+		strtab.append(name);
+		strtab.push_back('\0');
+		syms.emplace_back(out);
+	};
+
+	auto is_output = [](const int &file, const Elf64_Sym &esym)
+	{
+		if (SHN_ABS == esym.st_shndx)
+		{
+			return true;
+		}
+		if (SHN_UNDEF == esym.st_shndx || esym.st_shndx >= SHN_LORESERVE)
+		{
+			return false;
+		}
+		int isec = files[file]._sections[esym.st_shndx];
+		return isec >= 0 && input_sections[isec]._output >= 0;
+	};
+
+	for (size_t f = 0; f < files.size(); ++f)
+	{
+		const auto &obj = files[f];
+		for (size_t i = 1; i < obj._first_global; ++i)
+		{
+			const auto &esym = obj._syms[i];
+			string_view name = obj._strtab + esym.st_name;
+			auto type = ELF64_ST_TYPE(esym.st_info);
+			if (STT_SECTION == type || STT_FILE == type || name.empty() || name.starts_with(".L") || !is_output(f, esym))
+			{
+				continue;
+			}
+			add(f, esym, name);
+		}
+	}
+
+	size_t nlocal = syms.size();
+
+	for (const auto &sym : symbols)
+	{
+		if (sym._linker)
+		{
+			Elf64_Sym out = {};
+			out.st_name = strtab.size();
+			out.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+			out.st_shndx = SHN_ABS;
+			out.st_value = sym._value;
+			strtab.append(sym._name);
+			strtab.push_back('\0');
+			syms.emplace_back(out);
+			continue;
+		}
+
+		if (sym._file < 0)
+		{
+			continue;
+		}
+
+		const auto &esym = files[sym._file]._syms[sym._index];
+		if (sym._common)
+		{
+			Elf64_Sym out = esym;
+			out.st_name = strtab.size();
+			out.st_shndx = output_sections[bss]._index;
+			out.st_value = output_sections[bss]._addr + sym._value;
+			strtab.append(sym._name);
+			strtab.push_back('\0');
+			syms.emplace_back(out);
+		}
+		else if (is_output(sym._file, esym))
+		{
+			add(sym._file, esym, sym._name);
+		}
+	}
+
+	symtab.resize(syms.size() * sizeof(Elf64_Sym));
+	memcpy(symtab.data(), syms.data(), symtab.size());
+	return nlocal;
+}
+
+/**
+ * @brief 実行ファイルを書き出す
+ *
+ * @param output 出力先のパス
+ * @return true 成功した
+ * @return false 再配置の値が範囲外になった、またはエントリポイントがない
+ */
+bool Linker::write_output(const string &output)
+{
+	auto entry = symbol_map.find("_start");
+	if (symbol_map.end() == entry || symbols[entry->second]._file < 0)
+	{
+		return false;
+	}
+
+	/* セクションの内容 */
+	uint64_t size = 0;
+	for (const auto &osec : output_sections)
+	{
+		if (SHT_NOBITS != osec._type)
+		{
+			size = std::max(size, osec._offset + osec._size);
+		}
+	}
+
+	vector<uint8_t> symtab;
+	string strtab;
+	size_t nlocal = write_symtab(symtab, strtab);
+
+	string shstrtab(1, '\0');
+	auto add_name = [&shstrtab](const string &name)
+	{
+		uint32_t pos = shstrtab.size();
+		shstrtab.append(name);
+		shstrtab.push_back('\0');
+		return pos;
+	};
+
+	uint64_t symtab_offset = align_to(size, 8);
+	uint64_t strtab_offset = symtab_offset + symtab.size();
+	uint64_t shstrtab_offset = strtab_offset + strtab.size();
+
+	/* セクションヘッダ */
+	size_t shnum = output_sections.size() + 4;
+	vector<Elf64_Shdr> shdrs(shnum);
+	for (const auto &osec : output_sections)
+	{
+		auto &shdr = shdrs[osec._index];
+		shdr.sh_name = add_name(osec._name);
+		shdr.sh_type = osec._type;
+		shdr.sh_flags = osec._flags;
+		shdr.sh_addr = osec._addr;
+		shdr.sh_offset = osec._offset;
+		shdr.sh_size = osec._size;
+		shdr.sh_addralign = osec._align;
+		if (SHT_RELA == osec._type)
+		{
+			shdr.sh_entsize = sizeof(Elf64_Rela);
+		}
+		else if (SHT_INIT_ARRAY == osec._type || SHT_FINI_ARRAY == osec._type || SHT_PREINIT_ARRAY == osec._type)
+		{
+			shdr.sh_entsize = 8;
+		}
+	}
+
+	size_t symtab_index = output_sections.size() + 1;
+	shdrs[symtab_index].sh_name = add_name(".symtab");
+	shdrs[symtab_index].sh_type = SHT_SYMTAB;
+	shdrs[symtab_index].sh_offset = symtab_offset;
+	shdrs[symtab_index].sh_size = symtab.size();
+	shdrs[symtab_index].sh_link = symtab_index + 1;
+	shdrs[symtab_index].sh_info = nlocal;
+	shdrs[symtab_index].sh_addralign = 8;
+	shdrs[symtab_index].sh_entsize = sizeof(Elf64_Sym);
+
+	shdrs[symtab_index + 1].sh_name = add_name(".strtab");
+	shdrs[symtab_index + 1].sh_type = SHT_STRTAB;
+	shdrs[symtab_index + 1].sh_offset = strtab_offset;
+	shdrs[symtab_index + 1].sh_size = strtab.size();
+	shdrs[symtab_index + 1].sh_addralign = 1;
+
+	shdrs[symtab_index + 2].sh_name = add_name(".shstrtab");
+	shdrs[symtab_index + 2].sh_type = SHT_STRTAB;
+	shdrs[symtab_index + 2].sh_offset = shstrtab_offset;
+	shdrs[symtab_index + 2].sh_size = shstrtab.size();
+	shdrs[symtab_index + 2].sh_addralign = 1;
+
+	uint64_t shoff = align_to(shstrtab_offset + shstrtab.size(), 8);
+
+	/* プログラムヘッダ */
+	vector<Elf64_Phdr> phdrs;
+	for (const auto &seg : {SEG_R, SEG_RX, SEG_RW})
+	{
+		Elf64_Phdr phdr = {};
+		phdr.p_type = PT_LOAD;
+		phdr.p_flags = PF_R | (SEG_RX == seg ? PF_X : 0) | (SEG_RW == seg ? PF_W : 0);
+		phdr.p_align = SEGMENT_ALIGN;
+
+		bool found = false;
+		uint64_t file_end = 0, mem_end = 0;
+		if (SEG_R == seg)
+		{
+			file_end = sizeof(Elf64_Ehdr) + phnum * sizeof(Elf64_Phdr);
+			mem_end = BASE_ADDRESS + file_end;
+		}
+		for (const auto &osec : output_sections)
+		{
+			if (segment(osec) != seg)
+			{
+				continue;
+			}
+			if (!found || osec._addr < phdr.p_vaddr)
+			{
+				phdr.p_vaddr = osec._addr;
+				phdr.p_offset = osec._offset;
+			}
+			found = true;
+			if (SHT_NOBITS != osec._type)
+			{
+				file_end = std::max(file_end, osec._offset + osec._size);
+			}
+			if (!(SHT_NOBITS == osec._type && (osec._flags & SHF_TLS)))
+			{
+				mem_end = std::max(mem_end, osec._addr + osec._size);
+			}
+		}
+
+		/* 先頭のセグメントはELFヘッダとプログラムヘッダを含む */
+		if (SEG_R == seg)
+		{
+			phdr.p_vaddr = BASE_ADDRESS;
+			phdr.p_offset = 0;
+			found = true;
+		}
+		if (!found)
+		{
+			continue;
+		}
+
+		phdr.p_paddr = phdr.p_vaddr;
+		phdr.p_filesz = std::max(file_end, phdr.p_offset) - phdr.p_offset;
+		phdr.p_memsz = std::max(mem_end, phdr.p_vaddr + phdr.p_filesz) - phdr.p_vaddr;
+		phdrs.emplace_back(phdr);
+	}
+
+	/* スレッドローカル領域の初期値は.tdata、残りは0で初期化する */
+	Elf64_Phdr tls = {};
+	tls.p_type = PT_TLS;
+	tls.p_flags = PF_R;
+	tls.p_vaddr = tls.p_paddr = tls_start;
+	tls.p_align = 1;
+	bool has_tls = false;
+	for (const auto &osec : output_sections)
+	{
+		if (!(osec._flags & SHF_TLS))
+		{
+			continue;
+		}
+		if (!has_tls || SHT_NOBITS != osec._type)
+		{
+			tls.p_offset = osec._offset - (osec._addr - tls_start);
+		}
+		has_tls = true;
+		if (SHT_NOBITS != osec._type)
+		{
+			tls.p_filesz = std::max(tls.p_filesz, osec._addr + osec._size - tls_start);
+		}
+		tls.p_memsz = std::max(tls.p_memsz, osec._addr + osec._size - tls_start);
+		tls.p_align = std::max(tls.p_align, osec._align);
+	}
+	if (has_tls)
+	{
+		phdrs.emplace_back(tls);
+	}
+
+	/* スタックを実行不可能にする */
+	Elf64_Phdr stack = {};
+	stack.p_type = PT_GNU_STACK;
+	stack.p_flags = PF_R | PF_W;
+	stack.p_align = 16;
+	phdrs.emplace_back(stack);
+
+	/* ELFヘッダ */
+	Elf64_Ehdr ehdr = {};
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = iplt_entries.empty() ? ELFOSABI_NONE : ELFOSABI_GNU;
+	ehdr.e_type = ET_EXEC;
+	ehdr.e_machine = EM_X86_64;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_entry = resolve_global(entry->second)._value;
+	ehdr.e_phoff = sizeof(Elf64_Ehdr);
+	ehdr.e_shoff = shoff;
+	ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+	ehdr.e_phentsize = sizeof(Elf64_Phdr);
+	ehdr.e_phnum = phdrs.size();
+	ehdr.e_shentsize = sizeof(Elf64_Shdr);
+	ehdr.e_shnum = shnum;
+	ehdr.e_shstrndx = symtab_index + 2;
+
+	vector<uint8_t> buf(shoff + shnum * sizeof(Elf64_Shdr), 0);
+	memcpy(buf.data(), &ehdr, sizeof(ehdr));
+	memcpy(buf.data() + sizeof(ehdr), phdrs.data(), phdrs.size() * sizeof(Elf64_Phdr));
+
+	for (const auto &osec : output_sections)
+	{
+		if (SHT_NOBITS == osec._type)
+		{
+			continue;
+		}
+		for (const auto &i : osec._members)
+		{
+			const auto &isec = input_sections[i];
+			const auto &shdr = files[isec._file]._shdrs[isec._shndx];
+			if (SHT_NOBITS != shdr.sh_type)
+			{
+				memcpy(buf.data() + osec._offset + isec._offset, files[isec._file]._data + shdr.sh_offset, shdr.sh_size);
+			}
+		}
+	}
+
+	write_synthetic_sections(buf);
+	if (!apply_relocations(buf))
+	{
+		return false;
+	}
+
+	memcpy(buf.data() + symtab_offset, symtab.data(), symtab.size());
+	memcpy(buf.data() + strtab_offset, strtab.data(), strtab.size());
+	memcpy(buf.data() + shstrtab_offset, shstrtab.data(), shstrtab.size());
+	memcpy(buf.data() + shoff, shdrs.data(), shdrs.size() * sizeof(Elf64_Shdr));
+
+	/* 実行中のファイルを上書きしないよう、一度削除してから作り直す */
+	unlink(output.c_str());
+	int fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0777);
+	if (fd < 0)
+	{
+		error("ファイルが開けません: " + output);
+	}
+	for (size_t pos = 0; pos < buf.size();)
+	{
+		auto n = write(fd, buf.data() + pos, buf.size() - pos);
+		if (n <= 0)
+		{
+			error("ファイルの書き込みに失敗しました: " + output);
+		}
+		pos += n;
+	}
+	close(fd);
+	return true;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file linker.hpp
+ * @author K.Fukunaga
+ * @brief オブジェクトファイルと静的ライブラリから実行ファイルを生成する内蔵リンカ
+ * @version 0.1
+ * @date 2023-08-29
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <elf.h>
+
+/**
+ * @brief fccが出力したオブジェクトファイルとcrtファイル、libc.aなどの静的ライブラリをリンクして
+ * 静的リンクされた実行ファイルを出力するクラス
+ *
+ * @details -fuse-ld=fccオプションが指定されたとき'ld'の代わりに使う。
+ * 対応していない入力(圧縮されたセクション、共有ライブラリ、未対応の再配置、未定義シンボルなど)を見つけたときは
+ * 何も出力せずにfalseを返し、呼び出し元は'ld'でリンクし直す。
+ */
+class Linker
+{
+public:
+	/* 静的メンバ関数(public) */
+	static bool link(const vector<string> &inputs, const string &output, const string &libpath, const string &gcc_libpath);
+
+private:
+	/**
+	 * @brief 出力先のセグメント
+	 *
+	 */
+	enum Segment
+	{
+		SEG_R,	  /*!< 読み込み専用 */
+		SEG_RX,	  /*!< 読み込み、実行 */
+		SEG_RW,	  /*!< 読み書き */
+		SEG_NONE, /*!< メモリに配置しない(デバッグ情報) */
+	};
+
+	/**
+	 * @brief 入力オブジェクトファイル
+	 *
+	 */
+	struct ObjectFile
+	{
+		string _name;						/*!< ファイル名(アーカイブのメンバは"アーカイブ(メンバ)") */
+		const uint8_t *_data = nullptr;		/*!< ファイルの内容 */
+		const Elf64_Shdr *_shdrs = nullptr; /*!< セクションヘッダ */
+		size_t _shnum = 0;					/*!< セクションの数 */
+		const Elf64_Sym *_syms = nullptr;	/*!< シンボルテーブル */
+		size_t _symnum = 0;					/*!< シンボルの数 */
+		size_t _first_global = 0;			/*!< 最初の大域シンボルの番号 */
+		const char *_strtab = nullptr;		/*!< シンボル名の文字列テーブル */
+		vector<int> _sections;				/*!< セクション番号から入力セクションの番号への対応。使わないセクションは-1 */
+		vector<int> _symbols;				/*!< シンボル番号から大域シンボルの番号への対応。局所シンボルは-1 */
+	};
+
+	/**
+	 * @brief 入力セクション
+	 *
+	 */
+	struct InputSection
+	{
+		int _file = 0;		  /*!< セクションを含むファイル */
+		int _shndx = 0;		  /*!< ファイル内のセクション番号 */
+		int _rela = 0;		  /*!< 再配置情報のセクション番号。なければ0 */
+		int _output = -1;	  /*!< 出力セクションの番号。出力しない場合は-1 */
+		uint64_t _offset = 0; /*!< 出力セクション内のオフセット */
+		bool _discarded = false; /*!< 重複したCOMDATグループに属するため破棄されたか */
+	};
+
+	/**
+	 * @brief 出力セクション
+	 *
+	 */
+	struct OutputSection
+	{
+		string _name;		  /*!< セクション名 */
+		uint32_t _type = 0;	  /*!< セクションの種類 */
+		uint64_t _flags = 0;  /*!< セクションの属性 */
+		uint64_t _align = 1;  /*!< アライメント */
+		int _rank = 0;		  /*!< 配置順を決める値。小さいものから順に配置する */
+		vector<int> _members; /*!< 入力セクション */
+		uint64_t _addr = 0;	  /*!< 先頭アドレス */
+		uint64_t _offset = 0; /*!< ファイル内のオフセット */
+		uint64_t _size = 0;	  /*!< サイズ */
+		int _index = 0;		  /*!< 出力するセクションヘッダの番号 */
+	};
+
+	/**
+	 * @brief 大域シンボル
+	 *
+	 */
+	struct Symbol
+	{
+		string _name;			  /*!< シンボル名 */
+		int _file = -1;			  /*!< 定義したファイル。未定義なら-1 */
+		int _index = 0;			  /*!< 定義したファイル内のシンボル番号 */
+		bool _weak = false;		  /*!< 弱いシンボルとして定義されているか */
+		bool _common = false;	  /*!< コモンシンボルとして定義されているか */
+		bool _strong_ref = false; /*!< 弱くない参照があるか */
+		bool _linker = false;	  /*!< リンカが定義するシンボルか */
+		uint64_t _value = 0;	  /*!< リンカが定義したシンボルの値、コモンシンボルの場合は.bss内のオフセット */
+	};
+
+	/**
+	 * @brief 静的ライブラリ(アーカイブ)
+	 *
+	 */
+	struct Archive
+	{
+		string _path;								/*!< ファイルパス */
+		const uint8_t *_data = nullptr;				/*!< ファイルの内容 */
+		size_t _size = 0;							/*!< ファイルのサイズ */
+		string_view _long_names;					/*!< 長いメンバ名のテーブル */
+		vector<std::pair<string_view, size_t>> _index; /*!< シンボル名と、それを定義するメンバのヘッダ位置 */
+		std::unordered_set<size_t> _extracted;		/*!< 取り出したメンバのヘッダ位置 */
+	};
+
+	/**
+	 * @brief 再配置で参照するシンボルを解決した結果
+	 *
+	 */
+	struct Target
+	{
+		uint64_t _value = 0;	/*!< シンボルのアドレス */
+		bool _ifunc = false;	/*!< STT_GNU_IFUNCシンボルか */
+		std::pair<int, int> _key; /*!< GOT、IPLTのエントリを引くためのキー。大域シンボルは(-1, 大域シンボルの番号) */
+	};
+
+	Linker();
+
+	/* 静的メンバ関数(private) */
+	static void reset();
+	static const uint8_t *read_file(const string &path, size_t &size);
+	static bool load_object(const string &name, const uint8_t *data, const size_t &size);
+	static bool load_archive(const string &path);
+	static bool extract_members();
+	static int intern(const string_view &name);
+	static int output_section(const Elf64_Shdr &shdr, const string_view &name);
+	static bool create_output_sections();
+	static void define_linker_symbols();
+	static bool scan_relocations();
+	static void layout();
+	static void set_linker_symbols();
+	static Segment segment(const OutputSection &osec);
+	static uint64_t section_address(const int &isec);
+	static uint64_t symbol_value(const int &file, const Elf64_Sym &sym, bool &ifunc);
+	static Target resolve(const int &file, const size_t &symidx);
+	static Target resolve_global(const int &idx);
+	static Target resolve_key(const std::pair<int, int> &key);
+	static uint64_t got_address(const std::pair<int, int> &key, const bool &tls);
+	static uint64_t iplt_address(const std::pair<int, int> &key);
+	static void write_synthetic_sections(vector<uint8_t> &buf);
+	static bool apply_relocations(vector<uint8_t> &buf);
+	static size_t write_symtab(vector<uint8_t> &symtab, string &strtab);
+	static bool write_output(const string &output);
+
+	static vector<unique_ptr<uint8_t[]>> buffers;
+	static vector<ObjectFile> files;
+	static vector<InputSection> input_sections;
+	static vector<OutputSection> output_sections;
+	static std::unordered_map<string, int> output_map;
+	static vector<Symbol> symbols;
+	static std::unordered_map<string, int> symbol_map;
+	static vector<Archive> archives;
+	static std::unordered_set<string> comdat_groups;
+	static std::map<std::tuple<int, int, bool>, int> got_map;
+	static vector<std::pair<std::pair<int, int>, bool>> got_entries;
+	static std::map<std::pair<int, int>, int> iplt_map;
+	static vector<std::pair<int, int>> iplt_entries;
+	static vector<int> commons;
+	static int got, iplt, rela_iplt, bss;
+	static size_t phnum;
+	static uint64_t tls_start, tls_size;
+
+	/** 実行ファイルを配置する先頭アドレス */
+	static constexpr uint64_t BASE_ADDRESS = 0x400000;
+
+	/** セグメントの境界 */
+	static constexpr uint64_t SEGMENT_ALIGN = 0x1000;
+};
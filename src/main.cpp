@@ -8,8 +8,15 @@
  *  - プリプロセス
  * 	- 構文解析：トークン・リストを抽象構文木に変換
  * 	- コード生成：アセンブリを生成
- *  - 'as'コマンドを呼び出しアセンブルする
+ *  - 'as'コマンドを呼び出しアセンブルする(-fintegrated-asオプション指定時は内蔵アセンブラでアセンブルする)
  *  - 'ld'コマンドを呼び出しリンクする
+ *
+ * コンパイル(字句解析からコード生成まで)はドライバのプロセス内で行う。
+ * -fsubprocessオプションを指定すると翻訳単位ごとに子プロセスのfccでコンパイルする。
+ * -fcacheオプションを指定するとプリプロセス済みのトークン列をキーとしてコンパイル結果をキャッシュする。
+ * 'fcc --server'で起動したコンパイルサーバは事前定義マクロとヘッダファイルを保持し、-fserverオプションを指定した
+ * fccから受け取った要求を処理する。
+ * 入力ファイルが複数ある場合、リンクまでの処理は-jオプションで指定した数まで並列に実行する。
  * 	.
  * @version 0.1
  * @date 2023-06-28
@@ -24,7 +31,18 @@
 #include "input.hpp"
 #include "postprocess.hpp"
 #include "preprocess.hpp"
+#include "scheduler.hpp"
+#include "assembler.hpp"
+#include "cache.hpp"
+#include "server.hpp"
+#include "timereport.hpp"
+#include "codegenstats.hpp"
+#include "pch.hpp"
+#include "scan.hpp"
 #include "common.hpp"
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
 
 /**
  * @brief -fccオプションを引数に追加した上でで子プロセスとしてfccを起動する。
@@ -47,12 +65,25 @@ void run_fcc(const vector<string> &args, const string &input_path, const string
 }
 
 /**
- * @brief 初期化を行う
+ * @brief 初期化を行う。
+ * 同じプロセスで複数の翻訳単位をコンパイルするため、前回のコンパイルで使った状態もここで破棄する。
+ *
  * @param in 入力引数
  */
 void initialize(const unique_ptr<Input> &in)
 {
 	init_warning_level(in->_opt_w ? 0 : 1);
+
+	/* トークンを保持する状態をすべて破棄してから、トークンのアリーナを解放する */
+	Pch::reset();
+	PreProcess::reset();
+	Object::reset();
+	Node::reset();
+	CodeGen::reset();
+	Token::reset();
+
+	/* 前回のコンパイルで使ったオブジェクトの分を除く */
+	MemReport::reset_peak();
 }
 
 /**
@@ -60,17 +91,21 @@ void initialize(const unique_ptr<Input> &in)
  *
  * @param input_path 入力先
  * @param output_path 出力先
+ * @param output_fd 0以上の場合、output_pathの代わりにこのファイルディスクリプタ(パイプ)へ出力する
+ * @param out nullptrでない場合、output_pathの代わりにこのストリームへ出力する
  */
-void fcc(const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+void fcc(const unique_ptr<Input> &in, const string &input_path, const string &output_path, const int &output_fd = -1, std::ostream *out = nullptr)
 {
 	/* 初期化 */
 	initialize(in);
 
 	/* 入力ファイルをトークナイズする */
 	auto token = Token::tokenize_file(input_path);
+	MemReport::phase("tokenize");
 
 	/* プリプロセス */
 	token = PreProcess::preprocess(move(token), in);
+	MemReport::phase("preprocess");
 
 	/* -Eオプションが指定されている場合はプリプロセス済ファイルを出力 */
 	if (in->_opt_E)
@@ -79,33 +114,314 @@ void fcc(const unique_ptr<Input> &in, const string &input_path, const string &ou
 		return;
 	}
 
+	/* -fcacheオプションが指定されていればキャッシュしたアセンブリを再利用する */
+	if (!in->_cache_dir.empty())
+	{
+		auto key = Cache::key(token.get(), in, input_path, "s");
+		string text;
+		if (!Cache::fetch(in, key, text))
+		{
+			std::ostringstream ss;
+			CodeGen::generate_code(Node::parse(token), input_path, &ss, in->_opt_g);
+			MemReport::phase("codegen");
+			text = move(ss).str();
+			Cache::store(in, key, text);
+		}
+
+		if (out)
+		{
+			*out << text;
+			return;
+		}
+		auto os = output_fd >= 0 ? open_fd(output_fd) : open_file(output_path);
+		*os << text;
+		close_file();
+		return;
+	}
+
 	/* トークン列をパースし抽象構文木を構築する */
 	auto program = Node::parse(token);
+	MemReport::phase("parse");
 
 	/* 抽象構文木を巡回しながらコード生成 */
-	CodeGen::generate_code(program, input_path, output_path, in->_opt_g);
+	if (out)
+	{
+		CodeGen::generate_code(program, input_path, out, in->_opt_g);
+		MemReport::phase("codegen");
+		return;
+	}
+	auto os = output_fd >= 0 ? open_fd(output_fd) : open_file(output_path);
+	CodeGen::generate_code(program, input_path, os, in->_opt_g);
+	close_file();
+	MemReport::phase("codegen");
 }
 
 /**
- * @brief メイン処理
+ * @brief input_pathのヘッダファイルをプリプロセス、構文解析した状態をプリコンパイル済みヘッダとしてoutput_pathに出力する(-x c-header)
  *
- * @param argc
- * @param argv
- * @return int
+ * @param in 入力引数
+ * @param input_path 入力先
+ * @param output_path 出力先
  */
-int main(int argc, char **argv)
+void compile_header(const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+{
+	initialize(in);
+
+	auto token = Token::tokenize_file(input_path);
+	MemReport::phase("tokenize");
+
+	token = PreProcess::preprocess(move(token), in);
+	MemReport::phase("preprocess");
+
+	vector<Node::Definition> definitions;
+	auto program = Node::parse(token, &definitions);
+	MemReport::phase("parse");
+
+	Pch::write(output_path, in, program.get(), definitions);
+}
+
+/**
+ * @brief input_pathのファイルをコンパイルしoutput_pathに出力する。
+ * -fsubprocessオプションが指定されていれば子プロセスのfccで、そうでなければこのプロセス内でコンパイルする。
+ *
+ * @param args もともとの引数
+ * @param in 入力引数
+ * @param input_path 入力先
+ * @param output_path 出力先
+ */
+void compile(const vector<string> &args, const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+{
+	if (in->_opt_subprocess)
+	{
+		run_fcc(args, input_path, output_path);
+	}
+	else
+	{
+		fcc(in, input_path, output_path);
+	}
+}
+
+/**
+ * @brief input_pathのアセンブリをアセンブルしてoutput_pathに出力する。
+ * -fintegrated-asオプションが指定されていれば内蔵アセンブラを、そうでなければ'as'を使う。
+ *
+ * @param in 入力引数
+ * @param input_path 入力先
+ * @param output_path 出力先
+ */
+void assemble(const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+{
+	if (in->_opt_integrated_as)
+	{
+		Assembler::assemble_file(input_path, output_path);
+	}
+	else
+	{
+		PostProcess::assemble(input_path, output_path);
+	}
+	MemReport::phase("assemble");
+}
+
+/**
+ * @brief input_pathのファイルをコンパイル、アセンブルしてオブジェクトファイルをoutput_pathに出力する。
+ * オブジェクトファイルをキャッシュし、キャッシュヒットした場合は構文解析、コード生成、アセンブルを省略する(-fcache)。
+ *
+ * @param in 入力引数
+ * @param input_path 入力先
+ * @param output_path オブジェクトファイルの出力先
+ */
+void compile_and_assemble_cached(const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+{
+	initialize(in);
+	auto token = Token::tokenize_file(input_path);
+	MemReport::phase("tokenize");
+	token = PreProcess::preprocess(move(token), in);
+	MemReport::phase("preprocess");
+
+	/* 内蔵アセンブラと'as'の出力は異なるので別のエントリにする */
+	auto key = Cache::key(token.get(), in, input_path, in->_opt_integrated_as ? "o-integrated-as" : "o-as");
+	if (Cache::fetch_file(in, key, output_path))
+	{
+		return;
+	}
+
+	std::ostringstream text;
+	CodeGen::generate_code(Node::parse(token), input_path, &text, in->_opt_g);
+	MemReport::phase("codegen");
+
+	if (in->_opt_integrated_as)
+	{
+		Assembler::assemble(text.view(), output_path);
+	}
+	else
+	{
+		auto tmpfile = PostProcess::create_tmpfile();
+		{
+			std::ofstream ofs(tmpfile);
+			ofs << text.view();
+		}
+		PostProcess::assemble(tmpfile, output_path);
+		PostProcess::remove_tmpfile(tmpfile);
+	}
+	MemReport::phase("assemble");
+
+	Cache::store_file(in, key, output_path);
+}
+
+/**
+ * @brief input_pathのファイルをコンパイル、アセンブルしてオブジェクトファイルをoutput_pathに出力する。
+ *
+ * @details -pipeオプションが指定されている場合、生成したアセンブリは一時ファイルを介さずに
+ * パイプで'as'の標準入力へ直接流し込む。コード生成とアセンブルは並行して進む。コンパイルに失敗した場合は
+ * 途中までのアセンブリから作られたオブジェクトファイルを削除する。
+ * -fintegrated-asオプションが指定されている場合、生成したアセンブリはメモリ上で内蔵アセンブラに渡す。
+ * -fintegrated-as, -fcacheオプションは一時ファイルもパイプも使わないので、-pipeオプションは無視する。
+ * @param args もともとの引数
+ * @param in 入力引数
+ * @param input_path 入力先
+ * @param output_path オブジェクトファイルの出力先
+ */
+void compile_and_assemble(const vector<string> &args, const unique_ptr<Input> &in, const string &input_path, const string &output_path)
+{
+	if (!in->_cache_dir.empty() && !in->_opt_subprocess)
+	{
+		compile_and_assemble_cached(in, input_path, output_path);
+		return;
+	}
+
+	if (in->_opt_integrated_as && !in->_opt_subprocess)
+	{
+		std::ostringstream text;
+		fcc(in, input_path, "", -1, &text);
+		Assembler::assemble(text.view(), output_path);
+		MemReport::phase("assemble");
+		return;
+	}
+
+	if (!in->_opt_pipe || in->_opt_integrated_as)
+	{
+		/* 一時ファイルを作成 */
+		auto tmpfile = PostProcess::create_tmpfile();
+		/* アセンブリコードを生成 */
+		compile(args, in, input_path, tmpfile);
+		/* アセンブル */
+		assemble(in, tmpfile, output_path);
+		/* アセンブリはもう不要 */
+		PostProcess::remove_tmpfile(tmpfile);
+		return;
+	}
+
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) < 0)
+	{
+		error("\'pipe\'に失敗しました");
+	}
+
+	/* パイプの読み出し側を標準入力として'as'を起動 */
+	pid_t as_pid = PostProcess::spawn_assembler(fds[0], output_path);
+	close(fds[0]);
+	PostProcess::discard_on_exit(output_path, as_pid);
+
+	if (in->_opt_subprocess)
+	{
+		/* 子プロセスのfccは標準出力(=パイプ)にアセンブリを出力する */
+		auto cmd(args);
+		cmd.emplace_back("-fcc");
+		cmd.emplace_back("-fcc-input");
+		cmd.emplace_back(input_path);
+		cmd.emplace_back("-fcc-output");
+		cmd.emplace_back("-");
+		pid_t fcc_pid = spawn_subprocess(cmd, -1, fds[1]);
+		close(fds[1]);
+		TimeReport::Scope scope(TimeReport::PH_SUBPROCESS);
+		wait_subprocess(fcc_pid);
+	}
+	else
+	{
+		fcc(in, input_path, "", fds[1]);
+		close(fds[1]);
+	}
+
+	/* コンパイルに成功したので出力を残す。パイプを閉じたので'as'は入力の終わりを検出して終了する */
+	PostProcess::keep_output();
+	TimeReport::Scope scope(TimeReport::PH_AS);
+	wait_subprocess(as_pid);
+	MemReport::phase("assemble");
+}
+
+/**
+ * @brief 入力ファイルの処理をジョブとして登録する。
+ * -ftime-report, -fmem-reportオプションが指定されていれば、ジョブの終了時にその入力ファイルの処理時間、メモリ使用量を報告する。
+ *
+ * @param name 入力ファイルの名前
+ * @param task 実行する処理
+ */
+void add_job(const string &name, std::function<void()> &&task)
+{
+	Scheduler::add_job([name, task = move(task)]
+					   {
+						   TimeReport::begin(name);
+						   MemReport::begin(name);
+						   task();
+						   TimeReport::end();
+						   MemReport::end(); });
+}
+
+/**
+ * @brief 引数に従ってコンパイル、アセンブル、リンクを行う
+ *
+ * @param args コマンドライン引数
+ * @return 終了ステータス
+ */
+int run(const vector<string> &args)
 {
-	/* 入力をvectorに変換 */
-	vector<string> args(argv, argv + argc);
 	/* 引数を解析してオプションを判断 */
 	auto in = Input::parse_args(args);
 	/* リンクを行うファイル */
 	vector<string> ld_args;
 
+	/* -fserverオプションが指定されていればコンパイルサーバに任せる。接続できなければこのプロセスで処理する */
+	if (!in->_server_socket.empty() && !in->_opt_fcc && !Server::is_serving())
+	{
+		int status = Server::forward(args, in->_server_socket);
+		if (status >= 0)
+		{
+			return status;
+		}
+	}
+
+	/* -ftime-reportオプションが指定されていればフェーズごとの処理時間を計測する */
+	if (in->_opt_time_report)
+	{
+		TimeReport::enable(in->_opt_time_report_json);
+	}
+
+	/* -fmem-reportオプションが指定されていればデータ構造ごとのメモリ使用量を計測する */
+	if (in->_opt_mem_report)
+	{
+		MemReport::enable();
+	}
+
+	/* -fcodegen-statsオプションが指定されていれば生成したアセンブリの命令数などを集計する */
+	if (in->_opt_codegen_stats)
+	{
+		CodeGenStats::enable();
+	}
+
+	/* -fscan=オプションが指定されていればトークナイザの走査の実装を切り替える */
+	if (!in->_opt_scan.empty() && !Scan::set_level(in->_opt_scan))
+	{
+		error("-fscan=" + in->_opt_scan + "は指定できません(scalar, sse2, avx2, autoのうちこのCPUで使えるもの)");
+	}
+
 	/* -fccオプションが指定されている場合は-fcc_input, -fcc_outputを入力、出力先としてコンパイルを実行 */
 	if (in->_opt_fcc)
 	{
+		TimeReport::begin(in->_fcc_input + " (-fcc)");
+		MemReport::begin(in->_fcc_input + " (-fcc)");
 		fcc(in, in->_fcc_input, in->_fcc_output);
+		TimeReport::end();
+		MemReport::end();
 		return 0;
 	}
 
@@ -154,56 +470,84 @@ int main(int argc, char **argv)
 			/* -Sオプションが入っていなければアセンブルする */
 			if (!in->_opt_S)
 			{
-				PostProcess::assemble(input._name, output_path);
+				add_job(input._name, [=, &in]
+								{ assemble(in, input._name, output_path); });
 			}
 			continue;
 		}
 
-		assert(input._type == FileType::FILE_C);
-
-		if (in->_opt_E)
+		/* -x c-headerが指定されていればプリコンパイル済みヘッダを出力する */
+		if (input._type == FileType::FILE_C_HEADER && !in->_opt_E)
 		{
-			run_fcc(args, input._name, output_path);
+			auto pch_path = in->_output_path.empty() ? input._name + ".pch" : in->_output_path;
+			add_job(input._name, [=, &in]
+								{ compile_header(in, input._name, pch_path); });
 			continue;
 		}
 
-		/* -Sオプションが指定されていれば単にコンパイルするだけ */
-		if (in->_opt_S)
+		assert(input._type == FileType::FILE_C || input._type == FileType::FILE_C_HEADER);
+
+		/* -E, -Sオプションが指定されていれば単にコンパイルするだけ */
+		if (in->_opt_E || in->_opt_S)
 		{
-			run_fcc(args, input._name, output_path);
+			add_job(input._name, [=, &args, &in]
+								{ compile(args, in, input._name, output_path); });
 			continue;
 		}
 
 		/* -cオプションが指定されていればコンパイル後アセンブル */
 		if (in->_opt_c)
 		{
-			/* 一時ファイルを作成 */
-			auto tmpfile = PostProcess::create_tmpfile();
-			/* アセンブリコードを生成 */
-			run_fcc(args, input._name, tmpfile);
-			/* アセンブル */
-			PostProcess::assemble(tmpfile, output_path);
+			add_job(input._name, [=, &args, &in]
+								{ compile_and_assemble(args, in, input._name, output_path); });
 			continue;
 		}
 
 		/* それ以外はコンパイル、アセンブル、リンクしたファイルを最終生成物とする */
 
-		/* 一時ファイルを作成 */
-		auto tmpfile1 = PostProcess::create_tmpfile();
-		auto tmpfile2 = PostProcess::create_tmpfile();
-		/* アセンブリコードを生成 */
-		run_fcc(args, input._name, tmpfile1);
-		/* アセンブル */
-		PostProcess::assemble(tmpfile1, tmpfile2);
-		/* リンク対象のリストに追加 */
-		ld_args.emplace_back(tmpfile2);
+		/* オブジェクトファイルを出力する一時ファイルを作成 */
+		auto tmpfile = PostProcess::create_tmpfile();
+		add_job(input._name, [=, &args, &in]
+							{ compile_and_assemble(args, in, input._name, tmpfile); });
+		/* リンク対象のリストに追加。リンクの順序はコマンドラインの順序と同じ */
+		ld_args.emplace_back(tmpfile);
 	}
 
+	/* 登録したコンパイル、アセンブルを最大-j個まで並列に実行する */
+	Scheduler::run(in->_jobs);
+
 	/* リンク */
 	if (!ld_args.empty())
 	{
-		PostProcess::run_linker(ld_args, in->_output_path.empty() ? "a.out" : in->_output_path);
+		auto output = in->_output_path.empty() ? "a.out" : in->_output_path;
+		TimeReport::begin(output + " (link)");
+		MemReport::begin(output + " (link)");
+		PostProcess::run_linker(ld_args, output, in->_opt_internal_ld);
+		MemReport::phase("link");
+		TimeReport::end();
+		MemReport::end();
 	}
 
 	return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief メイン処理
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char **argv)
+{
+	/* 入力をvectorに変換 */
+	vector<string> args(argv, argv + argc);
+
+	/* --serverが指定されていればコンパイルサーバとして起動する */
+	if (args.size() >= 2 && "--server" == args[1])
+	{
+		return Server::serve(args.size() >= 3 ? args[2] : Server::default_socket(), run);
+	}
+
+	return run(args);
+}
@@ -0,0 +1,177 @@
+/**
+ * @file memreport.cpp
+ * @author K.Fukunaga
+ * @brief コンパイラのデータ構造ごとのメモリ使用量の計測
+ * @version 0.1
+ * @date 2023-09-05
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "common.hpp"
+#include <cstdio>
+#include <sys/resource.h>
+
+/** 計測するか */
+bool MemReport::enabled = false;
+
+/** 計測中の入力ファイルの名前 */
+string MemReport::current_name;
+
+/** データ構造ごとの計測結果 */
+MemReport::Counter MemReport::counters[MK_COUNT];
+
+/** フェーズの名前と、フェーズ終了時の最大RSS(KB) */
+vector<std::pair<string, long>> MemReport::phases;
+
+/**
+ * @brief 計測を有効にする
+ *
+ */
+void MemReport::enable()
+{
+	enabled = true;
+}
+
+/**
+ * @brief 入力ファイル1つ分の計測を開始する。これまでの計測結果は破棄する。
+ *
+ * @param name 入力ファイルの名前
+ */
+void MemReport::begin(const string &name)
+{
+	if (!enabled)
+	{
+		return;
+	}
+	current_name = name;
+	for (auto &c : counters)
+	{
+		c._created = c._bytes = c._string_bytes = 0;
+		c._peak_bytes = c._live_bytes;
+	}
+	phases.clear();
+}
+
+/**
+ * @brief 生存しているオブジェクトのバイト数の最大値を現在の値に戻す。
+ * 前の翻訳単位の状態を破棄した後に呼び、その分を最大値に含めないようにする。
+ *
+ */
+void MemReport::reset_peak()
+{
+	for (auto &c : counters)
+	{
+		c._peak_bytes = c._live_bytes;
+	}
+}
+
+/**
+ * @brief フェーズの終了を記録する
+ *
+ * @param name フェーズの名前
+ */
+void MemReport::phase(const string_view &name)
+{
+	if (enabled)
+	{
+		phases.emplace_back(string(name), peak_rss());
+	}
+}
+
+/**
+ * @brief begin()からの計測結果を標準エラー出力に書き出す
+ *
+ */
+void MemReport::end()
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	char buf[256];
+	std::cerr << "メモリ使用量: " << current_name << "\n";
+	snprintf(buf, sizeof(buf), "  %-12s %14s\n", "phase", "peak RSS(KB)");
+	std::cerr << buf;
+	for (const auto &[name, rss] : phases)
+	{
+		snprintf(buf, sizeof(buf), "  %-12s %14ld\n", name.c_str(), rss);
+		std::cerr << buf;
+	}
+
+	/* リンクなど、コンパイラのデータ構造を使わない処理ではRSSのみを表示する */
+	uint64_t created = 0;
+	for (const auto &c : counters)
+	{
+		created += c._created;
+	}
+	if (0 == created)
+	{
+		std::cerr.flush();
+		return;
+	}
+
+	snprintf(buf, sizeof(buf), "  %-12s %12s %14s %14s %14s %14s\n", "class", "created", "bytes", "peak live", "strings", "arena");
+	std::cerr << buf;
+	Counter total;
+	for (int i = 0; i < MK_COUNT; ++i)
+	{
+		const auto &c = counters[i];
+		snprintf(buf, sizeof(buf), "  %-12s %12lu %14lu %14ld %14lu %14ld\n", kind_names[i].data(), c._created, c._bytes, c._peak_bytes,
+				 c._string_bytes, c._arena_bytes.load());
+		std::cerr << buf;
+		total._created += c._created;
+		total._bytes += c._bytes;
+		total._peak_bytes += c._peak_bytes;
+		total._string_bytes += c._string_bytes;
+		total._arena_bytes += c._arena_bytes;
+	}
+	snprintf(buf, sizeof(buf), "  %-12s %12lu %14lu %14ld %14lu %14ld\n", "TOTAL", total._created, total._bytes, total._peak_bytes,
+			 total._string_bytes, total._arena_bytes.load());
+	std::cerr << buf;
+	std::cerr.flush();
+}
+
+/**
+ * @brief 文字列がヒープに確保した領域のバイト数を記録する。オブジェクト内に格納される短い文字列は数えない。
+ *
+ * @param kind 文字列を保持するデータ構造
+ * @param str 文字列
+ */
+void MemReport::count_string(const Kind &kind, const string &str)
+{
+	if (!enabled)
+	{
+		return;
+	}
+	auto obj = reinterpret_cast<const char *>(&str);
+	if (str.data() < obj || str.data() >= obj + sizeof(str))
+	{
+		counters[kind]._string_bytes += str.capacity() + 1;
+	}
+}
+
+/**
+ * @brief アリーナが確保しているチャンクのバイト数の増減を記録する。計測が無効な間も記録する。
+ *
+ * @param kind アリーナから割り当てるデータ構造
+ * @param bytes 増減したバイト数
+ */
+void MemReport::arena_grown(const Kind &kind, const int64_t &bytes)
+{
+	counters[kind]._arena_bytes += bytes;
+}
+
+/**
+ * @brief このプロセスの最大RSSを返す
+ *
+ * @return 最大RSS(KB)
+ */
+long MemReport::peak_rss()
+{
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
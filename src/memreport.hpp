@@ -0,0 +1,138 @@
+/**
+ * @file memreport.hpp
+ * @author K.Fukunaga
+ * @brief コンパイラのデータ構造ごとのメモリ使用量の計測
+ * @version 0.1
+ * @date 2023-09-05
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief -fmem-reportオプションが指定されたとき、データ構造ごとの生成数、使用バイト数と
+ * フェーズごとの最大RSSを計測して報告するクラス
+ *
+ * @details 生成数はMemCountedを基底クラスに持つクラスのコンストラクタで数える。バイト数はオブジェクト自身のサイズで、
+ * ヒープに確保された文字列(Object::_nameなど)の中身は別に数える。短い文字列はオブジェクト内に格納されるので数えない。
+ * アリーナ(Arena)から割り当てるデータ構造は、アリーナが確保しているチャンクのバイト数も報告する。
+ * 集計はTimeReportと同様に入力ファイル(ジョブ)ごとに行い、begin()からend()までの結果を標準エラー出力に書き出す。
+ */
+class MemReport
+{
+public:
+	/**
+	 * @brief 計測するデータ構造
+	 *
+	 */
+	enum Kind
+	{
+		MK_TOKEN,	 /*!< Token */
+		MK_NODE,	 /*!< Node */
+		MK_TYPE,	 /*!< Type */
+		MK_MEMBER,	 /*!< Member */
+		MK_OBJECT,	 /*!< Object */
+		MK_VARSCOPE, /*!< Object::VarScope */
+		MK_HIDESET,	 /*!< Hideset */
+		MK_COUNT,	 /*!< データ構造の数 */
+	};
+
+	/* 静的メンバ関数(public) */
+	static void enable();
+	static void begin(const std::string &name);
+	static void phase(const std::string_view &name);
+	static void end();
+	static void reset_peak();
+	static void count_string(const Kind &kind, const std::string &str);
+	static void arena_grown(const Kind &kind, const int64_t &bytes);
+
+	/**
+	 * @brief オブジェクトの生成を記録する
+	 *
+	 * @param kind データ構造
+	 * @param size オブジェクトのサイズ
+	 */
+	static void created(const Kind &kind, const size_t &size)
+	{
+		if (enabled)
+		{
+			auto &c = counters[kind];
+			++c._created;
+			c._bytes += size;
+			c._live_bytes += size;
+			c._peak_bytes = std::max(c._peak_bytes, c._live_bytes);
+		}
+	}
+
+	/**
+	 * @brief オブジェクトの破棄を記録する
+	 *
+	 * @param kind データ構造
+	 * @param size オブジェクトのサイズ
+	 */
+	static void destroyed(const Kind &kind, const size_t &size)
+	{
+		/* 計測を有効にする前に生成したオブジェクトは数えない */
+		if (enabled)
+		{
+			auto &c = counters[kind];
+			c._live_bytes = std::max<int64_t>(c._live_bytes - static_cast<int64_t>(size), 0);
+		}
+	}
+
+private:
+	/**
+	 * @brief データ構造ごとの計測結果
+	 *
+	 */
+	struct Counter
+	{
+		uint64_t _created = 0;		/*!< 生成したオブジェクトの数 */
+		uint64_t _bytes = 0;		/*!< 生成したオブジェクトのバイト数の合計 */
+		int64_t _live_bytes = 0;	/*!< 現在生存しているオブジェクトのバイト数 */
+		int64_t _peak_bytes = 0;	/*!< 生存しているオブジェクトのバイト数の最大値 */
+		uint64_t _string_bytes = 0; /*!< ヒープに確保された文字列のバイト数 */
+		std::atomic<int64_t> _arena_bytes = 0; /*!< アリーナが確保しているチャンクのバイト数(翻訳単位をまたいで保持する。ヘッダファイルを先読みするスレッドからも記録する) */
+	};
+
+	MemReport();
+
+	/* 静的メンバ関数(private) */
+	static long peak_rss();
+
+	static bool enabled;
+	static std::string current_name;
+	static Counter counters[MK_COUNT];
+	static std::vector<std::pair<std::string, long>> phases;
+
+	/** データ構造の名前 */
+	static constexpr std::string_view kind_names[] = {"Token", "Node", "Type", "Member", "Object", "VarScope", "Hideset"};
+};
+
+/**
+ * @brief 基底クラスとすることで、生成と破棄をMemReportに記録する
+ *
+ * @tparam T 派生クラス
+ * @tparam K データ構造の種類
+ */
+template <class T, MemReport::Kind K>
+class MemCounted
+{
+protected:
+	MemCounted() { MemReport::created(K, sizeof(T)); }
+	MemCounted(const MemCounted &) { MemReport::created(K, sizeof(T)); }
+	MemCounted(MemCounted &&) { MemReport::created(K, sizeof(T)); }
+	MemCounted &operator=(const MemCounted &) = default;
+	MemCounted &operator=(MemCounted &&) = default;
+	~MemCounted() { MemReport::destroyed(K, sizeof(T)); }
+};
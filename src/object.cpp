@@ -30,10 +30,16 @@ unique_ptr<Object::Scope> Object::scope = make_unique<Scope>();
 
 Object::Object() = default;
 
-Object::Object(const string &name) : _name(name) {}
+Object::Object(const string &name) : _name(name)
+{
+	MemReport::count_string(MemReport::MK_OBJECT, _name);
+}
 
 Object::Object(const string &name, shared_ptr<Type> &ty)
-	: _name(name), _ty(ty) {}
+	: _name(name), _ty(ty)
+{
+	MemReport::count_string(MemReport::MK_OBJECT, _name);
+}
 
 Object::Object(unique_ptr<Node> &&body, unique_ptr<Object> &&locs) : _body(move(body)), _locals(move(locs)) {}
 
@@ -50,7 +56,7 @@ unique_ptr<Object> Object::new_var(const string &name, shared_ptr<Type> &ty)
 {
 	auto var = make_unique<Object>(name, ty);
 	var->_align = ty->_align;
-	push_scope(name)->_var = var.get();
+	push_scope(Atom(name))->_var = var.get();
 	return var;
 }
 
@@ -242,7 +248,7 @@ void Object::create_params_lvars(shared_ptr<Type> &param)
 		{
 			error_token("引数名がありません", param->_name_pos);
 		}
-		new_lvar(param->_name->_str, param);
+		new_lvar(string(param->_name->_str), param);
 	}
 }
 
@@ -270,7 +276,7 @@ void Object::leave_scope()
  * @param name 追加する変数の名前
  * @param obj 追加する変数のオブジェクト
  */
-Object::VarScope *Object::push_scope(const string &name)
+Object::VarScope *Object::push_scope(const Atom &name)
 {
 	scope->_vars = make_unique<VarScope>(move(scope->_vars), name);
 	return scope->_vars.get();
@@ -284,7 +290,7 @@ Object::VarScope *Object::push_scope(const string &name)
  */
 void Object::push_tag_scope(Token *token, const shared_ptr<Type> &ty)
 {
-	scope->_tags = make_unique<TagScope>(token->_str, ty, move(scope->_tags));
+	scope->_tags = make_unique<TagScope>(token->_atom, ty, move(scope->_tags));
 }
 
 /**
@@ -298,6 +304,17 @@ bool Object::at_outermost_scope()
 	return scope->_next == nullptr;
 }
 
+/**
+ * @brief 翻訳単位ごとの状態(変数リスト、スコープ)を初期化する
+ *
+ */
+void Object::reset()
+{
+	locals = nullptr;
+	globals = nullptr;
+	scope = make_unique<Scope>();
+}
+
 /**
  * @brief 'n'を切り上げて最も近い'align'の倍数にする。
  *
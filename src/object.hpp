@@ -26,7 +26,7 @@ struct Member;
  * @brief 変数または関数を表す。各オブジェクトは名前によって区別する
  *
  */
-class Object
+class Object : MemCounted<Object, MemReport::MK_OBJECT>
 {
 public:
 	/**
@@ -36,26 +36,26 @@ public:
 	struct TagScope
 	{
 		unique_ptr<TagScope> _next; /*!< スコープ内の次のタグ */
-		string _name = "";			/*!< 構造体の名前 */
+		Atom _name;					/*!< 構造体の名前 */
 		shared_ptr<Type> _ty;		/*!< 構造体の型 */
 
-		TagScope(const string &name, const shared_ptr<Type> &ty, unique_ptr<TagScope> &&next) : _name(name), _ty(ty), _next(std::move(next)) {}
+		TagScope(const Atom &name, const shared_ptr<Type> &ty, unique_ptr<TagScope> &&next) : _name(name), _ty(ty), _next(std::move(next)) {}
 	};
 
 	/**
 	 * @brief ローカル変数、グローバル変数、typedef, 列挙型のスコープ
 	 *
 	 */
-	struct VarScope
+	struct VarScope : MemCounted<VarScope, MemReport::MK_VARSCOPE>
 	{
 		unique_ptr<VarScope> _next;	  /*!< 次の変数  */
-		const string _name = "";	  /*!< 変数名 */
+		const Atom _name;			  /*!< 変数名 */
 		const Object *_var = nullptr; /*!< 対応する変数のオブジェクト */
 		shared_ptr<Type> type_def;	  /*!< typedefされた型  */
 		shared_ptr<Type> enum_ty;	  /*!< 列挙型の型 */
 		int enum_val = 0;			  /*!< 列挙型が表す数値 */
 
-		VarScope(unique_ptr<VarScope> &&next, const string &name) : _next(std::move(next)), _name(name) {}
+		VarScope(unique_ptr<VarScope> &&next, const Atom &name) : _next(std::move(next)), _name(name) {}
 	};
 
 	/**
@@ -184,9 +184,10 @@ public:
 	static void enter_scope();
 	static void leave_scope();
 	static bool at_outermost_scope();
-	static VarScope *push_scope(const string &name);
+	static VarScope *push_scope(const Atom &name);
 	static void push_tag_scope(Token *token, const shared_ptr<Type> &ty);
 	static int align_to(const int &n, const int &align);
+	static void reset();
 
 	/* 静的メンバ変数 */
 
@@ -196,6 +197,8 @@ public:
 	static unique_ptr<Object> globals;
 
 private:
+	friend class Pch;
+
 	/* 静的メンバ関数 (private) */
 
 	static unique_ptr<Object> new_var(const string &name, shared_ptr<Type> &ty);
@@ -14,6 +14,7 @@
 #include "parse.hpp"
 #include "tokenize.hpp"
 #include "type.hpp"
+#include "timereport.hpp"
 
 /** 現在パースしている関数 */
 static Object *current_function = nullptr;
@@ -31,6 +32,9 @@ static string cont_label = "";
 /** 現在しているswitch文のノードへのポインタ、それ以外の場合はnullptr */
 static Node *current_switch = nullptr;
 
+/** 一意な名前を生成するための通し番号 */
+static int unique_name_id = 0;
+
 /**************/
 /* Node Class */
 /**************/
@@ -55,6 +59,41 @@ Node::Node(const int64_t &val, const shared_ptr<Type> &ty, Token *token)
 
 Node::Node(const Object *var, Token *token) : _kind(NodeKind::ND_VAR), _var(var), _token(token) {}
 
+/**
+ * @brief 翻訳単位ごとのパーサーの状態を初期化する
+ *
+ */
+void Node::reset()
+{
+	current_function = nullptr;
+	gotos = nullptr;
+	labels = nullptr;
+	brk_label = "";
+	cont_label = "";
+	current_switch = nullptr;
+	unique_name_id = 0;
+}
+
+/**
+ * @brief 一意な名前を生成するための通し番号を返す
+ *
+ * @return 次に使う通し番号
+ */
+int Node::get_unique_name_id()
+{
+	return unique_name_id;
+}
+
+/**
+ * @brief 一意な名前を生成するための通し番号を設定する(プリコンパイル済みヘッダで生成した名前と重複しないようにする)
+ *
+ * @param id 次に使う通し番号
+ */
+void Node::set_unique_name_id(const int &id)
+{
+	unique_name_id = id;
+}
+
 /**
  * @brief 型キャストに対応するノードを作成する
  *
@@ -169,8 +208,9 @@ unique_ptr<Node> Node::new_sub(unique_ptr<Node> &&lhs, unique_ptr<Node> &&rhs, T
  */
 string Node::new_unique_name()
 {
-	static int id = 0;
-	return ".L.." + std::to_string(id++);
+	auto name = ".L.." + std::to_string(unique_name_id++);
+	MemReport::count_string(MemReport::MK_NODE, name);
+	return name;
 }
 
 /**
@@ -236,16 +276,21 @@ unique_ptr<Node> Node::new_inc_dec(unique_ptr<Node> &&node, Token *token, int ad
  * @brief トークン・リストを構文解析して関数ごとにASTを構築する
  *
  * @param list トークン・リスト
+ * @param definitions nullptrでなければ、関数の定義の範囲を追加する
  * @return 構文解析結果
  * @details program = (typedef | function-definition | global-variable)*
  */
-unique_ptr<Object> Node::parse(const unique_ptr<Token> &list)
+unique_ptr<Object> Node::parse(const unique_ptr<Token> &list, vector<Definition> *definitions)
 {
+	TimeReport::Scope scope(TimeReport::PH_PARSE);
+
 	auto token = list.get();
 
 	/* トークンリストを最後まで辿る*/
 	while (TokenKind::TK_EOF != token->_kind)
 	{
+		const auto start = token;
+		const auto last = Object::globals.get();
 		Object::VarAttr attr = {};
 		auto base = declspec(&token, token, &attr);
 
@@ -260,6 +305,20 @@ unique_ptr<Object> Node::parse(const unique_ptr<Token> &list)
 		if (is_function(token))
 		{
 			token = function_definition(token, move(base), &attr);
+
+			/* 関数のオブジェクトは本体より先に生成するので、生成したもののうち最も古い */
+			if (definitions)
+			{
+				auto fn = Object::globals.get();
+				while (fn->_next.get() != last)
+				{
+					fn = fn->_next.get();
+				}
+				if (fn->_is_definition)
+				{
+					definitions->push_back({start, token, Object::globals.get(), last});
+				}
+			}
 			continue;
 		}
 
@@ -682,7 +741,7 @@ Token *Node::function_definition(Token *token, shared_ptr<Type> &&base, Object::
 	}
 
 	/* 新しい関数を生成する。 */
-	auto fn = Object::new_gvar(ty->_name->_str, ty);
+	auto fn = Object::new_gvar(string(ty->_name->_str), ty);
 	/* 関数であるフラグをセット */
 	fn->_is_function = true;
 
@@ -786,7 +845,7 @@ unique_ptr<Node> Node::declaration(Token **next_token, Token *current_token, sha
 			/* ブローバル変数として仮名をつけて登録 */
 			auto var = new_anonymous_gvar(ty);
 			/* ローカル変数に名前を登録してグローバル変数のオブジェクトを参照 */
-			Object::push_scope(ty->_name->_str)->_var = var;
+			Object::push_scope(ty->_name->_atom)->_var = var;
 
 			/* 初期化式を持つ場合 */
 			if (current_token->is_equal("="))
@@ -796,7 +855,7 @@ unique_ptr<Node> Node::declaration(Token **next_token, Token *current_token, sha
 			continue;
 		}
 
-		const auto var = Object::new_lvar(ty->_name->_str, ty);
+		const auto var = Object::new_lvar(string(ty->_name->_str), ty);
 
 		/* アライン指定がある場合 */
 		if (attr && attr->_align)
@@ -956,8 +1015,7 @@ void Node::string_initializer(Token **next_token, Token *current_token, Object::
 {
 
 	/* 前後の'"'を削除 */
-	auto str = current_token->_str.substr(1);
-	str.pop_back();
+	auto str = current_token->_str.substr(1, current_token->_str.size() - 2);
 
 	if (init->_is_flexible)
 	{
@@ -1825,8 +1883,7 @@ shared_ptr<Member> Node::get_struct_member(Type *ty, Token *token)
 {
 	for (auto mem = ty->_members; mem; mem = mem->_next)
 	{
-		if (mem->_token->_str.size() == token->_str.size() &&
-			std::equal(token->_str.begin(), token->_str.end(), mem->_token->_str.begin()))
+		if (mem->_token->_atom == token->_atom)
 		{
 			return mem;
 		}
@@ -1899,26 +1956,26 @@ shared_ptr<Type> Node::declspec(Token **next_token, Token *current_token, Object
 	constexpr int SIGNED = 1 << 17;
 	constexpr int UNSIGNED = 1 << 18;
 
-	static const std::unordered_map<string_view, void (*)(int &)> add_counter = {
-		{"void", [](int &counter)
+	static const std::unordered_map<Atom, void (*)(int &)> add_counter = {
+		{Atom("void"), [](int &counter)
 		 { counter += VOID; }},
-		{"_Bool", [](int &counter)
+		{Atom("_Bool"), [](int &counter)
 		 { counter += BOOL; }},
-		{"char", [](int &counter)
+		{Atom("char"), [](int &counter)
 		 { counter += CHAR; }},
-		{"short", [](int &counter)
+		{Atom("short"), [](int &counter)
 		 { counter += SHORT; }},
-		{"int", [](int &counter)
+		{Atom("int"), [](int &counter)
 		 { counter += INT; }},
-		{"long", [](int &counter)
+		{Atom("long"), [](int &counter)
 		 { counter += LONG; }},
-		{"float", [](int &counter)
+		{Atom("float"), [](int &counter)
 		 { counter += FLOAT; }},
-		{"double", [](int &counter)
+		{Atom("double"), [](int &counter)
 		 { counter += DOUBLE; }},
-		{"signed", [](int &counter)
+		{Atom("signed"), [](int &counter)
 		 { counter |= SIGNED; }},
-		{"unsigned", [](int &counter)
+		{Atom("unsigned"), [](int &counter)
 		 { counter |= UNSIGNED; }},
 	};
 
@@ -2054,7 +2111,7 @@ shared_ptr<Type> Node::declspec(Token **next_token, Token *current_token, Object
 			continue;
 		}
 
-		auto it = add_counter.find(current_token->_str);
+		auto it = add_counter.find(current_token->_atom);
 		if (it != add_counter.end())
 		{
 			it->second(counter);
@@ -2136,7 +2193,7 @@ shared_ptr<Type> Node::enum_specifier(Token **next_token, Token *current_token)
 		}
 		first = false;
 		/* 列挙型の変数名 */
-		auto name = current_token->_str;
+		auto name = current_token->_atom;
 		current_token = current_token->_next.get();
 
 		/* 数値の指定がある場合 */
@@ -2552,15 +2609,15 @@ unique_ptr<Node> Node::to_assign(unique_ptr<Node> &&binary)
  */
 unique_ptr<Node> Node::assign(Token **next_token, Token *current_token)
 {
-	static const std::unordered_map<string, NodeKind> str_to_op = {
-		{"*=", NodeKind::ND_MUL},
-		{"/=", NodeKind::ND_DIV},
-		{"%=", NodeKind::ND_MOD},
-		{"&=", NodeKind::ND_BITAND},
-		{"|=", NodeKind::ND_BITOR},
-		{"^=", NodeKind::ND_BITXOR},
-		{"<<=", NodeKind::ND_SHL},
-		{">>=", NodeKind::ND_SHR},
+	static const std::unordered_map<Atom, NodeKind> str_to_op = {
+		{Atom("*="), NodeKind::ND_MUL},
+		{Atom("/="), NodeKind::ND_DIV},
+		{Atom("%="), NodeKind::ND_MOD},
+		{Atom("&="), NodeKind::ND_BITAND},
+		{Atom("|="), NodeKind::ND_BITOR},
+		{Atom("^="), NodeKind::ND_BITXOR},
+		{Atom("<<="), NodeKind::ND_SHL},
+		{Atom(">>="), NodeKind::ND_SHR},
 	};
 
 	auto node = conditional(&current_token, current_token);
@@ -2579,7 +2636,7 @@ unique_ptr<Node> Node::assign(Token **next_token, Token *current_token)
 		return to_assign(new_sub(move(node), assign(next_token, current_token->_next.get()), current_token));
 	}
 
-	auto it = str_to_op.find(current_token->_str);
+	auto it = str_to_op.find(current_token->_atom);
 	if (it != str_to_op.end())
 	{
 		return to_assign(make_unique<Node>(it->second, move(node), assign(next_token, current_token->_next.get()), current_token));
@@ -2959,12 +3016,12 @@ unique_ptr<Node> Node::mul(Token **next_token, Token *current_token)
  */
 unique_ptr<Node> Node::unary(Token **next_token, Token *current_token)
 {
-	static const std::unordered_map<string, NodeKind> str_to_type = {
-		{"-", NodeKind::ND_NEG},
-		{"&", NodeKind::ND_ADDR},
-		{"*", NodeKind::ND_DEREF},
-		{"!", NodeKind::ND_NOT},
-		{"~", NodeKind::ND_BITNOT},
+	static const std::unordered_map<Atom, NodeKind> str_to_type = {
+		{Atom("-"), NodeKind::ND_NEG},
+		{Atom("&"), NodeKind::ND_ADDR},
+		{Atom("*"), NodeKind::ND_DEREF},
+		{Atom("!"), NodeKind::ND_NOT},
+		{Atom("~"), NodeKind::ND_BITNOT},
 	};
 
 	if (current_token->is_equal("+"))
@@ -2977,7 +3034,7 @@ unique_ptr<Node> Node::unary(Token **next_token, Token *current_token)
 		return make_unique<Node>(NodeKind::ND_NEG, cast(next_token, current_token->_next.get()), current_token);
 	}
 
-	auto it = str_to_type.find(current_token->_str);
+	auto it = str_to_type.find(current_token->_atom);
 	if (it != str_to_type.end())
 	{
 		return make_unique<Node>(it->second, cast(next_token, current_token->_next.get()), current_token);
@@ -3131,7 +3188,7 @@ unique_ptr<Node> Node::primary(Token **next_token, Token *current_token)
 	{
 		/* 前後の'"'を取り除く */
 		auto str = current_token->_str.substr(1, current_token->_str.size() - 2);
-		auto var = new_string_literal(str);
+		auto var = new_string_literal(string(str));
 		*next_token = current_token->_next.get();
 		return make_unique<Node>(var, current_token);
 	}
@@ -3224,7 +3281,7 @@ unique_ptr<Node> Node::primary(Token **next_token, Token *current_token)
 	if (TokenKind::TK_NUM == current_token->_kind)
 	{
 		unique_ptr<Node> node;
-		if (current_token->_ty->is_flonum())
+		if (current_token->type()->is_flonum())
 		{
 			node = make_unique<Node>(NodeKind::ND_NUM, current_token);
 			node->_fval = current_token->_fval;
@@ -3233,7 +3290,7 @@ unique_ptr<Node> Node::primary(Token **next_token, Token *current_token)
 		{
 			node = make_unique<Node>(current_token->_val, current_token);
 		}
-		node->_ty = current_token->_ty;
+		node->_ty = current_token->type();
 		*next_token = current_token->_next.get();
 		return node;
 	}
@@ -3273,7 +3330,7 @@ Token *Node::parse_typedef(Token *token, shared_ptr<Type> &base)
 			error_token("typedefする型名がありません", ty->_name_pos);
 		}
 
-		Object::push_scope(ty->_name->_str)->type_def = ty;
+		Object::push_scope(ty->_name->_atom)->type_def = ty;
 	}
 	return token;
 }
@@ -3490,7 +3547,7 @@ Token *Node::global_variable(Token *token, shared_ptr<Type> &&base, const Object
 			error_token("変数名がありません", ty->_name_pos);
 		}
 
-		auto var = Object::new_gvar(ty->_name->_str, ty);
+		auto var = Object::new_gvar(string(ty->_name->_str), ty);
 		var->_is_definition = !attr->_is_extern;
 		var->_is_static = attr->_is_static;
 
@@ -3546,9 +3603,9 @@ void Node::resolve_goto_label()
  * @param op 比較する文字列
  * @return 一致：true, 不一致：false
  */
-bool Node::consume(Token **next_token, Token *current_token, string &&str)
+bool Node::consume(Token **next_token, Token *current_token, const Atom &str)
 {
-	if (current_token->is_equal(move(str)))
+	if (current_token->is_equal(str))
 	{
 		*next_token = current_token->_next.get();
 		return true;
@@ -3564,11 +3621,11 @@ bool Node::consume(Token **next_token, Token *current_token, string &&str)
  * @param op 比較する文字列
  * @return 次のトークン
  */
-Token *Node::skip(Token *token, string &&op)
+Token *Node::skip(Token *token, const Atom &op)
 {
-	if (!token->is_equal(move(op)))
+	if (!token->is_equal(op))
 	{
-		error_token(op + "が必要です", token);
+		error_token(op.str() + "が必要です", token);
 	}
 	return token->_next.get();
 }
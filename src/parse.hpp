@@ -21,7 +21,7 @@ class Token;
  * @brief 構造体のメンバーを表すクラス
  *
  */
-struct Member
+struct Member : MemCounted<Member, MemReport::MK_MEMBER>
 {
 	shared_ptr<Member> _next; /*!< 次のメンバ */
 	shared_ptr<Type> _ty;	  /*!< 型情報 e.g. int or pointer to int */
@@ -85,9 +85,22 @@ enum class NodeKind
  * @brief 抽象構文木(AST)を構成するノード
  *
  */
-class Node
+class Node : MemCounted<Node, MemReport::MK_NODE>
 {
 public:
+	/**
+	 * @brief 関数の定義のトークンの範囲と、その構文解析で生成したグローバル変数の範囲。
+	 * プリコンパイル済みヘッダでは関数の定義を構文解析し直すので、範囲を記録しておく。
+	 *
+	 */
+	struct Definition
+	{
+		const Token *_start;  /*!< 定義の先頭のトークン */
+		const Token *_end;	  /*!< 定義の直後のトークン */
+		const Object *_first; /*!< 生成したグローバル変数のうちリストの先頭にあるもの */
+		const Object *_last;  /*!< 定義の前にリストの先頭にあったグローバル変数(生成したものを含まない) */
+	};
+
 	/* メンバ変数 (public) */
 
 	NodeKind _kind = NodeKind::ND_EXPR_STMT; /*!< ノードの種類*/
@@ -152,9 +165,12 @@ public:
 	/* 静的メンバ関数 (public) */
 	/**************************/
 
-	static unique_ptr<Object> parse(const unique_ptr<Token> &list);
+	static unique_ptr<Object> parse(const unique_ptr<Token> &list, vector<Definition> *definitions = nullptr);
 	static unique_ptr<Node> new_cast(unique_ptr<Node> &&expr, const shared_ptr<Type> &ty);
 	static int64_t const_expr(Token **next_token, Token *current_token);
+	static void reset();
+	static int get_unique_name_id();
+	static void set_unique_name_id(const int &id);
 
 private:
 	/***************************/
@@ -231,7 +247,7 @@ private:
 	static Token *global_variable(Token *token, shared_ptr<Type> &&base, const Object::VarAttr *attr);
 	static void resolve_goto_label();
 	static bool is_function(Token *token);
-	static bool consume(Token **next_token, Token *current_token, string &&str);
+	static bool consume(Token **next_token, Token *current_token, const Atom &str);
 	static bool consume_end(Token **next_token, Token *current_token);
-	static Token *skip(Token *token, string &&op);
+	static Token *skip(Token *token, const Atom &op);
 };
@@ -0,0 +1,1181 @@
+/**
+ * @file pch.cpp
+ * @author K.Fukunaga
+ * @brief プリコンパイル済みヘッダの書き出しと読み込み
+ * @version 0.1
+ * @date 2023-09-14
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "pch.hpp"
+#include "cache.hpp"
+#include "input.hpp"
+#include "object.hpp"
+#include "parse.hpp"
+#include "preprocess.hpp"
+#include "timereport.hpp"
+#include "type.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Macro = PreProcess::Macro;
+
+/** 型の番号(0はnullptr)のうち、静的に確保されている基本型に割り当てる番号の型。以降の番号は保存した型に割り当てる */
+static const shared_ptr<Type> *const builtin_types[] = {
+	nullptr, &Type::VOID_BASE, &Type::BOOL_BASE, &Type::CHAR_BASE, &Type::SHORT_BASE, &Type::INT_BASE, &Type::LONG_BASE,
+	&Type::UCHAR_BASE, &Type::USHORT_BASE, &Type::UINT_BASE, &Type::ULONG_BASE, &Type::FLOAT_BASE, &Type::DOUBLE_BASE};
+
+/** トークンの綴りの保存形式 */
+enum SpellingKind : uint8_t
+{
+	SP_EMPTY,	 /*!< 空 */
+	SP_CONTENTS, /*!< ファイルの中身の位置と長さ */
+	SP_STORED,	 /*!< 綴りそのもの(ファイルの中身にない文字列リテラルなど) */
+};
+
+/** 読み込んだプリコンパイル済みヘッダのトークンのうち、型やオブジェクトから参照されるもの */
+vector<unique_ptr<Token>> Pch::tokens;
+
+/** 読み込んだプリコンパイル済みヘッダのファイルのうち、入力ファイルでないもの(マクロ展開で生成したものなど) */
+vector<unique_ptr<File>> Pch::files;
+
+/**
+ * @brief プリコンパイル済みヘッダの内容をバイト列に書き出すクラス
+ *
+ * @details 保存する状態から参照されるファイル、トークン、型、構造体のメンバにそれぞれ通し番号を振り、
+ * 参照は番号で書き出す。型とメンバは互いに循環して参照しうるので、読み込むときは先にすべて生成してから中身を埋める。
+ */
+class Pch::Writer
+{
+public:
+	string _buf; /*!< 書き出したバイト列 */
+
+	/**
+	 * @brief 整数を書き出す
+	 *
+	 * @tparam T 整数の型
+	 * @param val 値
+	 */
+	template <class T>
+	void put(const T &val)
+	{
+		_buf.append(reinterpret_cast<const char *>(&val), sizeof(T));
+	}
+
+	/**
+	 * @brief 長さと文字列を書き出す
+	 *
+	 * @param str 文字列
+	 */
+	void put_str(const string_view &str)
+	{
+		put<uint32_t>(str.size());
+		_buf.append(str);
+	}
+
+	int file_id(const File *file);
+	int token_id(const Token *token);
+	int type_id(const Type *ty);
+	int member_id(const Member *mem);
+	void collect();
+	void put_files();
+	void put_token(const Token *token);
+	void put_tokens();
+	void put_types();
+
+private:
+	std::unordered_map<const File *, int> _file_ids;	 /*!< ファイルの番号 */
+	vector<const File *> _files;						 /*!< 番号順のファイル */
+	std::unordered_map<const Token *, int> _token_ids;	 /*!< 型などから参照されるトークンの番号 */
+	vector<const Token *> _tokens;						 /*!< 番号順のトークン */
+	std::unordered_map<const Type *, int> _type_ids;	 /*!< 型の番号 */
+	vector<const Type *> _types;						 /*!< 番号順の型(基本型を除く) */
+	std::unordered_map<const Member *, int> _member_ids; /*!< メンバの番号 */
+	vector<const Member *> _members;					 /*!< 番号順のメンバ */
+};
+
+/**
+ * @brief ファイルの番号を返す。初めて現れたファイルには番号を振る
+ *
+ * @param file ファイル
+ * @return 番号。nullptrであれば-1
+ */
+int Pch::Writer::file_id(const File *file)
+{
+	if (!file)
+	{
+		return -1;
+	}
+	auto [itr, inserted] = _file_ids.try_emplace(file, _files.size());
+	if (inserted)
+	{
+		_files.emplace_back(file);
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 型などから参照されるトークンの番号を返す。初めて現れたトークンには番号を振る
+ *
+ * @param token トークン
+ * @return 番号。nullptrであれば-1
+ */
+int Pch::Writer::token_id(const Token *token)
+{
+	if (!token)
+	{
+		return -1;
+	}
+	auto [itr, inserted] = _token_ids.try_emplace(token, _tokens.size());
+	if (inserted)
+	{
+		_tokens.emplace_back(token);
+		file_id(token->_file);
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 型の番号を返す。初めて現れた型には番号を振る(参照する型などはcollect()でたどる)
+ *
+ * @param ty 型
+ * @return 番号。nullptrであれば0、基本型であればbuiltin_typesの添字
+ */
+int Pch::Writer::type_id(const Type *ty)
+{
+	if (!ty)
+	{
+		return 0;
+	}
+	for (int i = 1; i < static_cast<int>(std::size(builtin_types)); ++i)
+	{
+		if (builtin_types[i]->get() == ty)
+		{
+			return i;
+		}
+	}
+	auto [itr, inserted] = _type_ids.try_emplace(ty, std::size(builtin_types) + _types.size());
+	if (inserted)
+	{
+		_types.emplace_back(ty);
+	}
+	return itr->second;
+}
+
+/**
+ * @brief メンバの番号を返す。初めて現れたメンバには番号を振る(参照する型などはcollect()でたどる)
+ *
+ * @param mem メンバ
+ * @return 番号。nullptrであれば-1
+ */
+int Pch::Writer::member_id(const Member *mem)
+{
+	if (!mem)
+	{
+		return -1;
+	}
+	auto [itr, inserted] = _member_ids.try_emplace(mem, _members.size());
+	if (inserted)
+	{
+		_members.emplace_back(mem);
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 番号を振った型とメンバから参照される型、メンバ、トークンにすべて番号を振る。
+ * リストが長くても再帰が深くならないように、番号順に1つずつたどる
+ *
+ */
+void Pch::Writer::collect()
+{
+	size_t t = 0, m = 0;
+	while (t < _types.size() || m < _members.size())
+	{
+		for (; t < _types.size(); ++t)
+		{
+			const auto ty = _types[t];
+			type_id(ty->_base.get());
+			token_id(ty->_name);
+			token_id(ty->_name_pos);
+			member_id(ty->_members.get());
+			type_id(ty->_return_ty.get());
+			type_id(ty->_params.get());
+			type_id(ty->_next.get());
+		}
+		for (; m < _members.size(); ++m)
+		{
+			const auto mem = _members[m];
+			member_id(mem->_next.get());
+			type_id(mem->_ty.get());
+			token_id(mem->_token);
+		}
+	}
+}
+
+/**
+ * @brief 番号順にファイルを書き出す
+ *
+ */
+void Pch::Writer::put_files()
+{
+	const auto &input_files = Token::get_input_files();
+	put<uint32_t>(_files.size());
+	for (auto file : _files)
+	{
+		const bool is_input = std::any_of(input_files.begin(), input_files.end(), [file](const auto &f)
+										  { return f.get() == file; });
+		int64_t mtime = 0, size = 0;
+		if (is_input)
+		{
+			Token::file_stat(file->_name, mtime, size);
+		}
+
+		put_str(file->_name);
+		put<int32_t>(file->_file_no);
+		put<uint8_t>(is_input);
+		put<int64_t>(mtime);
+		put<int64_t>(size);
+		put_str(file->_contents);
+		const auto &splice_points = file->_source->splice_points();
+		put<uint32_t>(splice_points.size());
+		for (auto p : splice_points)
+		{
+			put<int32_t>(p);
+		}
+	}
+}
+
+/**
+ * @brief トークン1つの内容を書き出す(次のトークンは含まない)
+ *
+ * @param token トークン
+ */
+void Pch::Writer::put_token(const Token *token)
+{
+	put<int32_t>(file_id(token->_file));
+	put<uint8_t>(static_cast<uint8_t>(token->_kind));
+	put<uint8_t>(token->_literal_type);
+	put<uint8_t>(token->_at_begining);
+	put<uint8_t>(token->_has_space);
+	put<int32_t>(token->_location);
+	put<int32_t>(token->_file ? token->line_no() : 0);
+	put<int64_t>(token->_val);
+	put_str(0 == token->_atom.id() ? "" : token->_atom.str());
+
+	/* 綴りがファイルの中身にあれば位置だけを書き出す */
+	const auto contents = token->_file ? token->_file->_contents : string_view();
+	if (token->_str.empty())
+	{
+		put<uint8_t>(SP_EMPTY);
+	}
+	else if (contents.data() <= token->_str.data() && token->_str.data() + token->_str.size() <= contents.data() + contents.size())
+	{
+		put<uint8_t>(SP_CONTENTS);
+		put<uint32_t>(token->_str.data() - contents.data());
+		put<uint32_t>(token->_str.size());
+	}
+	else
+	{
+		put<uint8_t>(SP_STORED);
+		put_str(token->_str);
+	}
+
+	put<uint32_t>(token->_hideset ? token->_hideset->size() : 0);
+	if (token->_hideset)
+	{
+		for (const auto &name : *token->_hideset)
+		{
+			put_str(name.str());
+		}
+	}
+}
+
+/**
+ * @brief 型などから参照されるトークンを番号順に書き出す
+ *
+ */
+void Pch::Writer::put_tokens()
+{
+	put<uint32_t>(_tokens.size());
+	for (auto token : _tokens)
+	{
+		put_token(token);
+	}
+}
+
+/**
+ * @brief 型とメンバを番号順に書き出す。互いに参照しうるので、先に両方の数を書き出す
+ *
+ */
+void Pch::Writer::put_types()
+{
+	put<uint32_t>(_types.size());
+	put<uint32_t>(_members.size());
+	for (auto ty : _types)
+	{
+		put<uint8_t>(static_cast<uint8_t>(ty->_kind));
+		put<int32_t>(ty->_size);
+		put<int32_t>(ty->_align);
+		put<uint8_t>(ty->_is_unsigned);
+		put<int32_t>(type_id(ty->_base.get()));
+		put<int32_t>(token_id(ty->_name));
+		put<int32_t>(token_id(ty->_name_pos));
+		put<int32_t>(ty->_array_length);
+		put<int32_t>(member_id(ty->_members.get()));
+		put<uint8_t>(ty->_is_flexible);
+		put<int32_t>(type_id(ty->_return_ty.get()));
+		put<int32_t>(type_id(ty->_params.get()));
+		put<uint8_t>(ty->_is_variadic);
+		put<int32_t>(type_id(ty->_next.get()));
+	}
+	for (auto mem : _members)
+	{
+		put<int32_t>(member_id(mem->_next.get()));
+		put<int32_t>(type_id(mem->_ty.get()));
+		put<int32_t>(token_id(mem->_token));
+		put<int32_t>(mem->_idx);
+		put<int32_t>(mem->_align);
+		put<int32_t>(mem->_offset);
+	}
+}
+
+/**
+ * @brief mmapしたプリコンパイル済みヘッダを先頭から読み込むクラス。範囲外を読もうとしたらエラーとする
+ *
+ */
+class Pch::Reader
+{
+public:
+	Reader(const string &path);
+	~Reader();
+
+	/**
+	 * @brief 整数を読み込む
+	 *
+	 * @tparam T 整数の型
+	 * @return 値
+	 */
+	template <class T>
+	T get()
+	{
+		T val;
+		std::memcpy(&val, take(sizeof(T)), sizeof(T));
+		return val;
+	}
+
+	/**
+	 * @brief 長さと文字列を読み込む
+	 *
+	 * @return mmapした領域を指す文字列
+	 */
+	string_view get_str()
+	{
+		auto size = get<uint32_t>();
+		return string_view(take(size), size);
+	}
+
+	string_view get_bytes(const size_t &size);
+	uint32_t get_count();
+	void get_files(std::unordered_map<int, int> &file_nos);
+	unique_ptr<Token> get_token();
+	void get_tokens();
+	void get_types();
+	shared_ptr<Type> type(const int32_t &id);
+	shared_ptr<Member> member(const int32_t &id);
+	Token *token(const int32_t &id);
+	[[noreturn]] void corrupted();
+
+private:
+	const char *take(const size_t &size);
+
+	string _path;								/*!< ファイルのパス */
+	void *_map = MAP_FAILED;					/*!< mmapした領域 */
+	size_t _size = 0;							/*!< 領域のサイズ */
+	size_t _pos = 0;							/*!< 次に読み込む位置 */
+	vector<const File *> _files;				/*!< 番号順のファイル */
+	vector<shared_ptr<Type>> _types;			/*!< 番号順の型(基本型を除く) */
+	vector<shared_ptr<Member>> _members;		/*!< 番号順のメンバ */
+	vector<Token *> _tokens;					/*!< 番号順の型などから参照されるトークン */
+};
+
+/**
+ * @brief ファイルをmmapする
+ *
+ * @param path ファイルのパス
+ */
+Pch::Reader::Reader(const string &path) : _path(path)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		error("プリコンパイル済みヘッダを開けません: " + path);
+	}
+	_size = st.st_size;
+	if (_size > 0)
+	{
+		_map = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (MAP_FAILED == _map)
+	{
+		corrupted();
+	}
+}
+
+Pch::Reader::~Reader()
+{
+	if (MAP_FAILED != _map)
+	{
+		munmap(_map, _size);
+	}
+}
+
+/**
+ * @brief 現在の位置から指定したバイト数を読み込む
+ *
+ * @param size バイト数
+ * @return 読み込んだ領域の先頭
+ */
+const char *Pch::Reader::take(const size_t &size)
+{
+	if (_size - _pos < size)
+	{
+		corrupted();
+	}
+	auto p = static_cast<const char *>(_map) + _pos;
+	_pos += size;
+	return p;
+}
+
+/**
+ * @brief 指定したバイト数を読み込む
+ *
+ * @param size バイト数
+ * @return mmapした領域を指すバイト列
+ */
+string_view Pch::Reader::get_bytes(const size_t &size)
+{
+	return string_view(take(size), size);
+}
+
+/**
+ * @brief 要素の個数を読み込む。要素は1バイト以上あるので、残りのバイト数より多ければ壊れたファイルとする
+ *
+ * @return 個数
+ */
+uint32_t Pch::Reader::get_count()
+{
+	auto n = get<uint32_t>();
+	if (n > _size - _pos)
+	{
+		corrupted();
+	}
+	return n;
+}
+
+/**
+ * @brief 壊れたファイルとしてエラーにする
+ *
+ */
+void Pch::Reader::corrupted()
+{
+	error("プリコンパイル済みヘッダが壊れています: " + _path);
+}
+
+/**
+ * @brief ファイルを読み込み、入力ファイルは更新されていないことを確かめて入力ファイルのリストに加える
+ *
+ * @param file_nos 作成時のファイル番号から入力ファイルのリストに加えた番号への対応を格納する
+ */
+void Pch::Reader::get_files(std::unordered_map<int, int> &file_nos)
+{
+	struct Entry
+	{
+		string _name;
+		int _file_no;
+		bool _is_input;
+		string_view _contents;
+		vector<int> _splice_points;
+	};
+
+	/* 状態を変える前にすべての入力ファイルを確かめる */
+	vector<Entry> entries(get_count());
+	for (auto &e : entries)
+	{
+		e._name = get_str();
+		e._file_no = get<int32_t>();
+		e._is_input = get<uint8_t>();
+		auto mtime = get<int64_t>();
+		auto size = get<int64_t>();
+		e._contents = get_str();
+		e._splice_points.resize(get_count());
+		for (auto &p : e._splice_points)
+		{
+			p = get<int32_t>();
+		}
+
+		int64_t cur_mtime, cur_size;
+		if (e._is_input && (!Token::file_stat(e._name, cur_mtime, cur_size) || cur_mtime != mtime || cur_size != size))
+		{
+			error("プリコンパイル済みヘッダの作成後に" + e._name + "が変更されています: " + _path);
+		}
+	}
+
+	for (auto &e : entries)
+	{
+		auto file = make_unique<File>(e._name, e._file_no, make_shared<Token::Source>(string(e._contents), move(e._splice_points)));
+		if (e._is_input)
+		{
+			_files.emplace_back(Token::add_input_file(move(file)));
+			file_nos[e._file_no] = _files.back()->_file_no;
+		}
+		else
+		{
+			_files.emplace_back(file.get());
+			Pch::files.emplace_back(move(file));
+		}
+	}
+
+	/* マクロ展開などで生成したファイルは元のファイルと同じ番号を使う */
+	for (auto &file : Pch::files)
+	{
+		auto itr = file_nos.find(file->_file_no);
+		if (itr != file_nos.end())
+		{
+			file->_file_no = itr->second;
+		}
+	}
+}
+
+/**
+ * @brief トークン1つを読み込む
+ *
+ * @return 読み込んだトークン(次のトークンは繋がっていない)
+ */
+unique_ptr<Token> Pch::Reader::get_token()
+{
+	auto token = make_unique<Token>();
+	auto file_id = get<int32_t>();
+	if (file_id < -1 || file_id >= static_cast<int32_t>(_files.size()))
+	{
+		corrupted();
+	}
+	token->_file = file_id < 0 ? nullptr : _files[file_id];
+	auto kind = get<uint8_t>();
+	auto literal_type = get<uint8_t>();
+	if (kind > static_cast<uint8_t>(TokenKind::TK_EOF) || literal_type >= std::size(Token::literal_types))
+	{
+		corrupted();
+	}
+	token->_kind = static_cast<TokenKind>(kind);
+	token->_literal_type = literal_type;
+	token->_at_begining = get<uint8_t>();
+	token->_has_space = get<uint8_t>();
+	token->_location = get<int32_t>();
+	token->_line_no = get<int32_t>();
+	token->_val = get<int64_t>();
+	auto atom = get_str();
+	if (!atom.empty())
+	{
+		token->_atom = Atom(atom);
+	}
+
+	switch (get<uint8_t>())
+	{
+	case SP_EMPTY:
+		break;
+	case SP_CONTENTS:
+	{
+		auto offset = get<uint32_t>();
+		auto size = get<uint32_t>();
+		if (!token->_file || token->_file->_contents.size() < static_cast<size_t>(offset) + size)
+		{
+			corrupted();
+		}
+		token->_str = token->_file->_contents.substr(offset, size);
+		break;
+	}
+	case SP_STORED:
+	{
+		auto str = get_str();
+		if (!token->_file)
+		{
+			corrupted();
+		}
+		token->_str = token->_file->_source->store(string(str));
+		break;
+	}
+	default:
+		corrupted();
+	}
+
+	auto hideset_size = get_count();
+	for (uint32_t i = 0; i < hideset_size; ++i)
+	{
+		token->_hideset = Hideset::add(token->_hideset, Atom(get_str()));
+	}
+	return token;
+}
+
+
+/**
+ * @brief 型などから参照されるトークンを読み込む
+ *
+ */
+void Pch::Reader::get_tokens()
+{
+	auto n = get_count();
+	for (uint32_t i = 0; i < n; ++i)
+	{
+		Pch::tokens.emplace_back(get_token());
+		_tokens.emplace_back(Pch::tokens.back().get());
+	}
+}
+
+/**
+ * @brief 型とメンバを読み込む。互いに参照しうるので、先にすべて生成してから中身を埋める
+ *
+ */
+void Pch::Reader::get_types()
+{
+	_types.resize(get_count());
+	_members.resize(get_count());
+	for (auto &ty : _types)
+	{
+		ty = make_shared<Type>();
+	}
+	for (auto &mem : _members)
+	{
+		mem = make_shared<Member>();
+	}
+
+	for (auto &ty : _types)
+	{
+		auto kind = get<uint8_t>();
+		if (kind > static_cast<uint8_t>(TypeKind::TY_UNION))
+		{
+			corrupted();
+		}
+		ty->_kind = static_cast<TypeKind>(kind);
+		ty->_size = get<int32_t>();
+		ty->_align = get<int32_t>();
+		ty->_is_unsigned = get<uint8_t>();
+		ty->_base = type(get<int32_t>());
+		ty->_name = token(get<int32_t>());
+		ty->_name_pos = token(get<int32_t>());
+		ty->_array_length = get<int32_t>();
+		ty->_members = member(get<int32_t>());
+		ty->_is_flexible = get<uint8_t>();
+		ty->_return_ty = type(get<int32_t>());
+		ty->_params = type(get<int32_t>());
+		ty->_is_variadic = get<uint8_t>();
+		ty->_next = type(get<int32_t>());
+	}
+	for (auto &mem : _members)
+	{
+		mem->_next = member(get<int32_t>());
+		mem->_ty = type(get<int32_t>());
+		mem->_token = token(get<int32_t>());
+		mem->_idx = get<int32_t>();
+		mem->_align = get<int32_t>();
+		mem->_offset = get<int32_t>();
+	}
+}
+
+/**
+ * @brief 番号の型を返す
+ *
+ * @param id 番号
+ * @return 型
+ */
+shared_ptr<Type> Pch::Reader::type(const int32_t &id)
+{
+	constexpr int32_t n_builtin = std::size(builtin_types);
+	if (0 == id)
+	{
+		return nullptr;
+	}
+	if (0 < id && id < n_builtin)
+	{
+		return *builtin_types[id];
+	}
+	if (id < n_builtin || id - n_builtin >= static_cast<int32_t>(_types.size()))
+	{
+		corrupted();
+	}
+	return _types[id - n_builtin];
+}
+
+/**
+ * @brief 番号のメンバを返す
+ *
+ * @param id 番号
+ * @return メンバ
+ */
+shared_ptr<Member> Pch::Reader::member(const int32_t &id)
+{
+	if (id < -1 || id >= static_cast<int32_t>(_members.size()))
+	{
+		corrupted();
+	}
+	return id < 0 ? nullptr : _members[id];
+}
+
+/**
+ * @brief 番号のトークンを返す
+ *
+ * @param id 番号
+ * @return トークン
+ */
+Token *Pch::Reader::token(const int32_t &id)
+{
+	if (id < -1 || id >= static_cast<int32_t>(_tokens.size()))
+	{
+		corrupted();
+	}
+	return id < 0 ? nullptr : _tokens[id];
+}
+
+/**
+ * @brief ヘッダファイルをパースした後の状態をプリコンパイル済みヘッダとして書き出す
+ *
+ * @param path 出力先
+ * @param in 入力引数
+ * @param globals ヘッダファイルをパースした結果のグローバル変数と関数のリスト
+ * @param definitions ヘッダファイルに含まれる関数の定義の範囲
+ */
+void Pch::write(const string &path, const unique_ptr<Input> &in, const Object *globals, const vector<Node::Definition> &definitions)
+{
+	Writer w;
+
+	/* 書き出す前に、保存するものから参照されるファイル、トークン、型にすべて番号を振る。入力ファイルは読み込んだ順にする */
+	for (const auto &file : Token::get_input_files())
+	{
+		w.file_id(file.get());
+	}
+
+	/* 関数の定義とその構文解析で生成したグローバル変数(文字列リテラルなど)は、読み込んだ後に構文解析し直して生成する */
+	std::unordered_set<const Object *> reparsed;
+	for (const auto &def : definitions)
+	{
+		for (auto obj = def._first; obj != def._last; obj = obj->_next.get())
+		{
+			reparsed.insert(obj);
+		}
+		for (auto t = def._start; t != def._end; t = t->_next.get())
+		{
+			w.file_id(t->_file);
+		}
+	}
+
+	for (const auto &[name, macro] : PreProcess::macros)
+	{
+		if (PreProcess::is_builtin_macro(macro.get()))
+		{
+			continue;
+		}
+		for (auto t = macro->_body.get(); t; t = t->_next.get())
+		{
+			w.file_id(t->_file);
+		}
+	}
+	vector<const Object *> objects;
+	for (auto obj = globals; obj; obj = obj->_next.get())
+	{
+		if (reparsed.contains(obj))
+		{
+			continue;
+		}
+		objects.emplace_back(obj);
+		w.token_id(obj->_token);
+		w.type_id(obj->_ty.get());
+	}
+	std::unordered_map<const Object *, int> object_ids;
+	for (auto obj : objects)
+	{
+		object_ids.emplace(obj, object_ids.size());
+	}
+	vector<const Object::VarScope *> vars;
+	for (auto sc = Object::scope->_vars.get(); sc; sc = sc->_next.get())
+	{
+		if (reparsed.contains(sc->_var))
+		{
+			continue;
+		}
+		vars.emplace_back(sc);
+		w.type_id(sc->type_def.get());
+		w.type_id(sc->enum_ty.get());
+	}
+	vector<const Object::TagScope *> tags;
+	for (auto sc = Object::scope->_tags.get(); sc; sc = sc->_next.get())
+	{
+		tags.emplace_back(sc);
+		w.type_id(sc->_ty.get());
+	}
+	w.collect();
+
+	w._buf.append(MAGIC);
+	w.put_str(Cache::build_id());
+	w.put_str(flags(in));
+	w.put_files();
+	w.put_tokens();
+	w.put_types();
+
+	/* グローバル変数と関数の宣言(リストの順) */
+	w.put<uint32_t>(objects.size());
+	for (auto obj : objects)
+	{
+		w.put_str(obj->_name);
+		w.put<int32_t>(w.token_id(obj->_token));
+		w.put<int32_t>(w.type_id(obj->_ty.get()));
+		w.put<int32_t>(obj->_align);
+		w.put<uint8_t>(obj->_is_function);
+		w.put<uint8_t>(obj->_is_definition);
+		w.put<uint8_t>(obj->_is_static);
+		w.put<uint8_t>(obj->_init_data != nullptr);
+		if (obj->_init_data)
+		{
+			w._buf.append(reinterpret_cast<const char *>(obj->_init_data.get()), obj->_ty->_size);
+		}
+		vector<const Object::Relocation *> rels;
+		for (auto rel = obj->_rel.get(); rel; rel = rel->_next.get())
+		{
+			rels.emplace_back(rel);
+		}
+		w.put<uint32_t>(rels.size());
+		for (auto rel : rels)
+		{
+			w.put<int32_t>(rel->_offset);
+			w.put_str(rel->_label);
+			w.put<int64_t>(rel->_addend);
+		}
+	}
+
+	/* ファイルスコープの変数とタグ(内側から外側の順) */
+	w.put<uint32_t>(vars.size());
+	for (auto sc : vars)
+	{
+		auto itr = sc->_var ? object_ids.find(sc->_var) : object_ids.end();
+		w.put_str(sc->_name.str());
+		w.put<int32_t>(itr == object_ids.end() ? -1 : itr->second);
+		w.put<int32_t>(w.type_id(sc->type_def.get()));
+		w.put<int32_t>(w.type_id(sc->enum_ty.get()));
+		w.put<int32_t>(sc->enum_val);
+	}
+	w.put<uint32_t>(tags.size());
+	for (auto sc : tags)
+	{
+		w.put_str(sc->_name.str());
+		w.put<int32_t>(w.type_id(sc->_ty.get()));
+	}
+	w.put<int32_t>(Node::get_unique_name_id());
+
+	/* 関数の定義のトークン */
+	w.put<uint32_t>(definitions.size());
+	for (const auto &def : definitions)
+	{
+		uint32_t n = 0;
+		for (auto t = def._start; t != def._end; t = t->_next.get())
+		{
+			++n;
+		}
+		w.put<uint32_t>(n);
+		for (auto t = def._start; t != def._end; t = t->_next.get())
+		{
+			w.put_token(t);
+		}
+	}
+
+	/* マクロ。事前定義マクロは名前だけを書き出し、読み込む側で定義済みのものを使う */
+	w.put<uint32_t>(PreProcess::macros.size());
+	for (const auto &[name, macro] : PreProcess::macros)
+	{
+		w.put_str(name.str());
+		const bool builtin = PreProcess::is_builtin_macro(macro.get());
+		w.put<uint8_t>(builtin);
+		if (builtin)
+		{
+			continue;
+		}
+		w.put<uint8_t>(macro->_is_objlike);
+		w.put<uint8_t>(macro->_is_variadic);
+		w.put<uint32_t>(macro->_params ? macro->_params->size() : 0);
+		if (macro->_params)
+		{
+			for (const auto &param : *macro->_params)
+			{
+				w.put_str(param.str());
+			}
+		}
+		uint32_t n = 0;
+		for (auto t = macro->_body.get(); t; t = t->_next.get())
+		{
+			++n;
+		}
+		w.put<uint32_t>(n);
+		for (auto t = macro->_body.get(); t; t = t->_next.get())
+		{
+			w.put_token(t);
+		}
+	}
+
+	/* 多重インクルードの記録 */
+	w.put<uint32_t>(PreProcess::include_guards.size());
+	for (const auto &[file, guard] : PreProcess::include_guards)
+	{
+		w.put_str(file);
+		w.put_str(guard.str());
+	}
+	w.put<uint32_t>(PreProcess::pragma_once_files.size());
+	for (const auto &file : PreProcess::pragma_once_files)
+	{
+		w.put_str(file);
+	}
+
+	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+	if (!ofs || !ofs.write(w._buf.data(), w._buf.size()))
+	{
+		error("プリコンパイル済みヘッダを書き込めません: " + path);
+	}
+}
+
+/**
+ * @brief プリコンパイル済みヘッダを読み込み、ヘッダファイルをインクルードした直後の状態を復元する。
+ * 事前定義マクロを定義した後、翻訳単位のトークンをプリプロセスする前に呼び出す。
+ *
+ * @param path プリコンパイル済みヘッダのパス
+ * @param in 入力引数
+ */
+void Pch::load(const string &path, const unique_ptr<Input> &in)
+{
+	TimeReport::Scope scope(TimeReport::PH_INCLUDE);
+	Reader r(path);
+
+	if (r.get_bytes(MAGIC.size()) != MAGIC)
+	{
+		r.corrupted();
+	}
+	if (r.get_str() != Cache::build_id())
+	{
+		error("プリコンパイル済みヘッダは別のビルドのfccで作成されています: " + path);
+	}
+	if (r.get_str() != flags(in))
+	{
+		error("プリコンパイル済みヘッダは異なるインクルードパスで作成されています: " + path);
+	}
+
+	std::unordered_map<int, int> file_nos;
+	r.get_files(file_nos);
+	r.get_tokens();
+	r.get_types();
+
+	/* グローバル変数と関数の宣言。リストの末尾から組み立てる */
+	vector<unique_ptr<Object>> objects(r.get_count());
+	for (auto &obj : objects)
+	{
+		obj = make_unique<Object>(string(r.get_str()));
+		obj->_token = r.token(r.get<int32_t>());
+		obj->_ty = r.type(r.get<int32_t>());
+		obj->_align = r.get<int32_t>();
+		obj->_is_function = r.get<uint8_t>();
+		obj->_is_definition = r.get<uint8_t>();
+		obj->_is_static = r.get<uint8_t>();
+		if (r.get<uint8_t>())
+		{
+			if (!obj->_ty)
+			{
+				r.corrupted();
+			}
+			auto data = r.get_bytes(obj->_ty->_size);
+			obj->_init_data = make_unique<unsigned char[]>(data.size());
+			std::memcpy(obj->_init_data.get(), data.data(), data.size());
+		}
+		vector<unique_ptr<Object::Relocation>> rels(r.get_count());
+		for (auto &rel : rels)
+		{
+			rel = make_unique<Object::Relocation>();
+			rel->_offset = r.get<int32_t>();
+			rel->_label = r.get_str();
+			rel->_addend = r.get<int64_t>();
+		}
+		for (auto itr = rels.rbegin(); itr != rels.rend(); ++itr)
+		{
+			(*itr)->_next = move(obj->_rel);
+			obj->_rel = move(*itr);
+		}
+	}
+	vector<const Object *> object_ptrs;
+	for (const auto &obj : objects)
+	{
+		object_ptrs.emplace_back(obj.get());
+	}
+
+	/* ファイルスコープの変数とタグ。push_scope()と同じく先頭に追加するので、外側から順に追加する */
+	struct VarEntry
+	{
+		Atom _name;
+		int32_t _var;
+		shared_ptr<Type> _type_def;
+		shared_ptr<Type> _enum_ty;
+		int32_t _enum_val;
+	};
+	vector<VarEntry> vars(r.get_count());
+	for (auto &v : vars)
+	{
+		v._name = Atom(r.get_str());
+		v._var = r.get<int32_t>();
+		v._type_def = r.type(r.get<int32_t>());
+		v._enum_ty = r.type(r.get<int32_t>());
+		v._enum_val = r.get<int32_t>();
+		if (v._var < -1 || v._var >= static_cast<int32_t>(object_ptrs.size()))
+		{
+			r.corrupted();
+		}
+	}
+	vector<std::pair<Atom, shared_ptr<Type>>> tags(r.get_count());
+	for (auto &[name, ty] : tags)
+	{
+		name = Atom(r.get_str());
+		ty = r.type(r.get<int32_t>());
+	}
+	const auto unique_name_id = r.get<int32_t>();
+
+	/* 関数の定義のトークンを連結する */
+	auto definitions = make_unique<Token>();
+	auto cur = definitions.get();
+	auto ndefs = r.get_count();
+	for (uint32_t i = 0; i < ndefs; ++i)
+	{
+		auto ntokens = r.get_count();
+		for (uint32_t j = 0; j < ntokens; ++j)
+		{
+			cur->_next = r.get_token();
+			cur = cur->_next.get();
+		}
+	}
+	cur->_next = make_unique<Token>(TokenKind::TK_EOF, cur->_location);
+	cur->_next->_file = cur->_file;
+
+	/* マクロ */
+	std::unordered_map<Atom, unique_ptr<Macro>> macros;
+	auto nmacros = r.get_count();
+	for (uint32_t i = 0; i < nmacros; ++i)
+	{
+		Atom name(r.get_str());
+		if (r.get<uint8_t>())
+		{
+			auto itr = PreProcess::macros.find(name);
+			if (itr == PreProcess::macros.end())
+			{
+				r.corrupted();
+			}
+			macros[name] = move(itr->second);
+			continue;
+		}
+
+		const bool objlike = r.get<uint8_t>();
+		const bool variadic = r.get<uint8_t>();
+		auto nparams = r.get_count();
+		unique_ptr<vector<Atom>> params;
+		if (!objlike)
+		{
+			params = make_unique<vector<Atom>>();
+			for (uint32_t j = 0; j < nparams; ++j)
+			{
+				params->emplace_back(r.get_str());
+			}
+		}
+		auto ntokens = r.get_count();
+		auto head = make_unique_for_overwrite<Token>();
+		auto tail = head.get();
+		for (uint32_t j = 0; j < ntokens; ++j)
+		{
+			tail->_next = r.get_token();
+			tail = tail->_next.get();
+		}
+		auto macro = make_unique<Macro>(move(head->_next), objlike);
+		macro->_params = move(params);
+		macro->_is_variadic = variadic;
+		macros[name] = move(macro);
+	}
+
+	/* 多重インクルードの記録 */
+	std::unordered_map<string, Atom> include_guards;
+	auto nguards = r.get_count();
+	for (uint32_t i = 0; i < nguards; ++i)
+	{
+		string file(r.get_str());
+		include_guards[move(file)] = Atom(r.get_str());
+	}
+	std::unordered_set<string> pragma_once_files;
+	auto nonce = r.get_count();
+	for (uint32_t i = 0; i < nonce; ++i)
+	{
+		pragma_once_files.emplace(r.get_str());
+	}
+
+	/* すべて読み込めたら状態を置き換える */
+	for (auto itr = objects.rbegin(); itr != objects.rend(); ++itr)
+	{
+		(*itr)->_next = move(Object::globals);
+		Object::globals = move(*itr);
+	}
+	for (auto itr = vars.rbegin(); itr != vars.rend(); ++itr)
+	{
+		auto sc = Object::push_scope(itr->_name);
+		sc->_var = itr->_var < 0 ? nullptr : object_ptrs[itr->_var];
+		sc->type_def = itr->_type_def;
+		sc->enum_ty = itr->_enum_ty;
+		sc->enum_val = itr->_enum_val;
+	}
+	for (auto itr = tags.rbegin(); itr != tags.rend(); ++itr)
+	{
+		Object::scope->_tags = make_unique<Object::TagScope>(itr->first, itr->second, move(Object::scope->_tags));
+	}
+	Node::set_unique_name_id(unique_name_id);
+	PreProcess::macros = move(macros);
+	PreProcess::include_guards.merge(include_guards);
+	PreProcess::pragma_once_files.merge(pragma_once_files);
+
+	/* 関数の定義を構文解析し直す。トークンは翻訳単位の終わりまで参照される */
+	tokens.emplace_back(move(definitions->_next));
+	if (TokenKind::TK_EOF != tokens.back()->_kind)
+	{
+		Object::globals = Node::parse(tokens.back());
+	}
+}
+
+/**
+ * @brief 読み込んだプリコンパイル済みヘッダのトークンとファイルを破棄する。
+ * トークンのアリーナを解放するToken::reset()より前に呼び出す。
+ *
+ */
+void Pch::reset()
+{
+	tokens.clear();
+	files.clear();
+}
+
+/**
+ * @brief プリコンパイル済みヘッダの内容に影響するオプションを文字列にする
+ *
+ * @param in 入力引数
+ * @return インクルードパスを改行で区切って連結した文字列
+ */
+string Pch::flags(const unique_ptr<Input> &in)
+{
+	string str;
+	for (const auto &dir : in->_include)
+	{
+		str += dir;
+		str += '\n';
+	}
+	return str;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file pch.hpp
+ * @author K.Fukunaga
+ * @brief プリコンパイル済みヘッダの書き出しと読み込み
+ * @version 0.1
+ * @date 2023-09-14
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include "parse.hpp"
+#include "tokenize.hpp"
+
+class Input;
+
+/**
+ * @brief プリコンパイル済みヘッダ(-x c-headerで作成し、-include-pchで読み込む)を扱うクラス
+ *
+ * @details ヘッダファイルをプリプロセスとパースまで処理した後の状態を保存する。
+ * 保存するのはマクロ、インクルードガードと#pragma onceの記録、入力ファイルのリスト、
+ * ファイルスコープの変数/typedef/列挙定数とタグ、グローバル変数と関数の宣言、およびそれらが参照する型とトークンである。
+ * トークンの綴りと位置はファイルの中身を指すので、参照されるファイルの中身も保存する。
+ * 関数の定義(stdarg.hの__va_arg_gpなど)は抽象構文木を保存する代わりにプリプロセス済みのトークンを保存し、
+ * 読み込んだ後に構文解析し直す。
+ * 読み込むときはファイルをmmapし、fccのビルド、-Iオプション、入力ファイルの更新時刻とサイズが
+ * 作成時と一致することを確かめてから、翻訳単位の先頭でヘッダファイルをインクルードした直後の状態を復元する。
+ */
+class Pch
+{
+public:
+	/* 静的メンバ関数(public) */
+	static void write(const string &path, const unique_ptr<Input> &in, const Object *globals, const vector<Node::Definition> &definitions);
+	static void load(const string &path, const unique_ptr<Input> &in);
+	static void reset();
+
+private:
+	class Writer;
+	class Reader;
+
+	Pch();
+
+	/* 静的メンバ関数(private) */
+	static string flags(const unique_ptr<Input> &in);
+
+	/** ファイル形式を識別する先頭のバイト列(形式を変えたら末尾の番号を変える) */
+	static constexpr string_view MAGIC = "FCCPCH1\n";
+
+	static vector<unique_ptr<Token>> tokens;
+	static vector<unique_ptr<File>> files;
+};
@@ -0,0 +1,115 @@
+/**
+ * @file perfecthash.hpp
+ * @author K.Fukunaga
+ * @brief コンパイル時に生成する完全ハッシュ表
+ * @version 0.1
+ * @date 2023-09-10
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief 固定された文字列の集合から、文字列が集合のどの要素かを定数時間で求める完全ハッシュ表
+ *
+ * @details 構築はコンパイル時に行う。シードを変えながらFNV-1a(と上位ビットの攪拌)で全要素のハッシュ値を計算し、
+ * 2^B個のスロットに衝突なく収まるシードを探す。検索はハッシュ値の計算1回と文字列の比較1回で済む。
+ * 衝突しないシードが見つからない場合はコンパイルエラーになるので、Bを大きくする。
+ *
+ * @tparam N 要素の数
+ * @tparam B スロットの数の2を底とする対数
+ */
+template <size_t N, unsigned B>
+class PerfectHash
+{
+public:
+	/**
+	 * @brief 要素の一覧から表を構築する
+	 *
+	 * @param keys 要素の一覧(重複しないこと)。表は一覧を参照するので、静的な配列を渡す。
+	 */
+	consteval PerfectHash(const std::string_view (&keys)[N]) : _keys(keys)
+	{
+		for (_seed = 1; _seed < (1u << 16); ++_seed)
+		{
+			if (build())
+			{
+				return;
+			}
+		}
+		throw "衝突しないシードが見つかりませんでした";
+	}
+
+	/**
+	 * @brief 文字列が要素であればその添字を返す
+	 *
+	 * @param str 検索する文字列
+	 * @return 要素の添字。要素でなければ-1
+	 */
+	constexpr int find(const std::string_view &str) const
+	{
+		auto slot = _slots[hash(_seed, str)];
+		if (0 != slot && _keys[slot - 1] == str)
+		{
+			return slot - 1;
+		}
+		return -1;
+	}
+
+private:
+	/**
+	 * @brief 文字列のハッシュ値をスロットの番号として返す
+	 *
+	 * @param seed シード
+	 * @param str 文字列
+	 * @return スロットの番号
+	 */
+	static constexpr uint32_t hash(const uint32_t &seed, const std::string_view &str)
+	{
+		uint32_t h = 2166136261u ^ seed;
+		for (auto c : str)
+		{
+			h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+		}
+		/* 短い文字列でも上位ビットが散らばるように攪拌する */
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		h *= 0x297a2d39u;
+		h ^= h >> 15;
+		return h >> (32 - B);
+	}
+
+	/**
+	 * @brief 現在のシードで全要素をスロットに割り当てる
+	 *
+	 * @return 衝突せずに割り当てられたか
+	 */
+	consteval bool build()
+	{
+		for (auto &slot : _slots)
+		{
+			slot = 0;
+		}
+		for (size_t i = 0; i < N; ++i)
+		{
+			auto &slot = _slots[hash(_seed, _keys[i])];
+			if (0 != slot)
+			{
+				return false;
+			}
+			slot = i + 1;
+		}
+		return true;
+	}
+
+	const std::string_view *_keys;	/*!< 要素の一覧 */
+	uint32_t _seed = 0;				/*!< 衝突しなかったシード */
+	uint16_t _slots[1u << B] = {}; /*!< スロットに割り当てた要素の添字+1(0は空き) */
+};
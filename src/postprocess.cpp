@@ -10,13 +10,22 @@
  */
 
 #include "postprocess.hpp"
+#include "linker.hpp"
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <csignal>
 #include <libgen.h>
 #include <string.h>
 #include <glob.h>
 #include <sys/stat.h>
 
+/** 作成した一時ファイルの一覧。終了時に削除する */
+vector<std::pair<string, pid_t>> PostProcess::tmpfiles;
+
+/** パイプでアセンブル中の出力。keep_output()を呼ぶ前に終了した場合は削除する */
+PostProcess::PendingOutput PostProcess::pending_output;
+
 /**
  * @brief 'as'コマンドでアセンブルする
  *
@@ -30,13 +39,79 @@ void PostProcess::assemble(const string &input_path, const string &output_path)
 }
 
 /**
- * @brief 'ld'コマンドでリンクする
+ * @brief in_fdから読み込んだアセンブリをアセンブルする'as'コマンドを起動する。終了は待たない。
  *
- * @param input_path 入力先ファイルのパス
+ * @param in_fd アセンブリを読み込むファイルディスクリプタ(パイプの読み出し側)
  * @param output_path 出力先ファイルのパス
+ * @return 起動した'as'のpid
+ */
+pid_t PostProcess::spawn_assembler(const int &in_fd, const string &output_path)
+{
+	vector<string> cmd = {"as", "--noexecstack", "-c", "-", "-o", output_path};
+	return spawn_subprocess(cmd, in_fd, -1);
+}
+
+/**
+ * @brief パイプでアセンブル中の出力を、keep_output()を呼ぶ前にプロセスが終了した場合(コンパイルの失敗)に削除するように登録する
+ *
+ * @param output_path 'as'の出力先ファイルのパス
+ * @param as_pid 'as'のpid
+ */
+void PostProcess::discard_on_exit(const string &output_path, const pid_t &as_pid)
+{
+	static bool registered = false;
+	if (!registered)
+	{
+		atexit(discard_output);
+		registered = true;
+	}
+	pending_output = {output_path, as_pid, getpid()};
+}
+
+/**
+ * @brief discard_on_exit()で登録した出力を削除しないようにする
+ *
+ */
+void PostProcess::keep_output()
+{
+	pending_output = {};
+}
+
+/**
+ * @brief 終了時に、アセンブル中の出力があれば'as'を止めてから削除する。
+ * 途中までのアセンブリから作られたオブジェクトファイルを残さない。
+ *
  */
-void PostProcess::run_linker(const vector<string> &inputs, const string &output)
+void PostProcess::discard_output()
 {
+	if (pending_output._owner != getpid())
+	{
+		return;
+	}
+
+	/* 'as'が出力を書き終えた後に削除しても残らないように、終了させてから削除する */
+	kill(pending_output._as_pid, SIGKILL);
+	waitpid(pending_output._as_pid, nullptr, 0);
+	unlink(pending_output._path.c_str());
+}
+
+/**
+ * @brief 'ld'コマンドでリンクする。internalがtrueなら内蔵リンカで静的リンクし、対応できない入力があれば'ld'でリンクし直す
+ *
+ * @param inputs 入力ファイルのパス
+ * @param output 出力先ファイルのパス
+ * @param internal 内蔵リンカを使うか(-fuse-ld=fcc)
+ */
+void PostProcess::run_linker(const vector<string> &inputs, const string &output, const bool &internal)
+{
+	string libpath, gcc_libpath;
+	find_library_paths(libpath, gcc_libpath);
+
+	if (internal && Linker::link(inputs, output, libpath, gcc_libpath))
+	{
+		return;
+	}
+
 	vector<string> cmd;
 	cmd.reserve(50);
 
@@ -48,9 +123,6 @@ void PostProcess::run_linker(const vector<string> &inputs, const string &output)
 	cmd.emplace_back("-dynamic-linker");
 	cmd.emplace_back("/lib64/ld-linux-x86-64.so.2");
 
-	string libpath = find_libpath();
-	string gcc_libpath = find_gcc_libpath();
-
 	cmd.emplace_back(libpath + "/crt1.o");
 	cmd.emplace_back(libpath + "/crti.o");
 	cmd.emplace_back(gcc_libpath + "/crtbegin.o");
@@ -98,9 +170,42 @@ string PostProcess::create_tmpfile()
 
 	auto tmp_path = string(path);
 	free(path);
+
+	/* 終了時に削除する */
+	if (tmpfiles.empty())
+	{
+		atexit(remove_tmpfiles);
+	}
+	tmpfiles.emplace_back(tmp_path, getpid());
 	return tmp_path;
 }
 
+/**
+ * @brief 不要になった一時ファイルを削除する
+ *
+ * @param path 削除する一時ファイルのパス
+ */
+void PostProcess::remove_tmpfile(const string &path)
+{
+	unlink(path.c_str());
+}
+
+/**
+ * @brief このプロセスが作成した一時ファイルをすべて削除する。
+ * forkした子プロセスは親プロセスが作成した一時ファイルを削除しない。
+ *
+ */
+void PostProcess::remove_tmpfiles()
+{
+	for (const auto &[path, pid] : tmpfiles)
+	{
+		if (pid == getpid())
+		{
+			unlink(path.c_str());
+		}
+	}
+}
+
 /**
  * @brief ファイルパスを正規表現でパターンマッチングして検索
  *
@@ -166,4 +271,70 @@ string PostProcess::find_gcc_libpath()
 		}
 	}
 	error("gccライブラリが見つかりません");
-}
\ No newline at end of file
+}
+
+/**
+ * @brief リンク時に必要なライブラリとgccのライブラリのパスを返す。
+ * 検索結果はキャッシュファイルに保存し、次回からはcrtファイルが存在する限り検索せずに再利用する
+ *
+ * @param libpath ライブラリのパスを格納する
+ * @param gcc_libpath gccのライブラリのパスを格納する
+ */
+void PostProcess::find_library_paths(string &libpath, string &gcc_libpath)
+{
+	auto cache = cache_path();
+
+	if (!cache.empty())
+	{
+		std::ifstream ifs(cache);
+		string lib, gcc;
+		if (ifs && std::getline(ifs, lib) && std::getline(ifs, gcc) &&
+			fs::is_regular_file(lib + "/crti.o") && fs::is_regular_file(gcc + "/crtbegin.o"))
+		{
+			libpath = lib;
+			gcc_libpath = gcc;
+			return;
+		}
+	}
+
+	libpath = find_libpath();
+	gcc_libpath = find_gcc_libpath();
+
+	if (cache.empty())
+	{
+		return;
+	}
+
+	/* 並列に実行された他のfccと競合しないよう一時ファイルに書いてから置き換える。失敗しても無視する */
+	std::error_code ec;
+	fs::create_directories(fs::path(cache).parent_path(), ec);
+	auto tmp = cache + "." + std::to_string(getpid());
+	{
+		std::ofstream ofs(tmp);
+		ofs << libpath << "\n"
+			<< gcc_libpath << "\n";
+	}
+	fs::rename(tmp, cache, ec);
+	if (ec)
+	{
+		fs::remove(tmp, ec);
+	}
+}
+
+/**
+ * @brief ライブラリのパスのキャッシュファイルのパスを返す。$XDG_CACHE_HOME/fcc/pathsか~/.cache/fcc/paths
+ *
+ * @return キャッシュファイルのパス。ホームディレクトリが分からなければ空文字列
+ */
+string PostProcess::cache_path()
+{
+	if (auto dir = getenv("XDG_CACHE_HOME"); dir && *dir)
+	{
+		return string(dir) + "/fcc/paths";
+	}
+	if (auto home = getenv("HOME"); home && *home)
+	{
+		return string(home) + "/.cache/fcc/paths";
+	}
+	return "";
+}
@@ -21,12 +21,35 @@ class PostProcess
 {
 public:
 	static void assemble(const string &input_path, const string &output_path);
-	static void run_linker(const vector<string> &inputs, const string &output);
+	static void run_linker(const vector<string> &inputs, const string &output, const bool &internal = false);
+	static pid_t spawn_assembler(const int &in_fd, const string &output_path);
+	static void discard_on_exit(const string &output_path, const pid_t &as_pid);
+	static void keep_output();
 	static string create_tmpfile();
+	static void remove_tmpfile(const string &path);
 
 private:
 	PostProcess();
+	static void remove_tmpfiles();
+	static void discard_output();
+
+	/**
+	 * @brief パイプでアセンブル中の出力を表す構造体
+	 *
+	 */
+	struct PendingOutput
+	{
+		string _path;		/*!< 'as'の出力先ファイルのパス */
+		pid_t _as_pid = -1; /*!< 'as'のpid */
+		pid_t _owner = -1;	/*!< 登録したプロセスのpid */
+	};
+	static PendingOutput pending_output;
+
+	/** 作成した一時ファイルと作成したプロセスのpid */
+	static vector<std::pair<string, pid_t>> tmpfiles;
 	static string find_file(const string &patern);
+	static void find_library_paths(string &libpath, string &gcc_libpath);
+	static string cache_path();
 	static string find_libpath();
 	static string find_gcc_libpath();
 };
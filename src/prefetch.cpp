@@ -0,0 +1,316 @@
+/**
+ * @file prefetch.cpp
+ * @author K.Fukunaga
+ * @brief インクルードされるヘッダファイルをバックグラウンドでトークナイズするスレッドプール
+ * @version 0.1
+ * @date 2023-09-12
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "prefetch.hpp"
+#include "preprocess.hpp"
+#include "timereport.hpp"
+
+/** queue, jobs, stoppingとJob::_doneを保護するロック */
+std::mutex Prefetch::mutex;
+
+/** ジョブが追加されたか、終了が要求された */
+std::condition_variable Prefetch::queued;
+
+/** ジョブが完了した */
+std::condition_variable Prefetch::finished;
+
+/** まだ始まっていないジョブ(追加した順) */
+std::deque<Prefetch::Job *> Prefetch::queue;
+
+/** パスごとの受け取られていないジョブ */
+std::unordered_map<string, unique_ptr<Prefetch::Job>> Prefetch::jobs;
+
+/** 受け取られたジョブのパス */
+std::unordered_set<string> Prefetch::taken;
+
+/** ワーカースレッド */
+vector<std::thread> Prefetch::workers;
+
+/** ワーカースレッドに終了を要求しているか */
+bool Prefetch::stopping = false;
+
+/**
+ * @brief ワーカースレッドを起動する
+ *
+ * @param threads ワーカースレッドの数。0以下であれば先読みしない
+ */
+void Prefetch::start(const int &threads)
+{
+	if (threads <= 0)
+	{
+		return;
+	}
+
+	/* エラーで終了する場合も、静的変数が破棄される前にワーカースレッドを止める */
+	static bool registered = false;
+	if (!registered)
+	{
+		std::atexit(stop);
+		registered = true;
+	}
+
+	Atom::set_concurrent(true);
+	stopping = false;
+	for (int i = 0; i < threads; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+}
+
+/**
+ * @brief ワーカースレッドを止め、受け取られなかった結果を破棄する
+ *
+ */
+void Prefetch::stop()
+{
+	if (workers.empty())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+	}
+	queued.notify_all();
+	for (auto &w : workers)
+	{
+		w.join();
+	}
+	workers.clear();
+
+	for (auto &[path, job] : jobs)
+	{
+		discard(job.get());
+	}
+	jobs.clear();
+	taken.clear();
+	Atom::set_concurrent(false);
+}
+
+/**
+ * @brief トークンリストの#include行からインクルードされるヘッダファイルを求めて先読みする
+ *
+ * @param token トークナイズしたファイルのトークンリスト
+ */
+void Prefetch::scan(const Token *token)
+{
+	if (workers.empty())
+	{
+		return;
+	}
+	submit(find_includes(token));
+}
+
+/**
+ * @brief 先読みしたヘッダファイルを受け取る。トークナイズ中であれば完了を待つ。
+ *
+ * @param path ヘッダファイルのパス
+ * @return トークナイズした結果。先読みしていないか、まだ始まっていないか、エラーが発生した場合はnullptr
+ */
+unique_ptr<Token> Prefetch::take(const string &path)
+{
+	if (workers.empty())
+	{
+		return nullptr;
+	}
+
+	TimeReport::Scope scope(TimeReport::PH_TOKENIZE);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	auto itr = jobs.find(path);
+	if (itr == jobs.end())
+	{
+		return nullptr;
+	}
+	auto job = move(itr->second);
+	jobs.erase(itr);
+	taken.insert(path);
+
+	if (!job->_done)
+	{
+		/* まだ始まっていなければ待たずに呼び出し元でトークナイズする */
+		auto queued_job = std::find(queue.begin(), queue.end(), job.get());
+		if (queued_job != queue.end())
+		{
+			queue.erase(queued_job);
+			return nullptr;
+		}
+		finished.wait(lock, [&job]
+					  { return job->_done; });
+	}
+	lock.unlock();
+
+	/* エラーは呼び出し元でトークナイズし直して報告する */
+	if (job->_failed)
+	{
+		discard(job.get());
+		return nullptr;
+	}
+	return Token::adopt_file(move(job->_file), move(job->_tokens), move(job->_arena));
+}
+
+/**
+ * @brief ワーカースレッドの処理。終了が要求されるまでジョブを順に実行する
+ *
+ */
+void Prefetch::worker()
+{
+	defer_errors(true);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		queued.wait(lock, []
+					{ return stopping || !queue.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+		auto job = queue.front();
+		queue.pop_front();
+
+		lock.unlock();
+		auto includes = run(job);
+		submit(includes);
+		lock.lock();
+
+		job->_done = true;
+		finished.notify_all();
+	}
+}
+
+/**
+ * @brief ジョブのヘッダファイルを読み込んでトークナイズする
+ *
+ * @param job ジョブ
+ * @return ヘッダファイルがインクルードするファイルのパス
+ */
+vector<string> Prefetch::run(Job *job)
+{
+	vector<string> includes;
+	Token::set_thread_arena(&job->_arena);
+	try
+	{
+		job->_file = make_unique<File>(job->_path, 0, Token::Source::load(job->_path));
+		job->_tokens = Token::tokenize(job->_file.get());
+		includes = find_includes(job->_tokens.get());
+	}
+	catch (const DeferredError &)
+	{
+		job->_tokens.reset();
+		job->_failed = true;
+	}
+	Token::set_thread_arena(nullptr);
+	return includes;
+}
+
+/**
+ * @brief 先読みしていない、かつ受け取られていないパスのジョブを追加する
+ *
+ * @param paths ヘッダファイルのパス
+ */
+void Prefetch::submit(const vector<string> &paths)
+{
+	if (paths.empty())
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (stopping)
+	{
+		return;
+	}
+	for (const auto &path : paths)
+	{
+		if (jobs.contains(path) || taken.contains(path))
+		{
+			continue;
+		}
+		auto job = make_unique<Job>();
+		job->_path = path;
+		queue.emplace_back(job.get());
+		jobs.emplace(path, move(job));
+	}
+	queued.notify_all();
+}
+
+/**
+ * @brief トークンリストの行頭の#include "..."と#include <...>からインクルードされるファイルのパスを求める。
+ * マクロで指定されたファイル名(#include FOO)は対象にしない。
+ *
+ * @param token トークンリスト
+ * @return 見つかったファイルのパス(出現順)
+ */
+vector<string> Prefetch::find_includes(const Token *token)
+{
+	vector<string> paths;
+	for (auto t = token; TokenKind::TK_EOF != t->_kind; t = t->_next.get())
+	{
+		if (!t->_at_begining || !t->is_equal("#") || !t->_next->is_equal("include"))
+		{
+			continue;
+		}
+
+		auto name = t->_next->_next.get();
+		if (name->_at_begining)
+		{
+			continue;
+		}
+
+		string filename;
+		bool dquote = false;
+		if (TokenKind::TK_STR == name->_kind)
+		{
+			filename = Token::reverse_str_literal(name);
+			filename = filename.substr(1, filename.size() - 2);
+			dquote = true;
+		}
+		else if (name->is_equal("<"))
+		{
+			auto end = name->_next.get();
+			while (TokenKind::TK_EOF != end->_kind && !end->_at_begining && !end->is_equal(">"))
+			{
+				end = end->_next.get();
+			}
+			if (!end->is_equal(">") || end->_at_begining)
+			{
+				continue;
+			}
+			filename = PreProcess::join_tokens(name->_next.get(), end);
+		}
+		else
+		{
+			continue;
+		}
+
+		auto path = PreProcess::search_include_path(t->_file->_name, filename, dquote);
+		if (!path.empty())
+		{
+			paths.emplace_back(move(path));
+		}
+	}
+	return paths;
+}
+
+/**
+ * @brief 受け取られなかったジョブのトークンを、割り当てたアリーナに返して破棄する
+ *
+ * @param job ジョブ
+ */
+void Prefetch::discard(Job *job)
+{
+	Token::set_thread_arena(&job->_arena);
+	job->_tokens.reset();
+	Token::set_thread_arena(nullptr);
+}
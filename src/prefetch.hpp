@@ -0,0 +1,73 @@
+/**
+ * @file prefetch.hpp
+ * @author K.Fukunaga
+ * @brief インクルードされるヘッダファイルをバックグラウンドでトークナイズするスレッドプール
+ * @version 0.1
+ * @date 2023-09-12
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include "tokenize.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief インクルードされるヘッダファイルを先読みしてトークナイズするクラス
+ *
+ * @details トークナイズはマクロの状態によらないので、ファイルの#include行から求めたパスのヘッダファイルを
+ * ワーカースレッドで先にトークナイズしておき、プリプロセッサが実際にインクルードしたときに結果を受け取る。
+ * ワーカースレッドはトークナイズしたヘッダファイルの#include行もさらに先読みする。
+ * 同じパスは1度しか先読みしない(2回目以降のインクルードはインクルードガードなどで飛ばされることが多い)。
+ * ワーカースレッドのトークンはジョブごとのアリーナから割り当て、受け取るときに共通のアリーナに引き取る。
+ * ファイル番号は受け取った順に振り、エラーは受け取ったときに同期的にトークナイズし直して報告するので、
+ * 出力とエラーはスレッド数によらず同期的にトークナイズした場合と同じになる。
+ */
+class Prefetch
+{
+public:
+	/* 静的メンバ関数(public) */
+	static void start(const int &threads);
+	static void stop();
+	static void scan(const Token *token);
+	static unique_ptr<Token> take(const string &path);
+
+private:
+	/**
+	 * @brief ヘッダファイル1つをトークナイズするジョブ
+	 *
+	 */
+	struct Job
+	{
+		string _path;							 /*!< ヘッダファイルのパス */
+		unique_ptr<File> _file;					 /*!< トークナイズしたファイル */
+		unique_ptr<Token> _tokens;				 /*!< トークナイズした結果 */
+		Arena<Token, MemReport::MK_TOKEN> _arena; /*!< _tokensを割り当てたアリーナ */
+		bool _done = false;						 /*!< 完了したか */
+		bool _failed = false;					 /*!< エラーが発生したか */
+	};
+
+	Prefetch();
+
+	/* 静的メンバ関数(private) */
+	static void worker();
+	static vector<string> run(Job *job);
+	static void submit(const vector<string> &paths);
+	static vector<string> find_includes(const Token *token);
+	static void discard(Job *job);
+
+	static std::mutex mutex;
+	static std::condition_variable queued;
+	static std::condition_variable finished;
+	static std::deque<Job *> queue;
+	static std::unordered_map<string, unique_ptr<Job>> jobs;
+	static std::unordered_set<string> taken;
+	static vector<std::thread> workers;
+	static bool stopping;
+};
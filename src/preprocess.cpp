@@ -13,6 +13,9 @@
 #include "tokenize.hpp"
 #include "parse.hpp"
 #include "input.hpp"
+#include "timereport.hpp"
+#include "prefetch.hpp"
+#include "pch.hpp"
 
 using Macro = PreProcess::Macro;
 using CondIncl = PreProcess::CondIncl;
@@ -30,11 +33,41 @@ Macro::Macro(unique_ptr<Token> &&body, const bool &objlike)
 vector<unique_ptr<CondIncl>> PreProcess::cond_incl;
 
 /** マクロの一覧 */
-std::unordered_map<string, unique_ptr<Macro>> PreProcess::macros;
+std::unordered_map<Atom, unique_ptr<Macro>> PreProcess::macros;
+
+/** 事前定義マクロの一覧。翻訳単位ごとにmacrosへコピーして使う */
+std::unordered_map<Atom, unique_ptr<Macro>> PreProcess::builtin_macros;
+
+/** 文字列から生成した仮想的なファイルの実体 */
+vector<unique_ptr<File>> PreProcess::virtual_files;
+
+/** 事前定義マクロのトークンが属する仮想的なファイルの実体 */
+vector<unique_ptr<File>> PreProcess::builtin_files;
 
 /** 入力オプション */
 const Input *PreProcess::input_options = nullptr;
 
+/** インクルードファイルのパスから正規化したパスへの対応 */
+std::unordered_map<string, string> PreProcess::canonical_paths;
+
+/** インクルードガードを持つファイルの正規化したパスとガードマクロ */
+std::unordered_map<string, Atom> PreProcess::include_guards;
+
+/** #pragma onceを含むファイルの正規化したパス */
+std::unordered_set<string> PreProcess::pragma_once_files;
+
+/** インクルードガードを持たないヘッダファイルの正規化したパスとトークナイズした結果。プリプロセスの間だけ保持する */
+std::unordered_map<string, unique_ptr<Token>> PreProcess::header_cache;
+
+/** インクルードするディレクトリ、形式、ファイル名の組から検索したパスへの対応(見つからなかった場合は空文字列) */
+std::unordered_map<string, string> PreProcess::include_paths;
+
+/** ディレクトリごとの含まれる通常ファイルの名前 */
+std::unordered_map<string, std::unordered_set<string>> PreProcess::directory_entries;
+
+/** include_pathsとdirectory_entriesを保護するロック(ヘッダファイルを先読みするスレッドからも検索する) */
+std::mutex PreProcess::include_paths_mutex;
+
 /**
  * @brief プリプロセスを行う
  *
@@ -43,14 +76,32 @@ const Input *PreProcess::input_options = nullptr;
  */
 unique_ptr<Token> PreProcess::preprocess(unique_ptr<Token> &&token, const unique_ptr<Input> &in)
 {
+	TimeReport::Scope scope(TimeReport::PH_PREPROCESS);
+
 	/* 入力オプション */
 	input_options = in.get();
 
 	/* 事前定義マクロの定義 */
 	init_macros();
 
+	/* -include-pchオプションが指定されていれば、プリコンパイル済みヘッダをインクルードした直後の状態にする */
+	if (!in->_include_pch.empty())
+	{
+		Pch::load(in->_include_pch, in);
+	}
+
+	/* インクルードされるヘッダファイルの先読みを始める。
+	 * メモリ使用量の計測中と、ヘッダファイルのキャッシュを使うコンパイルサーバでは先読みしない */
+	if (!in->_opt_mem_report && !Token::is_file_cache_enabled())
+	{
+		Prefetch::start(in->_threads);
+		Prefetch::scan(token.get());
+	}
+
 	/* プリプロセスマクロとディレクティブを処理 */
 	token = preprocess2(move(token));
+	Prefetch::stop();
+	header_cache.clear();
 
 	/* #ifと#endifの対応を確認 */
 	if (!cond_incl.empty())
@@ -111,6 +162,8 @@ unique_ptr<Token> PreProcess::preprocess2(unique_ptr<Token> &&token)
 
 		if (token->is_equal("include"))
 		{
+			TimeReport::Scope scope(TimeReport::PH_INCLUDE);
+
 			bool dquote;
 			string filename = read_include_filename(token, move(token->_next), dquote);
 
@@ -122,6 +175,13 @@ unique_ptr<Token> PreProcess::preprocess2(unique_ptr<Token> &&token)
 				error_token("ファイルが見つかりません", start.get());
 			}
 
+			/* 2回目以降は読み込まなくても結果が変わらないファイルは飛ばす */
+			if (is_included_once(inc_path))
+			{
+				TimeReport::count_skipped_include();
+				continue;
+			}
+
 			/* includeしたトークンを繋ぐ */
 			token = include_file(move(token), inc_path);
 			continue;
@@ -142,7 +202,7 @@ unique_ptr<Token> PreProcess::preprocess2(unique_ptr<Token> &&token)
 				error_token("マクロ名は識別子である必要があります", token.get());
 			}
 			/* マクロを削除する */
-			delete_macro(token->_str);
+			delete_macro(token->_atom);
 			token = skip_line(move(token->_next));
 			continue;
 		}
@@ -244,6 +304,21 @@ unique_ptr<Token> PreProcess::preprocess2(unique_ptr<Token> &&token)
 			continue;
 		}
 
+		if (token->is_equal("pragma"))
+		{
+			/* #pragma onceのファイルは以降インクルードしない */
+			if (!token->_next->_at_begining && token->_next->is_equal("once"))
+			{
+				pragma_once_files.insert(canonical_path(start->_file->_name));
+			}
+			/* それ以外の#pragmaは無視する */
+			do
+			{
+				token = move(token->_next);
+			} while (!token->_at_begining);
+			continue;
+		}
+
 		error_token("無効なプリプロセッサディレクティブです", token.get());
 	}
 
@@ -300,14 +375,7 @@ void PreProcess::convert_keywords(unique_ptr<Token> &token)
  */
 bool PreProcess::is_keyword(const Token *token)
 {
-	for (auto &kw : keywords)
-	{
-		if (kw == token->_str)
-		{
-			return true;
-		}
-	}
-	return false;
+	return token->_atom.is_keyword();
 }
 
 /**
@@ -355,6 +423,7 @@ unique_ptr<Token> PreProcess::new_eof_token(const unique_ptr<Token> &src)
 	auto t = Token::copy_token(src.get());
 	t->_kind = TokenKind::TK_EOF;
 	t->_str = "";
+	t->_atom = Atom();
 	return t;
 }
 
@@ -448,6 +517,8 @@ unique_ptr<Token> PreProcess::copy_line(unique_ptr<Token> &next_token, unique_pt
  */
 long PreProcess::evaluate_const_expr(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token)
 {
+	TimeReport::Scope scope(TimeReport::PH_COND);
+
 	auto start = current_token.get();
 	/* 文末までのトークンを読み取る */
 	auto expr = read_const_expr(next_token, move(current_token->_next));
@@ -516,7 +587,7 @@ unique_ptr<Token> PreProcess::read_const_expr(unique_ptr<Token> &next_token, uni
 				error_token("definedの引数はマクロ名である必要があります", start.get());
 			}
 
-			cur->_next = new_num_token(macros.contains(tok->_str) ? 1 : 0, start.get());
+			cur->_next = new_num_token(macros.contains(tok->_atom) ? 1 : 0, start.get());
 			cur = cur->_next.get();
 
 			tok = move(tok->_next);
@@ -591,9 +662,10 @@ Macro *PreProcess::find_macro(const unique_ptr<Token> &token)
 		return nullptr;
 	}
 
-	if (macros.contains(token->_str))
+	auto it = macros.find(token->_atom);
+	if (it != macros.end())
 	{
-		return macros[token->_str].get();
+		return it->second.get();
 	}
 	else
 	{
@@ -611,12 +683,13 @@ Macro *PreProcess::find_macro(const unique_ptr<Token> &token)
  */
 Macro *PreProcess::add_macro(const unique_ptr<Token> &token, const bool &is_objlike, unique_ptr<Token> &&body)
 {
-	if (macros.contains(token->_str))
+	auto &m = macros[token->_atom];
+	if (m)
 	{
 		warn_token("マクロが再定義されています", 1, token.get());
 	}
-	macros[token->_str] = make_unique<Macro>(move(body), is_objlike);
-	return macros[token->_str].get();
+	m = make_unique<Macro>(move(body), is_objlike);
+	return m.get();
 }
 
 /**
@@ -629,7 +702,7 @@ Macro *PreProcess::add_macro(const unique_ptr<Token> &token, const bool &is_objl
  */
 bool PreProcess::expand_macro(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token)
 {
-	auto name = current_token->_str;
+	auto name = current_token->_atom;
 	auto macro_token = move(current_token);
 
 	if (macro_token->_hideset && macro_token->_hideset->contains(name))
@@ -645,6 +718,8 @@ bool PreProcess::expand_macro(unique_ptr<Token> &next_token, unique_ptr<Token> &
 		return false;
 	}
 
+	TimeReport::Scope scope(TimeReport::PH_MACRO);
+
 	/* 動的な事前定義マクロ（__LINE__など） */
 	if (m->_handler)
 	{
@@ -661,9 +736,10 @@ bool PreProcess::expand_macro(unique_ptr<Token> &next_token, unique_ptr<Token> &
 
 		auto body = substitute_obj_macro(macro_token, m->_body);
 		/* 展開元のマクロの行数情報をコピー */
+		const auto line_no = macro_token->line_no();
 		for (auto t = body.get(); TokenKind::TK_EOF != t->_kind; t = t->_next.get())
 		{
-			t->_line_no = macro_token->_line_no;
+			t->_line_no = line_no;
 		}
 		/* 展開したマクロのトークンリストの末尾に現在のトークンシルトを接続する */
 		next_token = append(move(body), move(macro_token->_next));
@@ -685,9 +761,10 @@ bool PreProcess::expand_macro(unique_ptr<Token> &next_token, unique_ptr<Token> &
 	/* 引数を代入してマクロを展開する */
 	auto body = substitute_func_macro(macro_token, m->_body, *args);
 	/* 展開元のマクロの行数情報をコピー */
+	const auto line_no = macro_token->line_no();
 	for (auto t = body.get(); TokenKind::TK_EOF != t->_kind; t = t->_next.get())
 	{
-		t->_line_no = macro_token->_line_no;
+		t->_line_no = line_no;
 	}
 	next_token = append(move(body), move(current_token));
 	next_token->_has_space = macro_token->_has_space;
@@ -706,7 +783,7 @@ unique_ptr<Token> PreProcess::substitute_obj_macro(const unique_ptr<Token> &dst,
 {
 	/* マクロの展開先のトークンリストをコピーする */
 	auto head = make_unique_for_overwrite<Token>();
-	copy_macro_token(head.get(), macro.get(), dst->_str, dst->_hideset);
+	copy_macro_token(head.get(), macro.get(), dst->_atom, dst->_hideset);
 	return move(head->_next);
 }
 
@@ -720,7 +797,7 @@ unique_ptr<Token> PreProcess::substitute_obj_macro(const unique_ptr<Token> &dst,
  */
 unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst, const unique_ptr<Token> &macro, const MacroArgs &args)
 {
-	auto name = dst->_str;
+	auto name = dst->_atom;
 
 	/* マクロの展開先のトークンリストをコピーする */
 	auto head = make_unique_for_overwrite<Token>();
@@ -732,11 +809,11 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
 		/* #引数は引数をそのまま文字列リテラルとして置き換える */
 		if (tok->is_equal("#"))
 		{
-			if (!args.contains(tok->_next->_str))
+			if (!args.contains(tok->_next->_atom))
 			{
 				error_token("'#'の後にはマクロ引数が必要です", tok->_next.get());
 			}
-			cur->_next = stringize(dst.get(), args.at(tok->_next->_str).get());
+			cur->_next = stringize(dst.get(), args.at(tok->_next->_atom).get());
 			cur->_next->_at_begining = tok->_at_begining;
 			cur->_next->_has_space = tok->_has_space;
 			cur = cur->_next.get();
@@ -757,9 +834,9 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
 			}
 
 			/* ##演算子の二番目のオペランドが引数の場合 */
-			if (args.contains(tok->_next->_str))
+			if (args.contains(tok->_next->_atom))
 			{
-				auto arg_token = args.at(tok->_next->_str).get();
+				auto arg_token = args.at(tok->_next->_atom).get();
 				/* 引数が空でないとき引数の先頭トークンと連結する */
 				if (TokenKind::TK_EOF != arg_token->_kind)
 				{
@@ -781,18 +858,18 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
 		}
 
 		/* (引数トークン)##(トークン) */
-		if (args.contains(tok->_str) && tok->_next->is_equal("##"))
+		if (args.contains(tok->_atom) && tok->_next->is_equal("##"))
 		{
 			auto rhs = tok->_next->_next.get();
-			auto arg_token = args.at(tok->_str).get();
+			auto arg_token = args.at(tok->_atom).get();
 
 			/* １番目のオペランドの引数トークンが空の場合 */
 			if (TokenKind::TK_EOF == arg_token->_kind)
 			{
 				/* 2番目のオペランドのトークンが引数の場合 */
-				if (args.contains(rhs->_str))
+				if (args.contains(rhs->_atom))
 				{
-					for (auto t = args.at(rhs->_str).get(); TokenKind::TK_EOF != t->_kind; t = t->_next.get())
+					for (auto t = args.at(rhs->_atom).get(); TokenKind::TK_EOF != t->_kind; t = t->_next.get())
 					{
 						cur->_next = Token::copy_token(t);
 						cur = cur->_next.get();
@@ -818,9 +895,9 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
 		}
 
 		/* マクロの引数トークンの場合。マクロの引数にマクロが含まれる場合はマクロは完全に展開する */
-		if (args.contains(tok->_str))
+		if (args.contains(tok->_atom))
 		{
-			copy_macro_token(cur, args.at(tok->_str).get(), name, dst->_hideset);
+			copy_macro_token(cur, args.at(tok->_atom).get(), name, dst->_hideset);
 			cur->_next = preprocess2(move(cur->_next));
 			cur->_next->_has_space = tok->_has_space;
 			cur->_next->_at_begining = tok->_at_begining;
@@ -834,11 +911,7 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
 
 		/* マクロの引数トークンではない場合 */
 		auto t = Token::copy_token(tok);
-		add_hideset(t->_hideset, name);
-		if (dst->_hideset)
-		{
-			t->_hideset->merge(*dst->_hideset);
-		}
+		t->_hideset = Hideset::merge(Hideset::add(t->_hideset, name), dst->_hideset);
 		cur->_next = move(t);
 		cur = cur->_next.get();
 		tok = tok->_next.get();
@@ -855,9 +928,9 @@ unique_ptr<Token> PreProcess::substitute_func_macro(const unique_ptr<Token> &dst
  * @param マクロが可変長引数を取るかどうかを返すための参照
  * @return 読み取った引数リスト
  */
-unique_ptr<vector<string>> PreProcess::read_macro_params(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, bool &is_variadic)
+unique_ptr<vector<Atom>> PreProcess::read_macro_params(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, bool &is_variadic)
 {
-	auto params = make_unique<vector<string>>();
+	auto params = make_unique<vector<Atom>>();
 	bool first = true;
 
 	/* ')'が出てくるまで読み込み続ける */
@@ -884,7 +957,7 @@ unique_ptr<vector<string>> PreProcess::read_macro_params(unique_ptr<Token> &next
 			error_token("識別子ではありません", current_token.get());
 		}
 
-		params->emplace_back(current_token->_str);
+		params->emplace_back(current_token->_atom);
 		current_token = move(current_token->_next);
 	}
 	next_token = move(current_token->_next);
@@ -954,7 +1027,7 @@ unique_ptr<Token> PreProcess::resd_macro_arg_one(unique_ptr<Token> &next_token,
 unique_ptr<MacroArgs> PreProcess::read_macro_args(
 	unique_ptr<Token> &next_token,
 	unique_ptr<Token> &&current_token,
-	const vector<string> &params,
+	const vector<Atom> &params,
 	const bool &is_variadic)
 {
 	auto args = make_unique<MacroArgs>();
@@ -990,7 +1063,7 @@ unique_ptr<MacroArgs> PreProcess::read_macro_args(
 			}
 			varg = resd_macro_arg_one(current_token, move(current_token), true);
 		}
-		(*args)["__VA_ARGS__"] = move(varg);
+		(*args)[Atom("__VA_ARGS__")] = move(varg);
 	}
 	else if (!current_token->is_equal(")"))
 	{
@@ -1000,33 +1073,14 @@ unique_ptr<MacroArgs> PreProcess::read_macro_args(
 	return args;
 }
 
-/**
- * @brief hidesetにマクロ名を追加する
- *
- * @param hs 対象となるhideset
- * @param name 追加するマクロの名前
- */
-void PreProcess::add_hideset(unique_ptr<Hideset> &hs, const string &name)
-{
-	/* hsが空なら新しく作成する */
-	if (!hs)
-	{
-		hs = make_unique<Hideset>();
-	}
-	hs->insert(name);
-}
-
 /**
  * @brief マクロを削除する
  *
  * @param name 削除するマクロの名前
  */
-void PreProcess::delete_macro(const string &name)
+void PreProcess::delete_macro(const Atom &name)
 {
-	if (macros.contains(name))
-	{
-		macros.erase(name);
-	}
+	macros.erase(name);
 }
 
 /**
@@ -1035,11 +1089,11 @@ void PreProcess::delete_macro(const string &name)
  * @param token 対象のトークン
  * @param op 期待している文字列
  */
-unique_ptr<Token> PreProcess::skip(unique_ptr<Token> &&token, const string &op)
+unique_ptr<Token> PreProcess::skip(unique_ptr<Token> &&token, const Atom &op)
 {
 	if (!token->is_equal(op))
 	{
-		error_token("\'" + op + "\'が必要です", token.get());
+		error_token("\'" + op.str() + "\'が必要です", token.get());
 	}
 	return move(token->_next);
 }
@@ -1052,7 +1106,7 @@ unique_ptr<Token> PreProcess::skip(unique_ptr<Token> &&token, const string &op)
  * @param name マクロの名前
  * @param hs マクロの展開元のhideset
  */
-void PreProcess::copy_macro_token(Token *dst, const Token *macro, const string &name, const unique_ptr<Hideset> &hs)
+void PreProcess::copy_macro_token(Token *dst, const Token *macro, const Atom &name, const Hideset *hs)
 {
 	auto tok = macro;
 	auto cur = dst;
@@ -1063,13 +1117,8 @@ void PreProcess::copy_macro_token(Token *dst, const Token *macro, const string &
 		cur->_next = Token::copy_token(tok);
 		tok = tok->_next.get();
 		cur = cur->_next.get();
-		/* hidesetに展開するマクロ名を追加 */
-		add_hideset(cur->_hideset, name);
-		/* 展開元のトークンのhidesetとマージする */
-		if (hs)
-		{
-			cur->_hideset->merge(*hs);
-		}
+		/* hidesetに展開するマクロ名を追加し、展開元のトークンのhidesetとマージする */
+		cur->_hideset = Hideset::merge(Hideset::add(cur->_hideset, name), hs);
 	}
 	/* EOFトークンをコピー */
 	cur->_next = Token::copy_token(tok);
@@ -1197,12 +1246,9 @@ unique_ptr<Token> PreProcess::paste(const Token *lhs, const Token *rhs)
  */
 unique_ptr<Token> PreProcess::vir_file_tokenize(const string &str, const string &file_name, const int &file_no)
 {
-	/* ファイル構造体の実体を管理するための配列 */
-	static vector<unique_ptr<File>> files;
-
-	files.push_back(make_unique<File>(file_name, file_no, str));
+	virtual_files.push_back(make_unique<File>(file_name, file_no, str));
 	/* ファイルをトークナイズする */
-	auto tok = Token::tokenize(files.back().get());
+	auto tok = Token::tokenize(virtual_files.back().get());
 	return tok;
 }
 
@@ -1274,12 +1320,144 @@ string PreProcess::read_include_filename(unique_ptr<Token> &next_token, unique_p
  */
 unique_ptr<Token> PreProcess::include_file(unique_ptr<Token> &&follow_token, const string &path)
 {
-	auto include_token = Token::tokenize_file(path);
+	/* 既にインクルードしたファイルはトークナイズした結果を複製する。
+	 * File構造体も最初のインクルードのものを使うので、入力ファイルのリストには1度だけ現れる */
+	const auto &canonical = canonical_path(path);
+	auto itr = header_cache.find(canonical);
+	if (itr != header_cache.end())
+	{
+		TimeReport::Scope scope(TimeReport::PH_TOKENIZE);
+		return append(copy_tokens(itr->second.get()), move(follow_token));
+	}
+
+	/* 先読みしていなければここでトークナイズし、インクルードするファイルを先読みする */
+	auto include_token = Prefetch::take(path);
+	if (!include_token)
+	{
+		include_token = Token::tokenize_header(path);
+		Prefetch::scan(include_token.get());
+	}
+
+	/* インクルードガードがあれば記録し、ガードマクロが定義された後は読み込まない。
+	 * ガードがなければ再びインクルードされたときのために、プリプロセスする前のトークンリストを複製しておく */
+	auto guard = find_include_guard(include_token.get());
+	if (Atom() != guard)
+	{
+		include_guards[canonical] = guard;
+	}
+	else
+	{
+		header_cache[canonical] = copy_tokens(include_token.get());
+	}
 	return append(move(include_token), move(follow_token));
 }
 
+/**
+ * @brief ファイルを再び読み込まずに済ませられるかを判定する。
+ * #pragma onceを含むファイルと、インクルードガードのマクロが定義済みのファイルが該当する。
+ *
+ * @param path インクルードするファイルのパス
+ * @return 読み込まずに済ませられるときtrue
+ */
+bool PreProcess::is_included_once(const string &path)
+{
+	if (pragma_once_files.empty() && include_guards.empty())
+	{
+		return false;
+	}
+
+	const auto &canonical = canonical_path(path);
+	if (pragma_once_files.contains(canonical))
+	{
+		return true;
+	}
+	auto itr = include_guards.find(canonical);
+	return itr != include_guards.end() && macros.contains(itr->second);
+}
+
+/**
+ * @brief ファイル全体が#ifndef X, #define X, ..., #endifで囲まれているとき、ガードマクロXを返す。
+ * 最初の#ifndefに対応する#endifの後にトークンがあるものや、#else, #elifを持つものは対象にしない。
+ *
+ * @param token ファイルのトークンリストの先頭
+ * @return ガードマクロ。インクルードガードがなければ空のアトム
+ */
+Atom PreProcess::find_include_guard(const Token *token)
+{
+	/* #ifndef X */
+	if (!is_directive(token, "ifndef") || TokenKind::TK_IDENT != token->_next->_next->_kind ||
+		token->_next->_next->_at_begining)
+	{
+		return Atom();
+	}
+	const auto guard = token->_next->_next->_atom;
+
+	/* 次の行が#define X */
+	auto t = token->_next->_next->_next.get();
+	if (!is_directive(t, "define") || t->_next->_next->_at_begining || t->_next->_next->_atom != guard)
+	{
+		return Atom();
+	}
+
+	/* 最初の#ifndefに対応する#endifを探す */
+	int depth = 1;
+	for (; TokenKind::TK_EOF != t->_kind; t = t->_next.get())
+	{
+		if (is_directive(t, "if") || is_directive(t, "ifdef") || is_directive(t, "ifndef"))
+		{
+			++depth;
+		}
+		else if (1 == depth && (is_directive(t, "else") || is_directive(t, "elif")))
+		{
+			return Atom();
+		}
+		else if (is_directive(t, "endif") && 0 == --depth)
+		{
+			/* #endifの行の後はファイルの終わりでなければならない */
+			for (t = t->_next->_next.get(); TokenKind::TK_EOF != t->_kind && !t->_at_begining; t = t->_next.get())
+			{
+			}
+			return TokenKind::TK_EOF == t->_kind ? guard : Atom();
+		}
+	}
+	return Atom();
+}
+
+/**
+ * @brief トークンが行頭の'#'で始まる指定したディレクティブであるか
+ *
+ * @param token トークン
+ * @param name ディレクティブの名前
+ * @return 指定したディレクティブであるときtrue
+ */
+bool PreProcess::is_directive(const Token *token, const Atom &name)
+{
+	return token->_at_begining && token->is_equal("#") && !token->_next->_at_begining && token->_next->is_equal(name);
+}
+
+/**
+ * @brief ファイルのパスを正規化する。同じファイルを別のパスでインクルードしても同じ結果になる。
+ *
+ * @param path ファイルのパス
+ * @return 正規化したパス。正規化できなければpathのまま
+ */
+const string &PreProcess::canonical_path(const string &path)
+{
+	auto itr = canonical_paths.find(path);
+	if (itr != canonical_paths.end())
+	{
+		return itr->second;
+	}
+
+	std::error_code ec;
+	auto canonical = fs::weakly_canonical(path, ec);
+	return canonical_paths.emplace(path, ec ? path : canonical.string()).first->second;
+}
+
 /**
  * @brief インクルードファイルのパスを検索する。見つからなければ空文字列を返す。
+ * 結果は見つからなかった場合も含めて、#include "..."では現在のファイルのディレクトリごとに、
+ * #include <...>では翻訳単位全体で記録して使い回す。
  *
  * @param current_path 現在処理しているファイルのパス
  * @param filename インクルードファイルの名前
@@ -1288,9 +1466,6 @@ unique_ptr<Token> PreProcess::include_file(unique_ptr<Token> &&follow_token, con
  */
 string PreProcess::search_include_path(const string &current_path, const string &filename, const bool &dquote)
 {
-
-	constexpr string_view std_inc_path[] = {"/usr/local/include", "/usr/include/x86_64-linux-gnu", "/usr/include"};
-
 	fs::path pfilename = filename;
 	/* 絶対パス */
 	if (pfilename.is_absolute())
@@ -1298,8 +1473,33 @@ string PreProcess::search_include_path(const string &current_path, const string
 		return filename;
 	}
 
-	/* 現在のファイル */
+	/* 検索結果はディレクトリ、形式、ファイル名で決まる('\0'はパスに現れないので区切りに使う) */
 	fs::path pcurrent_path = current_path;
+	string key = dquote ? pcurrent_path.parent_path().string() : "";
+	key += dquote ? string_view("\0\"", 2) : string_view("\0<", 2);
+	key += filename;
+
+	std::lock_guard<std::mutex> lock(include_paths_mutex);
+	auto itr = include_paths.find(key);
+	if (itr == include_paths.end())
+	{
+		itr = include_paths.emplace(move(key), find_include_file(move(pcurrent_path), pfilename, dquote)).first;
+	}
+	return itr->second;
+}
+
+/**
+ * @brief 現在のファイルのディレクトリ、-Iオプションのパス、標準インクルードパスの順にインクルードファイルを探す
+ *
+ * @param current_path 現在処理しているファイルのパス
+ * @param filename インクルードファイルの名前(相対パス)
+ * @param dquote #include "..."形式であるか
+ * @return インクルードファイルのパス。見つからなければ空文字列
+ */
+string PreProcess::find_include_file(fs::path current_path, const fs::path &filename, const bool &dquote)
+{
+	constexpr string_view std_inc_path[] = {"/usr/local/include", "/usr/include/x86_64-linux-gnu", "/usr/include"};
+
 	/* インクルードするファイルのパス */
 	fs::path inc_path;
 
@@ -1307,9 +1507,9 @@ string PreProcess::search_include_path(const string &current_path, const string
 	if (dquote)
 	{
 		/* 現在のファイルからの相対パス */
-		inc_path = pcurrent_path.replace_filename(filename);
+		inc_path = current_path.replace_filename(filename);
 		/* ファイルが存在するとき読み込む */
-		if (fs::is_regular_file(inc_path))
+		if (is_file_in_directory(inc_path))
 		{
 			return inc_path.string();
 		}
@@ -1319,9 +1519,9 @@ string PreProcess::search_include_path(const string &current_path, const string
 	for (const auto &base_path : input_options->_include)
 	{
 		/* includeするファイルのパスを生成、base_pathからの相対パス */
-		inc_path = fs::path(base_path) / pfilename;
+		inc_path = fs::path(base_path) / filename;
 		/* ファイルが存在するときパスを返す */
-		if (fs::is_regular_file(inc_path))
+		if (is_file_in_directory(inc_path))
 		{
 			return inc_path.string();
 		}
@@ -1331,9 +1531,9 @@ string PreProcess::search_include_path(const string &current_path, const string
 	for (const auto &base_path : std_inc_path)
 	{
 		/* includeするファイルのパスを生成、base_pathからの相対パス */
-		inc_path = fs::path(base_path) / pfilename;
+		inc_path = fs::path(base_path) / filename;
 		/* ファイルが存在するときパスを返す */
-		if (fs::is_regular_file(inc_path))
+		if (is_file_in_directory(inc_path))
 		{
 			return inc_path.string();
 		}
@@ -1343,6 +1543,36 @@ string PreProcess::search_include_path(const string &current_path, const string
 	return "";
 }
 
+/**
+ * @brief パスが通常ファイル(を指すシンボリックリンク)であるか。
+ * ディレクトリの中身を最初に調べたときに一覧にしておき、以降はファイルシステムに問い合わせない。
+ *
+ * @param path ファイルのパス
+ * @return 通常ファイルであればtrue
+ */
+bool PreProcess::is_file_in_directory(const fs::path &path)
+{
+	auto dir = path.parent_path();
+	auto itr = directory_entries.find(dir.string());
+	if (itr == directory_entries.end())
+	{
+		/* ディレクトリが存在しなければ空の一覧にする */
+		std::unordered_set<string> entries;
+		std::error_code ec;
+		for (fs::directory_iterator it(dir.empty() ? "." : dir, ec), end; !ec && it != end; it.increment(ec))
+		{
+			/* シンボリックリンクのときだけリンク先を調べる */
+			std::error_code type_ec;
+			if (it->is_regular_file(type_ec))
+			{
+				entries.emplace(it->path().filename().string());
+			}
+		}
+		itr = directory_entries.emplace(dir.string(), move(entries)).first;
+	}
+	return itr->second.contains(path.filename().string());
+}
+
 /**
  * @brief マクロを定義する
  *
@@ -1352,7 +1582,7 @@ string PreProcess::search_include_path(const string &current_path, const string
 void PreProcess::define_macro(const string &name, const string &buf)
 {
 	auto tok = vir_file_tokenize(buf, "<built-in>", 1);
-	macros[name] = make_unique<Macro>(move(tok), true);
+	macros[Atom(name)] = make_unique<Macro>(move(tok), true);
 }
 
 /**
@@ -1365,14 +1595,126 @@ void PreProcess::add_builtin(const string &name, const Macro_handler_fn &fn)
 {
 	auto m = make_unique<Macro>(nullptr, true);
 	m->_handler = fn;
-	macros[name] = move(m);
+	macros[Atom(name)] = move(m);
+}
+
+/**
+ * @brief 翻訳単位ごとの状態(マクロ、#if関連の条件リスト、多重インクルードの記録)を初期化する。
+ * 事前定義マクロは次回のinit_macros()で複製し直す。
+ *
+ */
+void PreProcess::reset()
+{
+	cond_incl.clear();
+	macros.clear();
+	virtual_files.clear();
+	canonical_paths.clear();
+	include_guards.clear();
+	pragma_once_files.clear();
+	header_cache.clear();
+	include_paths.clear();
+	Hideset::reset();
+	directory_entries.clear();
+	input_options = nullptr;
+}
+
+/**
+ * @brief 事前定義マクロをあらかじめトークナイズしておく。
+ * コンパイルサーバが起動時に呼び出し、forkした子プロセスに引き継ぐ。
+ *
+ */
+void PreProcess::warm_up()
+{
+	init_macros();
+	reset();
+}
+
+/**
+ * @brief マクロを複製する
+ *
+ * @param src 複製元のマクロ
+ * @return 複製したマクロ
+ */
+unique_ptr<Macro> PreProcess::copy_macro(const Macro *src)
+{
+	auto m = make_unique<Macro>(src->_body ? copy_tokens(src->_body.get()) : nullptr, src->_is_objlike);
+	if (src->_params)
+	{
+		m->_params = make_unique<vector<Atom>>(*src->_params);
+	}
+	m->_is_variadic = src->_is_variadic;
+	m->_handler = src->_handler;
+	return m;
+}
+
+/**
+ * @brief 事前定義マクロであるか。事前定義マクロの展開先はinit_macros()で複製したものなので、事前定義マクロ用のファイルを指す
+ *
+ * @param macro マクロ
+ * @return 事前定義マクロであればtrue
+ */
+bool PreProcess::is_builtin_macro(const Macro *macro)
+{
+	if (macro->_handler)
+	{
+		return true;
+	}
+	if (!macro->_body)
+	{
+		return false;
+	}
+	return std::any_of(builtin_files.begin(), builtin_files.end(), [macro](const auto &file)
+					   { return file.get() == macro->_body->_file; });
+}
+
+/**
+ * @brief トークンリストを末尾(終端トークンを含む)まで複製する
+ *
+ * @param token 複製元のトークンリストの先頭
+ * @return 複製したトークンリスト
+ */
+unique_ptr<Token> PreProcess::copy_tokens(const Token *token)
+{
+	auto head = make_unique_for_overwrite<Token>();
+	auto cur = head.get();
+	for (auto t = token; t; t = t->_next.get())
+	{
+		cur->_next = Token::copy_token(t);
+		cur = cur->_next.get();
+	}
+	return move(head->_next);
 }
 
 /**
  * @brief 事前定義マクロを定義する。（例：__STDC__）
+ * 事前定義マクロのトークナイズはプロセスで一度だけ行い、以降の翻訳単位では複製して使う。
  *
  */
 void PreProcess::init_macros()
+{
+	if (builtin_macros.empty())
+	{
+		/* 事前定義マクロは翻訳単位をまたいで使うので、翻訳単位ごとのトークンとは別のアリーナに置く */
+		Token::set_thread_arena(&Token::persistent_arena());
+		define_builtin_macros();
+		Token::set_thread_arena(nullptr);
+		builtin_macros = move(macros);
+		builtin_files = move(virtual_files);
+		macros.clear();
+		virtual_files.clear();
+	}
+
+	for (const auto &[name, m] : builtin_macros)
+	{
+		macros[name] = copy_macro(m.get());
+	}
+}
+
+/**
+ * @brief 事前定義マクロをトークナイズしてmacrosに登録する
+ *
+ */
+void PreProcess::define_builtin_macros()
 {
 	add_builtin("__FILE__", file_macro);
 	add_builtin("__LINE__", line_macro);
@@ -1439,7 +1781,7 @@ unique_ptr<Token> PreProcess::file_macro(const Token *macro_token)
  */
 unique_ptr<Token> PreProcess::line_macro(const Token *macro_token)
 {
-	return new_num_token(macro_token->_line_no, macro_token);
+	return new_num_token(macro_token->line_no(), macro_token);
 }
 
 /**
@@ -1473,7 +1815,7 @@ void PreProcess::join_adjacent_string_literals(Token *token1)
 		buf += token2->_str.substr(1, token2->_str.size() - 2);
 		buf.push_back('"');
 
-		token1->_str = buf;
+		token1->_str = token1->_file->_source->store(move(buf));
 		token1->_next = move(token2->_next);
 		token1 = token1->_next.get();
 	}
@@ -12,10 +12,11 @@
 #pragma once
 
 #include "common.hpp"
+#include "tokenize.hpp"
+#include <mutex>
 
-class Token;
 class Input;
-using MacroArgs = std::unordered_map<string, unique_ptr<Token>>;
+using MacroArgs = std::unordered_map<Atom, unique_ptr<Token>>;
 using Macro_handler_fn = unique_ptr<Token> (*)(const Token *);
 
 /**
@@ -58,7 +59,7 @@ public:
 	struct Macro
 	{
 		unique_ptr<Token> _body;			 /*!< マクロの展開先 */
-		unique_ptr<vector<string>> _params;	 /*!< 関数マクロの引数 */
+		unique_ptr<vector<Atom>> _params;	 /*!< 関数マクロの引数 */
 		bool _is_objlike = true;			 /*!< オブジェクトマクロであるか */
 		bool _is_variadic = false;			 /*!< 可変長引数をとるか */
 		Macro_handler_fn _handler = nullptr; /*!< 動的な事前定義マクロの動作(__LINE__など) */
@@ -68,8 +69,14 @@ public:
 
 	/* 静的メンバ関数(public) */
 	static unique_ptr<Token> preprocess(unique_ptr<Token> &&token, const unique_ptr<Input> &in);
+	static void reset();
+	static void warm_up();
+	static string join_tokens(const Token *start, const Token *end);
+	static string search_include_path(const string &current_path, const string &filename, const bool &dquote);
 
 private:
+	friend class Pch;
+
 	PreProcess();
 	/* 静的メンバ関数(private) */
 	static unique_ptr<Token> preprocess2(unique_ptr<Token> &&token);
@@ -85,44 +92,54 @@ private:
 	static void read_macro_definition(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token);
 	static Macro *find_macro(const unique_ptr<Token> &token);
 	static Macro *add_macro(const unique_ptr<Token> &token, const bool &is_objlike, unique_ptr<Token> &&body);
-	static void delete_macro(const string &name);
+	static void delete_macro(const Atom &name);
 	static bool expand_macro(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token);
 	static unique_ptr<Token> substitute_obj_macro(const unique_ptr<Token> &dst, const unique_ptr<Token> &macro);
 	static unique_ptr<Token> substitute_func_macro(const unique_ptr<Token> &dst, const unique_ptr<Token> &macro, const MacroArgs &args);
-	static unique_ptr<vector<string>> read_macro_params(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, bool &is_variadic);
+	static unique_ptr<vector<Atom>> read_macro_params(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, bool &is_variadic);
 	static unique_ptr<Token> resd_macro_arg_one(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, const bool &read_rest);
-	static unique_ptr<MacroArgs> read_macro_args(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, const vector<string> &params, const bool &is_variadic);
-	static void add_hideset(unique_ptr<Hideset> &hs, const string &name);
+	static unique_ptr<MacroArgs> read_macro_args(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, const vector<Atom> &params, const bool &is_variadic);
 	static long evaluate_const_expr(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token);
 	static unique_ptr<Token> read_const_expr(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token);
 	static CondIncl *push_cond_incl(unique_ptr<Token> &&token, bool included);
-	static unique_ptr<Token> skip(unique_ptr<Token> &&token, const string &op);
-	static void copy_macro_token(Token *dst, const Token *src, const string &name, const unique_ptr<Hideset> &hs);
+	static unique_ptr<Token> skip(unique_ptr<Token> &&token, const Atom &op);
+	static void copy_macro_token(Token *dst, const Token *src, const Atom &name, const Hideset *hs);
 	static string quate_string(const string &str);
 	static unique_ptr<Token> new_str_token(const string &str, const Token *ref);
 	static unique_ptr<Token> new_num_token(const int &val, const Token *ref);
-	static string join_tokens(const Token *start, const Token *end);
 	static unique_ptr<Token> stringize(const Token *ref, const Token *arg);
 	static unique_ptr<Token> paste(const Token *lhs, const Token *rhs);
 	static unique_ptr<Token> vir_file_tokenize(const string &str, const string &file_name, const int &file_no);
 	static string read_include_filename(unique_ptr<Token> &next_token, unique_ptr<Token> &&current_token, bool &is_dquote);
 	static unique_ptr<Token> include_file(unique_ptr<Token> &&follow_token, const string &path);
-	static string search_include_path(const string &current_path, const string &filename, const bool &dquote);
+	static bool is_included_once(const string &path);
+	static Atom find_include_guard(const Token *token);
+	static bool is_directive(const Token *token, const Atom &name);
+	static const string &canonical_path(const string &path);
+	static string find_include_file(fs::path current_path, const fs::path &filename, const bool &dquote);
+	static bool is_file_in_directory(const fs::path &path);
 	static void define_macro(const string &name, const string &buf);
 	static void add_builtin(const string &name, const Macro_handler_fn &fn);
 	static void init_macros();
+	static void define_builtin_macros();
+	static unique_ptr<Macro> copy_macro(const Macro *src);
+	static bool is_builtin_macro(const Macro *macro);
+	static unique_ptr<Token> copy_tokens(const Token *token);
 	static unique_ptr<Token> file_macro(const Token *macro_token);
 	static unique_ptr<Token> line_macro(const Token *macro_token);
 	static void join_adjacent_string_literals(Token *token);
 
 	static vector<unique_ptr<CondIncl>> cond_incl;
-	static std::unordered_map<string, unique_ptr<Macro>> macros;
+	static std::unordered_map<Atom, unique_ptr<Macro>> macros;
+	static std::unordered_map<Atom, unique_ptr<Macro>> builtin_macros;
+	static vector<unique_ptr<File>> virtual_files;
+	static vector<unique_ptr<File>> builtin_files;
 	static const Input *input_options;
-
-	/** 識別子一覧 */
-	static constexpr string_view keywords[] = {"return", "if", "else", "for", "while", "int", "sizeof", "char", "float", "double",
-											   "struct", "union", "short", "long", "void", "typedef", "_Bool",
-											   "enum", "static", "goto", "break", "continue", "switch", "case",
-											   "default", "extern", "_Alignof", "_Alignas", "do", "signed", "unsigned",
-											   "const", "volatile", "auto", "register", "restrict", "__restrict", "__restrict__", "_Noreturn"};
+	static std::unordered_map<string, string> canonical_paths;
+	static std::unordered_map<string, Atom> include_guards;
+	static std::unordered_set<string> pragma_once_files;
+	static std::unordered_map<string, unique_ptr<Token>> header_cache;
+	static std::unordered_map<string, string> include_paths;
+	static std::unordered_map<string, std::unordered_set<string>> directory_entries;
+	static std::mutex include_paths_mutex;
 };
\ No newline at end of file
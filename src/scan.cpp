@@ -0,0 +1,364 @@
+/**
+ * @file scan.cpp
+ * @author K.Fukunaga
+ * @brief トークナイザが使う文字列の走査(SIMD版とスカラー版)
+ * @version 0.1
+ * @date 2023-09-11
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "scan.hpp"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**************/
+/* スカラー版 */
+/**************/
+
+/**
+ * @brief 改行以外の空白文字であるか
+ *
+ * @param c 文字
+ * @return 改行以外の空白文字であればtrue
+ */
+static bool is_blank(const char &c)
+{
+	return ' ' == c || ('\t' <= c && c <= '\r' && '\n' != c);
+}
+
+/**
+ * @brief 識別子を構成する文字であるか
+ *
+ * @param c 文字
+ * @return 英数字または'_'であればtrue
+ */
+static bool is_ident(const char &c)
+{
+	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || '_' == c;
+}
+
+/**
+ * @brief 文字列リテラルの中で特別な扱いが必要な文字であるか
+ *
+ * @param c 文字
+ * @return '"', '\\', '\n', '\0'のいずれかであればtrue
+ */
+static bool is_string_special(const char &c)
+{
+	return '"' == c || '\\' == c || '\n' == c || '\0' == c;
+}
+
+static const char *skip_blank_scalar(const char *p, const char *end)
+{
+	while (p != end && is_blank(*p))
+	{
+		++p;
+	}
+	return p;
+}
+
+static const char *ident_end_scalar(const char *p, const char *end)
+{
+	while (p != end && is_ident(*p))
+	{
+		++p;
+	}
+	return p;
+}
+
+static const char *find_char_scalar(const char *p, const char *end, const char &c)
+{
+	while (p != end && c != *p)
+	{
+		++p;
+	}
+	return p;
+}
+
+static const char *string_special_scalar(const char *p, const char *end)
+{
+	while (p != end && !is_string_special(*p))
+	{
+		++p;
+	}
+	return p;
+}
+
+#if defined(__x86_64__)
+
+/************************/
+/* SSE2版(16バイトずつ) */
+/************************/
+
+/**
+ * @brief 16バイト中の各バイトが改行以外の空白文字であるかのマスク
+ *
+ */
+static __m128i blank_mask_sse2(const __m128i &v)
+{
+	/* '\t', '\v', '\f', '\r'は'\n'を除く9～13。0x80以上のバイトは負なので範囲に入らない */
+	auto ctrl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+	ctrl = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), ctrl);
+	return _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+/**
+ * @brief 16バイト中の各バイトが識別子を構成する文字であるかのマスク
+ *
+ */
+static __m128i ident_mask_sse2(const __m128i &v)
+{
+	/* 0x20を立てると英大文字は小文字になり、英字以外が'a'～'z'に入ることはない */
+	auto lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	auto alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	auto digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	return _mm_or_si128(_mm_or_si128(alpha, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+}
+
+static const char *skip_blank_sse2(const char *p, const char *end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		unsigned mask = ~_mm_movemask_epi8(blank_mask_sse2(v)) & 0xffff;
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return skip_blank_scalar(p, end);
+}
+
+static const char *ident_end_sse2(const char *p, const char *end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		unsigned mask = ~_mm_movemask_epi8(ident_mask_sse2(v)) & 0xffff;
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return ident_end_scalar(p, end);
+}
+
+static const char *find_char_sse2(const char *p, const char *end, const char &c)
+{
+	const auto target = _mm_set1_epi8(c);
+	for (; end - p >= 16; p += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, target));
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return find_char_scalar(p, end, c);
+}
+
+static const char *string_special_sse2(const char *p, const char *end)
+{
+	for (; end - p >= 16; p += 16)
+	{
+		auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		auto m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+		unsigned mask = _mm_movemask_epi8(m);
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return string_special_scalar(p, end);
+}
+
+/************************/
+/* AVX2版(32バイトずつ) */
+/************************/
+
+__attribute__((target("avx2"))) static __m256i blank_mask_avx2(const __m256i &v)
+{
+	auto ctrl = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+	ctrl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), ctrl);
+	return _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2"))) static __m256i ident_mask_avx2(const __m256i &v)
+{
+	auto lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	auto alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	auto digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+	return _mm256_or_si256(_mm256_or_si256(alpha, digit), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+}
+
+__attribute__((target("avx2"))) static const char *skip_blank_avx2(const char *p, const char *end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(blank_mask_avx2(v)));
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return skip_blank_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *ident_end_avx2(const char *p, const char *end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(ident_mask_avx2(v)));
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return ident_end_sse2(p, end);
+}
+
+__attribute__((target("avx2"))) static const char *find_char_avx2(const char *p, const char *end, const char &c)
+{
+	const auto target = _mm256_set1_epi8(c);
+	for (; end - p >= 32; p += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, target));
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return find_char_sse2(p, end, c);
+}
+
+__attribute__((target("avx2"))) static const char *string_special_avx2(const char *p, const char *end)
+{
+	for (; end - p >= 32; p += 32)
+	{
+		auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		auto m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+		unsigned mask = _mm256_movemask_epi8(m);
+		if (mask)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return string_special_sse2(p, end);
+}
+
+#endif
+
+/**************/
+/* Scan Class */
+/**************/
+
+/** 実装の一覧 */
+const Scan::Impl Scan::impls[] = {
+	{SCALAR, skip_blank_scalar, ident_end_scalar, find_char_scalar, string_special_scalar},
+#if defined(__x86_64__)
+	{SSE2, skip_blank_sse2, ident_end_sse2, find_char_sse2, string_special_sse2},
+	{AVX2, skip_blank_avx2, ident_end_avx2, find_char_avx2, string_special_avx2},
+#endif
+};
+
+/** 使用している実装 */
+Scan::Impl Scan::impl = *find_impl(best_level());
+
+/**
+ * @brief CPUが対応している最も速い実装の種類を返す
+ *
+ * @return 実装の種類
+ */
+Scan::Level Scan::best_level()
+{
+#if defined(__x86_64__)
+	return __builtin_cpu_supports("avx2") ? AVX2 : SSE2;
+#else
+	return SCALAR;
+#endif
+}
+
+/**
+ * @brief 使用する実装を切り替える
+ *
+ * @param level 実装の種類
+ * @return このCPUで使える実装であればtrue
+ */
+bool Scan::set_level(const Level &level)
+{
+	if (level > best_level())
+	{
+		return false;
+	}
+	auto found = find_impl(level);
+	if (!found)
+	{
+		return false;
+	}
+	impl = *found;
+	return true;
+}
+
+/**
+ * @brief 使用する実装を名前(scalar, sse2, avx2, auto)で切り替える
+ *
+ * @param name 実装の名前
+ * @return 名前が正しく、このCPUで使える実装であればtrue
+ */
+bool Scan::set_level(const string &name)
+{
+	if ("auto" == name)
+	{
+		return set_level(best_level());
+	}
+	if ("scalar" == name)
+	{
+		return set_level(SCALAR);
+	}
+	if ("sse2" == name)
+	{
+		return set_level(SSE2);
+	}
+	if ("avx2" == name)
+	{
+		return set_level(AVX2);
+	}
+	return false;
+}
+
+/**
+ * @brief 使用している実装の種類を返す
+ *
+ * @return 実装の種類
+ */
+Scan::Level Scan::get_level()
+{
+	return impl._level;
+}
+
+/**
+ * @brief 実装の一覧から種類が一致するものを探す
+ *
+ * @param level 実装の種類
+ * @return 実装。このアーキテクチャで使えなければnullptr
+ */
+const Scan::Impl *Scan::find_impl(const Level &level)
+{
+	for (const auto &i : impls)
+	{
+		if (level == i._level)
+		{
+			return &i;
+		}
+	}
+	return nullptr;
+}
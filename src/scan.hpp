@@ -0,0 +1,115 @@
+/**
+ * @file scan.hpp
+ * @author K.Fukunaga
+ * @brief トークナイザが使う文字列の走査(SIMD版とスカラー版)
+ * @version 0.1
+ * @date 2023-09-11
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+
+/**
+ * @brief 空白、コメント、識別子、文字列リテラルの終わりを探す関数をまとめたクラス
+ *
+ * @details x86-64ではSSE2(16バイトずつ)とAVX2(32バイトずつ)の実装を持ち、起動時にCPUが対応している最も速い実装を選ぶ。
+ * スカラー版は他のアーキテクチャでの実装であり、SIMD版の末尾の処理とテストの基準を兼ねる。
+ * どの実装も[p, end)の外は読まないので、入力の末尾がページ境界にあっても安全に使える。
+ * -fscan=オプションで実装を指定できる(実装の間で結果を比較するテスト用)。
+ */
+class Scan
+{
+public:
+	/**
+	 * @brief 実装の種類
+	 *
+	 */
+	enum Level
+	{
+		SCALAR, /*!< 1バイトずつ */
+		SSE2,	/*!< 16バイトずつ */
+		AVX2,	/*!< 32バイトずつ */
+	};
+
+	/* 静的メンバ関数(public) */
+
+	/**
+	 * @brief 改行以外の空白文字(' ', '\\t', '\\v', '\\f', '\\r')を読み飛ばす
+	 *
+	 * @param p 開始位置
+	 * @param end 末尾
+	 * @return 空白文字でない最初の文字の位置。なければend
+	 */
+	static const char *skip_blank(const char *p, const char *end)
+	{
+		return impl._skip_blank(p, end);
+	}
+
+	/**
+	 * @brief 識別子を構成する文字(英数字と'_')を読み飛ばす
+	 *
+	 * @param p 開始位置
+	 * @param end 末尾
+	 * @return 識別子を構成しない最初の文字の位置。なければend
+	 */
+	static const char *ident_end(const char *p, const char *end)
+	{
+		return impl._ident_end(p, end);
+	}
+
+	/**
+	 * @brief 文字を探す(行コメントの終わりの'\\n'、ブロックコメントの'*'など)
+	 *
+	 * @param p 開始位置
+	 * @param end 末尾
+	 * @param c 探す文字
+	 * @return 最初に現れる位置。なければend
+	 */
+	static const char *find_char(const char *p, const char *end, const char &c)
+	{
+		return impl._find_char(p, end, c);
+	}
+
+	/**
+	 * @brief 文字列リテラルの中で特別な扱いが必要な文字('"', '\\\\', '\\n', '\\0')を探す
+	 *
+	 * @param p 開始位置
+	 * @param end 末尾
+	 * @return 最初に現れる位置。なければend
+	 */
+	static const char *string_special(const char *p, const char *end)
+	{
+		return impl._string_special(p, end);
+	}
+
+	static Level best_level();
+	static bool set_level(const Level &level);
+	static bool set_level(const string &name);
+	static Level get_level();
+
+private:
+	/**
+	 * @brief 実装の関数の組
+	 *
+	 */
+	struct Impl
+	{
+		Level _level;												   /*!< 実装の種類 */
+		const char *(*_skip_blank)(const char *, const char *);		   /*!< skip_blank()の実装 */
+		const char *(*_ident_end)(const char *, const char *);		   /*!< ident_end()の実装 */
+		const char *(*_find_char)(const char *, const char *, const char &); /*!< find_char()の実装 */
+		const char *(*_string_special)(const char *, const char *);	   /*!< string_special()の実装 */
+	};
+
+	Scan();
+
+	/* 静的メンバ関数(private) */
+	static const Impl *find_impl(const Level &level);
+
+	static const Impl impls[];
+	static Impl impl;
+};
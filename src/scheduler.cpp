@@ -0,0 +1,197 @@
+/**
+ * @file scheduler.cpp
+ * @author K.Fukunaga
+ * @brief 複数の入力ファイルの処理を並列に実行するジョブスケジューラ
+ * @version 0.1
+ * @date 2023-08-20
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "scheduler.hpp"
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** 登録されたジョブの一覧 */
+vector<Scheduler::Job> Scheduler::jobs;
+
+/**
+ * @brief ジョブを登録する。登録したジョブはrun()で実行される。
+ *
+ * @param task 実行する処理
+ */
+void Scheduler::add_job(std::function<void()> &&task)
+{
+	jobs.emplace_back(move(task));
+}
+
+/**
+ * @brief デフォルトの並列数としてオンラインのCPU数を返す
+ *
+ * @return 並列数
+ */
+int Scheduler::default_jobs()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? static_cast<int>(n) : 1;
+}
+
+/**
+ * @brief 登録されたジョブを最大max_jobs個まで並列に実行する。
+ * いずれかのジョブが失敗した場合、コマンドライン順で最初に失敗したジョブまでの出力を行い終了する。
+ *
+ * @param max_jobs 同時に実行するジョブの最大数
+ */
+void Scheduler::run(const int &max_jobs)
+{
+	/* 並列化の必要がなければこのプロセスで順に実行する */
+	if (max_jobs <= 1 || jobs.size() <= 1)
+	{
+		for (auto &job : jobs)
+		{
+			job._task();
+		}
+		jobs.clear();
+		return;
+	}
+
+	/* 次に起動するジョブ */
+	size_t next_launch = 0;
+	/* 次に出力を報告するジョブ */
+	size_t next_report = 0;
+	/* 実行中のジョブの数 */
+	int running = 0;
+	/* 失敗したジョブが見つかったか */
+	bool failed = false;
+	/* 起動したが出力を報告していないジョブの最大数。各ジョブは報告するまで一時ファイルを2つ開いたままにするので、
+	 * 先頭のジョブが長引いても開いたままのファイルが増え続けないようにする */
+	const size_t max_pending = static_cast<size_t>(max_jobs) * 2;
+
+	while (next_report < jobs.size())
+	{
+		/* 空きがあれば次のジョブを起動する。失敗が見つかった後は新たに起動しない */
+		while (!failed && running < max_jobs && next_launch < jobs.size() && next_launch - next_report < max_pending)
+		{
+			launch(jobs[next_launch++]);
+			++running;
+		}
+
+		if (running == 0)
+		{
+			break;
+		}
+
+		/* いずれかの子プロセスの終了を待つ */
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			error("\'waitpid\'に失敗しました");
+		}
+
+		for (auto &job : jobs)
+		{
+			if (job._pid == pid && !job._done)
+			{
+				job._done = true;
+				job._failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+				--running;
+				break;
+			}
+		}
+
+		/* コマンドライン順に終了済みのジョブの出力を報告する */
+		while (next_report < jobs.size() && jobs[next_report]._done)
+		{
+			report(jobs[next_report]);
+			if (jobs[next_report]._failed)
+			{
+				failed = true;
+			}
+			++next_report;
+			if (failed)
+			{
+				break;
+			}
+		}
+
+		/* 最初に失敗したジョブより前のジョブはすべて起動済みのため、実行中のジョブの終了を待って終了する */
+		if (failed)
+		{
+			while (running > 0 && waitpid(-1, &status, 0) > 0)
+			{
+				--running;
+			}
+			exit(1);
+		}
+	}
+
+	jobs.clear();
+}
+
+/**
+ * @brief ジョブをforkした子プロセスで起動する
+ *
+ * @param job 起動するジョブ
+ */
+void Scheduler::launch(Job &job)
+{
+	job._out = tmpfile();
+	job._err = tmpfile();
+	if (!job._out || !job._err)
+	{
+		error("一時ファイルの作成に失敗しました");
+	}
+
+	/* バッファに残った出力が子プロセスで重複しないようにする */
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+
+	job._pid = fork();
+	if (job._pid < 0)
+	{
+		error("\'fork\'に失敗しました");
+	}
+
+	if (job._pid == 0)
+	{
+		/* 子プロセスの出力を一時ファイルに退避 */
+		dup2(fileno(job._out), STDOUT_FILENO);
+		dup2(fileno(job._err), STDERR_FILENO);
+		job._task();
+		exit(0);
+	}
+}
+
+/**
+ * @brief 終了したジョブが退避した出力を書き出す
+ *
+ * @param job 対象のジョブ
+ */
+void Scheduler::report(Job &job)
+{
+	replay(job._out, std::cout);
+	replay(job._err, std::cerr);
+	job._out = job._err = nullptr;
+}
+
+/**
+ * @brief 一時ファイルの内容を出力ストリームに書き出して閉じる
+ *
+ * @param fp 一時ファイル
+ * @param os 出力先
+ */
+void Scheduler::replay(FILE *fp, std::ostream &os)
+{
+	rewind(fp);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+	{
+		os.write(buf, n);
+	}
+	os.flush();
+	fclose(fp);
+}
@@ -0,0 +1,58 @@
+/**
+ * @file scheduler.hpp
+ * @author K.Fukunaga
+ * @brief 複数の入力ファイルの処理を並列に実行するジョブスケジューラ
+ * @version 0.1
+ * @date 2023-08-20
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdio>
+#include <sys/types.h>
+
+/**
+ * @brief 入力ファイルごとのコンパイル、アセンブルの処理を最大N個まで並列に実行するクラス
+ *
+ * @details 各ジョブはforkした子プロセスで実行する。子プロセスの標準出力、標準エラー出力は
+ * 一時ファイルに退避し、コマンドラインで指定された順に出力する。そのため出力内容と
+ * 報告されるエラーは並列数によらず逐次実行した場合と同じになる。先に起動したジョブが終わらなくても、
+ * 出力を報告していないジョブは並列数の2倍までしか起動しないので、開いたままの一時ファイルは一定数に収まる。
+ */
+class Scheduler
+{
+public:
+	/* 静的メンバ関数(public) */
+	static void add_job(std::function<void()> &&task);
+	static void run(const int &max_jobs);
+	static int default_jobs();
+
+private:
+	/**
+	 * @brief ジョブを表す構造体
+	 *
+	 */
+	struct Job
+	{
+		std::function<void()> _task;  /*!< 実行する処理 */
+		pid_t _pid = -1;			  /*!< 実行中の子プロセスのpid */
+		FILE *_out = nullptr;		  /*!< 標準出力の退避先 */
+		FILE *_err = nullptr;		  /*!< 標準エラー出力の退避先 */
+		bool _done = false;			  /*!< 終了したか */
+		bool _failed = false;		  /*!< 失敗したか */
+
+		Job(std::function<void()> &&task) : _task(move(task)) {}
+	};
+
+	Scheduler();
+	/* 静的メンバ関数(private) */
+	static void launch(Job &job);
+	static void report(Job &job);
+	static void replay(FILE *fp, std::ostream &os);
+
+	static vector<Job> jobs;
+};
@@ -0,0 +1,578 @@
+/**
+ * @file server.cpp
+ * @author K.Fukunaga
+ * @brief ヘッダファイルと事前定義マクロを保持し続けるコンパイルサーバ
+ * @version 0.1
+ * @date 2023-09-02
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "server.hpp"
+#include "tokenize.hpp"
+#include "preprocess.hpp"
+#include <cstring>
+#include <cstdint>
+#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/** 処理中の要求の一覧 */
+vector<Server::Request> Server::requests;
+
+/** キャッシュになかったヘッダファイルを報告するパイプ(子プロセスのみ) */
+int Server::report_fd = -1;
+
+/** サーバの子プロセスとして要求を処理しているか */
+bool Server::serving = false;
+
+/** 終了の要求(SIGINT, SIGTERM)を受けたか */
+volatile sig_atomic_t Server::stop_requested = 0;
+
+/** 受け付ける要求の最大サイズ */
+static constexpr uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+/** 要求の受信を待つ最大の秒数 */
+static constexpr time_t REQUEST_TIMEOUT = 10;
+
+/**
+ * @brief コンパイルサーバとして要求を待ち受ける。SIGINTかSIGTERMを受けると処理中の要求を終えてから終了する。
+ *
+ * @param socket_path 待ち受けるUnixドメインソケットのパス
+ * @param run 要求を処理する関数。引数はクライアントのコマンドライン引数で、戻り値を終了ステータスとする
+ * @return 終了ステータス
+ */
+int Server::serve(const string &socket_path, const std::function<int(const vector<string> &)> &run)
+{
+	/* 事前定義マクロを用意しておき、forkした子プロセスに引き継ぐ */
+	PreProcess::warm_up();
+	Token::enable_file_cache();
+
+	int listen_fd = listen_socket(socket_path);
+
+	struct sigaction sa = {};
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::cerr << "fccサーバを起動しました: " << socket_path << std::endl;
+
+	while (!stop_requested)
+	{
+		vector<pollfd> fds;
+		fds.push_back({listen_fd, POLLIN, 0});
+		for (const auto &req : requests)
+		{
+			fds.push_back({req._report, POLLIN, 0});
+		}
+
+		if (poll(fds.data(), fds.size(), -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			error("\'poll\'に失敗しました");
+		}
+
+		/* 子プロセスからの報告を読む。パイプが閉じられたら要求の処理は終わっている */
+		for (size_t i = requests.size(); i-- > 0;)
+		{
+			if (0 == fds[i + 1].revents)
+			{
+				continue;
+			}
+			char buf[4096];
+			ssize_t n = read(requests[i]._report, buf, sizeof(buf));
+			if (n > 0)
+			{
+				requests[i]._buf.append(buf, n);
+			}
+			else if (n == 0 || errno != EINTR)
+			{
+				finish_request(requests[i]);
+				requests.erase(requests.begin() + i);
+			}
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			accept_request(listen_fd, run);
+		}
+	}
+
+	/* 新たな要求の受け付けをやめ、処理中の要求の終了を待つ */
+	close(listen_fd);
+	unlink(socket_path.c_str());
+	for (auto &req : requests)
+	{
+		char buf[4096];
+		ssize_t n;
+		while ((n = read(req._report, buf, sizeof(buf))) != 0)
+		{
+			if (n > 0)
+			{
+				req._buf.append(buf, n);
+			}
+			else if (errno != EINTR)
+			{
+				break;
+			}
+		}
+		finish_request(req);
+	}
+	requests.clear();
+	return 0;
+}
+
+/**
+ * @brief コマンドライン引数とカレントディレクトリ、標準入出力をコンパイルサーバに渡して処理を任せる
+ *
+ * @param args コマンドライン引数
+ * @param socket_path コンパイルサーバのソケットのパス
+ * @return コンパイルサーバが返した終了ステータス。サーバに接続できなかった場合は-1
+ */
+int Server::forward(const vector<string> &args, const string &socket_path)
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path))
+	{
+		return -1;
+	}
+	memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	/* 他のユーザが起動したサーバには標準入出力を渡さない */
+	if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || !is_same_user(fd))
+	{
+		close(fd);
+		return -1;
+	}
+
+	/* カレントディレクトリ、引数の順に'\0'区切りで送る */
+	std::error_code ec;
+	string payload = fs::current_path(ec).string();
+	payload.push_back('\0');
+	for (const auto &arg : args)
+	{
+		payload += arg;
+		payload.push_back('\0');
+	}
+
+	/* 長さと一緒に標準入力、標準出力、標準エラー出力を渡す */
+	uint32_t len = payload.size();
+	iovec iov = {&len, sizeof(len)};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)] = {};
+	msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	const int std_fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+	memcpy(CMSG_DATA(cmsg), std_fds, sizeof(std_fds));
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(len) || !write_all(fd, payload.data(), payload.size()))
+	{
+		close(fd);
+		return -1;
+	}
+
+	int32_t status;
+	if (!read_all(fd, &status, sizeof(status)))
+	{
+		close(fd);
+		error("fccサーバとの接続が切断されました");
+	}
+	close(fd);
+	return status;
+}
+
+/**
+ * @brief デフォルトのソケットのパスを返す。$XDG_RUNTIME_DIRがあればその下、なければ/tmp以下のユーザごとのディレクトリの下
+ *
+ * @return ソケットのパス
+ */
+string Server::default_socket()
+{
+	if (const char *dir = getenv("XDG_RUNTIME_DIR"); dir && *dir)
+	{
+		return string(dir) + "/fcc/server.sock";
+	}
+	return "/tmp/fcc_server." + std::to_string(getuid()) + "/server.sock";
+}
+
+/**
+ * @brief サーバの子プロセスとして要求を処理しているかを返す
+ *
+ * @return サーバの子プロセスであればtrue
+ */
+bool Server::is_serving()
+{
+	return serving;
+}
+
+/**
+ * @brief Unixドメインソケットを作成して待ち受けを開始する。
+ * ソケットのディレクトリがなければ所有者のみがアクセスできるように作成し、あれば自分だけが書き込めることを確認する。
+ * 既にファイルが存在する場合、接続できればサーバが起動済みとしてエラー、できなければ削除して作り直す。
+ *
+ * @param socket_path ソケットのパス
+ * @return 待ち受けるソケット
+ */
+int Server::listen_socket(const string &socket_path)
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path))
+	{
+		error("ソケットのパスが長すぎます: " + socket_path);
+	}
+	memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+	/* 他のユーザが作成したディレクトリや、他のユーザが書き込めるディレクトリにはソケットを置かない */
+	auto dir = fs::path(socket_path).parent_path();
+	if (dir.empty())
+	{
+		dir = ".";
+	}
+	struct stat st;
+	if (mkdir(dir.c_str(), S_IRWXU) < 0 && errno != EEXIST)
+	{
+		error("ソケットのディレクトリを作成できませんでした: " + dir.string());
+	}
+	if (lstat(dir.c_str(), &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & (S_IWGRP | S_IWOTH)))
+	{
+		error("ソケットのディレクトリが他のユーザから変更できる状態です: " + dir.string());
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		error("\'socket\'に失敗しました");
+	}
+
+	/* 他のユーザからは接続させない(bindした時点で所有者のみが読み書きできるようにする) */
+	mode_t old_mask = umask(S_IRWXG | S_IRWXO);
+	int ret = bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+	if (ret < 0 && errno == EADDRINUSE)
+	{
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		bool running = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+		if (probe >= 0)
+		{
+			close(probe);
+		}
+		if (running)
+		{
+			error("fccサーバは既に起動しています: " + socket_path);
+		}
+
+		unlink(socket_path.c_str());
+		ret = bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+	}
+	umask(old_mask);
+	if (ret < 0)
+	{
+		error("ソケットを作成できませんでした: " + socket_path);
+	}
+
+	if (listen(fd, SOMAXCONN) < 0)
+	{
+		error("\'listen\'に失敗しました");
+	}
+	return fd;
+}
+
+/**
+ * @brief 要求を受け付け、forkした子プロセスで処理を開始する。
+ * 要求の中身は子プロセスで読み込むので、送信が遅いクライアントがいても他の要求の受け付けは止まらない。
+ *
+ * @param listen_fd 待ち受けているソケット
+ * @param run 要求を処理する関数
+ */
+void Server::accept_request(const int &listen_fd, const std::function<int(const vector<string> &)> &run)
+{
+	int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if (conn < 0)
+	{
+		return;
+	}
+
+	/* 他のユーザからの要求は受け付けない */
+	int pipefd[2] = {-1, -1};
+	if (!is_same_user(conn) || pipe2(pipefd, O_CLOEXEC) < 0)
+	{
+		close(conn);
+		return;
+	}
+
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		/* 要求の処理に関係のないファイルディスクリプタは閉じる */
+		close(listen_fd);
+		close(pipefd[0]);
+		for (const auto &req : requests)
+		{
+			close(req._conn);
+			close(req._report);
+		}
+		requests.clear();
+
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGPIPE, SIG_DFL);
+
+		/* 要求を読み込む。不正な要求であれば何もせずに終了する */
+		vector<string> fields;
+		bool valid = read_request(conn, fields);
+		close(conn);
+		if (!valid)
+		{
+			_exit(1);
+		}
+
+		serving = true;
+		report_fd = pipefd[1];
+		atexit(report_headers);
+
+		if (chdir(fields[0].c_str()) != 0)
+		{
+			error("カレントディレクトリを変更できませんでした: " + fields[0]);
+		}
+		exit(run(vector<string>(fields.begin() + 1, fields.end())));
+	}
+
+	close(pipefd[1]);
+	if (pid < 0)
+	{
+		close(pipefd[0]);
+		close(conn);
+		return;
+	}
+
+	Request req;
+	req._conn = conn;
+	req._report = pipefd[0];
+	req._pid = pid;
+	requests.emplace_back(move(req));
+}
+
+/**
+ * @brief 要求を読み込み、クライアントの標準入力、標準出力、標準エラー出力をこのプロセスに引き継ぐ。
+ * 要求を処理する子プロセスで呼ぶ。
+ *
+ * @param conn クライアントとの接続
+ * @param fields 要求の中身(カレントディレクトリと引数)の格納先
+ * @return 正しい要求を読み込めたか
+ */
+bool Server::read_request(const int &conn, vector<string> &fields)
+{
+	/* 送信が途中で止まったクライアントのためにいつまでも待たない */
+	timeval timeout = {REQUEST_TIMEOUT, 0};
+	setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	/* 要求の長さと、クライアントの標準入力、標準出力、標準エラー出力を受け取る */
+	uint32_t len = 0;
+	iovec iov = {&len, sizeof(len)};
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)] = {};
+	msghdr msg = {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+
+	cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	int fds[3] = {-1, -1, -1};
+	if (n >= 0 && cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+	{
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	}
+
+	string payload;
+	bool valid = n == sizeof(len) && fds[0] >= 0 && len <= MAX_REQUEST_SIZE;
+	if (valid)
+	{
+		payload.resize(len);
+		valid = read_all(conn, payload.data(), len);
+	}
+
+	/* カレントディレクトリと引数に分割する */
+	for (size_t pos = 0; valid && pos < payload.size();)
+	{
+		auto end = payload.find('\0', pos);
+		if (end == string::npos)
+		{
+			valid = false;
+			break;
+		}
+		fields.emplace_back(payload.substr(pos, end - pos));
+		pos = end + 1;
+	}
+	valid = valid && fields.size() >= 2;
+
+	/* クライアントの標準入出力を引き継ぐ */
+	if (valid)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			dup2(fds[i], i);
+		}
+	}
+	for (auto fd : fds)
+	{
+		if (fd > STDERR_FILENO)
+		{
+			close(fd);
+		}
+	}
+	return valid;
+}
+
+/**
+ * @brief 子プロセスの終了を待って終了ステータスをクライアントに返し、報告されたヘッダファイルをキャッシュする
+ *
+ * @param req 終了した要求
+ */
+void Server::finish_request(Request &req)
+{
+	close(req._report);
+
+	int status = 0;
+	while (waitpid(req._pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+	int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	write_all(req._conn, &code, sizeof(code));
+	close(req._conn);
+
+	/* 以降の要求を処理する子プロセスに引き継がれるようにこのプロセスでトークナイズしておく */
+	std::istringstream ss(req._buf);
+	string path;
+	while (std::getline(ss, path))
+	{
+		if (!path.empty())
+		{
+			Token::preload_file(path);
+		}
+	}
+}
+
+/**
+ * @brief キャッシュになかったヘッダファイルのパスをサーバに報告する。子プロセスの終了時に呼ばれる。
+ * 並列に実行したジョブの報告が混ざらないように1行ずつ書き込む。
+ *
+ */
+void Server::report_headers()
+{
+	if (report_fd < 0)
+	{
+		return;
+	}
+	for (const auto &path : Token::get_file_cache_misses())
+	{
+		auto line = path + "\n";
+		write_all(report_fd, line.data(), line.size());
+	}
+}
+
+/**
+ * @brief 接続の相手が自分と同じユーザのプロセスであるかを返す
+ *
+ * @param fd 接続済みのソケット
+ * @return 同じユーザであればtrue
+ */
+bool Server::is_same_user(const int &fd)
+{
+	ucred cred = {};
+	socklen_t len = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+}
+
+/**
+ * @brief SIGINT, SIGTERMのハンドラ
+ *
+ */
+void Server::on_signal(int)
+{
+	stop_requested = 1;
+}
+
+/**
+ * @brief ファイルディスクリプタからsizeバイトを読み込む
+ *
+ * @param fd ファイルディスクリプタ
+ * @param buf 格納先
+ * @param size 読み込むバイト数
+ * @return すべて読み込めたか
+ */
+bool Server::read_all(const int &fd, void *buf, size_t size)
+{
+	auto p = static_cast<char *>(buf);
+	while (size > 0)
+	{
+		ssize_t n = read(fd, p, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+/**
+ * @brief ファイルディスクリプタにsizeバイトを書き込む
+ *
+ * @param fd ファイルディスクリプタ
+ * @param buf 書き込むデータ
+ * @param size 書き込むバイト数
+ * @return すべて書き込めたか
+ */
+bool Server::write_all(const int &fd, const void *buf, size_t size)
+{
+	auto p = static_cast<const char *>(buf);
+	while (size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file server.hpp
+ * @author K.Fukunaga
+ * @brief ヘッダファイルと事前定義マクロを保持し続けるコンパイルサーバ
+ * @version 0.1
+ * @date 2023-09-02
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <functional>
+#include <csignal>
+#include <sys/types.h>
+
+/**
+ * @brief 'fcc --server'で起動し、Unixドメインソケットで受け付けたコンパイル要求を処理するクラス
+ *
+ * @details サーバは事前定義マクロとトークナイズ済みのヘッダファイルを保持し、要求ごとにforkした子プロセスで
+ * 通常のfccと同じ処理を行う。子プロセスはクライアントの標準入出力とカレントディレクトリを引き継ぐので、
+ * 出力と終了ステータスは直接実行した場合と同じになる。子プロセスがキャッシュになかったヘッダファイルを報告すると、
+ * サーバはそれらをトークナイズしてキャッシュし、以降の要求で再利用する。ヘッダファイルは更新時刻とサイズが
+ * 変わっていれば読み込み直す。クライアント側(-fserverオプション)はサーバに接続できなければ自身でコンパイルする。
+ */
+class Server
+{
+public:
+	/* 静的メンバ関数(public) */
+	static int serve(const string &socket_path, const std::function<int(const vector<string> &)> &run);
+	static int forward(const vector<string> &args, const string &socket_path);
+	static string default_socket();
+	static bool is_serving();
+
+private:
+	/**
+	 * @brief 処理中の要求を表す構造体
+	 *
+	 */
+	struct Request
+	{
+		int _conn = -1;	  /*!< クライアントとの接続 */
+		int _report = -1; /*!< 子プロセスがキャッシュになかったヘッダファイルを報告するパイプ */
+		pid_t _pid = -1;  /*!< 要求を処理する子プロセスのpid */
+		string _buf;	  /*!< 子プロセスから受け取った報告 */
+	};
+
+	Server();
+
+	/* 静的メンバ関数(private) */
+	static int listen_socket(const string &socket_path);
+	static void accept_request(const int &listen_fd, const std::function<int(const vector<string> &)> &run);
+	static bool read_request(const int &conn, vector<string> &fields);
+	static void finish_request(Request &req);
+	static void report_headers();
+	static void on_signal(int);
+	static bool is_same_user(const int &fd);
+	static bool read_all(const int &fd, void *buf, size_t size);
+	static bool write_all(const int &fd, const void *buf, size_t size);
+
+	static vector<Request> requests;
+	static int report_fd;
+	static bool serving;
+	static volatile sig_atomic_t stop_requested;
+};
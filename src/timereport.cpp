@@ -0,0 +1,311 @@
+/**
+ * @file timereport.cpp
+ * @author K.Fukunaga
+ * @brief コンパイルの各フェーズの処理時間の計測
+ * @version 0.1
+ * @date 2023-09-04
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#include "timereport.hpp"
+#include "tokenize.hpp"
+#include <cstdio>
+#include <ctime>
+#include <sys/resource.h>
+
+/** 計測するか */
+bool TimeReport::enabled = false;
+
+/** 結果をJSONで出力するか */
+bool TimeReport::json_output = false;
+
+/** 計測中の入力ファイルの名前 */
+string TimeReport::current_name;
+
+/** 計測中のフェーズのスタック */
+vector<TimeReport::Phase> TimeReport::stack;
+
+/** 最後に時間を計上した時刻 */
+TimeReport::Sample TimeReport::last;
+
+/** フェーズごとの合計時間 */
+TimeReport::Sample TimeReport::totals[PH_COUNT];
+
+/** トークナイズしたファイルの行数 */
+uint64_t TimeReport::input_lines = 0;
+
+/** トークナイズしたファイルのトークン数 */
+uint64_t TimeReport::input_tokens = 0;
+
+/** 多重インクルードの防止により読み込まずに済ませた#includeの数 */
+uint64_t TimeReport::skipped_includes = 0;
+
+/**
+ * @brief フェーズの計測を開始する。計測が無効な場合とbegin()の前に呼ばれた場合は何もしない。
+ *
+ * @param phase フェーズ
+ */
+TimeReport::Scope::Scope(const Phase &phase) : _active(enabled && !stack.empty())
+{
+	if (_active)
+	{
+		push(phase);
+	}
+}
+
+/**
+ * @brief フェーズの計測を終了する
+ *
+ */
+TimeReport::Scope::~Scope()
+{
+	if (_active)
+	{
+		pop();
+	}
+}
+
+/**
+ * @brief 計測を有効にする
+ *
+ * @param json 結果をJSONで出力するか
+ */
+void TimeReport::enable(const bool &json)
+{
+	enabled = true;
+	json_output = json;
+}
+
+/**
+ * @brief 計測が有効かを返す
+ *
+ * @return 計測が有効であればtrue
+ */
+bool TimeReport::is_enabled()
+{
+	return enabled;
+}
+
+/**
+ * @brief 入力ファイル1つ分の計測を開始する。これまでの計測結果は破棄する。
+ *
+ * @param name 入力ファイルの名前
+ */
+void TimeReport::begin(const string &name)
+{
+	if (!enabled)
+	{
+		return;
+	}
+	current_name = name;
+	for (auto &t : totals)
+	{
+		t = Sample();
+	}
+	input_lines = input_tokens = skipped_includes = 0;
+	stack.assign(1, PH_OTHER);
+	last = now();
+}
+
+/**
+ * @brief begin()からの計測結果を標準エラー出力に書き出す
+ *
+ */
+void TimeReport::end()
+{
+	if (!enabled || stack.empty())
+	{
+		return;
+	}
+	charge();
+	stack.clear();
+
+	Sample total;
+	for (const auto &t : totals)
+	{
+		total._wall += t._wall;
+		total._cpu += t._cpu;
+	}
+
+	char buf[256];
+	if (json_output)
+	{
+		string name;
+		for (auto c : current_name)
+		{
+			if (c == '"' || c == '\\')
+			{
+				name.push_back('\\');
+			}
+			name.push_back(c);
+		}
+
+		std::cerr << "{\"file\":\"" << name << "\",\"phases\":{";
+		bool first = true;
+		for (int i = 0; i < PH_COUNT; ++i)
+		{
+			if (0 == totals[i]._wall && 0 == totals[i]._cpu)
+			{
+				continue;
+			}
+			snprintf(buf, sizeof(buf), "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", first ? "" : ",",
+					 phase_names[i].data(), totals[i]._wall / 1e6, totals[i]._cpu / 1e6);
+			std::cerr << buf;
+			first = false;
+		}
+		snprintf(buf, sizeof(buf), "},\"total\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f},\"lines\":%lu,\"tokens\":%lu,\"skipped_includes\":%lu,\"peak_rss_kb\":%ld}\n",
+				 total._wall / 1e6, total._cpu / 1e6, input_lines, input_tokens, skipped_includes, peak_rss());
+		std::cerr << buf;
+		std::cerr.flush();
+		return;
+	}
+
+	std::cerr << "実行時間: " << current_name << "\n";
+	snprintf(buf, sizeof(buf), "  入力: %lu行, %luトークン, 省略したインクルード: %lu, 最大RSS: %ldKB\n", input_lines, input_tokens,
+			 skipped_includes, peak_rss());
+	std::cerr << buf;
+	snprintf(buf, sizeof(buf), "  %-24s %12s %12s %7s\n", "phase", "wall(ms)", "cpu(ms)", "wall%");
+	std::cerr << buf;
+	for (int i = 0; i < PH_COUNT; ++i)
+	{
+		if (0 == totals[i]._wall && 0 == totals[i]._cpu)
+		{
+			continue;
+		}
+		snprintf(buf, sizeof(buf), "  %-24s %12.3f %12.3f %6.1f%%\n", phase_names[i].data(), totals[i]._wall / 1e6,
+				 totals[i]._cpu / 1e6, total._wall > 0 ? 100.0 * totals[i]._wall / total._wall : 0.0);
+		std::cerr << buf;
+	}
+	snprintf(buf, sizeof(buf), "  %-24s %12.3f %12.3f\n", "TOTAL", total._wall / 1e6, total._cpu / 1e6);
+	std::cerr << buf;
+	std::cerr.flush();
+}
+
+/**
+ * @brief 外部コマンドの名前から計上するフェーズを返す
+ *
+ * @param command コマンド名
+ * @return フェーズ
+ */
+TimeReport::Phase TimeReport::subprocess_phase(const string &command)
+{
+	auto name = fs::path(command).filename().string();
+	if ("as" == name)
+	{
+		return PH_AS;
+	}
+	if ("ld" == name)
+	{
+		return PH_LD;
+	}
+	return PH_SUBPROCESS;
+}
+
+/**
+ * @brief トークナイズしたファイルの行数とトークン数を加える。数えるのにかかった時間はどのフェーズにも計上しない。
+ *
+ * @param contents ファイルの中身
+ * @param token トークナイズした結果のトークンリスト
+ */
+void TimeReport::count_input(const string_view &contents, const Token *token)
+{
+	if (!enabled || stack.empty())
+	{
+		return;
+	}
+	charge();
+
+	input_lines += std::count(contents.begin(), contents.end(), '\n');
+	for (auto t = token; t && TokenKind::TK_EOF != t->_kind; t = t->_next.get())
+	{
+		++input_tokens;
+	}
+
+	last = now();
+}
+
+/**
+ * @brief #pragma onceまたはインクルードガードにより読み込まずに済ませた#includeを1つ数える
+ *
+ */
+void TimeReport::count_skipped_include()
+{
+	if (!enabled)
+	{
+		return;
+	}
+	++skipped_includes;
+}
+
+/**
+ * @brief このプロセスの最大RSSを返す
+ *
+ * @return 最大RSS(KB)
+ */
+long TimeReport::peak_rss()
+{
+	rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_maxrss;
+}
+
+/**
+ * @brief 現在時刻とCPU時間を取得する
+ *
+ * @return 現在の時刻
+ */
+TimeReport::Sample TimeReport::now()
+{
+	Sample s;
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	s._wall = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	s._cpu = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+
+	rusage ru;
+	getrusage(RUSAGE_CHILDREN, &ru);
+	s._cpu += (static_cast<int64_t>(ru.ru_utime.tv_sec) + ru.ru_stime.tv_sec) * 1000000000 +
+			  (static_cast<int64_t>(ru.ru_utime.tv_usec) + ru.ru_stime.tv_usec) * 1000;
+	return s;
+}
+
+/**
+ * @brief 前回計上した時刻からの経過時間をスタックの先頭のフェーズに計上する
+ *
+ */
+void TimeReport::charge()
+{
+	auto s = now();
+	auto &t = totals[stack.back()];
+	t._wall += s._wall - last._wall;
+	t._cpu += s._cpu - last._cpu;
+	last = s;
+}
+
+/**
+ * @brief フェーズを開始する
+ *
+ * @param phase 開始するフェーズ
+ */
+void TimeReport::push(const Phase &phase)
+{
+	charge();
+	stack.emplace_back(phase);
+}
+
+/**
+ * @brief 最後に開始したフェーズを終了する
+ *
+ */
+void TimeReport::pop()
+{
+	if (stack.empty())
+	{
+		return;
+	}
+	charge();
+	stack.pop_back();
+}
@@ -0,0 +1,112 @@
+/**
+ * @file timereport.hpp
+ * @author K.Fukunaga
+ * @brief コンパイルの各フェーズの処理時間の計測
+ * @version 0.1
+ * @date 2023-09-04
+ *
+ * @copyright Copyright (c) 2023 MIT License
+ *
+ */
+
+#pragma once
+
+#include "common.hpp"
+#include <cstdint>
+
+class Token;
+
+/**
+ * @brief -ftime-reportオプションが指定されたとき、フェーズごとの実時間とCPU時間を計測して報告するクラス
+ *
+ * @details 計測はフェーズのスタックで行い、入れ子になったフェーズの時間は外側のフェーズに含めない。
+ * 例えば#includeの処理中にヘッダファイルをトークナイズした時間はtokenizeに計上する。
+ * 外部コマンド('as', 'ld'など)のCPU時間は終了を待った子プロセスの分を加える。
+ * 集計は入力ファイル(ジョブ)ごとに行い、begin()からend()までの結果を標準エラー出力に書き出す。
+ * 処理速度を求められるように、トークナイズしたファイル(ヘッダファイルを含む)の行数とトークン数、最大RSSも報告する。
+ */
+class TimeReport
+{
+public:
+	/**
+	 * @brief 計測するフェーズ
+	 *
+	 */
+	enum Phase
+	{
+		PH_OTHER,		 /*!< いずれのフェーズにも含まれない処理 */
+		PH_TOKENIZE,	 /*!< トークナイズ */
+		PH_PREPROCESS,	 /*!< プリプロセス(以下の3つを除く) */
+		PH_INCLUDE,		 /*!< #includeの処理 */
+		PH_MACRO,		 /*!< マクロ展開 */
+		PH_COND,		 /*!< #if, #elifの条件式の評価 */
+		PH_PARSE,		 /*!< 構文解析 */
+		PH_LVAR_OFFSETS, /*!< ローカル変数のオフセットの計算 */
+		PH_EMIT_DATA,	 /*!< .data部の出力 */
+		PH_EMIT_TEXT,	 /*!< .text部の出力 */
+		PH_ASSEMBLE,	 /*!< 内蔵アセンブラ */
+		PH_LINK,		 /*!< 内蔵リンカ */
+		PH_AS,			 /*!< 'as'の実行 */
+		PH_LD,			 /*!< 'ld'の実行 */
+		PH_SUBPROCESS,	 /*!< その他の外部コマンド(-fsubprocessのfcc) */
+		PH_COUNT,		 /*!< フェーズの数 */
+	};
+
+	/**
+	 * @brief 生存期間の間を指定したフェーズとして計測するクラス
+	 *
+	 */
+	class Scope
+	{
+	public:
+		Scope(const Phase &phase);
+		~Scope();
+
+	private:
+		bool _active; /*!< 計測を開始したか */
+	};
+
+	/* 静的メンバ関数(public) */
+	static void enable(const bool &json);
+	static bool is_enabled();
+	static void begin(const string &name);
+	static void end();
+	static Phase subprocess_phase(const string &command);
+	static void count_input(const string_view &contents, const Token *token);
+	static void count_skipped_include();
+
+private:
+	/**
+	 * @brief 時刻
+	 *
+	 */
+	struct Sample
+	{
+		int64_t _wall = 0; /*!< 実時間(ナノ秒) */
+		int64_t _cpu = 0;  /*!< このプロセスと終了した子プロセスのCPU時間(ナノ秒) */
+	};
+
+	TimeReport();
+
+	/* 静的メンバ関数(private) */
+	static Sample now();
+	static long peak_rss();
+	static void charge();
+	static void push(const Phase &phase);
+	static void pop();
+
+	static bool enabled;
+	static bool json_output;
+	static string current_name;
+	static vector<Phase> stack;
+	static Sample last;
+	static Sample totals[PH_COUNT];
+	static uint64_t input_lines;
+	static uint64_t input_tokens;
+	static uint64_t skipped_includes;
+
+	/** フェーズの名前 */
+	static constexpr string_view phase_names[] = {"other", "tokenize", "preprocess", "preprocess: include", "preprocess: macro", "preprocess: #if",
+												  "parse", "codegen: lvar offsets", "codegen: data", "codegen: text",
+												  "assemble (integrated)", "link (fcc)", "as", "ld", "subprocess"};
+};
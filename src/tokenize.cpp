@@ -12,20 +12,54 @@
 #include "tokenize.hpp"
 #include "object.hpp"
 #include "type.hpp"
+#include "timereport.hpp"
+#include "scan.hpp"
 #include <sstream>
-#include <iterator>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Scanの関数にイテレーターをそのまま渡す */
+static_assert(std::is_same_v<string_view::const_iterator, const char *>);
+
+/* トークンはキャッシュラインに収める */
+static_assert(sizeof(Token) <= 64);
+
+/** 数値トークンの型の一覧 */
+const shared_ptr<Type> *const Token::literal_types[7] = {
+	nullptr, &Type::INT_BASE, &Type::UINT_BASE, &Type::LONG_BASE, &Type::ULONG_BASE, &Type::FLOAT_BASE, &Type::DOUBLE_BASE};
 
 /** 入力ファイルのリスト */
 vector<unique_ptr<File>> Token::input_files;
 
 /** 入力ファイル */
-const File *Token::current_file = nullptr;
+thread_local const File *Token::current_file = nullptr;
+
+/** これまでに読み込んだファイルの数 */
+int Token::file_count = 0;
 
 /** 行頭であるか */
-bool Token::at_begining = false;
+thread_local bool Token::at_begining = false;
 
 /** スペースであるか */
-bool Token::has_space = false;
+thread_local bool Token::has_space = false;
+
+/** トークナイズ中のファイルの'\\' + '\n'を行の継続として扱うか(行の継続を除去済みの中身であればfalse) */
+thread_local bool Token::splices = true;
+
+/** このスレッドでトークンを割り当てるアリーナ(nullptrであれば共通のアリーナ) */
+thread_local Arena<Token, MemReport::MK_TOKEN> *Token::thread_arena = nullptr;
+
+/** トークナイズ済みのヘッダファイル。翻訳単位をまたいで保持する */
+std::unordered_map<string, Token::CachedFile> Token::file_cache;
+
+/** ヘッダファイルのキャッシュを使うか */
+bool Token::file_cache_enabled = false;
+
+/** キャッシュになかったヘッダファイルのパス */
+vector<string> Token::file_cache_misses;
 
 /***************/
 /* Token Class */
@@ -33,49 +67,227 @@ bool Token::has_space = false;
 
 /* コンストラクタ */
 
-Token::Token() = default;
+Token::Token() : MemCounted()
+{
+}
+
 Token::Token(const TokenKind &kind, const int &location)
-	: _kind(kind), _location(location), _at_begining(at_begining), _file(current_file), _has_space(has_space)
+	: MemCounted(), _file(current_file), _location(location), _kind(kind), _at_begining(at_begining), _has_space(has_space)
 {
 	at_begining = false;
 	has_space = false;
 }
 
 Token::Token(const int64_t &value, const int &location)
-	: _kind(TokenKind::TK_NUM), _location(location), _val(move(value)), _at_begining(at_begining), _file(current_file),
+	: MemCounted(), _file(current_file), _val(value), _location(location), _kind(TokenKind::TK_NUM), _at_begining(at_begining),
 	  _has_space(has_space)
 {
 	at_begining = false;
 	has_space = false;
 }
 
-Token::Token(const TokenKind &kind, const int &location, string &&str)
-	: _kind(kind), _location(location), _str(move(str)), _at_begining(at_begining), _file(current_file), _has_space(has_space)
+Token::Token(const TokenKind &kind, const int &location, const string_view &str)
+	: MemCounted(), _str(str), _file(current_file), _location(location), _kind(kind), _at_begining(at_begining), _has_space(has_space)
 {
+	if (TokenKind::TK_IDENT == _kind || TokenKind::TK_PUNCT == _kind)
+	{
+		_atom = Atom(_str);
+	}
 	at_begining = false;
 	has_space = false;
 }
 
 Token::Token(const Token &src)
-	: _kind(src._kind), _val(src._val), _fval(src._fval), _ty(src._ty), _location(src._location),
-	  _str(src._str), _file(src._file), _line_no(src._line_no), _at_begining(src._at_begining), _has_space(src._has_space)
+	: MemCounted(src), _str(src._str), _file(src._file), _hideset(src._hideset), _val(src._val), _location(src._location), _line_no(src._line_no),
+	  _atom(src._atom), _kind(src._kind), _literal_type(src._literal_type), _at_begining(src._at_begining), _has_space(src._has_space)
 {
-	if (src._hideset)
-	{
-		_hideset = make_unique<std::unordered_set<string>>(*src._hideset);
-	}
 }
 
 Token::Token(Token &&src) = default;
 Token &Token::operator=(Token &&rhs) = default;
 
+/* デストラクタ */
+
+/**
+ * @brief 後続のトークンを先頭から順に破棄する。
+ * _nextのデストラクタに任せると再帰がトークン数だけ深くなり、大きな入力でスタックが溢れる。
+ *
+ */
+Token::~Token()
+{
+	auto next = move(_next);
+	while (next)
+	{
+		next = move(next->_next);
+	}
+}
+
+/* アリーナからの割り当て */
+
+/**
+ * @brief トークンの領域をアリーナから割り当てる。トークナイズしたトークン列はメモリ上で連続して並ぶ。
+ *
+ * @param size 割り当てるサイズ(sizeof(Token))
+ * @return 割り当てた領域
+ */
+void *Token::operator new(size_t size)
+{
+	assert(sizeof(Token) == size);
+	return arena().allocate();
+}
+
+/**
+ * @brief トークンの領域を割り当て元のアリーナに返す
+ *
+ * @param p 解放する領域
+ */
+void Token::operator delete(void *p)
+{
+	if (p)
+	{
+		auto &persistent = persistent_arena();
+		(persistent.owns(p) ? persistent : arena()).deallocate(p);
+	}
+}
+
+/**
+ * @brief トークンを割り当てるアリーナを返す。
+ * 静的変数の破棄の順序によらず、終了時に破棄されるトークンがアリーナを使えるように、アリーナ自体は破棄しない。
+ * ヘッダファイルを先読みするスレッドでは、そのスレッドに設定したアリーナを返す。
+ *
+ * @return トークンのアリーナ
+ */
+Arena<Token, MemReport::MK_TOKEN> &Token::arena()
+{
+	static auto arena = new Arena<Token, MemReport::MK_TOKEN>();
+	return thread_arena ? *thread_arena : *arena;
+}
+
+/**
+ * @brief 事前定義マクロやコンパイルサーバのヘッダファイルのキャッシュなど、翻訳単位をまたいで使うトークンを割り当てるアリーナを返す。
+ * これらを共通のアリーナと分けておくことで、翻訳単位のトークンがすべて破棄されたときに共通のアリーナをまとめて解放できる。
+ * 割り当てるときはset_thread_arena()で設定する。
+ *
+ * @return 翻訳単位をまたいで使うトークンのアリーナ
+ */
+Arena<Token, MemReport::MK_TOKEN> &Token::persistent_arena()
+{
+	static auto arena = new Arena<Token, MemReport::MK_TOKEN>();
+	return *arena;
+}
+
+/****************/
+/* Source Class */
+/****************/
+
+/**
+ * @brief 文字列を中身とする
+ *
+ * @param str ファイルの中身('\n'で終わっていること)
+ * @param splice_points 行の継続を除去した中身であれば、除去した位置のリスト
+ */
+Token::Source::Source(string &&str, vector<int> &&splice_points) : _str(move(str)), _splice_points(move(splice_points))
+{
+}
+
+/**
+ * @brief mmapした領域を中身とする。破棄するときにmunmapする。
+ *
+ * @param map mmapした領域
+ * @param size 領域のサイズ
+ */
+Token::Source::Source(void *map, const size_t &size) : _map(map), _map_size(size)
+{
+}
+
+Token::Source::~Source()
+{
+	if (_map)
+	{
+		munmap(_map, _map_size);
+	}
+}
+
+/**
+ * @brief 中身を返す
+ *
+ * @return ファイルの中身
+ */
+string_view Token::Source::view() const
+{
+	if (_map)
+	{
+		return string_view(static_cast<const char *>(_map), _map_size);
+	}
+	return _str;
+}
+
+/**
+ * @brief 中身の位置が含まれる物理的な行の行数を返す。
+ * 行の継続を除去した中身では、同じ行の中で位置までに除去した行の継続の数を加える
+ * (除去した数の'\n'は行末に補ってあるので、次の行以降の行数はずれない)。
+ *
+ * @param location 中身の位置
+ * @return 行数
+ */
+int Token::Source::line_no(const int &location) const
+{
+	/* 初めて呼ばれたときに各行の先頭の位置の表を作る */
+	if (_line_starts.empty())
+	{
+		const auto contents = view();
+		const auto first = contents.data();
+		const auto last = first + contents.size();
+		_line_starts.emplace_back(0);
+		for (auto p = Scan::find_char(first, last, '\n'); p != last; p = Scan::find_char(p + 1, last, '\n'))
+		{
+			_line_starts.emplace_back(p + 1 - first);
+		}
+	}
+
+	/* 位置以下で最も後ろにある行の先頭 */
+	auto line = std::upper_bound(_line_starts.begin(), _line_starts.end(), location) - 1;
+	int n = line - _line_starts.begin() + 1;
+	if (!_splice_points.empty())
+	{
+		n += std::upper_bound(_splice_points.begin(), _splice_points.end(), location) -
+			 std::lower_bound(_splice_points.begin(), _splice_points.end(), *line);
+	}
+	return n;
+}
+
+/**
+ * @brief ファイルの中身に綴りがない文字列(エスケープシーケンスを含む文字列リテラルの内容など)を保持する。
+ * 保持した文字列はこのSourceと同じだけ生存し、移動しない。
+ *
+ * @param str 保持する文字列
+ * @return 保持した文字列を指すstring_view
+ */
+string_view Token::Source::store(string &&str) const
+{
+	const auto &stored = _literals.emplace_back(move(str));
+	MemReport::count_string(MemReport::MK_TOKEN, stored);
+	return stored;
+}
+
+/**
+ * @brief 行の継続を除去した位置のリストを返す
+ *
+ * @return 除去した位置のリスト(行の継続を含まなければ空)
+ */
+const vector<int> &Token::Source::splice_points() const
+{
+	return _splice_points;
+}
+
 /**
- * @brief 入力されたパスのファイルを開いて中身を文字列として返す
+ * @brief 入力されたパスのファイルを開いて中身を読み込む。
+ * 大きなファイルはmmapし、それ以外は1回の読み込みで文字列に格納する。どちらの場合も中身をコピーし直すことはない。
  *
  * @param path ファイルパス
- * @return 読み取ったファイルの中身
+ * @return 読み込んだファイルの中身
  */
-string Token::read_inputfile(const string &path)
+shared_ptr<const Token::Source> Token::Source::load(const string &path)
 {
 	string input_data;
 
@@ -97,15 +309,58 @@ string Token::read_inputfile(const string &path)
 	}
 	else
 	{
-		std::ifstream ifs(path);
-		if (!ifs)
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			error("ファイルが開けませんでした： " + path);
+		}
+
+		struct stat st;
+		size_t size = 0;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+		{
+			size = st.st_size;
+		}
+
+		/* mmapした領域の末尾の直後を'\0'として読めるように、サイズがページサイズの倍数でないファイルに限る */
+		static const size_t page_size = sysconf(_SC_PAGESIZE);
+		if (size >= MMAP_THRESHOLD && 0 != size % page_size)
 		{
-			std::cerr << "ファイルが開けませんでした： " << path << std::endl;
-			exit(1);
+			void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (MAP_FAILED != map)
+			{
+				if ('\n' == static_cast<const char *>(map)[size - 1])
+				{
+					close(fd);
+					return make_shared<Source>(map, size);
+				}
+				/* 改行で終わっていないファイルは'\n'を付け加えるために読み込む */
+				munmap(map, size);
+			}
 		}
 
-		/* ファイルから読み込む */
-		input_data = std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+		/* ファイルから読み込む。サイズが分からないファイル(パイプなど)は読めなくなるまで読み込む */
+		input_data.resize(size ? size + 1 : 4096);
+		size_t len = 0;
+		for (;;)
+		{
+			if (len == input_data.size())
+			{
+				input_data.resize(len * 2);
+			}
+			auto n = read(fd, input_data.data() + len, input_data.size() - len);
+			if (n < 0 && EINTR == errno)
+			{
+				continue;
+			}
+			if (n <= 0)
+			{
+				break;
+			}
+			len += n;
+		}
+		close(fd);
+		input_data.resize(len);
 	}
 
 	/* ファイルが空または改行で終わっていない場合、'\n'を付け加える */
@@ -114,9 +369,13 @@ string Token::read_inputfile(const string &path)
 		input_data.push_back('\n');
 	}
 
-	return input_data;
+	return make_shared<Source>(move(input_data));
 }
 
+/***************/
+/* Token Class */
+/***************/
+
 /**
  * @brief 入力されたパスにあるファイルを開いてトークナイズする
  *
@@ -125,27 +384,54 @@ string Token::read_inputfile(const string &path)
  */
 unique_ptr<Token> Token::tokenize_file(const string &input_path)
 {
-	static int file_no = 0;
-	/* ファイルを開いて中身を読み込む */
-	auto content = read_inputfile(input_path);
-	/* '\\' + '\n'を処理する */
-	content = remove_backslash_newline(content);
-	/* File構造体を生成 */
-	auto file = make_unique<File>(input_path, ++file_no, content);
+	TimeReport::Scope scope(TimeReport::PH_TOKENIZE);
+
+	/* ファイルを開いて中身を読み込み、File構造体を生成 */
+	auto file = make_unique<File>(input_path, ++file_count, Source::load(input_path));
 	/* リストに追加 */
 	input_files.emplace_back(move(file));
 	/* トークナイズ */
-	return tokenize(input_files.back().get());
+	auto token = tokenize(input_files.back().get());
+	TimeReport::count_input(input_files.back()->_contents, token.get());
+	return token;
+}
+
+/**
+ * @brief 入力文字列をトークナイズする。
+ * 行の継続('\\' + '\n')はトークンの間にあればその場で読み飛ばす。
+ * トークンの途中にある場合に限り、行の継続を除去した中身に置き換えてからトークナイズし直す。
+ *
+ * @param file 入力ファイル
+ * @return トークナイズした結果のトークン・リスト
+ */
+unique_ptr<Token> Token::tokenize(File *file)
+{
+	try
+	{
+		splices = true;
+		return tokenize_contents(file);
+	}
+	catch (const SpliceInToken &)
+	{
+		/* 行の継続を除去した位置を記録しておき、行数は元のファイルの物理的な行に合わせる */
+		vector<int> splice_points;
+		auto contents = remove_backslash_newline(file->_contents, splice_points);
+		file->_source = make_shared<Source>(move(contents), move(splice_points));
+		file->_contents = file->_source->view();
+		splices = false;
+		auto token = tokenize_contents(file);
+		splices = true;
+		return token;
+	}
 }
 
 /**
- * @brief 入力文字列をトークナイズする
+ * @brief ファイルの中身をトークナイズする
  *
- * @param filename 入力ファイル
- * @param input 入力文字列
+ * @param file 入力ファイル
  * @return トークナイズした結果のトークン・リスト
  */
-unique_ptr<Token> Token::tokenize(const File *file)
+unique_ptr<Token> Token::tokenize_contents(const File *file)
 {
 	current_file = file;
 
@@ -162,6 +448,23 @@ unique_ptr<Token> Token::tokenize(const File *file)
 
 	while (itr != last)
 	{
+		/* 行の継続 */
+		if (is_splice(itr))
+		{
+			auto next = itr + 2;
+			while (next != last && is_splice(next))
+			{
+				next += 2;
+			}
+			/* 直前のトークンと直後の文字がつながる可能性がある場合は行の継続を除去してから読み直す */
+			if (itr != first && !std::isspace(*(itr - 1)) && next != last && !std::isspace(*next))
+			{
+				throw SpliceInToken();
+			}
+			itr = next;
+			continue;
+		}
+
 		/* 改行 */
 		if ('\n' == *itr)
 		{
@@ -172,10 +475,10 @@ unique_ptr<Token> Token::tokenize(const File *file)
 			continue;
 		}
 
-		/* 空白文字をスキップ */
+		/* 空白文字をスキップ。改行は行頭の判定のため上で1つずつ処理する */
 		if (std::isspace(*itr))
 		{
-			++itr;
+			itr = Scan::skip_blank(itr + 1, last);
 			has_space = true;
 			continue;
 		}
@@ -186,8 +489,14 @@ unique_ptr<Token> Token::tokenize(const File *file)
 		if ('/' == *itr && '/' == *(itr + 1))
 		{
 			itr += 2;
-			while ('\n' != *itr)
+			/* 行の継続があれば次の行もコメントとする */
+			for (;;)
 			{
+				itr = Scan::find_char(itr, last, '\n');
+				if (itr == last || !is_splice(itr - 1))
+				{
+					break;
+				}
 				++itr;
 			}
 			continue;
@@ -197,8 +506,17 @@ unique_ptr<Token> Token::tokenize(const File *file)
 		if ('/' == *itr && '*' == *(itr + 1))
 		{
 			itr += 2;
-			while (itr != last && !('*' == *itr && '/' == *(itr + 1)))
+			for (;;)
 			{
+				itr = Scan::find_char(itr, last, '*');
+				if (itr == last || '/' == *(itr + 1))
+				{
+					break;
+				}
+				if (is_splice(itr + 1))
+				{
+					throw SpliceInToken();
+				}
 				++itr;
 			}
 			if (itr == last)
@@ -250,25 +568,21 @@ unique_ptr<Token> Token::tokenize(const File *file)
 		{
 			/* 先頭は現在のイテレーター */
 			const auto start = itr;
-			/* 1文字ずつ識別子となりうる文字かみていく */
 			/* 識別子となりえない文字が出てくるまで1つの識別子として認識する */
-			do
-			{
-				++itr;
-			} while (is_char_of_ident(*itr));
+			itr = Scan::ident_end(itr + 1, last);
 
 			/* 新しいトークンを生成してcurに繋ぎcurを一つ進める */
-			current_token->_next = make_unique<Token>(TokenKind::TK_IDENT, start - first, string(start, itr));
+			current_token->_next = make_unique<Token>(TokenKind::TK_IDENT, start - first, string_view(start, itr));
 			current_token = current_token->_next.get();
 			continue;
 		}
 
 		/* パンクチュエータ:構文的に意味を持つ記号またはキーワードこの段階では区別しない */
-		size_t punct_len = read_punct(string(itr, last));
+		size_t punct_len = read_punct(string_view(itr, last));
 		if (punct_len)
 		{
 			/* 新しいトークンを生成してcurに繋ぎcurを一つ進める */
-			current_token->_next = make_unique<Token>(TokenKind::TK_PUNCT, itr - first, string(itr, itr + punct_len));
+			current_token->_next = make_unique<Token>(TokenKind::TK_PUNCT, itr - first, string_view(itr, itr + punct_len));
 			current_token = current_token->_next.get();
 			itr += punct_len;
 			continue;
@@ -279,8 +593,6 @@ unique_ptr<Token> Token::tokenize(const File *file)
 
 	/* 最後に終端トークンを作成して繋ぐ */
 	current_token->_next = make_unique<Token>(TokenKind::TK_EOF, last - first);
-	/* 行数をセットする */
-	add_line_number(head->_next.get());
 	/* ダミーの次のトークン以降を切り離して返す */
 	return move(head->_next);
 }
@@ -291,14 +603,14 @@ unique_ptr<Token> Token::tokenize(const File *file)
  * @param itr 文字列リテラルの始まりの'"'の次の位置
  * @return 文字列リテラルの終わりの'"'の位置
  */
-string::const_iterator Token::string_literal_end(string::const_iterator itr)
+string_view::const_iterator Token::string_literal_end(string_view::const_iterator itr)
 {
 	auto start = itr;
 	const auto first = current_file->_contents.cbegin();
 	const auto last = current_file->_contents.cend();
 
 	/* '"'が出てくるか末尾まで到達するまで読み込み続ける */
-	for (; itr != last && *itr != '"'; ++itr)
+	for (; (itr = Scan::string_special(itr, last)) != last && *itr != '"'; ++itr)
 	{
 		/* エスケープシーケンスは無視する */
 		if (*itr == '\\')
@@ -308,6 +620,10 @@ string::const_iterator Token::string_literal_end(string::const_iterator itr)
 		/* 途中で改行や'\0'が出てきたらエラーとする */
 		if (*itr == '\n' || *itr == '\0')
 		{
+			if (is_splice(itr - 1))
+			{
+				throw SpliceInToken();
+			}
 			error_at("文字列が閉じられていません", start - first);
 		}
 	}
@@ -325,13 +641,22 @@ string::const_iterator Token::string_literal_end(string::const_iterator itr)
  * @param itr 文字列リテラルの開始位置。(1個目の'"'の位置)
  * @return 文字列リテラルを表すトークン
  */
-unique_ptr<Token> Token::read_string_literal(string::const_iterator &itr)
+unique_ptr<Token> Token::read_string_literal(string_view::const_iterator &itr)
 {
 	auto start = itr + 1;
 	auto end = string_literal_end(start);
-	string buf = "\"";
+	itr = end + 1;
 
-	for (auto p = start; p != end;)
+	/* エスケープシーケンスを含まなければ、前後の'"'を含めたファイルの中身の綴りをそのまま使う */
+	auto escape = Scan::find_char(start, end, '\\');
+	if (escape == end)
+	{
+		return make_unique<Token>(TokenKind::TK_STR, start - current_file->_contents.cbegin(), string_view(start - 1, end + 1));
+	}
+
+	string buf = "\"";
+	buf.append(start, escape);
+	for (auto p = escape; p != end;)
 	{
 		/* エスケープシーケンス */
 		if (*p == '\\')
@@ -345,12 +670,11 @@ unique_ptr<Token> Token::read_string_literal(string::const_iterator &itr)
 			++p;
 		}
 	}
-	itr = end + 1;
 
 	/* 末尾に'"'を付け加える */
 	buf.push_back('"');
 
-	return make_unique<Token>(TokenKind::TK_STR, start - current_file->_contents.cbegin(), move(buf));
+	return make_unique<Token>(TokenKind::TK_STR, start - current_file->_contents.cbegin(), current_file->_source->store(move(buf)));
 }
 
 /**
@@ -361,7 +685,7 @@ unique_ptr<Token> Token::read_string_literal(string::const_iterator &itr)
  * @return 対応する文字
  * @details \a, \b, \t, \n \v, \f, \r, \e
  */
-char Token::read_escaped_char(string::const_iterator &new_pos, string::const_iterator &&pos)
+char Token::read_escaped_char(string_view::const_iterator &new_pos, string_view::const_iterator &&pos)
 {
 	/* 16進数エスケープ */
 	if (*pos == 'x')
@@ -429,7 +753,7 @@ char Token::read_escaped_char(string::const_iterator &new_pos, string::const_ite
  * @param start 開始位置
  * @return 数値トークン
  */
-unique_ptr<Token> Token::read_number(const string::const_iterator &start)
+unique_ptr<Token> Token::read_number(const string_view::const_iterator &start)
 {
 	unique_ptr<Token> token;
 
@@ -448,21 +772,16 @@ unique_ptr<Token> Token::read_number(const string::const_iterator &start)
 	}
 
 	/* そうでなければ小数である */
-	size_t idx = 0;
-	double val = 0;
-	auto itr = start;
-
-	try
-	{
-		val = std::stod(string(start, current_file->_contents.cend()), &idx);
-	}
-	catch (const std::invalid_argument &e)
+	/* ファイルの中身は'\0'で終端されているので、そのまま変換する */
+	char *end = nullptr;
+	double val = std::strtod(&*start, &end);
+	if (end == &*start)
 	{
 		error_at("無効な数値です", start - current_file->_contents.begin());
 	}
 
 	/* 変換した数値の桁数だけイテレーターを進める */
-	itr += idx;
+	auto itr = start + (end - &*start);
 
 	shared_ptr<Type> ty;
 	if ('f' == *itr || 'F' == *itr)
@@ -487,9 +806,9 @@ unique_ptr<Token> Token::read_number(const string::const_iterator &start)
 		bol = token->_at_begining;
 		space = token->_has_space;
 	}
-	token = make_unique<Token>(TokenKind::TK_NUM, start - current_file->_contents.begin(), string(start, itr));
+	token = make_unique<Token>(TokenKind::TK_NUM, start - current_file->_contents.begin(), string_view(start, itr));
 	token->_fval = val;
-	token->_ty = ty;
+	token->set_type(ty);
 	if (flg)
 	{
 		token->_at_begining = bol;
@@ -505,7 +824,7 @@ unique_ptr<Token> Token::read_number(const string::const_iterator &start)
  * @param start 開始位置
  * @return 数値トークン
  */
-unique_ptr<Token> Token::read_int_literal(const string::const_iterator &start)
+unique_ptr<Token> Token::read_int_literal(const string_view::const_iterator &start)
 {
 	auto itr = start;
 	int base = 0;
@@ -517,25 +836,22 @@ unique_ptr<Token> Token::read_int_literal(const string::const_iterator &start)
 		base = 2;
 	}
 
-	size_t idx = 0;
-	int64_t val = 0;
-	try
-	{
-		val = std::stoull(string(itr, current_file->_contents.cend()), &idx, base);
-	}
-	catch (const std::invalid_argument &e)
+	/* ファイルの中身は'\0'で終端されているので、そのまま変換する */
+	char *end = nullptr;
+	int64_t val = std::strtoull(&*itr, &end, base);
+	if (end == &*itr)
 	{
 		error_at("無効な数値です", itr - current_file->_contents.cbegin());
 	}
 
 	/* 変換した数値の桁数だけイテレーターを進める */
-	itr += idx;
+	itr += end - &*itr;
 
 	/* 現在のイテレータ位置から末尾までの文字数 */
 	int res = current_file->_contents.cend() - itr;
 
 	/* 数値の次の3文字（サフィックスの可能性がある）を取り出す */
-	string suffix = string(itr, itr + std::min(3, res));
+	string_view suffix = string_view(itr, itr + std::min(3, res));
 
 	bool u = false, l = false;
 
@@ -614,9 +930,9 @@ unique_ptr<Token> Token::read_int_literal(const string::const_iterator &start)
 			ty = Type::INT_BASE;
 	}
 
-	auto token = make_unique<Token>(TokenKind::TK_NUM, start - current_file->_contents.cbegin(), string(start, itr));
+	auto token = make_unique<Token>(TokenKind::TK_NUM, start - current_file->_contents.cbegin(), string_view(start, itr));
 	token->_val = val;
-	token->_ty = ty;
+	token->set_type(ty);
 
 	return token;
 }
@@ -627,13 +943,17 @@ unique_ptr<Token> Token::read_int_literal(const string::const_iterator &start)
  * @param start 開始位置("'"の位置)
  * @return 文字リテラルのトークン
  */
-unique_ptr<Token> Token::read_char_literal(const string::const_iterator &start, const string::const_iterator &quote)
+unique_ptr<Token> Token::read_char_literal(const string_view::const_iterator &start, const string_view::const_iterator &quote)
 {
 	auto pos = quote + 1;
 	if (current_file->_contents.cend() == pos)
 	{
 		error_at("文字リテラルが閉じられていません", start - current_file->_contents.cbegin());
 	}
+	if (is_splice(pos))
+	{
+		throw SpliceInToken();
+	}
 	char c;
 	/* エスケープされている場合 */
 	if (*pos == '\\')
@@ -648,6 +968,10 @@ unique_ptr<Token> Token::read_char_literal(const string::const_iterator &start,
 	/* ２個めの"'"を探す */
 	while (pos != current_file->_contents.cend() && *pos != '\'')
 	{
+		if (is_splice(pos))
+		{
+			throw SpliceInToken();
+		}
 		++pos;
 	}
 
@@ -658,33 +982,11 @@ unique_ptr<Token> Token::read_char_literal(const string::const_iterator &start,
 	}
 
 	auto token = make_unique<Token>(c, start - current_file->_contents.cbegin());
-	token->_str = string(start, pos + 1);
-	token->_ty = Type::INT_BASE;
+	token->_str = string_view(start, pos + 1);
+	token->set_type(Type::INT_BASE);
 	return token;
 }
 
-/**
- * @brief トークンが期待している演算子または識別子と一致するかどうか
- *
- * @param op 比較する文字列
- * @return 一致:true, 不一致:false
- */
-bool Token::is_equal(string &&op) const
-{
-	return this->_str == op;
-}
-
-/**
- * @brief トークンが期待している演算子または識別子と一致するかどうか
- *
- * @param op 比較する文字列
- * @return 一致:true, 不一致:false
- */
-bool Token::is_equal(const string &op) const
-{
-	return this->_str == op;
-}
-
 /**
  * @brief トークンが配列、配列、共用体の初期化式の末尾であるかを判定
  *
@@ -706,12 +1008,9 @@ bool Token::is_end() const
 bool Token::is_typename() const
 {
 	/* 標準の型指定子 */
-	for (auto &name : type_names)
+	if (_atom.is_typename())
 	{
-		if (name == _str)
-		{
-			return true;
-		}
+		return true;
 	}
 
 	/* typedefされた定義を検索する */
@@ -722,6 +1021,50 @@ bool Token::is_typename() const
 	return false;
 }
 
+/**
+ * @brief トークンが書かれている物理的な行の行数を返す。初めて呼ばれたときにファイルの中身の位置から求める。
+ * マクロ展開の結果のトークンは展開元のマクロの行数を返す。
+ *
+ * @return 行数。ファイルに含まれないトークンであれば0
+ */
+int Token::line_no() const
+{
+	if (0 == _line_no && _file)
+	{
+		_line_no = _file->_source->line_no(_location);
+	}
+	return _line_no;
+}
+
+/**
+ * @brief 数値トークンの型を返す
+ *
+ * @return 数値の型。数値トークンでなければnullptr
+ */
+const shared_ptr<Type> &Token::type() const
+{
+	static const shared_ptr<Type> none;
+	return _literal_type ? *literal_types[_literal_type] : none;
+}
+
+/**
+ * @brief 数値トークンの型を設定する
+ *
+ * @param ty 数値の型(literal_typesのいずれか)
+ */
+void Token::set_type(const shared_ptr<Type> &ty)
+{
+	for (uint8_t i = 1; i < std::size(literal_types); ++i)
+	{
+		if (*literal_types[i] == ty)
+		{
+			_literal_type = i;
+			return;
+		}
+	}
+	unreachable();
+}
+
 /**
  * @brief 文字列の先頭がパンクチュエーターかどうか判定しその長さを返す
  *
@@ -730,13 +1073,14 @@ bool Token::is_typename() const
  * @param last 文字列の末端位置のイテレーター
  * @return パンクチュエーターの長さ
  */
-size_t Token::read_punct(string &&str)
+size_t Token::read_punct(const string_view &str)
 {
-	for (const auto &kw : punctuators)
+	/* 長いものから順に、先頭の3文字、2文字が区切り文字一覧にあるかを調べる */
+	for (size_t len = 3; len >= 2; --len)
 	{
-		if (str.starts_with(kw))
+		if (str.size() >= len && punct_hash.find(str.substr(0, len)) >= 0)
 		{
-			return kw.size();
+			return len;
 		}
 	}
 
@@ -755,18 +1099,6 @@ bool Token::is_first_char_of_ident(const char &c)
 	return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
 }
 
-/**
- * @brief cが識別子の先頭以外の文字となりうるか判定。
- *
- * @details アルファベットの小文字 or 大文字 or アンダースコア'_' or 数字
- * @param c cが識別子の先頭以外の文字となりうるか判定。
- * @return なりうる:true, ならない:false
- */
-bool Token::is_char_of_ident(const char &c)
-{
-	return is_first_char_of_ident(c) || ('0' <= c && c <= '9');
-}
-
 /**
  * @brief トークンが表す値を返す。トークンが数値型でなければエラーとする。
  *
@@ -801,30 +1133,210 @@ int Token::from_hex(const char &c)
 }
 
 /**
- * @brief トークンリストを辿って行数をセットする
+ * @brief posが行の継続('\\' + '\n')の先頭であるか。行の継続を除去済みの中身では常にfalseを返す。
  *
- * @param token トークンリストの先頭
+ * @param pos 判定する位置
+ * @return 行の継続の先頭であればtrue
  */
-void Token::add_line_number(Token *token)
+bool Token::is_splice(const string_view::const_iterator &pos)
 {
-	int pos = 0;
-	const int total = current_file->_contents.end() - current_file->_contents.begin();
-	int n = 1;
+	return splices && '\\' == *pos && '\n' == *(pos + 1);
+}
 
-	while (token->_kind != TokenKind::TK_EOF && pos != total)
+/**
+ * @brief 翻訳単位ごとの状態を初期化する。同じプロセスで続けて別のファイルをコンパイルする前に呼ぶ。
+ *
+ */
+void Token::reset()
+{
+	input_files.clear();
+	current_file = nullptr;
+	file_count = 0;
+	at_begining = false;
+	has_space = false;
+	/* 前の翻訳単位のトークンがすべて破棄されていればチャンクをまとめて解放する */
+	arena().release();
+}
+
+/**
+ * @brief インクルードするヘッダファイルをトークナイズする。
+ * ヘッダファイルのキャッシュが有効であり、更新時刻とサイズが読み込んだ時点から変わっていなければ
+ * キャッシュしたトークン列を複製して返す。
+ *
+ * @param path ファイルパス
+ * @return トークナイズした結果のトークンリスト
+ */
+unique_ptr<Token> Token::tokenize_header(const string &path)
+{
+	if (!file_cache_enabled)
 	{
-		if (pos == token->_location)
-		{
-			token->_line_no = n;
-			token = token->_next.get();
-			continue;
-		}
-		if (current_file->_contents[pos] == '\n')
-		{
-			++n;
-		}
-		++pos;
+		return tokenize_file(path);
+	}
+
+	int64_t mtime, size;
+	auto itr = file_cache.find(path);
+	if (itr == file_cache.end() || !file_stat(path, mtime, size) || itr->second._mtime != mtime || itr->second._size != size)
+	{
+		file_cache_misses.emplace_back(path);
+		return tokenize_file(path);
+	}
+
+	TimeReport::Scope scope(TimeReport::PH_TOKENIZE);
+
+	/* 翻訳単位ごとにファイル番号を振り直すのでFile構造体は新しく作る */
+	const auto &cached = itr->second;
+	input_files.emplace_back(make_unique<File>(cached._file->_name, ++file_count, cached._file->_source));
+	current_file = input_files.back().get();
+
+	auto head = make_unique_for_overwrite<Token>();
+	auto cur = head.get();
+	for (auto t = cached._tokens.get(); t; t = t->_next.get())
+	{
+		cur->_next = copy_token(t);
+		cur = cur->_next.get();
+		cur->_file = current_file;
+	}
+	TimeReport::count_input(current_file->_contents, head->_next.get());
+	return move(head->_next);
+}
+
+/**
+ * @brief このスレッドでトークンを割り当てるアリーナを設定する。
+ * 別のスレッドでトークナイズしたトークンは、adopt_file()でアリーナごと引き取るまで解放してはいけない。
+ *
+ * @param arena アリーナ。nullptrであれば共通のアリーナに戻す
+ */
+void Token::set_thread_arena(Arena<Token, MemReport::MK_TOKEN> *arena)
+{
+	thread_arena = arena;
+}
+
+/**
+ * @brief 別のスレッドでトークナイズしたファイルを入力ファイルのリストに加える。
+ * ファイル番号はここで振るので、同期的にトークナイズした場合と同じ順になる。
+ *
+ * @param file トークナイズしたファイル
+ * @param tokens トークナイズした結果のトークンリスト
+ * @param arena トークンを割り当てたアリーナ。共通のアリーナに引き取る
+ * @return トークンリスト
+ */
+unique_ptr<Token> Token::adopt_file(unique_ptr<File> &&file, unique_ptr<Token> &&tokens, Arena<Token, MemReport::MK_TOKEN> &&arena)
+{
+	Token::arena().adopt(move(arena));
+	file->_file_no = ++file_count;
+	input_files.emplace_back(move(file));
+	current_file = input_files.back().get();
+	TimeReport::count_input(current_file->_contents, tokens.get());
+	return move(tokens);
+}
+
+/**
+ * @brief トークナイズせずに復元したファイル(プリコンパイル済みヘッダの中身など)を入力ファイルのリストに加える
+ *
+ * @param file ファイル。ファイル番号はここで振る
+ * @return 入力ファイルのリストに加えたファイル
+ */
+const File *Token::add_input_file(unique_ptr<File> &&file)
+{
+	file->_file_no = ++file_count;
+	input_files.emplace_back(move(file));
+	return input_files.back().get();
+}
+
+/**
+ * @brief ヘッダファイルのキャッシュを有効にする
+ *
+ */
+void Token::enable_file_cache()
+{
+	file_cache_enabled = true;
+}
+
+/**
+ * @brief ヘッダファイルのキャッシュが有効であるか
+ *
+ * @return 有効であればtrue
+ */
+bool Token::is_file_cache_enabled()
+{
+	return file_cache_enabled;
+}
+
+/**
+ * @brief ファイルをトークナイズしてヘッダファイルのキャッシュに登録する。
+ * キャッシュ済みで変更されていないか、ファイルが存在しない場合は何もしない。トークナイズに失敗した場合はキャッシュしない。
+ *
+ * @param path ファイルパス
+ */
+void Token::preload_file(const string &path)
+{
+	int64_t mtime, size;
+	if (!file_stat(path, mtime, size))
+	{
+		return;
+	}
+
+	auto itr = file_cache.find(path);
+	if (itr != file_cache.end() && itr->second._mtime == mtime && itr->second._size == size)
+	{
+		return;
+	}
+
+	/* コンパイルサーバが終了しないように、字句エラーのあるファイルは報告も終了もせずにキャッシュから外す */
+	CachedFile cached;
+	defer_errors(true);
+	set_thread_arena(&persistent_arena());
+	try
+	{
+		cached._file = make_unique<File>(path, 0, Source::load(path));
+		cached._tokens = tokenize(cached._file.get());
+	}
+	catch (const DeferredError &)
+	{
+		cached._tokens.reset();
+	}
+	set_thread_arena(nullptr);
+	defer_errors(false);
+	current_file = nullptr;
+
+	if (!cached._tokens)
+	{
+		file_cache.erase(path);
+		return;
+	}
+	cached._mtime = mtime;
+	cached._size = size;
+	file_cache[path] = move(cached);
+}
+
+/**
+ * @brief このプロセスでキャッシュになかったヘッダファイルのパスのリストを返す
+ *
+ * @return キャッシュになかったヘッダファイルのパスのリスト
+ */
+const vector<string> &Token::get_file_cache_misses()
+{
+	return file_cache_misses;
+}
+
+/**
+ * @brief ファイルの更新時刻とサイズを取得する
+ *
+ * @param path ファイルパス
+ * @param mtime 更新時刻(ナノ秒)の格納先
+ * @param size サイズの格納先
+ * @return 取得できたか
+ */
+bool Token::file_stat(const string &path, int64_t &mtime, int64_t &size)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		return false;
 	}
+	mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+	size = st.st_size;
+	return true;
 }
 
 /**
@@ -872,6 +1384,7 @@ void Token::print_token(const unique_ptr<Token> &token, const string &output_pat
 		++line;
 	}
 	*os << endl;
+	close_file();
 }
 
 /**
@@ -885,11 +1398,11 @@ string Token::reverse_str_literal(const Token *token)
 {
 	if (TokenKind::TK_STR != token->_kind)
 	{
-		return token->_str;
+		return string(token->_str);
 	}
 
 	/* 文字列リテラル */
-	const string &str = token->_file->_contents;
+	const string_view &str = token->_file->_contents;
 	string buf;
 	buf.push_back('"');
 
@@ -922,9 +1435,10 @@ unique_ptr<Token> Token::copy_token(const Token *src)
  * @brief '\\' +'\n'による行の継続の変換を行う
  *
  * @param str 変換前の文字列
+ * @param splice_points 行の継続を除去した位置(変換後の文字列での位置)を格納する
  * @return 変換後の文字列
  */
-string Token::remove_backslash_newline(const string &str)
+string Token::remove_backslash_newline(const string_view &str, vector<int> &splice_points)
 {
 	string buf;
 	buf.reserve(str.size());
@@ -936,8 +1450,9 @@ string Token::remove_backslash_newline(const string &str)
 	for (size_t i = 0; i < str.size(); ++i)
 	{
 		/* '\\' + '\n' の場合は改行を無視して行を継続する */
-		if (str[i] == '\\' && str[i + 1] == '\n')
+		if (str[i] == '\\' && i + 1 < str.size() && str[i + 1] == '\n')
 		{
+			splice_points.emplace_back(buf.size());
 			++i;
 			++n;
 		}
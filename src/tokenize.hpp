@@ -13,12 +13,14 @@
 
 #include "common.hpp"
 #include "input.hpp"
+#include "arena.hpp"
+#include "hideset.hpp"
 
 /* 前方宣言 */
 class Type;
 
 /** @brief トークンの種類 */
-enum class TokenKind
+enum class TokenKind : uint8_t
 {
 	TK_PUNCT,	/*!< パンクチュエータ:構文的に意味を持つ記号 */
 	TK_IDENT,	/*!< 識別子 */
@@ -32,99 +34,203 @@ enum class TokenKind
  * @brief トークンを表すクラス
  *
  */
-class Token
+class Token : MemCounted<Token, MemReport::MK_TOKEN>
 {
 public:
+	/**
+	 * @brief ファイルの中身を保持する領域。大きなファイルはmmapした領域を、それ以外は読み込んだ文字列を持つ。
+	 * 中身は'\n'で終わり、末尾の直後の1バイトは'\0'であることを保証する。
+	 * 行番号は中身の'\n'の位置の表から求める。表は初めて行番号が必要になったときに作る。
+	 *
+	 */
+	class Source
+	{
+	public:
+		explicit Source(string &&str, vector<int> &&splice_points = {});
+		Source(void *map, const size_t &size);
+		Source(const Source &) = delete;
+		Source &operator=(const Source &) = delete;
+		~Source();
+
+		string_view view() const;
+		int line_no(const int &location) const;
+		string_view store(string &&str) const;
+		const vector<int> &splice_points() const;
+		static shared_ptr<const Source> load(const string &path);
+
+	private:
+		string _str;					  /*!< 読み込んだ中身(mmapしていない場合) */
+		void *_map = nullptr;			  /*!< mmapした領域 */
+		size_t _map_size = 0;			  /*!< mmapした領域のサイズ */
+		vector<int> _splice_points;		  /*!< 行の継続を除去した中身であれば、除去した位置のリスト */
+		mutable vector<int> _line_starts; /*!< 各行の先頭の位置(空であれば未作成) */
+		mutable std::deque<string> _literals; /*!< 中身に綴りがない文字列リテラルの内容(store()で追加する) */
+
+		/** この大きさ未満のファイルはmmapせずに読み込む */
+		static constexpr size_t MMAP_THRESHOLD = 16 * 1024;
+	};
+
 	/**
 	 * @brief ファイルを表す構造体
 	 * 
 	 */
 	struct File
 	{
-		string _name;	  /*!< ファイル名（フルパス） */
-		int _file_no;	  /*!< ファイルの通し番号 */
-		string _contents; /*!< ファイルの中身 */
+		string _name;					  /*!< ファイル名（フルパス） */
+		int _file_no;					  /*!< ファイルの通し番号 */
+		string_view _contents;			  /*!< ファイルの中身(_sourceの領域を指す) */
+		shared_ptr<const Source> _source; /*!< ファイルの中身を保持する領域 */
 
 		File(const string &name, const int &file_no, const string &content)
-			: _name(name), _file_no(file_no), _contents(content)
+			: _name(name), _file_no(file_no), _source(make_shared<Source>(string(content)))
+		{
+			_contents = _source->view();
+		}
+
+		File(const string &name, const int &file_no, const shared_ptr<const Source> &source)
+			: _name(name), _file_no(file_no), _contents(source->view()), _source(source)
 		{
 		}
 	};
 
 	/* メンバ変数 (public) */
+	/* トークンは大量に生成されるので、64バイトに収まるように大きい順に並べる */
 
-	unique_ptr<Token> _next;			 /*!< 次のトークン */
-	TokenKind _kind = TokenKind::TK_EOF; /*!< トークンの型 */
-	int64_t _val = 0;					 /*!< kindがTK_NUMの場合、その数値(整数) */
-	double _fval = 0.0;					 /*!< kindがTK_NUMの場合、その数値(浮動小数点) */
-	shared_ptr<Type> _ty;				 /*!< kindがTK_NUMの場合、数値の型 */
+	unique_ptr<Token> _next;	  /*!< 次のトークン */
+	string_view _str;			  /*!< トークンが表す文字列(ファイルの中身の綴り、または_file->_sourceに保持した文字列を指す) */
+	const File *_file = nullptr;  /*!< トークンが含まれるファイル */
+	const Hideset *_hideset = nullptr; /*!< マクロ展開に利用する、既に展開済みのマクロ(共有するので複製しない) */
+	union
+	{
+		int64_t _val = 0; /*!< kindがTK_NUMで整数の場合、その数値 */
+		double _fval;	  /*!< kindがTK_NUMで浮動小数点数の場合、その数値 */
+	};
 	int _location = 0;					 /*!< トークン文字列の開始位置 */
-	string _str = "";					 /*!< トークンが表す文字列 */
-	const File *_file = nullptr;		 /*!< トークンが含まれるファイル */
-	int _line_no = 0;					 /*!< トークン文字列が含まれる行数  */
+	mutable int _line_no = 0;			 /*!< トークン文字列が含まれる行数(0であれば未計算。line_no()で参照する) */
+	Atom _atom;							 /*!< kindがTK_IDENT, TK_PUNCT, TK_KEYWORDの場合、文字列に対応するアトム */
+	TokenKind _kind = TokenKind::TK_EOF; /*!< トークンの型 */
+	uint8_t _literal_type = 0;			 /*!< kindがTK_NUMの場合、数値の型(literal_typesの添字。0は型なし) */
 	bool _at_begining = false;			 /*!< トークンが行頭であるか  */
 	bool _has_space = false;			 /*!< トークンの直前にスペースが存在するか */
-	unique_ptr<Hideset> _hideset;		 /*!< マクロ展開に利用する、既に展開済みのマクロ */
 
 	/* コンストラクタ */
 	Token();
 	Token(const TokenKind &kind, const int &location);
 	Token(const int64_t &value, const int &location);
-	Token(const TokenKind &kind, const int &location, string &&str);
+	Token(const TokenKind &kind, const int &location, const string_view &str);
 	/* コピーコンストラクタ */
 	Token(const Token &src);
 	/* ムーブコンストラクタ */
 	Token(Token &&src);
 	Token &operator=(Token &&rhs);
+	/* デストラクタ */
+	~Token();
+
+	/* アリーナからの割り当て */
+	static void *operator new(size_t size);
+	static void operator delete(void *p);
 
 	/* メンバ関数 */
 
-	bool is_equal(string &&op) const;
-	bool is_equal(const string &op) const;
+	/**
+	 * @brief トークンが期待している演算子または識別子と一致するかどうか
+	 *
+	 * @param op 比較する文字列のアトム
+	 * @return 一致:true, 不一致:false
+	 */
+	bool is_equal(const Atom &op) const
+	{
+		return _atom == op;
+	}
+
 	bool is_end() const;
 	bool is_typename() const;
+	int line_no() const;
+	const shared_ptr<Type> &type() const;
+	void set_type(const shared_ptr<Type> &ty);
 	int64_t get_number() const;
 
 	/* 静的メンバ関数 (public) */
 
 	static unique_ptr<Token> tokenize_file(const string &input_path);
-	static unique_ptr<Token> tokenize(const File *file);
+	static unique_ptr<Token> tokenize(File *file);
 	static void print_token(const unique_ptr<Token> &token, const string &output_path);
 	static string reverse_str_literal(const Token *token);
 	static const vector<unique_ptr<File>> &get_input_files();
 	static const File *get_current_file();
 	static unique_ptr<Token> copy_token(const Token *src);
+	static void reset();
+	static unique_ptr<Token> tokenize_header(const string &path);
+	static void enable_file_cache();
+	static bool is_file_cache_enabled();
+	static void preload_file(const string &path);
+	static const vector<string> &get_file_cache_misses();
+	static void set_thread_arena(Arena<Token, MemReport::MK_TOKEN> *arena);
+	static Arena<Token, MemReport::MK_TOKEN> &persistent_arena();
+	static unique_ptr<Token> adopt_file(unique_ptr<File> &&file, unique_ptr<Token> &&tokens, Arena<Token, MemReport::MK_TOKEN> &&arena);
+	static const File *add_input_file(unique_ptr<File> &&file);
+	static bool file_stat(const string &path, int64_t &mtime, int64_t &size);
 
 private:
+	friend class Pch;
+	/**
+	 * @brief トークナイズ済みのヘッダファイル(コンパイルサーバで使う)
+	 *
+	 */
+	struct CachedFile
+	{
+		unique_ptr<File> _file;	   /*!< ファイル */
+		unique_ptr<Token> _tokens; /*!< トークナイズした結果 */
+		int64_t _mtime = 0;		   /*!< 読み込んだ時点のファイルの更新時刻(ナノ秒) */
+		int64_t _size = 0;		   /*!< 読み込んだ時点のファイルのサイズ */
+	};
+
+	/**
+	 * @brief トークンの途中に行の継続('\\' + '\n')があることを表す例外。
+	 * 投げられた場合は行の継続を除去した中身でトークナイズし直す。
+	 *
+	 */
+	struct SpliceInToken
+	{
+	};
+
 	/* 静的メンバ関数 (private) */
 
-	static string read_inputfile(const string &path);
-	static unique_ptr<Token> read_number(const string::const_iterator &start);
-	static unique_ptr<Token> read_int_literal(const string::const_iterator &start);
-	static unique_ptr<Token> read_char_literal(const string::const_iterator &start, const string::const_iterator &quote);
-	static size_t read_punct(string &&str);
-	static char read_escaped_char(string::const_iterator &new_pos, string::const_iterator &&pos);
-	static unique_ptr<Token> read_string_literal(string::const_iterator &itr);
-	static string::const_iterator string_literal_end(string::const_iterator itr);
+	static unique_ptr<Token> tokenize_contents(const File *file);
+	static unique_ptr<Token> read_number(const string_view::const_iterator &start);
+	static unique_ptr<Token> read_int_literal(const string_view::const_iterator &start);
+	static unique_ptr<Token> read_char_literal(const string_view::const_iterator &start, const string_view::const_iterator &quote);
+	static size_t read_punct(const string_view &str);
+	static char read_escaped_char(string_view::const_iterator &new_pos, string_view::const_iterator &&pos);
+	static unique_ptr<Token> read_string_literal(string_view::const_iterator &itr);
+	static string_view::const_iterator string_literal_end(string_view::const_iterator itr);
+	static bool is_splice(const string_view::const_iterator &pos);
 	static bool is_first_char_of_ident(const char &c);
-	static bool is_char_of_ident(const char &c);
 	static int from_hex(const char &c);
-	static void add_line_number(Token *token);
-	static string remove_backslash_newline(const string &str);
+	static string remove_backslash_newline(const string_view &str, vector<int> &splice_points);
+	static Arena<Token, MemReport::MK_TOKEN> &arena();
 
-	/** 型名 */
-	static constexpr string_view type_names[] = {"void", "_Bool", "char", "short", "int", "long", "float", "double", "struct", "union",
-												 "typedef", "enum", "static", "extern", "_Alignas", "signed", "unsigned",
-												 "const", "volatile", "auto", "register", "restrict", "__restrict", "__restrict__", "_Noreturn"};
+	/** 数値トークンの型の一覧。トークンは添字だけを持つ(先頭は型なし) */
+	static const shared_ptr<Type> *const literal_types[7];
 
-	/** 区切り文字一覧 */
+	/** 区切り文字一覧(2文字以上のもの) */
 	static constexpr string_view punctuators[] = {"<<=", ">>=", "...", "==", "!=", "<=", ">=", "->", "+=", "-=", "*=", "/=",
 												  "++", "--", "%=", "&=", "|=", "^=", "&&", "||", "<<", ">>", "##"};
 
+	/** 区切り文字一覧の完全ハッシュ表 */
+	static constexpr PerfectHash<std::size(punctuators), 7> punct_hash{punctuators};
+
 	static vector<unique_ptr<File>> input_files;
-	static const File *current_file;
-	static bool at_begining;
-	static bool has_space;
+	static int file_count;
+	/* トークナイズ中の状態はヘッダファイルを先読みするスレッドごとに持つ */
+	static thread_local const File *current_file;
+	static thread_local bool at_begining;
+	static thread_local bool has_space;
+	static thread_local bool splices;
+	static thread_local Arena<Token, MemReport::MK_TOKEN> *thread_arena;
+	static std::unordered_map<string, CachedFile> file_cache;
+	static bool file_cache_enabled;
+	static vector<string> file_cache_misses;
 };
 
 using File = Token::File;
\ No newline at end of file
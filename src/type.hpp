@@ -41,7 +41,7 @@ class Member;
  * @brief 型を表すクラス
  *
  */
-class Type
+class Type : MemCounted<Type, MemReport::MK_TYPE>
 {
 public:
 	/* メンバ変数 (public) */
@@ -0,0 +1,36 @@
+#!/bin/bash
+# 内蔵アセンブラ(-fintegrated-as)の出力を'as'の出力と比較する
+FCC='./bin/fcc'
+tmp=`mktemp -d /tmp/fcc-asmdiff-XXXXXX`
+trap 'rm -rf $tmp' INT TERM HUP EXIT
+
+check() {
+    if [ $? -eq 0 ]; then
+        echo "testing $1 ... passed"
+    else
+        echo "testing $1 ... failed"
+        exit 1
+    fi
+}
+
+# .textと.dataの内容、再配置、行番号情報を比較する
+compare() {
+    as --noexecstack -c $1 -o $tmp/as.o || return 1
+    $FCC -fintegrated-as -c $1 -o $tmp/ias.o || return 1
+    for obj in as ias; do
+        objdump -dr -j .text $tmp/$obj.o | tail -n +3 > $tmp/$obj.text
+        objdump -s -r -j .data $tmp/$obj.o | tail -n +3 > $tmp/$obj.data
+        objdump --dwarf=decodedline $tmp/$obj.o | tail -n +4 > $tmp/$obj.line
+    done
+    cmp -s $tmp/as.text $tmp/ias.text && cmp -s $tmp/as.data $tmp/ias.data && cmp -s $tmp/as.line $tmp/ias.line
+}
+
+for src in test/*.c test/common; do
+    name=`basename $src .c`
+    $FCC -I test -S -xc -o $tmp/$name.s $src && compare $tmp/$name.s
+    check "asmdiff $name"
+    $FCC -I test -g -S -xc -o $tmp/$name.s $src && compare $tmp/$name.s
+    check "asmdiff $name (-g)"
+done
+
+echo OK
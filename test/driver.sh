@@ -70,6 +70,239 @@ $tmp/foo
 [ "$?" = 42 ]
 check linker
 
+# -j
+rm -f $tmp/foo
+echo 'int bar(); int baz(); int main() { return bar() + baz(); }' > $tmp/foo.c
+echo 'int bar() { return 40; }' > $tmp/bar.c
+echo 'int baz() { return 2; }' > $tmp/baz.c
+$FCC -j4 -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check '-j'
+
+echo 'int x = ;' > $tmp/err1.c
+echo 'int y = ;' > $tmp/err2.c
+$FCC -j 3 -c $tmp/main.c $tmp/err1.c $tmp/err2.c > $tmp/err.txt 2>&1
+[ "$?" != 0 ] && grep -q 'err1.c' $tmp/err.txt && ! grep -q 'err2.c' $tmp/err.txt
+check '-j first error'
+
+# -fsubprocess
+rm -f $tmp/foo
+$FCC -fsubprocess -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check -fsubprocess
+
+echo 'int a() { if (1) return 1; return 0; }' > $tmp/sub1.c
+echo 'int b() { for (;;) return 2; }' > $tmp/sub2.c
+$FCC -j1 -S -o $tmp/sub2-alone.s $tmp/sub2.c
+(cd $tmp; $OLDPWD/bin/fcc -j1 -S sub1.c sub2.c)
+cmp -s $tmp/sub2-alone.s $tmp/sub2.s
+check 'in-process state reset'
+
+# -pipe
+rm -f $tmp/foo $tmp/foo.o
+$FCC -pipe -c -o $tmp/foo.o $tmp/main.c
+[ -f $tmp/foo.o ]
+check '-pipe -c'
+
+echo 'int bar(); int baz(); int main() { return bar() + baz(); }' > $tmp/foo.c
+$FCC -pipe -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check -pipe
+
+rm -f $tmp/foo
+$FCC -pipe -fsubprocess -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check '-pipe -fsubprocess'
+
+before=`ls /tmp | grep -c '^fcc-'`
+$FCC -pipe -o $tmp/foo $tmp/foo.c $tmp/bar.c
+after=`ls /tmp | grep -c '^fcc-'`
+[ "$before" = "$after" ]
+check '-pipe temporary files'
+
+rm -f $tmp/err.o
+$FCC -pipe -c -o $tmp/err.o $tmp/err1.c > /dev/null 2>&1
+[ "$?" != 0 ] && [ ! -e $tmp/err.o ]
+check '-pipe error'
+
+$FCC -pipe -fsubprocess -c -o $tmp/err.o $tmp/err1.c > /dev/null 2>&1
+[ "$?" != 0 ] && [ ! -e $tmp/err.o ]
+check '-pipe -fsubprocess error'
+
+# -fintegrated-as
+rm -f $tmp/foo
+$FCC -fintegrated-as -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check -fintegrated-as
+
+rm -f $tmp/foo
+$FCC -fintegrated-as -fsubprocess -g -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ]
+check '-fintegrated-as -fsubprocess -g'
+
+$FCC -S -o $tmp/foo.s $tmp/foo.c
+as --noexecstack -c $tmp/foo.s -o $tmp/foo-as.o
+$FCC -fintegrated-as -c $tmp/foo.s -o $tmp/foo-ias.o
+[ "`objdump -dr $tmp/foo-as.o | tail -n +3`" = "`objdump -dr $tmp/foo-ias.o | tail -n +3`" ]
+check '-fintegrated-as matches as'
+
+echo '  vzeroupper' | $FCC -fintegrated-as -c -x assembler -o $tmp/foo.o - 2>&1 | grep -q '未対応の命令です'
+check '-fintegrated-as unsupported instruction'
+
+# -fuse-ld=fcc
+rm -f $tmp/foo
+$FCC -fuse-ld=fcc -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ] && ! readelf -l $tmp/foo | grep -q INTERP
+check -fuse-ld=fcc
+
+rm -f $tmp/foo
+$FCC -fuse-ld=fcc -fintegrated-as -g -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ] && objdump --dwarf=decodedline $tmp/foo | grep -q 'bar.c'
+check '-fuse-ld=fcc -g'
+
+echo 'int undefined_fn(); int main() { return undefined_fn(); }' > $tmp/undef.c
+$FCC -fuse-ld=fcc -o $tmp/foo $tmp/undef.c 2>&1 | grep -q undefined_fn
+check '-fuse-ld=fcc falls back to ld'
+
+XDG_CACHE_HOME=$tmp/cache $FCC -fuse-ld=fcc -o $tmp/foo $tmp/main.c
+[ -f $tmp/cache/fcc/paths ] && XDG_CACHE_HOME=$tmp/cache $FCC -fuse-ld=fcc -o $tmp/foo $tmp/main.c
+check 'library path cache'
+
+# -fcache
+rm -f $tmp/foo
+$FCC -fcache-dir=$tmp/cache1 -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$FCC -fcache-dir=$tmp/cache1 -o $tmp/foo $tmp/foo.c $tmp/bar.c $tmp/baz.c
+$tmp/foo
+[ "$?" = 42 ] && $FCC -fcache-dir=$tmp/cache1 --cache-stats | grep -q 'ヒット: 3'
+check -fcache
+
+$FCC -fcache-dir=$tmp/cache1 -S -o $tmp/sub1-cache1.s $tmp/sub1.c
+$FCC -fcache-dir=$tmp/cache1 -S -o $tmp/sub1-cache2.s $tmp/sub1.c
+$FCC -S -o $tmp/sub1-nocache.s $tmp/sub1.c
+cmp -s $tmp/sub1-cache2.s $tmp/sub1-nocache.s && cmp -s $tmp/sub1-cache1.s $tmp/sub1-nocache.s
+check '-fcache -S'
+
+echo '#define N 2' > $tmp/cache.h
+echo '#include "cache.h"
+int main() { return N; }' > $tmp/cache.c
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache.c
+echo '#define N 3' > $tmp/cache.h
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache.c
+$tmp/foo
+[ "$?" = 3 ]
+check '-fcache header change'
+
+echo 'int main() { char *s = "a" "b"; return s[1]; }' > $tmp/cache-str.c
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache-str.c
+echo 'int main() { char *s = "a" "c"; return s[1]; }' > $tmp/cache-str.c
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache-str.c
+$tmp/foo
+[ "$?" = 99 ]
+check '-fcache concatenated string literal'
+
+echo '#define S(x) #x
+int main() { char *s = "a" S(b); return s[1]; }' > $tmp/cache-str.c
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache-str.c
+echo '#define S(x) #x
+int main() { char *s = "a" S(c); return s[1]; }' > $tmp/cache-str.c
+$FCC -fcache-dir=$tmp/cache2 -o $tmp/foo $tmp/cache-str.c
+$tmp/foo
+[ "$?" = 99 ]
+check '-fcache stringized string literal'
+
+for i in 1 2 3 4 5 6; do echo "int f$i() { return $i; }" > $tmp/evict$i.c; done
+$FCC -fcache-dir=$tmp/cache3 -fcache-size=2K -c $tmp/evict1.c $tmp/evict2.c $tmp/evict3.c $tmp/evict4.c $tmp/evict5.c $tmp/evict6.c
+[ `find $tmp/cache3 -type f ! -name stats | xargs cat | wc -c` -le 2048 ]
+check '-fcache-size'
+
+for i in 1 2 3 4; do $FCC -fcache-dir=$tmp/cache4 -S -o $tmp/race$i.s $tmp/sub1.c & done
+wait
+[ `cut -d' ' -f3 $tmp/cache4/stats` = `find $tmp/cache4 -type f ! -name stats | xargs cat | wc -c` ]
+check '-fcache concurrent store'
+
+# -ftime-report
+$FCC -ftime-report -c -o $tmp/foo.o $tmp/main.c 2>&1 | grep -q 'parse'
+check -ftime-report
+
+$FCC -ftime-report=json -o $tmp/foo $tmp/main.c 2>&1 | grep -q '^{"file":".*main.c","phases":{.*"tokenize".*},"total":{"wall_ms":'
+check '-ftime-report=json'
+
+# -fmem-report
+$FCC -fmem-report -c -o $tmp/foo.o $tmp/main.c 2>&1 | grep -q 'Token .* [1-9]'
+check -fmem-report
+
+# 同じ内容のhidesetは共有する({TWO}, {ONE}, {ONE, TWO}の3つ)
+printf '#define ONE 1\n#define TWO ONE + ONE\nint a = TWO; int b = TWO; int c = TWO;\n' > $tmp/hideset.c
+$FCC -fmem-report -E -o /dev/null $tmp/hideset.c 2>&1 | grep -q 'Hideset  *3 '
+check 'shared hidesets'
+
+# -fcodegen-stats
+echo 'int x = 3; int y; int add(int a, int b) { return a + b; }' > $tmp/stats.c
+$FCC -fcodegen-stats -S -o $tmp/stats.s $tmp/stats.c 2> $tmp/stats.json
+grep -q '^{"file":".*stats.c","functions":\[{"name":"add","frame_size":16,"instructions":[1-9]' $tmp/stats.json &&
+grep -q '"data":{"objects":[0-9]*,"data_bytes":[0-9]*,"bss_bytes":4}}$' $tmp/stats.json
+check -fcodegen-stats
+
+$FCC -S -o $tmp/stats2.s $tmp/stats.c
+cmp -s $tmp/stats.s $tmp/stats2.s
+check '-fcodegen-stats output'
+
+# --server
+sock=$tmp/server.sock
+$FCC --server $sock > /dev/null 2>&1 &
+server_pid=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do [ -S $sock ] && break; sleep 0.1; done
+echo '#define N 5' > $tmp/server.h
+echo '#include "server.h"
+int main() { return N; }' > $tmp/server.c
+$FCC -fserver=$sock -o $tmp/foo $tmp/server.c && $FCC -fserver=$sock -o $tmp/foo $tmp/server.c
+$tmp/foo
+[ "$?" = 5 ]
+check --server
+
+echo '#define N 7 ' > $tmp/server.h
+$FCC -fserver=$sock -o $tmp/foo $tmp/server.c
+$tmp/foo
+[ "$?" = 7 ]
+check '--server header change'
+
+$FCC -fserver=$sock -g -S -o $tmp/server1.s $tmp/server.c
+$FCC -g -S -o $tmp/server2.s $tmp/server.c
+cmp -s $tmp/server1.s $tmp/server2.s
+check '--server -g'
+
+$FCC -fserver=$sock -c -o $tmp/err.o $tmp/err1.c 2>&1 | grep -q 'err1.c'
+check '--server error'
+
+echo 'char *s = "unterminated;' > $tmp/broken.h
+echo '#include "broken.h"' > $tmp/broken.c
+$FCC -fserver=$sock -c -o $tmp/broken.o $tmp/broken.c > /dev/null 2>&1
+$FCC -fserver=$sock -o $tmp/foo $tmp/server.c && kill -0 $server_pid && [ -S $sock ]
+check '--server broken header'
+
+kill $server_pid
+wait $server_pid
+[ ! -e $sock ]
+check '--server shutdown'
+
+$FCC -fserver=$sock -o $tmp/foo $tmp/server.c
+$tmp/foo
+[ "$?" = 7 ]
+check '-fserver fallback'
+
+mkdir -m 777 $tmp/shared
+$FCC --server $tmp/shared/server.sock 2>&1 | grep -q 'ソケットのディレクトリ'
+[ ! -e $tmp/shared/server.sock ]
+check '--server shared directory'
+
 # a.out
 rm -f $tmp/a.out
 echo 'int main() {}' > $tmp/foo.c
@@ -88,6 +321,103 @@ echo "#include \"$tmp/out1.h\"" | $FCC -E -o $tmp/out2 -xc -
 cat $tmp/out2 | grep -q foo
 check '-E and -o'
 
+# mmapで読み込む大きなファイルと、トークンの途中の行の継続
+awk 'BEGIN { for (i = 0; i < 2000; i++) printf "int v%d = %d; /* padding padding */\n", i, i }' > $tmp/big.c
+printf 'int ma\\\nin() { return v1999 %% 256; }\n' >> $tmp/big.c
+$FCC -o $tmp/big $tmp/big.c
+$tmp/big
+[ "$?" = 207 ]
+check 'large input'
+
+# 行の継続を含むファイルの行数(__LINE__とエラーメッセージ)
+printf 'int a = __LINE__;\n#define X \\\n  __LINE__\nint b = X; int c \\\n = __LINE__ + \\\n  __LI\\\nNE__;\nint d = __LINE__;\n' > $tmp/line.c
+$FCC -E -o $tmp/line.i $tmp/line.c
+grep -q 'int a = 1;' $tmp/line.i && grep -q 'int b = 4; int c = 5 + 6;' $tmp/line.i && grep -q 'int d = 8;' $tmp/line.i
+check 'line number'
+printf 'int ma\\\nin() {\n  return 0 +\\\n ;\n}\n' > $tmp/line.c
+$FCC -S -o $tmp/line.s $tmp/line.c 2>&1 | grep -q 'line.c:4:'
+check 'line number in error'
+
+# -fscan: SIMD版の走査がスカラー版と同じ結果になること
+# 16, 32バイトの境界をまたぐ長さの空白、コメント、識別子、文字列リテラルを生成する
+awk 'BEGIN {
+    for (n = 1; n <= 70; n++) {
+        pad = sprintf("%*s", n, "")
+        id = ""
+        for (i = 0; i < n; i++) id = id substr("abcXYZ_09", i % 9 + 1, 1)
+        printf "int x%s;%s\t\v\f\r// 行コメント%s\\\n continued %s\n", id, pad, pad, id
+        printf "/*%s*%s**/ char *s%d = \"%s\\\"\\\\%s日本語\\n\";\n", pad, id, n, id, pad
+    }
+}' > $tmp/scan.c
+levels='scalar'
+if [ "`uname -m`" = x86_64 ]; then
+    levels="$levels sse2"
+    grep -qw avx2 /proc/cpuinfo && levels="$levels avx2"
+fi
+scan_ok=1
+for f in $tmp/scan.c test/*.c; do
+    for l in $levels; do
+        if ! $FCC -fscan=$l -E -Itest -o $tmp/scan.$l.i $f || ! cmp -s $tmp/scan.scalar.i $tmp/scan.$l.i; then
+            echo "-fscan=$l: $f" >&2
+            scan_ok=
+        fi
+    done
+done
+[ -n "$scan_ok" ]
+check -fscan
+
+# -fthreads: ヘッダファイルを先読みしても出力とエラーが変わらないこと
+threads_ok=1
+for f in test/*.c; do
+    $FCC -E -Itest -o $tmp/threads.0.i $f
+    for n in 1 4; do
+        if ! $FCC -fthreads=$n -E -Itest -o $tmp/threads.$n.i $f || ! cmp -s $tmp/threads.0.i $tmp/threads.$n.i; then
+            echo "-fthreads=$n: $f" >&2
+            threads_ok=
+        fi
+    done
+done
+[ -n "$threads_ok" ]
+check -fthreads
+echo 'int bad = "unterminated;' > $tmp/threads-bad.h
+printf '#if 0\n#include "threads-bad.h"\n#endif\nint x;\n' > $tmp/threads.c
+$FCC -fthreads=2 -E -o /dev/null $tmp/threads.c
+check '-fthreads error in skipped header'
+printf '#include "threads-bad.h"\n' > $tmp/threads.c
+$FCC -E -o /dev/null $tmp/threads.c 2> $tmp/threads.0.err
+$FCC -fthreads=2 -E -o /dev/null $tmp/threads.c 2> $tmp/threads.2.err
+[ "$?" = 1 ] && [ -s $tmp/threads.0.err ] && cmp -s $tmp/threads.0.err $tmp/threads.2.err
+check '-fthreads error in included header'
+
+# #pragma onceとインクルードガード: 2回目以降のインクルードは読み込まない
+printf '#pragma once\nint once_x;\n' > $tmp/once.h
+printf '#include "once.h"\n#include "./once.h"\n#include "once.h"\n' > $tmp/once.c
+[ "$($FCC -E $tmp/once.c | grep -c once_x)" = 1 ]
+check '#pragma once'
+printf '#ifndef GUARD_H\n#define GUARD_H\nint guard_x;\n#endif\n' > $tmp/guard.h
+printf '#include "guard.h"\n#include "guard.h"\n#undef GUARD_H\n#include "guard.h"\n' > $tmp/guard.c
+[ "$($FCC -E $tmp/guard.c | grep -c guard_x)" = 2 ]
+check 'include guard'
+$FCC -ftime-report=json -E -o /dev/null $tmp/guard.c 2>&1 | grep -q '"skipped_includes":1,'
+check 'include guard -ftime-report'
+printf '#ifndef ELSE_H\n#define ELSE_H\nint else_x;\n#else\nint else_y;\n#endif\n' > $tmp/else.h
+printf '#include "else.h"\n#include "else.h"\n' > $tmp/else.c
+$FCC -E $tmp/else.c | grep -q else_y
+check 'include guard with #else'
+printf '#ifndef TRAIL_H\n#define TRAIL_H\n#endif\nint trail_x;\n' > $tmp/trail.h
+printf '#include "trail.h"\n#include "trail.h"\n' > $tmp/trail.c
+[ "$($FCC -E $tmp/trail.c | grep -c trail_x)" = 2 ]
+check 'include guard with trailing tokens'
+printf 'X(xm_a)\nX(xm_b)\n' > $tmp/xmacro.h
+printf '#define X(n) int n;\n#include "xmacro.h"\n#undef X\n#define X(n) int n##_2;\n#include "./xmacro.h"\n' > $tmp/xmacro.c
+$FCC -E $tmp/xmacro.c | tr -d '\n ' | grep -q 'intxm_a;intxm_b;intxm_a_2;intxm_b_2;'
+check 'include unguarded header twice'
+[ "$($FCC -g -S -o - $tmp/xmacro.c | grep -c '^\.file .*xmacro\.h')" = 1 ]
+check 'include unguarded header twice .file'
+printf '#pragma pack(1)\n#pragma\nint x;\n' > $tmp/pragma.c
+$FCC -E $tmp/pragma.c | grep -q 'int x'
+check '#pragma'
+
 # -I
 mkdir $tmp/dir
 echo foo > $tmp/dir/i-option-test
@@ -95,6 +425,24 @@ echo "#include \"i-option-test\"" | $FCC -I$tmp/dir -E -xc - | grep -q foo
 
 check -I
 
+# 同じファイル名でもインクルードするファイルのディレクトリごとに検索する
+mkdir $tmp/dir1 $tmp/dir2
+echo 'int in_dir1;' > $tmp/dir1/same.h
+echo 'int in_dir2;' > $tmp/dir2/same.h
+echo '#include "same.h"' > $tmp/dir1/a.h
+echo '#include "same.h"' > $tmp/dir2/a.h
+printf '#include "dir1/a.h"\n#include "dir2/a.h"\n#include <same.h>\n' > $tmp/same.c
+$FCC -I$tmp/dir2 -E $tmp/same.c | tr -d '\n ' | grep -q 'intin_dir1;intin_dir2;intin_dir2;'
+check 'include path per directory'
+
+# 同じファイル名でも"..."と<...>は別々に検索する
+mkdir -p $tmp/quote/sys
+echo 'int a = 1;' > $tmp/quote/foo.h
+echo 'int a = 2;' > $tmp/quote/sys/foo.h
+printf '#include "foo.h"\n#include <foo.h>\n' > $tmp/quote/quote.c
+(cd $tmp/quote; $OLDPWD/bin/fcc -I sys -E quote.c) | tail -n 1 | grep -q 'int a = 2;'
+check 'include path "..." and <...>'
+
 # -x
 echo 'int x;' | $FCC -c -xc -o $tmp/foo.o -
 check -xc
@@ -105,4 +453,38 @@ echo 'int x;' > $tmp/foo.c
 $FCC -c -x assembler -x none -o $tmp/foo.o $tmp/foo.c
 check '-x none'
 
+# -x c-header, -include-pch
+cat <<'EOF' > $tmp/pch.h
+#ifndef PCH_H
+#define PCH_H
+typedef struct Point { int x; long y; struct Point *next; } Point;
+enum Color { RED, GREEN = 5, BLUE };
+#define SQUARE(x) ((x) * (x))
+extern int counter;
+static char *msg = "msg";
+static int twice(int x) { return x * 2; }
+#endif
+EOF
+cat <<'EOF' > $tmp/pch.c
+#include "pch.h"
+int counter = 3;
+int main() { Point p = {SQUARE(2), BLUE}; return p.x + p.y + counter + twice(msg[1]) - 13 - 's' * 2; }
+EOF
+$FCC -x c-header $tmp/pch.h && $FCC -include-pch $tmp/pch.h.pch -o $tmp/pch.exe $tmp/pch.c && $tmp/pch.exe
+check '-include-pch'
+
+$FCC -x c-header -o $tmp/pch2.pch $tmp/pch.h && $FCC -include-pch $tmp/pch2.pch -E $tmp/pch.c | grep -q 'Point p = {((2) \* (2)), BLUE}'
+check '-include-pch -E'
+
+touch -d '2000-01-01' $tmp/pch.h
+$FCC -include-pch $tmp/pch.h.pch -o $tmp/pch.exe $tmp/pch.c 2>&1 | grep -q '変更されています'
+check '-include-pch modified header'
+
+$FCC -x c-header $tmp/pch.h && $FCC -I$tmp -include-pch $tmp/pch.h.pch -o $tmp/pch.exe $tmp/pch.c 2>&1 | grep -q '異なるインクルードパス'
+check '-include-pch different -I'
+
+head -c 200 $tmp/pch.h.pch > $tmp/broken.pch
+$FCC -include-pch $tmp/broken.pch -o $tmp/pch.exe $tmp/pch.c 2>&1 | grep -q '壊れています'
+check '-include-pch corrupted'
+
 echo OK
\ No newline at end of file
@@ -5,6 +5,10 @@ char *main_filename1 = __FILE__;
 int main_line1 = __LINE__;
 #define LINE() __LINE__
 int main_line2 = LINE();
+int main_line3 = \
+__LINE__;
+int main_line4 = si\
+zeof(char) + __LINE__;
 
 #
 
@@ -356,6 +360,8 @@ of(char), \
 	ASSERT(0, strcmp(main_filename1, "test/macro.c"));
 	ASSERT(5, main_line1);
 	ASSERT(7, main_line2);
+	ASSERT(9, main_line3);
+	ASSERT(12, main_line4);
 	ASSERT(0, strcmp(include1_filename, "test/include1.h"));
 	ASSERT(4, include1_line);
 